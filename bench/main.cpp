@@ -0,0 +1,464 @@
+//
+// bench_trackerboy
+//
+// Benchmarks for the hot paths of trackerboy, run on a synthetic module.
+// Results are written as JSON so that they can be compared between releases.
+//
+// usage: bench_trackerboy [-o results.json] [-f filter] [-platform offscreen]
+//
+// Each benchmark is repeated until it has run for at least --min-time
+// milliseconds (default 1000). The reported rate is the amount of work done
+// per second, in the unit given for each benchmark.
+//
+
+#include "audio/Fft.hpp"
+#include "audio/Ringbuffer.hpp"
+#include "clipboard/PatternClip.hpp"
+#include "config/data/Palette.hpp"
+#include "core/Module.hpp"
+#include "core/ModuleFile.hpp"
+#include "export/WavExporter.hpp"
+#include "graphics/PatternLayout.hpp"
+#include "graphics/PatternPainter.hpp"
+#include "version.hpp"
+
+#include "trackerboy/apu/DefaultApu.hpp"
+#include "trackerboy/engine/Engine.hpp"
+#include "trackerboy/Synth.hpp"
+#include "trackerboy/note.hpp"
+
+#include "miniaudio.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFontDatabase>
+#include <QGuiApplication>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QSysInfo>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+constexpr int PATTERN_ROWS = 256;
+constexpr int PATTERN_COUNT = 64;
+
+//
+// Creates a module with a single song, where every row of every pattern
+// has a note in each track.
+//
+static std::unique_ptr<Module> makeModule() {
+    auto mod = std::make_unique<Module>();
+    auto song = mod->song();
+
+    song->setSpeed(0x30);
+    song->patterns().setLength(PATTERN_ROWS);
+    auto &order = song->order();
+    while (order.size() < PATTERN_COUNT) {
+        order.insert(order.size(), order.nextUnused());
+    }
+
+    for (int p = 0; p < PATTERN_COUNT; ++p) {
+        for (int ch = 0; ch < 4; ++ch) {
+            auto &track = song->patterns().getTrack(static_cast<trackerboy::ChType>(ch), (uint8_t)p);
+            for (int row = 0; row < PATTERN_ROWS; ++row) {
+                auto const note = (uint8_t)(trackerboy::NOTE_C + trackerboy::OCTAVE_4 + ((row * 7 + p + ch * 5) % 24));
+                track.setNote((uint16_t)row, note);
+                if (row % 8 == 4) {
+                    track.setEffect((uint16_t)row, 0, trackerboy::EffectType::delayedNote, 2);
+                }
+            }
+        }
+    }
+
+    return mod;
+}
+
+//
+// Playback buffer implementation used before Ringbuffer, a ma_rb accessed
+// through byte-based acquire/commit, for comparison.
+//
+class MaRingbuffer {
+
+public:
+    static constexpr size_t FRAME_SIZE = sizeof(float) * 2;
+
+    explicit MaRingbuffer(size_t frames) {
+        ma_rb_init(frames * FRAME_SIZE, nullptr, nullptr, &mRb);
+    }
+
+    ~MaRingbuffer() {
+        ma_rb_uninit(&mRb);
+    }
+
+    float* acquireWrite(size_t &frames) {
+        size_t bytes = frames * FRAME_SIZE;
+        void *buf;
+        ma_rb_acquire_write(&mRb, &bytes, &buf);
+        frames = bytes / FRAME_SIZE;
+        return static_cast<float*>(buf);
+    }
+
+    void commitWrite(float *buf, size_t frames) {
+        ma_rb_commit_write(&mRb, frames * FRAME_SIZE, buf);
+    }
+
+    size_t fullRead(float *out, size_t frames) {
+        // two acquire/copy/commit passes on wraparound
+        size_t total = 0;
+        for (int pass = 0; pass < 2 && total < frames; ++pass) {
+            if (ma_rb_available_read(&mRb) == 0) {
+                break;
+            }
+            size_t bytes = (frames - total) * FRAME_SIZE;
+            void *buf;
+            ma_rb_acquire_read(&mRb, &bytes, &buf);
+            std::memcpy(out + total * 2, buf, bytes);
+            ma_rb_commit_read(&mRb, bytes, buf);
+            total += bytes / FRAME_SIZE;
+        }
+        return total;
+    }
+
+private:
+    ma_rb mRb;
+};
+
+class SpscRingbuffer {
+
+public:
+    explicit SpscRingbuffer(size_t frames) {
+        mRb.init(frames);
+    }
+
+    float* acquireWrite(size_t &frames) {
+        return mRb.writer().acquireWrite(frames);
+    }
+
+    void commitWrite(float *buf, size_t frames) {
+        Q_UNUSED(buf)
+        mRb.writer().commitWrite(frames);
+    }
+
+    size_t fullRead(float *out, size_t frames) {
+        return mRb.reader().fullRead(out, frames);
+    }
+
+private:
+    AudioRingbuffer mRb;
+};
+
+//
+// Streams frames through a ringbuffer, with a producer thread writing
+// render-sized chunks in place and the calling thread reading device-sized
+// periods, like the Renderer and AudioStream do. Returns the number of
+// frames transferred.
+//
+template <class Rb>
+static double streamRingbuffer(Rb &rb) {
+    constexpr size_t TOTAL = 1 << 20;
+    constexpr size_t CHUNK = 441;       // 10 ms at 44100 Hz
+    constexpr size_t PERIOD = 256;
+
+    std::thread producer([&]() {
+        size_t written = 0;
+        while (written < TOTAL) {
+            size_t count = std::min(CHUNK, TOTAL - written);
+            auto buf = rb.acquireWrite(count);
+            std::fill_n(buf, count * 2, 0.5f);
+            rb.commitWrite(buf, count);
+            written += count;
+            if (count == 0) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    float period[PERIOD * 2];
+    size_t read = 0;
+    while (read < TOTAL) {
+        auto const count = rb.fullRead(period, PERIOD);
+        read += count;
+        if (count == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    return (double)TOTAL;
+}
+
+class Bench {
+
+public:
+
+    Bench(QString const& filter, qint64 minTimeMs) :
+        mFilter(filter),
+        mMinTimeNs(minTimeMs * 1000000),
+        mResults()
+    {
+    }
+
+    //
+    // Runs the given function repeatedly. The function returns the amount of
+    // work it did, in units.
+    //
+    void run(QString const& name, QString const& unit, std::function<double()> const& fn) {
+        if (!mFilter.isEmpty() && !name.contains(mFilter)) {
+            return;
+        }
+
+        fprintf(stderr, "%s... ", qPrintable(name));
+        fflush(stderr);
+
+        // warmup
+        fn();
+
+        double work = 0.0;
+        int iterations = 0;
+        QElapsedTimer timer;
+        timer.start();
+        qint64 elapsed;
+        do {
+            work += fn();
+            ++iterations;
+            elapsed = timer.nsecsElapsed();
+        } while (elapsed < mMinTimeNs);
+
+        double const seconds = elapsed / 1e9;
+        double const rate = work / seconds;
+        fprintf(stderr, "%.1f %s\n", rate, qPrintable(unit));
+
+        mResults.append(QJsonObject {
+            { QStringLiteral("name"), name },
+            { QStringLiteral("iterations"), iterations },
+            { QStringLiteral("seconds"), seconds },
+            { QStringLiteral("rate"), rate },
+            { QStringLiteral("unit"), unit }
+        });
+    }
+
+    QJsonArray const& results() const {
+        return mResults;
+    }
+
+private:
+    QString mFilter;
+    qint64 mMinTimeNs;
+    QJsonArray mResults;
+
+};
+
+int main(int argc, char *argv[]) {
+
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName("bench_trackerboy");
+    QCoreApplication::setApplicationVersion(VERSION_STR);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Trackerboy benchmarks");
+    parser.addHelpOption();
+    QCommandLineOption outputOption({ "o", "output" }, "Write the JSON results to the given file instead of stdout", "file");
+    QCommandLineOption filterOption({ "f", "filter" }, "Only run benchmarks whose name contains the given string", "filter");
+    QCommandLineOption minTimeOption("min-time", "Minimum time to run each benchmark, in milliseconds", "ms", "1000");
+    parser.addOptions({ outputOption, filterOption, minTimeOption });
+    parser.process(app);
+
+    Bench bench(parser.value(filterOption), parser.value(minTimeOption).toLongLong());
+
+    auto mod = makeModule();
+    float const framerate = mod->data().framerate();
+    constexpr int SAMPLERATE = 44100;
+
+    // render -----------------------------------------------------------------
+    // same loop as Renderer::render, without the audio device
+
+    {
+        trackerboy::DefaultApu apu;
+        trackerboy::Synth synth(apu, SAMPLERATE, framerate);
+        trackerboy::Engine engine(apu, &mod->data());
+        engine.setSong(mod->song());
+        engine.play(0, 0);
+        auto buffer = std::make_unique<float[]>(synth.framesize() * 2);
+
+        bench.run(QStringLiteral("render"), QStringLiteral("frames/s"), [&]() {
+            constexpr int FRAMES = 600;
+            trackerboy::Frame frame;
+            for (int i = 0; i < FRAMES; ++i) {
+                engine.step(frame);
+                synth.run();
+                apu.readSamples(buffer.get(), synth.framesize());
+            }
+            return (double)FRAMES;
+        });
+    }
+
+    // ringbuffer -------------------------------------------------------------
+    // a 40 ms playback buffer, the default latency
+
+    {
+        constexpr size_t BUFFER_FRAMES = SAMPLERATE * 40 / 1000;
+
+        bench.run(QStringLiteral("ringbuffer.ma_rb"), QStringLiteral("frames/s"), []() {
+            MaRingbuffer rb(BUFFER_FRAMES);
+            return streamRingbuffer(rb);
+        });
+
+        bench.run(QStringLiteral("ringbuffer.spsc"), QStringLiteral("frames/s"), []() {
+            SpscRingbuffer rb(BUFFER_FRAMES);
+            return streamRingbuffer(rb);
+        });
+    }
+
+    // spectrum ---------------------------------------------------------------
+    // one analysis of the spectrum analyzer, on a sawtooth
+
+    {
+        Fft fft(4096);
+        std::vector<float> input(fft.size());
+        std::vector<float> power(fft.bins());
+        for (size_t i = 0; i < input.size(); ++i) {
+            input[i] = (float)(i % 100) / 50.0f - 1.0f;
+        }
+
+        bench.run(QStringLiteral("spectrum.fft"), QStringLiteral("blocks/s"), [&]() {
+            constexpr int BLOCKS = 100;
+            for (int i = 0; i < BLOCKS; ++i) {
+                fft.powerSpectrum(input.data(), power.data());
+            }
+            return (double)BLOCKS;
+        });
+    }
+
+    // export -----------------------------------------------------------------
+
+    QTemporaryDir tempDir;
+
+    {
+        struct ExportFormat {
+            char const *name;
+            Encoder::Format format;
+        };
+        constexpr ExportFormat FORMATS[] = {
+            { "wav", Encoder::Format::wavFloat },
+            { "wav16", Encoder::Format::wav16 },
+            { "flac", Encoder::Format::flac16 }
+        };
+
+        for (auto const& fmt : FORMATS) {
+            WavExporter exporter(*mod, SAMPLERATE);
+            exporter.setDuration(std::chrono::seconds(60));
+            exporter.setFormat(fmt.format);
+            exporter.setDestination(tempDir.filePath(QStringLiteral("export.%1").arg(QString::fromLatin1(Encoder::extension(fmt.format)))));
+            bench.run(QStringLiteral("export.%1").arg(QString::fromLatin1(fmt.name)), QStringLiteral("frames/s"), [&]() {
+                exporter.start();
+                exporter.wait();
+                if (exporter.failed()) {
+                    // the numbers would be meaningless, abort the bench
+                    fprintf(stderr, "\nexport to %s failed\n", qPrintable(tempDir.path()));
+                    std::exit(1);
+                }
+                return 60.0 * framerate;
+            });
+        }
+    }
+
+    // clipboard --------------------------------------------------------------
+
+    {
+        auto pattern = mod->song()->getPattern(0);
+        PatternSelection const all(
+            PatternAnchor(0, 0, 0),
+            PatternAnchor(PATTERN_ROWS - 1, PatternAnchor::MAX_SELECTS - 1, 3)
+        );
+        PatternClip clip;
+
+        bench.run(QStringLiteral("clip.save"), QStringLiteral("rows/s"), [&]() {
+            clip.save(pattern, all);
+            return (double)PATTERN_ROWS;
+        });
+
+        auto dest = mod->song()->getPattern(1);
+        bench.run(QStringLiteral("clip.paste"), QStringLiteral("rows/s"), [&]() {
+            clip.paste(dest, PatternCursor(0, 0, 0), false);
+            return (double)PATTERN_ROWS;
+        });
+
+        bench.run(QStringLiteral("clip.mixpaste"), QStringLiteral("rows/s"), [&]() {
+            clip.paste(dest, PatternCursor(0, 0, 0), true);
+            return (double)PATTERN_ROWS;
+        });
+    }
+
+    // painting ---------------------------------------------------------------
+
+    {
+        auto const font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+        PatternPainter painter(font);
+        painter.setColors(Palette());
+        PatternLayout layout;
+        layout.setCellSize(painter.cellWidth(), painter.cellHeight());
+
+        auto pattern = mod->song()->getPattern(0);
+        QImage image(layout.rowWidth(), painter.cellHeight() * PATTERN_ROWS, QImage::Format_ARGB32_Premultiplied);
+
+        bench.run(QStringLiteral("paint.pattern"), QStringLiteral("rows/s"), [&]() {
+            QPainter p(&image);
+            p.setFont(font);
+            painter.drawPattern(p, layout, pattern, 0, PATTERN_ROWS - 1, 0);
+            return (double)PATTERN_ROWS;
+        });
+    }
+
+    // file I/O ---------------------------------------------------------------
+
+    {
+        auto const path = tempDir.filePath(QStringLiteral("bench.tbm"));
+        qint64 fileSize = 0;
+
+        bench.run(QStringLiteral("module.save"), QStringLiteral("bytes/s"), [&]() {
+            ModuleFile file;
+            file.save(path, *mod);
+            fileSize = QFile(path).size();
+            return (double)fileSize;
+        });
+
+        Module loaded;
+        bench.run(QStringLiteral("module.load"), QStringLiteral("bytes/s"), [&]() {
+            ModuleFile file;
+            file.open(path, loaded);
+            return (double)fileSize;
+        });
+    }
+
+    QJsonObject root {
+        { QStringLiteral("version"), QString::fromLatin1(VERSION_STR) },
+        { QStringLiteral("cpu"), QSysInfo::currentCpuArchitecture() },
+        { QStringLiteral("os"), QSysInfo::prettyProductName() },
+        { QStringLiteral("benchmarks"), bench.results() }
+    };
+    auto const json = QJsonDocument(root).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile out(parser.value(outputOption));
+        if (!out.open(QIODevice::WriteOnly)) {
+            fprintf(stderr, "could not open %s\n", qPrintable(out.fileName()));
+            return 1;
+        }
+        out.write(json);
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+
+    return 0;
+}
@@ -49,7 +49,12 @@ AudioStream::AudioStream(QObject *parent) :
     mContext(),
     mDevice(),
     mPlaybackDelay(0),
+    mRenderCallback(nullptr),
+    mRenderData(nullptr),
+    mPeriodSize(0),
     mUnderruns(0),
+    mUnderrunQueue(),
+    mConsumed(0),
     mDraining(false)
 {
 
@@ -71,14 +76,28 @@ void AudioStream::resetUnderruns() {
     mUnderruns = 0;
 }
 
+bool AudioStream::popUnderrun(Underrun &underrun) {
+    return mUnderrunQueue.pop(underrun);
+}
+
 size_t AudioStream::bufferSize() const {
-    return mBuffer.size();
+    return mRenderCallback ? mPeriodSize : mBuffer.size();
+}
+
+void AudioStream::setRenderCallback(RenderCallback callback, void *userData) {
+    Q_ASSERT(!isRunning());
+    mRenderCallback = callback;
+    mRenderData = userData;
 }
 
 void AudioStream::setDraining(bool draining) {
     mDraining = draining;
 }
 
+uint64_t AudioStream::consumed() const {
+    return mConsumed.load(std::memory_order_acquire);
+}
+
 AudioRingbuffer::Writer AudioStream::writer() {
     return mBuffer.writer();
 }
@@ -92,10 +111,16 @@ void AudioStream::open(AudioEnumerator::Device const& device, int samplerate, in
     // must be disabled when changing settings
     disable();
 
-    // update buffer size
-    mBuffer.init((size_t)(latency * samplerate / 1000));
-
     auto deviceConfig = ma_device_config_init(ma_device_type_playback);
+    if (mRenderCallback) {
+        // no playback buffer, the latency is the device's period
+        mBuffer.uninit();
+        deviceConfig.periodSizeInMilliseconds = (ma_uint32)latency;
+        deviceConfig.performanceProfile = ma_performance_profile_low_latency;
+    } else {
+        // update buffer size
+        mBuffer.init((size_t)(latency * samplerate / 1000));
+    }
     // always 32-bit float stereo format
     deviceConfig.playback.format = ma_format_f32;
     deviceConfig.playback.channels = 2;
@@ -111,6 +136,7 @@ void AudioStream::open(AudioEnumerator::Device const& device, int samplerate, in
         handleError("could not initialize device:", result);
         return;
     }
+    mPeriodSize = mDevice.get()->playback.internalPeriodSizeInFrames;
 
     mEnabled = true;
     if (running) {
@@ -120,9 +146,14 @@ void AudioStream::open(AudioEnumerator::Device const& device, int samplerate, in
 
 bool AudioStream::start() {
     if (isEnabled() && !isRunning()) {
-        mBuffer.reset();
-        mPlaybackDelay = mBuffer.size();
+        if (mRenderCallback) {
+            mPlaybackDelay = 0;
+        } else {
+            mBuffer.reset();
+            mPlaybackDelay = mBuffer.size();
+        }
         mDraining = false;
+        mConsumed = 0;
         auto result = ma_device_start(mDevice.get());
         if (result != MA_SUCCESS) {
             handleError("failed to start device:", result);
@@ -169,6 +200,14 @@ void AudioStream::deviceDataCallback(ma_device *device, void *out, const void *i
 
 void AudioStream::handleData(float *out, size_t frames) {
 
+    if (mRenderCallback) {
+        // synthesize directly into the device's buffer, these samples are
+        // played out as soon as we return
+        mConsumed.fetch_add(frames, std::memory_order_release);
+        mRenderCallback(mRenderData, out, frames);
+        return;
+    }
+
     // an entire buffer's worth of silence is played when the stream is started
     // this gives the us ample time to fill the buffer before playing from it.
     // Without this the output might be choppy at the start.
@@ -183,8 +222,10 @@ void AudioStream::handleData(float *out, size_t frames) {
     }
 
     auto nread = mBuffer.reader().fullRead(out, frames);
+    auto const position = mConsumed.fetch_add(nread, std::memory_order_release) + nread;
     if (nread < frames && !mDraining) {
         ++mUnderruns;
+        mUnderrunQueue.push(Underrun{ std::chrono::system_clock::now(), position, frames - nread });
     }
 }
 
@@ -2,23 +2,49 @@
 
 #include "audio/AudioEnumerator.hpp"
 #include "audio/Ringbuffer.hpp"
+#include "utils/SpscQueue.hpp"
 
 #include "miniaudio.h"
 
 #include <QObject>
 
 #include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 
 //
 // AudioStream class. Manages a miniaudio device and a playback buffer for
 // asynchronous sound output.
 //
+// Alternatively, a render callback can be set. The callback is then called
+// from the device's thread to synthesize the output directly, and the
+// playback buffer is not used.
+//
 class AudioStream : public QObject {
 
     Q_OBJECT
 
 public:
+
+    //
+    // Callback for synthesizing audio on demand. The callback must write
+    // the given number of stereo frames to the output buffer. Called from
+    // the device's thread.
+    //
+    using RenderCallback = void(*)(void *userData, float *out, size_t frames);
+
+    //
+    // Record of a single underrun
+    //
+    struct Underrun {
+        std::chrono::system_clock::time_point time;
+        // consumed() count when the underrun occurred
+        uint64_t position;
+        // number of samples that could not be read from the buffer
+        size_t missing;
+    };
+
     explicit AudioStream(QObject *parent = nullptr);
 
     //
@@ -45,23 +71,48 @@ public:
 
     //
     // Gets the size of the buffer, in samples. The size of the buffer is determined
-    // by the latency parameter in open().
+    // by the latency parameter in open(). If a render callback is set, this is
+    // the size of the device's period instead.
     //
     size_t bufferSize() const;
 
+    //
+    // Sets the render callback, or nullptr to use the playback buffer. Takes
+    // effect on the next call to open(). The stream must not be running.
+    //
+    void setRenderCallback(RenderCallback callback, void *userData);
+
     void setDraining(bool draining);
 
+    //
+    // Gets the number of samples handed to the device since the stream was
+    // last started. A sample written at buffer position N (counting from the
+    // start) is being played out once this count exceeds N. Thread-safe.
+    //
+    uint64_t consumed() const;
+
     //
     // Resets the underrun counter to 0.
     //
     void resetUnderruns();
 
+    //
+    // Retrieves the oldest underrun that has not been retrieved yet, false
+    // is returned if there are none. Only the thread writing to the buffer
+    // may call this function. If underruns are not retrieved, the most recent
+    // ones are dropped once the queue is full (the counter is still updated).
+    //
+    bool popUnderrun(Underrun &underrun);
+
     //
     // Opens an output stream for the configured device.
     // On success the stream is enabled, and audio can now be played out. On
     // failure the stream is disabled. If the stream was running when this
     // function is called, it is stopped and then restarted.
     //
+    // When a render callback is set, latency is the size of the device's
+    // period instead of the size of the playback buffer.
+    //
     // NOTE: this function should only be called from the GUI thread
     //
     void open(AudioEnumerator::Device const& device, int samplerate, int latency);
@@ -117,7 +168,13 @@ private:
     MaDeviceWrapper mDevice;
     size_t mPlaybackDelay;
 
+    RenderCallback mRenderCallback;
+    void *mRenderData;
+    size_t mPeriodSize;
+
     std::atomic_uint mUnderruns;
+    SpscQueue<Underrun, 64> mUnderrunQueue;
+    std::atomic_uint64_t mConsumed;
     std::atomic_bool mDraining;
 
 };
@@ -0,0 +1,264 @@
+#include "audio/ChannelScopeBuffer.hpp"
+
+#include <algorithm>
+
+#define TU ChannelScopeBufferTU
+namespace TU {
+
+using Reg = trackerboy::IApuIo;
+
+// registers of a channel are 5 apart, starting at NR10
+constexpr int CHANNEL_REGS = 5;
+
+// the output of a single channel at full volume is a quarter of the full
+// scale of the mixer
+constexpr float GAIN = (float)ChannelScopeBuffer::CHANNELS;
+
+// rate of captured samples
+constexpr int CAPTURE_RATE = 11025;
+
+//
+// Gets the start of the window to capture from the given history: the
+// latest rising edge through the midpoint of the searched samples, or the
+// latest window if there is none. Samples before end - window - search are
+// not searched.
+//
+template <size_t N>
+uint64_t findTrigger(std::array<float, N> const& history, uint64_t end, size_t window, size_t search) {
+    constexpr auto MASK = N - 1;
+    auto const last = end > window ? end - window : 0;
+    auto const first = last > search ? last - search : 0;
+
+    auto lo = history[first & MASK];
+    auto hi = lo;
+    for (auto i = first + 1; i <= last; ++i) {
+        auto const sample = history[i & MASK];
+        lo = std::min(lo, sample);
+        hi = std::max(hi, sample);
+    }
+    auto const mid = (lo + hi) * 0.5f;
+
+    for (auto i = last; i > first; --i) {
+        if (history[(i - 1) & MASK] < mid && history[i & MASK] >= mid) {
+            return i;
+        }
+    }
+    return last;
+}
+
+}
+
+ChannelScopeBuffer::Tap::Tap(trackerboy::IApuIo &apu, ChannelScopeBuffer &buffer) :
+    mApu(apu),
+    mBuffer(buffer)
+{
+}
+
+uint8_t ChannelScopeBuffer::Tap::readRegister(uint8_t reg) {
+    return mApu.readRegister(reg);
+}
+
+void ChannelScopeBuffer::Tap::writeRegister(uint8_t reg, uint8_t value) {
+    mApu.writeRegister(reg, value);
+    mBuffer.write(reg, value);
+}
+
+ChannelScopeBuffer::Voice::Voice() :
+    apu(),
+    synth(apu, 44100),
+    history(),
+    historyEnd(0)
+{
+}
+
+ChannelScopeBuffer::ChannelScopeBuffer() :
+    mEnabled(false),
+    mCapturing(false),
+    mRegisters(),
+    mVoices(),
+    mFramesize(mVoices[0].synth.framesize()),
+    mStride(44100 / TU::CAPTURE_RATE),
+    mScratch(),
+    mPending(),
+    mVersion(0),
+    mSnapshots()
+{
+    clear();
+}
+
+void ChannelScopeBuffer::setEnabled(bool enabled) {
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool ChannelScopeBuffer::isEnabled() const {
+    return mEnabled.load(std::memory_order_relaxed);
+}
+
+void ChannelScopeBuffer::setup(int samplerate, float framerate) {
+    for (auto &voice : mVoices) {
+        voice.synth.setSamplerate(samplerate);
+        voice.synth.setFramerate(framerate);
+        // resets the apu
+        voice.synth.setupBuffers();
+    }
+    mFramesize = mVoices[0].synth.framesize();
+    // the window must leave room in the history to search for a trigger
+    mStride = (size_t)std::clamp(samplerate / TU::CAPTURE_RATE, 1, (int)(HISTORY / SAMPLES / 2));
+    // resync on the next capture
+    mCapturing = false;
+}
+
+void ChannelScopeBuffer::reset() {
+    Capture discard;
+    while (mPending.pop(discard)) {
+    }
+}
+
+void ChannelScopeBuffer::clear() {
+    auto &snapshot = mSnapshots.back();
+    snapshot.version = ++mVersion;
+    for (auto &channel : snapshot.channels) {
+        channel.playing = false;
+    }
+    mSnapshots.publish();
+}
+
+void ChannelScopeBuffer::capture(trackerboy::IApuIo &apu, uint64_t position) {
+    if (!isEnabled()) {
+        mCapturing = false;
+        return;
+    }
+
+    if (!mCapturing) {
+        sync(apu.readRegister(TU::Reg::REG_NR52) & 0xF);
+        mCapturing = true;
+    }
+
+    Capture capture;
+    capture.position = position;
+    capture.playing = 0;
+
+    auto const window = SAMPLES * mStride;
+    auto const search = std::min(mFramesize, HISTORY - window);
+    for (int i = 0; i < CHANNELS; ++i) {
+        auto &voice = mVoices[i];
+        voice.synth.run();
+        while (auto const available = voice.apu.samplesAvailable()) {
+            auto const count = std::min(available, mScratch.size() / 2);
+            voice.apu.readSamples(mScratch.data(), count);
+            // the channel is panned to both terminals, keep the left one
+            for (size_t s = 0; s < count; ++s) {
+                voice.history[(voice.historyEnd + s) & (HISTORY - 1)] = mScratch[s * 2];
+            }
+            voice.historyEnd += count;
+        }
+
+        if (voice.apu.readRegister(TU::Reg::REG_NR52) & (1 << i)) {
+            capture.playing |= (uint8_t)(1 << i);
+        }
+
+        auto const start = TU::findTrigger(voice.history, voice.historyEnd, window, search);
+        auto &samples = capture.samples[i];
+        for (size_t s = 0; s < samples.size(); ++s) {
+            auto const sample = voice.history[(start + s * mStride) & (HISTORY - 1)] * TU::GAIN;
+            samples[s] = std::clamp(sample, -1.0f, 1.0f);
+        }
+    }
+
+    if (!mPending.push(capture)) {
+        // queue is full (very large buffer), drop the oldest
+        Capture dropped;
+        mPending.pop(dropped);
+        mPending.push(capture);
+    }
+}
+
+bool ChannelScopeBuffer::update(uint64_t position) {
+    Capture capture;
+    bool changed = false;
+    for (auto pending = mPending.peek(); pending != nullptr && pending->position < position; pending = mPending.peek()) {
+        mPending.pop(capture);
+        changed = true;
+    }
+    if (changed) {
+        publish(capture);
+    }
+    return changed;
+}
+
+ChannelScopeBuffer::Snapshot const& ChannelScopeBuffer::read() {
+    return mSnapshots.read();
+}
+
+void ChannelScopeBuffer::write(uint8_t reg, uint8_t value) {
+    if (reg < TU::Reg::REG_NR10 || reg >= TU::Reg::REG_NR10 + mRegisters.size()) {
+        return;
+    }
+    mRegisters[reg - TU::Reg::REG_NR10] = value;
+
+    if (!mCapturing) {
+        return;
+    }
+
+    if (reg == TU::Reg::REG_NR52) {
+        for (int i = 0; i < CHANNELS; ++i) {
+            auto &apu = mVoices[i].apu;
+            apu.writeRegister(reg, value);
+            if (value & 0x80) {
+                // powering off cleared the panning, only this channel is heard
+                apu.writeRegister(TU::Reg::REG_NR50, 0x77);
+                apu.writeRegister(TU::Reg::REG_NR51, (uint8_t)(0x11 << i));
+            }
+        }
+    } else if (reg >= TU::Reg::REG_WAVERAM) {
+        mVoices[2].apu.writeRegister(reg, value);
+    } else if (reg < TU::Reg::REG_NR50) {
+        mVoices[(reg - TU::Reg::REG_NR10) / TU::CHANNEL_REGS].apu.writeRegister(reg, value);
+    }
+    // NR50 and NR51 are fixed in the channel APUs
+}
+
+void ChannelScopeBuffer::sync(uint8_t playing) {
+    for (int i = 0; i < CHANNELS; ++i) {
+        auto &voice = mVoices[i];
+        auto &apu = voice.apu;
+        // powering off clears every register except wave RAM
+        apu.writeRegister(TU::Reg::REG_NR52, 0x00);
+        apu.writeRegister(TU::Reg::REG_NR52, 0x80);
+        apu.writeRegister(TU::Reg::REG_NR50, 0x77);
+        apu.writeRegister(TU::Reg::REG_NR51, (uint8_t)(0x11 << i));
+        if (i == 2) {
+            for (int r = TU::Reg::REG_WAVERAM; r < TU::Reg::REG_WAVERAM + 16; ++r) {
+                apu.writeRegister((uint8_t)r, mRegisters[r - TU::Reg::REG_NR10]);
+            }
+        }
+        auto const first = TU::Reg::REG_NR10 + i * TU::CHANNEL_REGS;
+        for (int r = first; r < first + TU::CHANNEL_REGS; ++r) {
+            auto value = mRegisters[r - TU::Reg::REG_NR10];
+            if (r == first + TU::CHANNEL_REGS - 1) {
+                // retrigger the channel if it is still playing, restarting
+                // its envelope and length
+                value = (playing & (1 << i)) ? (uint8_t)(value | 0x80) : (uint8_t)(value & 0x7F);
+            }
+            apu.writeRegister((uint8_t)r, value);
+        }
+
+        voice.history.fill(0.0f);
+        voice.historyEnd = 0;
+    }
+}
+
+void ChannelScopeBuffer::publish(Capture const& capture) {
+    auto &snapshot = mSnapshots.back();
+    snapshot.version = ++mVersion;
+    for (int i = 0; i < CHANNELS; ++i) {
+        auto &channel = snapshot.channels[i];
+        channel.playing = (capture.playing & (1 << i)) != 0;
+        if (channel.playing) {
+            channel.samples = capture.samples[i];
+        }
+    }
+    mSnapshots.publish();
+}
+
+#undef TU
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "utils/SpscQueue.hpp"
+#include "utils/TripleBuffer.hpp"
+
+#include "trackerboy/apu/DefaultApu.hpp"
+#include "trackerboy/Synth.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//
+// Per-channel waveforms for the channel scopes.
+//
+// The APU only outputs the mixed signal, so the buffer has its own APU for
+// each channel, with every other channel disabled in NR51. The engine writes
+// to the music APU through a Tap, which forwards each channel's register
+// writes to that channel's APU. Each frame, the channel APUs are synthesized
+// alongside the music APU, so the scopes show what the channel actually
+// outputs, envelopes, sweeps and noise included.
+//
+// The channel APUs only run while capturing is enabled. When capturing
+// starts, or after the APUs are reset, they are brought up to date from the
+// last value written to each register, with channels that are still playing
+// retriggered.
+//
+// Each frame, the latest SAMPLES samples (decimated to about 11 kHz) of each
+// channel are captured, starting at a rising edge so the scopes stay still.
+// Captures are kept until the device plays their frame, so the scopes stay
+// in sync with what is heard.
+//
+// The thread owning the render context (see Renderer) is the writer, the GUI
+// thread is the reader. Capturing is disabled by default, when disabled the
+// render thread only records register writes.
+//
+class ChannelScopeBuffer {
+
+public:
+
+    static constexpr int CHANNELS = 4;
+    static constexpr int SAMPLES = 128;
+
+    struct Channel {
+        bool playing;
+        // amplitude of each sample, -1.0 to 1.0
+        std::array<float, SAMPLES> samples;
+    };
+
+    struct Snapshot {
+        // incremented for each published snapshot
+        uint64_t version;
+        std::array<Channel, CHANNELS> channels;
+    };
+
+    //
+    // Register interface given to the engine in place of the music APU.
+    // Writes go to the music APU, and are forwarded to the buffer. Reads
+    // come from the music APU.
+    //
+    class Tap : public trackerboy::IApuIo {
+
+    public:
+        Tap(trackerboy::IApuIo &apu, ChannelScopeBuffer &buffer);
+
+        virtual uint8_t readRegister(uint8_t reg) override;
+
+        virtual void writeRegister(uint8_t reg, uint8_t value) override;
+
+    private:
+        trackerboy::IApuIo &mApu;
+        ChannelScopeBuffer &mBuffer;
+    };
+
+    ChannelScopeBuffer();
+    ~ChannelScopeBuffer() = default;
+
+    //
+    // Enables or disables capturing. Any thread.
+    //
+    void setEnabled(bool enabled);
+
+    bool isEnabled() const;
+
+    //
+    // Sets the samplerate and framerate of the channel APUs, same as the
+    // music's synth. Resets the channel APUs. Writer only.
+    //
+    void setup(int samplerate, float framerate);
+
+    //
+    // Discards all captures, called when the play position is reset. Writer
+    // only.
+    //
+    void reset();
+
+    //
+    // Publishes a snapshot where no channel is playing. Writer only.
+    //
+    void clear();
+
+    //
+    // Synthesizes a frame on each channel APU and captures it, for the
+    // frame that starts at the given position in the output. Called after
+    // the engine has stepped the frame, the given APU is the music APU.
+    // Only stops forwarding writes when capturing is disabled. Writer only.
+    //
+    void capture(trackerboy::IApuIo &apu, uint64_t position);
+
+    //
+    // Publishes the waveforms of the last capture played before the given
+    // position, if it has changed. Returns true if a snapshot was published.
+    // Writer only.
+    //
+    bool update(uint64_t position);
+
+    //
+    // Gets the most recently published snapshot. Reader only.
+    //
+    Snapshot const& read();
+
+private:
+
+    // samples kept of each channel's output, enough for a window and a
+    // frame to search for the trigger in (power of 2)
+    static constexpr size_t HISTORY = 4096;
+
+    //
+    // APU and synth of a single channel
+    //
+    struct Voice {
+        trackerboy::DefaultApu apu;
+        trackerboy::Synth synth;
+        // the last HISTORY samples of the output (left terminal only)
+        std::array<float, HISTORY> history;
+        // total number of samples written to the history
+        uint64_t historyEnd;
+
+        Voice();
+    };
+
+    struct Capture {
+        uint64_t position;
+        // bit n set if CHn+1 is playing
+        uint8_t playing;
+        std::array<std::array<float, SAMPLES>, CHANNELS> samples;
+    };
+
+    //
+    // Records a register write, forwarding it to the channel's APU when
+    // capturing.
+    //
+    void write(uint8_t reg, uint8_t value);
+
+    //
+    // Brings the channel APUs up to date with the recorded registers
+    //
+    void sync(uint8_t playing);
+
+    void publish(Capture const& capture);
+
+    std::atomic_bool mEnabled;
+
+    // true if the channel APUs are in sync with the music APU
+    bool mCapturing;
+    // last value written to each register, NR10 to the end of wave RAM
+    std::array<uint8_t, 0x30> mRegisters;
+
+    std::array<Voice, CHANNELS> mVoices;
+    // samples per frame
+    size_t mFramesize;
+    // history samples per captured sample
+    size_t mStride;
+    // stereo samples read from a voice's APU
+    std::array<float, 1024> mScratch;
+
+    // captures that have not been played yet, keyed by position
+    SpscQueue<Capture, 64> mPending;
+
+    uint64_t mVersion;
+    TripleBuffer<Snapshot> mSnapshots;
+
+};
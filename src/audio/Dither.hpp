@@ -0,0 +1,49 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//
+// Converts float samples to signed integer samples of a given bit depth,
+// using TPDF (triangular) dither to decorrelate the quantization error from
+// the signal. Each instance has its own noise generator state. The bit depth
+// must be in the range [2, 32].
+//
+class Dither {
+
+public:
+
+    explicit Dither(int bits) :
+        mScale((float)(INT64_C(1) << (bits - 1))),
+        mMin((int32_t)-(INT64_C(1) << (bits - 1))),
+        mMax((int32_t)((INT64_C(1) << (bits - 1)) - 1)),
+        mState(0x9E3779B9u)
+    {
+    }
+
+    int32_t operator()(float sample) {
+        // difference of two uniform randoms in [0, 1) is triangular in (-1, 1) LSB
+        auto const noise = nextUniform() - nextUniform();
+        // clamped before converting, the scaled sample may not fit in 32 bits
+        auto const quantized = (int64_t)std::floor((double)sample * mScale + noise + 0.5);
+        return (int32_t)std::clamp(quantized, (int64_t)mMin, (int64_t)mMax);
+    }
+
+private:
+
+    float nextUniform() {
+        // xorshift32
+        mState ^= mState << 13;
+        mState ^= mState >> 17;
+        mState ^= mState << 5;
+        return (mState >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float mScale;
+    int32_t mMin;
+    int32_t mMax;
+    uint32_t mState;
+
+};
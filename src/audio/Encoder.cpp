@@ -0,0 +1,37 @@
+
+#include "audio/Encoder.hpp"
+#include "audio/Flac.hpp"
+#include "audio/Wav.hpp"
+
+
+std::unique_ptr<Encoder> Encoder::create(
+    Format format,
+    std::string const& filename,
+    int channels,
+    int samplerate
+) {
+    switch (format) {
+        case Format::wavFloat:
+            return std::make_unique<Wav>(filename, channels, samplerate, Wav::Format::float32);
+        case Format::wav16:
+            return std::make_unique<Wav>(filename, channels, samplerate, Wav::Format::pcm16);
+        case Format::wav24:
+            return std::make_unique<Wav>(filename, channels, samplerate, Wav::Format::pcm24);
+        case Format::flac16:
+            return std::make_unique<Flac>(filename, channels, samplerate, 16);
+        case Format::flac24:
+            return std::make_unique<Flac>(filename, channels, samplerate, 24);
+    }
+
+    return nullptr;
+}
+
+char const* Encoder::extension(Format format) {
+    switch (format) {
+        case Format::flac16:
+        case Format::flac24:
+            return "flac";
+        default:
+            return "wav";
+    }
+}
@@ -0,0 +1,61 @@
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+//
+// Interface for a streaming audio file encoder. Samples are given in
+// interleaved float format, the encoder converts and writes them to the file
+// as they are given, so the entire render never needs to be kept in memory.
+//
+class Encoder {
+
+public:
+
+    enum class Format {
+        wavFloat,   // 32-bit float WAV
+        wav16,      // 16-bit PCM WAV, dithered
+        wav24,      // 24-bit PCM WAV, dithered
+        flac16,     // 16-bit FLAC, dithered
+        flac24      // 24-bit FLAC, dithered
+    };
+
+    //
+    // Creates an encoder for the given format, writing to the given file.
+    // Existing files will be overwritten. Use good() to check if the file
+    // could be opened.
+    //
+    static std::unique_ptr<Encoder> create(
+        Format format,
+        std::string const& filename,
+        int channels,
+        int samplerate
+    );
+
+    //
+    // File extension (without the dot) for the given format
+    //
+    static char const* extension(Format format);
+
+    virtual ~Encoder() = default;
+
+    //
+    // Returns true if no I/O errors have occurred.
+    //
+    virtual bool good() const = 0;
+
+    //
+    // Encodes the given number of samples from the given buffer. The buffer
+    // should be at least the size of nsamples * channels.
+    //
+    virtual void write(float const buf[], std::size_t nsamples) = 0;
+
+    //
+    // Flushes any buffered samples and finalizes the file. Called by the
+    // destructor if not called beforehand. Returns good().
+    //
+    virtual bool finish() = 0;
+
+};
@@ -0,0 +1,171 @@
+
+#include "audio/Fft.hpp"
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FFT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TU FftTU
+namespace TU {
+
+constexpr double PI = 3.14159265358979323846;
+
+//
+// dest[i] = a[i] * b[i]
+//
+void multiply(float *dest, float const *a, float const *b, size_t count) {
+    size_t i = 0;
+    #ifdef FFT_SSE2
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    #endif
+    for (; i < count; ++i) {
+        dest[i] = a[i] * b[i];
+    }
+}
+
+//
+// dest[i] = (re[i]^2 + im[i]^2) * scale
+//
+void power(float *dest, float const *re, float const *im, size_t count, float scale) {
+    size_t i = 0;
+    #ifdef FFT_SSE2
+    auto const vscale = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        auto const r = _mm_loadu_ps(re + i);
+        auto const m = _mm_loadu_ps(im + i);
+        auto const sum = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m));
+        _mm_storeu_ps(dest + i, _mm_mul_ps(sum, vscale));
+    }
+    #endif
+    for (; i < count; ++i) {
+        dest[i] = (re[i] * re[i] + im[i] * im[i]) * scale;
+    }
+}
+
+//
+// The butterflies for one block of a stage, with half-size h:
+// a = x[k], b = x[k + h] * w[k]; x[k] = a + b; x[k + h] = a - b
+//
+void butterflies(float *re, float *im, float const *wre, float const *wim, size_t h) {
+    auto re2 = re + h;
+    auto im2 = im + h;
+    size_t k = 0;
+    #ifdef FFT_SSE2
+    for (; k + 4 <= h; k += 4) {
+        auto const wr = _mm_loadu_ps(wre + k);
+        auto const wi = _mm_loadu_ps(wim + k);
+        auto const xr = _mm_loadu_ps(re2 + k);
+        auto const xi = _mm_loadu_ps(im2 + k);
+        auto const br = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+        auto const bi = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+        auto const ar = _mm_loadu_ps(re + k);
+        auto const ai = _mm_loadu_ps(im + k);
+        _mm_storeu_ps(re + k, _mm_add_ps(ar, br));
+        _mm_storeu_ps(im + k, _mm_add_ps(ai, bi));
+        _mm_storeu_ps(re2 + k, _mm_sub_ps(ar, br));
+        _mm_storeu_ps(im2 + k, _mm_sub_ps(ai, bi));
+    }
+    #endif
+    for (; k < h; ++k) {
+        auto const br = re2[k] * wre[k] - im2[k] * wim[k];
+        auto const bi = re2[k] * wim[k] + im2[k] * wre[k];
+        auto const ar = re[k];
+        auto const ai = im[k];
+        re[k] = ar + br;
+        im[k] = ai + bi;
+        re2[k] = ar - br;
+        im2[k] = ai - bi;
+    }
+}
+
+}
+
+Fft::Fft(size_t size) :
+    mSize(size),
+    mScale(0.0f),
+    mWindow(size),
+    mBitReverse(size),
+    mTwiddleRe(size > 1 ? size - 1 : 1),
+    mTwiddleIm(size > 1 ? size - 1 : 1),
+    mRe(size),
+    mIm(size)
+{
+    Q_ASSERT(size >= 2 && (size & (size - 1)) == 0);
+
+    // Hann window
+    double gain = 0.0;
+    for (size_t i = 0; i < size; ++i) {
+        auto const w = 0.5 - 0.5 * std::cos(2.0 * TU::PI * i / size);
+        mWindow[i] = (float)w;
+        gain += w;
+    }
+    // a full scale sine has a magnitude of gain / 2 in its bin
+    mScale = (float)(4.0 / (gain * gain));
+
+    int bits = 0;
+    while (((size_t)1 << bits) < size) {
+        ++bits;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        size_t reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        mBitReverse[i] = reversed;
+    }
+
+    for (size_t h = 1; h < size; h <<= 1) {
+        for (size_t k = 0; k < h; ++k) {
+            auto const angle = -TU::PI * k / h;
+            mTwiddleRe[h - 1 + k] = (float)std::cos(angle);
+            mTwiddleIm[h - 1 + k] = (float)std::sin(angle);
+        }
+    }
+}
+
+size_t Fft::size() const {
+    return mSize;
+}
+
+size_t Fft::bins() const {
+    return mSize / 2 + 1;
+}
+
+void Fft::powerSpectrum(float const *input, float *output) {
+    TU::multiply(mIm.data(), input, mWindow.data(), mSize);
+    // bit-reversed copy into the real part, imaginary part is zero
+    for (size_t i = 0; i < mSize; ++i) {
+        mRe[mBitReverse[i]] = mIm[i];
+    }
+    std::fill(mIm.begin(), mIm.end(), 0.0f);
+
+    transform();
+
+    TU::power(output, mRe.data(), mIm.data(), bins(), mScale);
+    // DC and Nyquist are not split with a mirrored negative frequency like a
+    // sine is, so their magnitude is twice as large for the same amplitude
+    output[0] *= 0.25f;
+    output[mSize / 2] *= 0.25f;
+}
+
+void Fft::transform() {
+    auto re = mRe.data();
+    auto im = mIm.data();
+    for (size_t h = 1; h < mSize; h <<= 1) {
+        auto const wre = mTwiddleRe.data() + h - 1;
+        auto const wim = mTwiddleIm.data() + h - 1;
+        for (size_t block = 0; block < mSize; block += h * 2) {
+            TU::butterflies(re + block, im + block, wre, wim, h);
+        }
+    }
+}
+
+#undef TU
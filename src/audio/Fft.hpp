@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//
+// Radix-2 FFT of a fixed, power of two size, for spectrum analysis.
+//
+// powerSpectrum() applies a Hann window to a block of real samples,
+// transforms it and computes the power of each bin, normalized so that a full
+// scale sine wave has a power of 1.0 (0 dBFS) in its bin. The window,
+// butterfly and power loops use SSE2 when available, 4 bins at a time.
+//
+// Tables and work buffers are allocated on construction, transforming does
+// not allocate. An instance may only be used by one thread at a time.
+//
+class Fft {
+
+public:
+
+    explicit Fft(size_t size);
+
+    size_t size() const;
+
+    //
+    // Number of bins output by powerSpectrum, size() / 2 + 1 (DC up to the
+    // Nyquist frequency).
+    //
+    size_t bins() const;
+
+    //
+    // Windows and transforms size() samples from input, writing the power
+    // of each bin to output.
+    //
+    void powerSpectrum(float const *input, float *output);
+
+private:
+
+    void transform();
+
+    size_t mSize;
+    // normalization of the squared magnitude, for the window's gain
+    float mScale;
+
+    std::vector<float> mWindow;
+    std::vector<size_t> mBitReverse;
+    // twiddle factors, for the stage of half-size h the h factors start at
+    // index h - 1
+    std::vector<float> mTwiddleRe;
+    std::vector<float> mTwiddleIm;
+
+    // work buffers, split real and imaginary parts
+    std::vector<float> mRe;
+    std::vector<float> mIm;
+
+};
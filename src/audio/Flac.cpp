@@ -0,0 +1,482 @@
+
+#include "audio/Flac.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <limits>
+
+
+#define TU FlacTU
+namespace TU {
+
+constexpr int MAX_FIXED_ORDER = 4;
+constexpr int MAX_PARTITION_ORDER = 8;
+
+// channel assignments for stereo frames
+constexpr uint32_t CHANNELS_LEFT_SIDE = 0x8;
+constexpr uint32_t CHANNELS_RIGHT_SIDE = 0x9;
+constexpr uint32_t CHANNELS_MID_SIDE = 0xA;
+
+uint8_t crc8(uint8_t const *data, size_t len) {
+    // polynomial x^8 + x^2 + x^1 + x^0
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t crc16(uint8_t const *data, size_t len) {
+    // polynomial x^16 + x^15 + x^2 + x^0
+    uint16_t crc = 0;
+    while (len--) {
+        crc ^= (uint16_t)(*data++ << 8);
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+//
+// Computes the residual of the fixed predictor of the given order, for
+// samples [order, n). The first order entries of residual are unused.
+//
+void fixedResidual(int32_t const *x, int n, int order, int32_t *residual) {
+    for (int i = order; i < n; ++i) {
+        int64_t prediction;
+        switch (order) {
+            case 0:
+                prediction = 0;
+                break;
+            case 1:
+                prediction = (int64_t)x[i - 1];
+                break;
+            case 2:
+                prediction = 2 * (int64_t)x[i - 1] - x[i - 2];
+                break;
+            case 3:
+                prediction = 3 * (int64_t)x[i - 1] - 3 * (int64_t)x[i - 2] + x[i - 3];
+                break;
+            default:
+                prediction = 4 * (int64_t)x[i - 1] - 6 * (int64_t)x[i - 2] + 4 * (int64_t)x[i - 3] - x[i - 4];
+                break;
+        }
+        residual[i] = (int32_t)(x[i] - prediction);
+    }
+}
+
+inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+//
+// Encoding decided for a single subframe
+//
+struct SubframePlan {
+
+    enum class Type {
+        constant,
+        verbatim,
+        fixed
+    };
+
+    Type type = Type::verbatim;
+    int order = 0;
+    int partitionOrder = 0;
+    std::array<uint8_t, 1 << MAX_PARTITION_ORDER> params{};
+    uint64_t bits = std::numeric_limits<uint64_t>::max();
+};
+
+//
+// Finds the partition order and rice parameters that minimize the size of
+// the given residual (samples [order, n)), updating the plan if it is smaller
+// than the plan's current size. Costs are estimated from the sum of the
+// folded residuals in each partition.
+//
+void planResidual(
+    SubframePlan &plan,
+    int32_t const *residual,
+    int n,
+    int order,
+    int bps,
+    int paramBits,
+    int maxParam
+) {
+    int maxPartitionOrder = 0;
+    while (
+        maxPartitionOrder < MAX_PARTITION_ORDER &&
+        (n & ((1 << (maxPartitionOrder + 1)) - 1)) == 0 &&
+        (n >> (maxPartitionOrder + 1)) > order
+    ) {
+        ++maxPartitionOrder;
+    }
+
+    // sums for the finest partitioning, merged for coarser orders
+    std::array<uint64_t, 1 << MAX_PARTITION_ORDER> sums{};
+    int const finest = 1 << maxPartitionOrder;
+    int const finestSize = n >> maxPartitionOrder;
+    for (int p = 0; p < finest; ++p) {
+        int const start = p == 0 ? order : p * finestSize;
+        int const end = (p + 1) * finestSize;
+        uint64_t sum = 0;
+        for (int i = start; i < end; ++i) {
+            sum += zigzag(residual[i]);
+        }
+        sums[p] = sum;
+    }
+
+    uint64_t const headerBits = 8 + (uint64_t)order * bps + 2 + 4;
+
+    for (int porder = maxPartitionOrder; porder >= 0; --porder) {
+        int const partitions = 1 << porder;
+        int const partitionSize = n >> porder;
+        uint64_t bits = headerBits;
+        std::array<uint8_t, 1 << MAX_PARTITION_ORDER> params;
+        for (int p = 0; p < partitions; ++p) {
+            uint64_t const count = partitionSize - (p == 0 ? order : 0);
+            uint64_t bestCost = std::numeric_limits<uint64_t>::max();
+            int bestParam = 0;
+            for (int k = 0; k <= maxParam; ++k) {
+                auto const cost = count * (k + 1) + (sums[p] >> k);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestParam = k;
+                }
+            }
+            params[p] = (uint8_t)bestParam;
+            bits += paramBits + bestCost;
+        }
+
+        if (bits < plan.bits) {
+            plan.type = SubframePlan::Type::fixed;
+            plan.order = order;
+            plan.partitionOrder = porder;
+            plan.params = params;
+            plan.bits = bits;
+        }
+
+        // merge pairs for the next coarser order
+        for (int p = 0; p < partitions / 2; ++p) {
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+        }
+    }
+}
+
+}
+
+//
+// Big-endian bit writer for a frame
+//
+class Flac::BitWriter {
+
+public:
+
+    explicit BitWriter(std::vector<uint8_t> &buf) :
+        mBuf(buf),
+        mAcc(0),
+        mCount(0)
+    {
+        mBuf.clear();
+    }
+
+    void write(uint32_t value, int bits) {
+        if (bits == 0) {
+            return;
+        }
+        mAcc = (mAcc << bits) | (value & ((UINT64_C(1) << bits) - 1));
+        mCount += bits;
+        while (mCount >= 8) {
+            mCount -= 8;
+            mBuf.push_back((uint8_t)(mAcc >> mCount));
+        }
+    }
+
+    void writeRice(uint32_t value, int param) {
+        // quotient in unary (zeros terminated by a one), then the remainder
+        auto quotient = value >> param;
+        while (quotient >= 32) {
+            write(0, 32);
+            quotient -= 32;
+        }
+        write(1, quotient + 1);
+        write(value, param);
+    }
+
+    void alignByte() {
+        if (mCount) {
+            write(0, 8 - mCount);
+        }
+    }
+
+    std::vector<uint8_t>& buffer() {
+        return mBuf;
+    }
+
+private:
+    std::vector<uint8_t> &mBuf;
+    uint64_t mAcc;
+    int mCount;
+
+};
+
+
+
+Flac::Flac(std::string const& filename, int channels, int samplerate, int bits) :
+    mStream(filename, std::ios::out | std::ios::binary),
+    mChannels(channels),
+    mSamplerate(samplerate),
+    mBits(bits),
+    mFinished(false),
+    mDither(bits),
+    mBlock(channels, std::vector<int32_t>(BLOCK_SIZE)),
+    mBlockFill(0),
+    mTotalSamples(0),
+    mFrameNumber(0),
+    mMinFrameSize(0),
+    mMaxFrameSize(0),
+    mFrameBuffer()
+{
+    assert(channels > 0 && channels <= 8);
+    assert(samplerate > 0);
+    assert(bits == 16 || bits == 24);
+
+    mStream.write("fLaC", 4);
+    writeStreamInfo();
+}
+
+Flac::~Flac() {
+    finish();
+}
+
+bool Flac::good() const {
+    return !mStream.fail();
+}
+
+void Flac::write(float const buf[], std::size_t nsamples) {
+    while (nsamples--) {
+        for (auto &channel : mBlock) {
+            channel[mBlockFill] = mDither(*buf++);
+        }
+        if (++mBlockFill == BLOCK_SIZE) {
+            encodeBlock();
+        }
+    }
+}
+
+bool Flac::finish() {
+    if (mFinished) {
+        return good();
+    }
+    mFinished = true;
+
+    if (mBlockFill) {
+        encodeBlock();
+    }
+
+    // rewrite STREAMINFO now that the totals are known
+    mStream.seekp(4);
+    writeStreamInfo();
+    mStream.close();
+    return good();
+}
+
+void Flac::writeStreamInfo() {
+    std::vector<uint8_t> buf;
+    BitWriter writer(buf);
+    // metadata block header: last block, type 0 (STREAMINFO), length 34
+    writer.write(1, 1);
+    writer.write(0, 7);
+    writer.write(34, 24);
+
+    writer.write(BLOCK_SIZE, 16);       // min block size
+    writer.write(BLOCK_SIZE, 16);       // max block size
+    writer.write(mMinFrameSize, 24);
+    writer.write(mMaxFrameSize, 24);
+    writer.write(mSamplerate, 20);
+    writer.write(mChannels - 1, 3);
+    writer.write(mBits - 1, 5);
+    writer.write((uint32_t)(mTotalSamples >> 32), 4);
+    writer.write((uint32_t)mTotalSamples, 32);
+    for (int i = 0; i < 4; ++i) {
+        writer.write(0, 32);            // MD5 (unknown)
+    }
+
+    mStream.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+void Flac::encodeBlock() {
+
+    int const n = mBlockFill;
+    // rice parameters are 4 bits for 16-bit audio and 5 bits (RICE2) for 24-bit
+    bool const rice2 = mBits > 16;
+    int const paramBits = rice2 ? 5 : 4;
+    int const maxParam = rice2 ? 30 : 14;
+
+    std::vector<int32_t> residual(n);
+
+    auto plan = [&](int32_t const *samples, int bps) {
+        TU::SubframePlan result;
+        if (std::all_of(samples + 1, samples + n, [samples](int32_t s) { return s == samples[0]; })) {
+            result.type = TU::SubframePlan::Type::constant;
+            result.bits = 8 + bps;
+            return result;
+        }
+        for (int order = 0; order <= TU::MAX_FIXED_ORDER && order < n; ++order) {
+            TU::fixedResidual(samples, n, order, residual.data());
+            TU::planResidual(result, residual.data(), n, order, bps, paramBits, maxParam);
+        }
+        uint64_t const verbatimBits = 8 + (uint64_t)n * bps;
+        if (verbatimBits <= result.bits) {
+            result.type = TU::SubframePlan::Type::verbatim;
+            result.bits = verbatimBits;
+        }
+        return result;
+    };
+
+    BitWriter writer(mFrameBuffer);
+
+    auto writeSubframe = [&](TU::SubframePlan const& p, int32_t const *samples, int bps) {
+        writer.write(0, 1);
+        switch (p.type) {
+            case TU::SubframePlan::Type::constant:
+                writer.write(0x00, 6);
+                writer.write(0, 1);
+                writer.write((uint32_t)samples[0], bps);
+                break;
+            case TU::SubframePlan::Type::verbatim:
+                writer.write(0x01, 6);
+                writer.write(0, 1);
+                for (int i = 0; i < n; ++i) {
+                    writer.write((uint32_t)samples[i], bps);
+                }
+                break;
+            case TU::SubframePlan::Type::fixed: {
+                writer.write(0x08 | p.order, 6);
+                writer.write(0, 1);
+                for (int i = 0; i < p.order; ++i) {
+                    writer.write((uint32_t)samples[i], bps);
+                }
+                TU::fixedResidual(samples, n, p.order, residual.data());
+                writer.write(rice2 ? 1 : 0, 2);
+                writer.write(p.partitionOrder, 4);
+                int const partitions = 1 << p.partitionOrder;
+                int const partitionSize = n >> p.partitionOrder;
+                int i = p.order;
+                for (int part = 0; part < partitions; ++part) {
+                    int const param = p.params[part];
+                    writer.write(param, paramBits);
+                    for (int const end = (part + 1) * partitionSize; i < end; ++i) {
+                        writer.writeRice(TU::zigzag(residual[i]), param);
+                    }
+                }
+                break;
+            }
+        }
+    };
+
+    // decide channel assignment and subframe encodings
+    uint32_t assignment = mChannels - 1;
+    std::vector<TU::SubframePlan> plans;
+    std::vector<int32_t const*> sources;
+    std::vector<int> depths;
+    std::vector<int32_t> mid, side;
+
+    if (mChannels == 2) {
+        auto const left = mBlock[0].data();
+        auto const right = mBlock[1].data();
+        mid.resize(n);
+        side.resize(n);
+        for (int i = 0; i < n; ++i) {
+            mid[i] = (left[i] + right[i]) >> 1;
+            side[i] = left[i] - right[i];
+        }
+
+        auto const leftPlan = plan(left, mBits);
+        auto const rightPlan = plan(right, mBits);
+        auto const midPlan = plan(mid.data(), mBits);
+        auto const sidePlan = plan(side.data(), mBits + 1);
+
+        auto const independentBits = leftPlan.bits + rightPlan.bits;
+        auto const leftSideBits = leftPlan.bits + sidePlan.bits;
+        auto const rightSideBits = rightPlan.bits + sidePlan.bits;
+        auto const midSideBits = midPlan.bits + sidePlan.bits;
+        auto const best = std::min({ independentBits, leftSideBits, rightSideBits, midSideBits });
+
+        if (best == independentBits) {
+            plans = { leftPlan, rightPlan };
+            sources = { left, right };
+            depths = { mBits, mBits };
+        } else if (best == leftSideBits) {
+            assignment = TU::CHANNELS_LEFT_SIDE;
+            plans = { leftPlan, sidePlan };
+            sources = { left, side.data() };
+            depths = { mBits, mBits + 1 };
+        } else if (best == rightSideBits) {
+            assignment = TU::CHANNELS_RIGHT_SIDE;
+            plans = { sidePlan, rightPlan };
+            sources = { side.data(), right };
+            depths = { mBits + 1, mBits };
+        } else {
+            assignment = TU::CHANNELS_MID_SIDE;
+            plans = { midPlan, sidePlan };
+            sources = { mid.data(), side.data() };
+            depths = { mBits, mBits + 1 };
+        }
+    } else {
+        for (auto &channel : mBlock) {
+            plans.push_back(plan(channel.data(), mBits));
+            sources.push_back(channel.data());
+            depths.push_back(mBits);
+        }
+    }
+
+    // frame header
+    writer.write(0xFFF8, 16);               // sync code, fixed blocksize
+    writer.write(0x7, 4);                   // blocksize: 16-bit (n-1) at end of header
+    writer.write(0x0, 4);                   // samplerate: from STREAMINFO
+    writer.write(assignment, 4);
+    writer.write(mBits == 16 ? 0x4 : 0x6, 3);
+    writer.write(0, 1);
+    // frame number, UTF-8 coded
+    if (mFrameNumber < 0x80) {
+        writer.write(mFrameNumber, 8);
+    } else {
+        int continuation = 1;
+        while (continuation < 5 && mFrameNumber >= (UINT32_C(1) << (6 + 5 * continuation))) {
+            ++continuation;
+        }
+        uint32_t const leading = (0xFF00u >> (continuation + 1)) & 0xFF;
+        writer.write(leading | (mFrameNumber >> (6 * continuation)), 8);
+        for (int i = continuation - 1; i >= 0; --i) {
+            writer.write(0x80 | ((mFrameNumber >> (6 * i)) & 0x3F), 8);
+        }
+    }
+    writer.write(n - 1, 16);
+    writer.write(TU::crc8(mFrameBuffer.data(), mFrameBuffer.size()), 8);
+
+    for (size_t i = 0; i < plans.size(); ++i) {
+        writeSubframe(plans[i], sources[i], depths[i]);
+    }
+
+    writer.alignByte();
+    writer.write(TU::crc16(mFrameBuffer.data(), mFrameBuffer.size()), 16);
+
+    mStream.write(reinterpret_cast<const char*>(mFrameBuffer.data()), mFrameBuffer.size());
+
+    uint32_t const frameSize = (uint32_t)mFrameBuffer.size();
+    if (mFrameNumber == 0 || frameSize < mMinFrameSize) {
+        mMinFrameSize = frameSize;
+    }
+    mMaxFrameSize = std::max(mMaxFrameSize, frameSize);
+
+    mTotalSamples += n;
+    ++mFrameNumber;
+    mBlockFill = 0;
+}
+
+#undef TU
@@ -0,0 +1,74 @@
+
+#pragma once
+
+#include "audio/Dither.hpp"
+#include "audio/Encoder.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//
+// Streaming FLAC encoder. Samples are buffered until a block is full, which
+// is then encoded as a single frame using fixed linear predictors with Rice
+// coded residuals. Stereo blocks also try left/side, right/side and mid/side
+// decorrelation, picking whichever encodes smallest.
+//
+// The STREAMINFO block is rewritten with the total sample count and frame
+// sizes when finished. No MD5 signature is computed (it is left as zero,
+// which decoders treat as unknown).
+//
+class Flac : public Encoder {
+
+public:
+
+    //
+    // Opens a flac file for writing with the given channel count (1-8),
+    // samplerate and bits per sample (16 or 24). Existing files will be
+    // overwritten.
+    //
+    explicit Flac(std::string const& filename, int channels, int samplerate, int bits);
+
+    virtual ~Flac();
+
+    virtual bool good() const override;
+
+    virtual void write(float const buf[], std::size_t nsamples) override;
+
+    virtual bool finish() override;
+
+private:
+
+    Flac(Flac const&) = delete;
+    Flac& operator=(Flac const&) = delete;
+
+    static constexpr int BLOCK_SIZE = 4096;
+
+    class BitWriter;
+
+    void writeStreamInfo();
+
+    void encodeBlock();
+
+    std::ofstream mStream;
+    int mChannels;
+    int mSamplerate;
+    int mBits;
+    bool mFinished;
+
+    Dither mDither;
+
+    // deinterleaved samples for the current block, one buffer per channel
+    std::vector<std::vector<int32_t>> mBlock;
+    int mBlockFill;
+
+    uint64_t mTotalSamples;
+    uint32_t mFrameNumber;
+    uint32_t mMinFrameSize;
+    uint32_t mMaxFrameSize;
+
+    std::vector<uint8_t> mFrameBuffer;
+
+};
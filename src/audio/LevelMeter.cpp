@@ -0,0 +1,250 @@
+
+#include "audio/LevelMeter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEVELMETER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TU LevelMeterTU
+namespace TU {
+
+constexpr double PI = 3.14159265358979323846;
+
+#ifdef LEVELMETER_SSE2
+inline __m128 abs(__m128 v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+#endif
+
+//
+// Sample peak and sum of squares of each channel, added to the given
+// measurement.
+//
+template <class Measurement>
+void measure(Measurement &m, float const *frames, size_t count) {
+    size_t i = 0;
+    float peakLeft = m.peak[0];
+    float peakRight = m.peak[1];
+    float sumLeft = 0.0f;
+    float sumRight = 0.0f;
+
+    #ifdef LEVELMETER_SSE2
+    // 2 frames at a time, lanes are L R L R
+    auto peak = _mm_setzero_ps();
+    auto sum = _mm_setzero_ps();
+    for (; i + 2 <= count; i += 2) {
+        auto const v = _mm_loadu_ps(frames + i * 2);
+        peak = _mm_max_ps(peak, abs(v));
+        sum = _mm_add_ps(sum, _mm_mul_ps(v, v));
+    }
+    peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    alignas(16) float lanes[8];
+    _mm_store_ps(lanes, peak);
+    _mm_store_ps(lanes + 4, sum);
+    peakLeft = std::max(peakLeft, lanes[0]);
+    peakRight = std::max(peakRight, lanes[1]);
+    sumLeft = lanes[4];
+    sumRight = lanes[5];
+    #endif
+
+    for (; i < count; ++i) {
+        auto const l = frames[i * 2];
+        auto const r = frames[i * 2 + 1];
+        peakLeft = std::max(peakLeft, std::abs(l));
+        peakRight = std::max(peakRight, std::abs(r));
+        sumLeft += l * l;
+        sumRight += r * r;
+    }
+
+    m.peak[0] = peakLeft;
+    m.peak[1] = peakRight;
+    m.sum[0] += sumLeft;
+    m.sum[1] += sumRight;
+    m.frames += count;
+}
+
+}
+
+LevelMeter::LevelMeter() :
+    mEnabled(false),
+    mSamplerate(44100),
+    mCoefficients(),
+    mHistory(),
+    mCurrent(),
+    mPending(),
+    mMeanSquare(),
+    mVersion(0),
+    mLevels()
+{
+    // windowed sinc, cutoff at the original Nyquist frequency
+    constexpr int LENGTH = TAPS * PHASES;
+    constexpr double CENTER = (LENGTH - 1) / 2.0;
+    std::array<double, PHASES> gains{};
+    std::array<double, LENGTH> h;
+    for (int n = 0; n < LENGTH; ++n) {
+        auto const x = (n - CENTER) / PHASES;
+        auto const sinc = x == 0.0 ? 1.0 : std::sin(TU::PI * x) / (TU::PI * x);
+        auto const window = 0.5 - 0.5 * std::cos(2.0 * TU::PI * (n + 0.5) / LENGTH);
+        h[n] = sinc * window;
+        gains[n % PHASES] += h[n];
+    }
+    // each phase has unity gain at DC
+    for (int n = 0; n < LENGTH; ++n) {
+        auto const tap = n / PHASES;
+        auto const phase = n % PHASES;
+        mCoefficients[tap * PHASES + phase] = (float)(h[n] / gains[phase]);
+    }
+
+    reset();
+    clear();
+}
+
+void LevelMeter::setEnabled(bool enabled) {
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool LevelMeter::isEnabled() const {
+    return mEnabled.load(std::memory_order_relaxed);
+}
+
+void LevelMeter::setSamplerate(int samplerate) {
+    mSamplerate = samplerate;
+}
+
+void LevelMeter::reset() {
+    Measurement discard;
+    while (mPending.pop(discard)) {
+    }
+    mCurrent = {};
+    for (auto &history : mHistory) {
+        history.fill(0.0f);
+    }
+    mMeanSquare.fill(0.0);
+}
+
+void LevelMeter::clear() {
+    auto &levels = mLevels.back();
+    levels.version = ++mVersion;
+    levels.peak.fill(0.0f);
+    levels.rms.fill(0.0f);
+    levels.truePeak.fill(0.0f);
+    mLevels.publish();
+}
+
+void LevelMeter::write(float const *frames, size_t count) {
+    while (count) {
+        auto const chunk = std::min(count, CHUNK);
+        TU::measure(mCurrent, frames, chunk);
+        measureTruePeak(frames, chunk);
+        frames += chunk * 2;
+        count -= chunk;
+    }
+}
+
+void LevelMeter::measureTruePeak(float const *frames, size_t count) {
+    // each channel's history followed by the new samples
+    float samples[TAPS - 1 + CHUNK];
+    for (int ch = 0; ch < 2; ++ch) {
+        auto &history = mHistory[ch];
+        std::copy(history.begin(), history.end(), samples);
+        for (size_t i = 0; i < count; ++i) {
+            samples[TAPS - 1 + i] = frames[i * 2 + ch];
+        }
+
+        float peak = mCurrent.truePeak[ch];
+        #ifdef LEVELMETER_SSE2
+        // all 4 phases of an output sample at once
+        auto vpeak = _mm_setzero_ps();
+        for (size_t i = 0; i < count; ++i) {
+            auto const newest = samples + i + TAPS - 1;
+            auto acc = _mm_setzero_ps();
+            for (int t = 0; t < TAPS; ++t) {
+                auto const coeff = _mm_load_ps(mCoefficients.data() + t * PHASES);
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(newest[-t]), coeff));
+            }
+            vpeak = _mm_max_ps(vpeak, TU::abs(acc));
+        }
+        vpeak = _mm_max_ps(vpeak, _mm_movehl_ps(vpeak, vpeak));
+        vpeak = _mm_max_ps(vpeak, _mm_shuffle_ps(vpeak, vpeak, _MM_SHUFFLE(1, 1, 1, 1)));
+        peak = std::max(peak, _mm_cvtss_f32(vpeak));
+        #else
+        for (size_t i = 0; i < count; ++i) {
+            auto const newest = samples + i + TAPS - 1;
+            for (int p = 0; p < PHASES; ++p) {
+                float acc = 0.0f;
+                for (int t = 0; t < TAPS; ++t) {
+                    acc += newest[-t] * mCoefficients[t * PHASES + p];
+                }
+                peak = std::max(peak, std::abs(acc));
+            }
+        }
+        #endif
+        mCurrent.truePeak[ch] = peak;
+
+        std::copy(samples + count, samples + count + TAPS - 1, history.begin());
+    }
+}
+
+void LevelMeter::mark(uint64_t position) {
+    if (mCurrent.frames == 0) {
+        return;
+    }
+    mCurrent.position = position;
+    if (!mPending.push(mCurrent)) {
+        // queue is full (very large buffer), drop the oldest
+        Measurement dropped;
+        mPending.pop(dropped);
+        mPending.push(mCurrent);
+    }
+    mCurrent = {};
+}
+
+bool LevelMeter::update(uint64_t position) {
+    Measurement combined{};
+    for (auto pending = mPending.peek(); pending != nullptr && pending->position <= position; pending = mPending.peek()) {
+        for (int ch = 0; ch < 2; ++ch) {
+            combined.peak[ch] = std::max(combined.peak[ch], pending->peak[ch]);
+            combined.truePeak[ch] = std::max(combined.truePeak[ch], pending->truePeak[ch]);
+            combined.sum[ch] += pending->sum[ch];
+        }
+        combined.frames += pending->frames;
+        Measurement discard;
+        mPending.pop(discard);
+    }
+
+    if (combined.frames == 0) {
+        return false;
+    }
+
+    // exponential integration, weighted by the number of frames played
+    auto const decay = std::exp(-(double)combined.frames / (RMS_TIME * mSamplerate));
+    for (int ch = 0; ch < 2; ++ch) {
+        auto const meanSquare = combined.sum[ch] / combined.frames;
+        mMeanSquare[ch] = mMeanSquare[ch] * decay + meanSquare * (1.0 - decay);
+    }
+
+    auto &levels = mLevels.back();
+    levels.version = ++mVersion;
+    for (int ch = 0; ch < 2; ++ch) {
+        levels.peak[ch] = combined.peak[ch];
+        // the true peak is never less than the sample peak
+        levels.truePeak[ch] = std::max(combined.truePeak[ch], combined.peak[ch]);
+        levels.rms[ch] = (float)std::sqrt(mMeanSquare[ch]);
+    }
+    levels.peak[master] = std::max(levels.peak[left], levels.peak[right]);
+    levels.truePeak[master] = std::max(levels.truePeak[left], levels.truePeak[right]);
+    levels.rms[master] = (float)std::sqrt((mMeanSquare[left] + mMeanSquare[right]) * 0.5);
+    mLevels.publish();
+    return true;
+}
+
+LevelMeter::Levels const& LevelMeter::read() {
+    return mLevels.read();
+}
+
+#undef TU
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "utils/SpscQueue.hpp"
+#include "utils/TripleBuffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//
+// Peak, RMS and true-peak levels of the rendered audio, for the level meters.
+//
+// The render thread measures each block as it is synthesized: the sample
+// peak and sum of squares of each channel, and the true peak, estimated by
+// upsampling by 4 with a polyphase FIR (as in ITU-R BS.1770). All 4 phases
+// of the FIR are computed together, and the peak/sum loops process 2 frames
+// at a time, using SSE2 when available.
+//
+// Measurements are accumulated per engine frame and queued with their
+// position in the output. Once played, they are combined and published
+// through a TripleBuffer, so the levels match what is being heard. RMS is
+// integrated exponentially with a time constant of RMS_TIME.
+//
+// The thread owning the render context (see Renderer) is the writer, the GUI
+// thread is the reader. When disabled, the render thread does not measure
+// anything.
+//
+class LevelMeter {
+
+public:
+
+    // integration time of the RMS level, in seconds
+    static constexpr double RMS_TIME = 0.3;
+
+    enum Channel {
+        left,
+        right,
+        master,
+
+        CHANNELS
+    };
+
+    struct Levels {
+        // incremented for each published snapshot
+        uint64_t version;
+        // levels are linear, 1.0 is full scale (0 dBFS)
+        // largest sample since the last snapshot
+        std::array<float, CHANNELS> peak;
+        std::array<float, CHANNELS> rms;
+        // largest interpolated sample since the last snapshot
+        std::array<float, CHANNELS> truePeak;
+    };
+
+    LevelMeter();
+    ~LevelMeter() = default;
+
+    //
+    // Enables or disables measuring. Any thread.
+    //
+    void setEnabled(bool enabled);
+
+    bool isEnabled() const;
+
+    //
+    // Sets the samplerate of the measured audio. Writer only.
+    //
+    void setSamplerate(int samplerate);
+
+    //
+    // Discards all measurements and resets the levels to silence, called
+    // when the play position is reset. Writer only.
+    //
+    void reset();
+
+    //
+    // Publishes silent levels. Writer only.
+    //
+    void clear();
+
+    //
+    // Measures the given stereo frames. Writer only.
+    //
+    void write(float const *frames, size_t count);
+
+    //
+    // Ends the current measurement, which is heard before the given position.
+    // Writer only.
+    //
+    void mark(uint64_t position);
+
+    //
+    // Publishes the levels of all measurements played before the given
+    // position. Returns true if the levels were published. Writer only.
+    //
+    bool update(uint64_t position);
+
+    //
+    // Gets the most recently published levels. Reader only.
+    //
+    Levels const& read();
+
+private:
+
+    // taps per phase of the upsampling FIR
+    static constexpr int TAPS = 12;
+    static constexpr int PHASES = 4;
+    // frames measured at a time
+    static constexpr size_t CHUNK = 256;
+
+    struct Measurement {
+        // end of the measured frames in the output
+        uint64_t position;
+        size_t frames;
+        std::array<float, 2> peak;
+        std::array<float, 2> truePeak;
+        std::array<double, 2> sum;
+    };
+
+    void measureTruePeak(float const *frames, size_t count);
+
+    std::atomic_bool mEnabled;
+    int mSamplerate;
+
+    // FIR coefficients, interleaved by phase: tap t of phase p is at
+    // t * PHASES + p
+    alignas(16) std::array<float, TAPS * PHASES> mCoefficients;
+    // last TAPS - 1 samples of each channel
+    std::array<std::array<float, TAPS - 1>, 2> mHistory;
+
+    Measurement mCurrent;
+    SpscQueue<Measurement, 256> mPending;
+
+    // mean squares being integrated
+    std::array<double, 2> mMeanSquare;
+
+    uint64_t mVersion;
+    TripleBuffer<Levels> mLevels;
+
+};
@@ -0,0 +1,436 @@
+
+#include "audio/PreviewVoice.hpp"
+
+#include "trackerboy/engine/ChannelControl.hpp"
+#include "trackerboy/note.hpp"
+
+#include <algorithm>
+
+#define TU PreviewVoiceTU
+namespace TU {
+
+// frames output after a preview stops, same as the renderer's STOP_FRAMES
+constexpr int RELEASE_FRAMES = 5;
+
+constexpr size_t WAVERAM_SIZE = 16;
+
+//
+// Channels a note may be allocated, in the order they are tried
+//
+struct Allocation {
+    int count;
+    trackerboy::ChType channels[2];
+};
+
+// by requested channel. Only the pulse channels are interchangeable, an
+// instrument never plays on a channel of another type
+constexpr Allocation ALLOCATION_ORDER[4] = {
+    { 2, { trackerboy::ChType::ch1, trackerboy::ChType::ch2 } },
+    { 2, { trackerboy::ChType::ch2, trackerboy::ChType::ch1 } },
+    { 1, { trackerboy::ChType::ch3 } },
+    { 1, { trackerboy::ChType::ch4 } }
+};
+
+// register that turns off the DAC of each channel when cleared
+constexpr uint8_t DAC_REGISTERS[4] = {
+    trackerboy::IApuIo::REG_NR12,
+    trackerboy::IApuIo::REG_NR22,
+    trackerboy::IApuIo::REG_NR30,
+    trackerboy::IApuIo::REG_NR42
+};
+
+void add(float *dest, float const *src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] += src[i];
+    }
+}
+
+}
+
+PreviewVoice::Event::Event(Type type) :
+    type(type),
+    time(),
+    key(GUI_KEY),
+    note(0),
+    channel(trackerboy::ChType::ch1),
+    instrumentId(-1),
+    waveId(0),
+    instrument(),
+    waveforms()
+{
+}
+
+PreviewVoice::PreviewVoice(trackerboy::DefaultApu &music) :
+    mMusic(music),
+    mApu(),
+    mSynth(mApu, 44100),
+    mSlots(),
+    mAge(0),
+    mNoInstruments(),
+    mNoWaveforms(),
+    mReleaseFrames(0),
+    mEvents(),
+    mMidiEvents(),
+    mSpent(),
+    mSamplerate(44100),
+    mBlockTime(),
+    mPreviousBlockTime(),
+    mBlockOffset(0),
+    mScratch()
+{
+    for (auto &slot : mSlots) {
+        slot.state = State::silent;
+        slot.key = GUI_KEY;
+        slot.age = 0;
+        slot.note = 0;
+        slot.instrumentId = -1;
+        slot.waveId = 0;
+    }
+    mScratch.resize(mSynth.framesize() * 2);
+    powerCycle();
+}
+
+std::shared_ptr<trackerboy::WaveformTable const> PreviewVoice::copyWaveform(trackerboy::Waveform const& waveform, uint8_t id) {
+    auto copy = std::make_shared<trackerboy::WaveformTable>();
+    copy->insert(id)->data() = waveform.data();
+    return copy;
+}
+
+bool PreviewVoice::post(Event &&event) {
+    event.time = Clock::now();
+    return mEvents.push(std::move(event));
+}
+
+bool PreviewVoice::postMidi(Event &&event) {
+    return mMidiEvents.push(std::move(event));
+}
+
+void PreviewVoice::collect() {
+    // each popped item is destroyed here, by the next pop or on return
+    Spent spent;
+    while (mSpent.pop(spent)) {
+    }
+}
+
+void PreviewVoice::setup(int samplerate, float framerate) {
+    mSamplerate = samplerate;
+    mSynth.setSamplerate(samplerate);
+    mSynth.setFramerate(framerate);
+    // resets the apu
+    mSynth.setupBuffers();
+    mScratch.resize(mSynth.framesize() * 2);
+
+    for (auto &slot : mSlots) {
+        stop(slot);
+    }
+    mReleaseFrames = 0;
+    powerCycle();
+}
+
+void PreviewVoice::reset() {
+    Event discarded;
+    while (mEvents.pop(discarded)) {
+        retire(discarded);
+    }
+    while (mMidiEvents.pop(discarded)) {
+        retire(discarded);
+    }
+    discard();
+    for (auto &slot : mSlots) {
+        stop(slot);
+    }
+    mReleaseFrames = 0;
+    powerCycle();
+}
+
+bool PreviewVoice::isActive() {
+    return isSounding() || mReleaseFrames || !mEvents.isEmpty() || !mMidiEvents.isEmpty();
+}
+
+void PreviewVoice::beginBlock(Clock::time_point time) {
+    mPreviousBlockTime = mBlockTime;
+    mBlockTime = time;
+    mBlockOffset = 0;
+}
+
+size_t PreviewVoice::offsetOf(Clock::time_point time) const {
+    // events posted before the previous block are late, apply them now
+    if (time <= mPreviousBlockTime) {
+        return 0;
+    }
+    auto const elapsed = std::chrono::duration<double>(time - mPreviousBlockTime);
+    return (size_t)(elapsed.count() * mSamplerate);
+}
+
+void PreviewVoice::mix(float *dest, size_t frames) {
+    size_t mixed = 0;
+    while (mixed < frames) {
+        // apply everything due at this sample, mix up to the next event
+        auto until = frames;
+        for (auto queue = nextEvent(); queue != nullptr; queue = nextEvent()) {
+            auto const offset = offsetOf(queue->peek()->time);
+            if (offset > mBlockOffset + mixed) {
+                until = std::min(frames, offset - mBlockOffset);
+                break;
+            }
+            Event event;
+            queue->pop(event);
+            apply(event);
+            retire(event);
+        }
+
+        while (mixed < until && (isSounding() || mReleaseFrames)) {
+            if (mApu.samplesAvailable() == 0 && !step()) {
+                break;
+            }
+            auto const count = std::min(until - mixed, mApu.samplesAvailable());
+            mApu.readSamples(mScratch.data(), count);
+            TU::add(dest + mixed * 2, mScratch.data(), count * 2);
+            mixed += count;
+        }
+        mixed = until;
+    }
+    mBlockOffset += frames;
+}
+
+SpscQueue<PreviewVoice::Event, 64>* PreviewVoice::nextEvent() {
+    // the earliest of the two queues
+    auto const gui = mEvents.peek();
+    auto const midi = mMidiEvents.peek();
+    if (gui == nullptr) {
+        return midi ? &mMidiEvents : nullptr;
+    }
+    if (midi == nullptr || gui->time <= midi->time) {
+        return &mEvents;
+    }
+    return &mMidiEvents;
+}
+
+void PreviewVoice::apply(Event &event) {
+    // the event starts a new frame, unless notes are held: dropping the
+    // rest of their frame would cut them, the event waits for the next one
+    if (!isSounding()) {
+        discard();
+    }
+
+    switch (event.type) {
+        case Event::Type::instrument: {
+            auto slot = find(event.key);
+            if (slot == nullptr) {
+                slot = &allocate(event.channel);
+            }
+            start(*slot, event.key);
+            auto const channel = static_cast<trackerboy::ChType>(slot - mSlots.data());
+            if (channel == trackerboy::ChType::ch3) {
+                // the instrument may not set a waveform, start with the
+                // music's
+                mApu.writeRegister(trackerboy::IApuIo::REG_NR30, 0x00);
+                for (size_t i = 0; i < TU::WAVERAM_SIZE; ++i) {
+                    auto const reg = (uint8_t)(trackerboy::IApuIo::REG_WAVERAM + i);
+                    mApu.writeRegister(reg, mMusic.readRegister(reg));
+                }
+                mApu.writeRegister(trackerboy::IApuIo::REG_NR30, 0x80);
+            }
+            slot->note = event.note;
+            slot->instrumentId = event.instrumentId;
+            slot->waveId = event.waveId;
+            slot->waveforms = std::move(event.waveforms);
+            slot->instrument = std::move(event.instrument);
+            slot->state = State::instrument;
+            trigger(*slot);
+            break;
+        }
+        case Event::Type::waveform: {
+            auto &slot = mSlots[(int)trackerboy::ChType::ch3];
+            start(slot, event.key);
+            slot.note = event.note;
+            slot.instrumentId = -1;
+            slot.waveId = event.waveId;
+            slot.waveforms = std::move(event.waveforms);
+            slot.state = State::waveform;
+            trigger(slot);
+            break;
+        }
+        case Event::Type::note: {
+            auto slot = find(event.key);
+            if (slot == nullptr) {
+                break;
+            }
+            slot->note = event.note;
+            if (slot->state == State::instrument) {
+                slot->ip.play((uint8_t)event.note);
+            } else {
+                auto const freq = trackerboy::lookupToneNote(event.note);
+                mApu.writeRegister(trackerboy::IApuIo::REG_NR33, (uint8_t)(freq & 0xFF));
+                mApu.writeRegister(trackerboy::IApuIo::REG_NR34, (uint8_t)(freq >> 8));
+            }
+            break;
+        }
+        case Event::Type::stop: {
+            auto slot = find(event.key);
+            if (slot != nullptr) {
+                stop(*slot);
+                if (!isSounding()) {
+                    mReleaseFrames = TU::RELEASE_FRAMES;
+                }
+            }
+            break;
+        }
+        case Event::Type::instrumentEdit:
+            // the event's copies are shared by every note using them, the
+            // event's own references are retired with it
+            for (auto &slot : mSlots) {
+                if (slot.state != State::instrument || slot.instrumentId != event.instrumentId) {
+                    continue;
+                }
+                retire(std::move(slot.instrument), std::move(slot.waveforms));
+                slot.instrument = event.instrument;
+                slot.waveId = event.waveId;
+                slot.waveforms = event.waveforms;
+                trigger(slot);
+            }
+            break;
+        case Event::Type::waveformEdit:
+            for (auto &slot : mSlots) {
+                if (slot.state == State::silent || slot.waveforms == nullptr || slot.waveId != event.waveId) {
+                    continue;
+                }
+                retire(nullptr, std::move(slot.waveforms));
+                slot.waveforms = event.waveforms;
+                trigger(slot);
+            }
+            break;
+    }
+}
+
+PreviewVoice::Slot* PreviewVoice::find(int key) {
+    for (auto &slot : mSlots) {
+        if (slot.state != State::silent && slot.key == key) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+PreviewVoice::Slot& PreviewVoice::allocate(trackerboy::ChType channel) {
+    auto const& order = TU::ALLOCATION_ORDER[(int)channel];
+    for (int i = 0; i < order.count; ++i) {
+        auto &slot = mSlots[(int)order.channels[i]];
+        if (slot.state == State::silent) {
+            return slot;
+        }
+    }
+
+    // every compatible channel is sounding, replace the oldest note
+    auto oldest = &mSlots[(int)order.channels[0]];
+    for (int i = 1; i < order.count; ++i) {
+        auto &slot = mSlots[(int)order.channels[i]];
+        if (slot.age < oldest->age) {
+            oldest = &slot;
+        }
+    }
+    return *oldest;
+}
+
+int PreviewVoice::channelOf(int key) {
+    auto const slot = find(key);
+    return slot ? (int)(slot - mSlots.data()) : -1;
+}
+
+void PreviewVoice::start(Slot &slot, int key) {
+    stop(slot);
+    slot.key = key;
+    slot.age = ++mAge;
+    mReleaseFrames = 0;
+}
+
+void PreviewVoice::trigger(Slot &slot) {
+    if (slot.state == State::instrument) {
+        auto const channel = static_cast<trackerboy::ChType>(&slot - mSlots.data());
+        // the slot keeps a reference, so the preview's is never the last
+        slot.ip.setInstrument(slot.instrument, channel);
+        slot.ip.play((uint8_t)slot.note);
+    } else {
+        trackerboy::ChannelState state(trackerboy::ChType::ch3);
+        state.playing = true;
+        state.frequency = trackerboy::lookupToneNote(slot.note);
+        state.envelope = slot.waveId;
+        trackerboy::ChannelControl<trackerboy::ChType::ch3>::init(mApu, waveforms(slot), state);
+    }
+}
+
+void PreviewVoice::stop(Slot &slot) {
+    if (slot.state == State::silent) {
+        return;
+    }
+    slot.ip.setInstrument(nullptr);
+    retire(std::move(slot.instrument), std::move(slot.waveforms));
+    slot.state = State::silent;
+    // turning the DAC off disables the channel
+    auto const index = &slot - mSlots.data();
+    mApu.writeRegister(TU::DAC_REGISTERS[index], 0x00);
+}
+
+void PreviewVoice::retire(Event &event) {
+    retire(std::move(event.instrument), std::move(event.waveforms));
+}
+
+void PreviewVoice::retire(std::shared_ptr<trackerboy::Instrument const> &&instrument,
+                          std::shared_ptr<trackerboy::WaveformTable const> &&waveforms) {
+    if (instrument == nullptr && waveforms == nullptr) {
+        return;
+    }
+    Spent spent;
+    spent.instrument = std::move(instrument);
+    spent.waveforms = std::move(waveforms);
+    // if the GUI thread is so far behind that the queue is full, there is no
+    // choice but to release them here
+    mSpent.push(std::move(spent));
+}
+
+bool PreviewVoice::step() {
+    if (isSounding()) {
+        for (auto &slot : mSlots) {
+            if (slot.state == State::instrument) {
+                trackerboy::RuntimeContext rc(mApu, mNoInstruments, waveforms(slot));
+                slot.ip.step(rc);
+            }
+        }
+    } else if (mReleaseFrames) {
+        --mReleaseFrames;
+    } else {
+        return false;
+    }
+    mSynth.run();
+    return true;
+}
+
+bool PreviewVoice::isSounding() const {
+    for (auto const& slot : mSlots) {
+        if (slot.state != State::silent) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PreviewVoice::discard() {
+    auto const capacity = mScratch.size() / 2;
+    while (auto available = mApu.samplesAvailable()) {
+        mApu.readSamples(mScratch.data(), std::min(available, capacity));
+    }
+}
+
+void PreviewVoice::powerCycle() {
+    // powering off clears every register except wave RAM
+    mApu.writeRegister(trackerboy::IApuIo::REG_NR52, 0x00);
+    mApu.writeRegister(trackerboy::IApuIo::REG_NR52, 0x80);
+    mApu.writeRegister(trackerboy::IApuIo::REG_NR50, 0x77);
+    mApu.writeRegister(trackerboy::IApuIo::REG_NR51, 0xFF);
+}
+
+trackerboy::WaveformTable const& PreviewVoice::waveforms(Slot const& slot) const {
+    return slot.waveforms ? *slot.waveforms : mNoWaveforms;
+}
+
+#undef TU
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "utils/SpscQueue.hpp"
+
+#include "trackerboy/apu/DefaultApu.hpp"
+#include "trackerboy/data/Instrument.hpp"
+#include "trackerboy/data/Table.hpp"
+#include "trackerboy/data/Waveform.hpp"
+#include "trackerboy/InstrumentPreview.hpp"
+#include "trackerboy/Synth.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//
+// Independent voice for instrument and waveform previews, mixed into the
+// rendered output.
+//
+// The voice has its own APU and synth, and an InstrumentPreview for each of
+// its channels, so a preview never takes a channel away from the engine and
+// never needs the module's lock: music keeps playing while a preview sounds
+// over it. The GUI thread copies
+// the instrument and waveform being previewed when posting a note, so the
+// render thread does not read the module for previews. When a previewed
+// instrument or waveform is edited, the GUI thread posts a copy of just that
+// item, and the notes using it are restarted with the edit.
+//
+// Events are timestamped and posted through a lock-free queue. The render
+// thread applies each event at the offset in the output block matching the
+// time it was posted, measured from the start of the previous block, so
+// notes start and stop on the sample with a constant latency of one render
+// period. When the voice is silent, it starts a new frame at the event. When
+// notes are held, the rest of the current frame is played out so they are
+// not cut, and the event takes effect on the next frame.
+//
+// MIDI input has its own queue, so notes go from the MIDI thread to the
+// render thread without a hop through the GUI. These events are timestamped
+// by the MIDI thread, with the time the message was received.
+//
+// Notes are polyphonic, each is identified by a key and is allocated a
+// channel of the voice of the type requested: CH1 or CH2 for pulse, the one
+// requested first, CH3 for wave and CH4 for noise. When every compatible
+// channel is sounding, the oldest note on them is replaced. Previews from
+// the GUI are monophonic and use GUI_KEY, waveform previews only play on CH3.
+//
+// When no preview is sounding, mixing only checks the queues.
+//
+// The copies an event carries are never freed by the render thread. Once an
+// event is applied, or a note using them stops, they are handed back through
+// a return queue and released by the GUI thread in collect.
+//
+// Threads:
+//  - GUI thread: post, copyWaveform, collect
+//  - MIDI input thread: postMidi
+//  - Render thread (owner of the render context): everything else
+//
+class PreviewVoice {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    // key of previews started by the GUI
+    static constexpr int GUI_KEY = -1;
+
+    struct Event {
+
+        enum class Type {
+            instrument,     // key, note, channel, instrumentId, instrument (optional), waveId, waveforms (optional)
+            waveform,       // key, note, waveId, waveforms
+            note,           // key, note
+            stop,           // key
+            instrumentEdit, // instrumentId, instrument, waveId, waveforms (optional)
+            waveformEdit    // waveId, waveforms
+        };
+
+        Type type;
+        // set by post, or by the MIDI thread for postMidi
+        Clock::time_point time;
+        // identifies the note, defaults to GUI_KEY
+        int key;
+        int note;
+        trackerboy::ChType channel;
+        // id of the instrument in the module, -1 for none
+        int instrumentId;
+        uint8_t waveId;
+        std::shared_ptr<trackerboy::Instrument const> instrument;
+        std::shared_ptr<trackerboy::WaveformTable const> waveforms;
+
+        Event() = default;
+        explicit Event(Type type);
+    };
+
+    //
+    // CH3 previews start with the wave RAM of the given APU (the music's), as
+    // the engine would have left it.
+    //
+    explicit PreviewVoice(trackerboy::DefaultApu &music);
+    ~PreviewVoice() = default;
+
+    //
+    // Makes a table holding only a copy of the given waveform at the given
+    // id, for an event. GUI thread.
+    //
+    static std::shared_ptr<trackerboy::WaveformTable const> copyWaveform(trackerboy::Waveform const& waveform, uint8_t id);
+
+    //
+    // Timestamps and queues the given event. Returns false if the queue is
+    // full. GUI thread.
+    //
+    bool post(Event &&event);
+
+    //
+    // Queues the given event, already timestamped. Returns false if the
+    // queue is full. MIDI input thread.
+    //
+    bool postMidi(Event &&event);
+
+    //
+    // Releases the instruments and waveforms the render thread is done
+    // with. Should be called regularly while rendering. GUI thread.
+    //
+    void collect();
+
+    //
+    // Sets the samplerate and framerate of the voice. Any preview sounding is
+    // stopped. Render thread.
+    //
+    void setup(int samplerate, float framerate);
+
+    //
+    // Stops the preview and discards all pending events. Render thread.
+    //
+    void reset();
+
+    //
+    // Determines if a preview is sounding or about to. Render thread.
+    //
+    bool isActive();
+
+    //
+    // Gets the channel (as an int ChType) playing the note with the given
+    // key, -1 if it is not sounding. Render thread.
+    //
+    int channelOf(int key);
+
+    //
+    // Starts a new output block, at the given time. Render thread.
+    //
+    void beginBlock(Clock::time_point time);
+
+    //
+    // Applies the events due in the given frames of the current block, and
+    // adds the voice's output to them. Render thread.
+    //
+    void mix(float *dest, size_t frames);
+
+private:
+
+    PreviewVoice(PreviewVoice const&) = delete;
+    PreviewVoice& operator=(PreviewVoice const&) = delete;
+
+    static constexpr int CHANNELS = 4;
+
+    enum class State {
+        silent,
+        instrument,
+        waveform
+    };
+
+    //
+    // A note sounding on one of the voice's channels
+    //
+    struct Slot {
+        State state;
+        int key;
+        // order the note was started in, the lowest is replaced first
+        uint64_t age;
+        int note;
+        // ids of the instrument and waveform, for edits
+        int instrumentId;
+        uint8_t waveId;
+        trackerboy::InstrumentPreview ip;
+        std::shared_ptr<trackerboy::Instrument const> instrument;
+        std::shared_ptr<trackerboy::WaveformTable const> waveforms;
+    };
+
+    //
+    // Copies released by the render thread, to be freed on the GUI thread
+    //
+    struct Spent {
+        std::shared_ptr<trackerboy::Instrument const> instrument;
+        std::shared_ptr<trackerboy::WaveformTable const> waveforms;
+    };
+
+    // offset of the given time in the current block
+    size_t offsetOf(Clock::time_point time) const;
+
+    // queue of the next event to apply, nullptr if there are none
+    SpscQueue<Event, 64>* nextEvent();
+
+    void apply(Event &event);
+
+    // slot playing the given key, nullptr if there is none
+    Slot* find(int key);
+
+    // gets a slot for a new note on a channel compatible with the given one
+    Slot& allocate(trackerboy::ChType channel);
+
+    // starts a note on the given slot, replacing what it was playing
+    void start(Slot &slot, int key);
+
+    // plays the slot's note from the start, with its instrument or waveform
+    void trigger(Slot &slot);
+
+    // stops the note on the given slot and silences its channel
+    void stop(Slot &slot);
+
+    // hands the copies held by the given event back to the GUI thread
+    void retire(Event &event);
+    void retire(std::shared_ptr<trackerboy::Instrument const> &&instrument,
+                std::shared_ptr<trackerboy::WaveformTable const> &&waveforms);
+
+    // synthesizes the next frame, returns false if the voice went silent
+    bool step();
+
+    bool isSounding() const;
+
+    // drops the samples left in the current frame
+    void discard();
+
+    // resets all registers, silencing every channel
+    void powerCycle();
+
+    trackerboy::WaveformTable const& waveforms(Slot const& slot) const;
+
+    trackerboy::DefaultApu &mMusic;
+
+    trackerboy::DefaultApu mApu;
+    trackerboy::Synth mSynth;
+    // one for each channel, indexed by ChType
+    std::array<Slot, CHANNELS> mSlots;
+    uint64_t mAge;
+    // the preview's instrument is set directly, this table is always empty
+    trackerboy::InstrumentTable mNoInstruments;
+    trackerboy::WaveformTable mNoWaveforms;
+
+    // frames left to output once every slot is silent, so the high pass
+    // filter decays
+    int mReleaseFrames;
+
+    SpscQueue<Event, 64> mEvents;
+    SpscQueue<Event, 64> mMidiEvents;
+    // copies to release, render thread to GUI thread
+    SpscQueue<Spent, 256> mSpent;
+
+    int mSamplerate;
+    Clock::time_point mBlockTime;
+    Clock::time_point mPreviousBlockTime;
+    // frames mixed since the start of the current block
+    size_t mBlockOffset;
+
+    std::vector<float> mScratch;
+
+};
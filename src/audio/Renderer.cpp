@@ -3,12 +3,71 @@
 #include "core/StandardRates.hpp"
 #include "utils/utils.hpp"
 
-#include "trackerboy/engine/ChannelControl.hpp"
-
-#include <QMutexLocker>
+#include <QTimerEvent>
 #include <QtDebug>
 
-//static auto LOG_PREFIX = "[Renderer]";
+#define TU RendererTU
+namespace TU {
+
+static auto LOG_PREFIX = "[Renderer]";
+
+// interval of the poll timer, in milliseconds
+static constexpr int POLL_INTERVAL = 4;
+
+//
+// Copies each item of src into a new table, keeping the ids. GUI thread.
+//
+template <class T>
+void copyTable(trackerboy::Table<T> const& src, trackerboy::Table<T> &dest) {
+    for (int id = 0; id < (int)trackerboy::Table<T>::MAX_SIZE; ++id) {
+        auto const item = src[id];
+        if (item != nullptr) {
+            *dest.insert(id) = *item;
+        }
+    }
+}
+
+//
+// Makes dest a copy of src, updating dest's items in place so that anything
+// referencing them stays valid. Render thread.
+//
+template <class T>
+void updateTable(trackerboy::Table<T> const& src, trackerboy::Table<T> &dest) {
+    for (int id = 0; id < (int)trackerboy::Table<T>::MAX_SIZE; ++id) {
+        auto const item = src[id];
+        auto existing = dest.get(id);
+        if (item != nullptr) {
+            if (existing == nullptr) {
+                existing = dest.insert(id);
+            }
+            *existing = *item;
+        } else if (existing != nullptr) {
+            dest.remove(id);
+        }
+    }
+}
+
+//
+// Determines if the two instruments would sound the same, their names are
+// not compared.
+//
+bool soundsSame(trackerboy::Instrument const& lhs, trackerboy::Instrument const& rhs) {
+    if (lhs.channel() != rhs.channel() ||
+        lhs.hasEnvelope() != rhs.hasEnvelope() ||
+        lhs.envelope() != rhs.envelope()) {
+        return false;
+    }
+    for (size_t i = 0; i < trackerboy::Instrument::SEQUENCE_COUNT; ++i) {
+        auto const& lseq = lhs.sequence(i);
+        auto const& rseq = rhs.sequence(i);
+        if (lseq.data() != rseq.data() || lseq.loop() != rseq.loop()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
 
 
 // Renderer Notes
@@ -21,22 +80,97 @@
 // utilization indicates that the callback is consuming faster than the rate the
 // audio is being produced. When this happens underruns occur, as the callback doesn't
 // get what it needs and there are now gaps in the playback.
+//
+// Threading
+//
+// The RenderContext is owned by the render (timer) thread while the timer is
+// running, and by the GUI thread when it is not. The GUI thread never touches
+// the context while the timer is running, instead it posts Commands via a
+// lock-free queue which the render thread processes at the start of each
+// period. The render thread publishes a Snapshot of its state after every
+// period via a triple buffer, which is what the GUI reads from.
+//
+// The engine does not read the module being edited. After each batch of
+// edits, the GUI thread copies the song, instruments and waveforms into a
+// ModuleData and posts it as a command. The render thread copies it into the
+// context's own module and song, then hands it back to the GUI thread to be
+// freed. The audio thread never locks the module, so an edit can never cost
+// a period.
+//
+// Playhead
+//
+// Frames are synthesized well ahead of when they are heard (up to the size of
+// the buffer). Each stepped frame is queued with the position of its first
+// sample in the output, and every render call compares these positions with
+// the number of samples the device has consumed. frameSync is emitted when the
+// device reaches the next frame, so the GUI follows what is being heard and
+// not what is being buffered.
+//
+// The timer runs its own thread, sleeping until absolute deadlines so that
+// periods do not drift. FastTimer::start and FastTimer::stop block until the
+// timer thread has started or exited, so ownership of the context is handed
+// off cleanly between the two threads when starting or stopping the timer.
+//
+// Callback rendering
+//
+// When enabled in the SoundConfig, there is no timer or playback buffer.
+// The device's data callback synthesizes what it needs on demand, so the
+// output latency is just the device's period. The device thread is the render
+// thread in this mode, and the context is handed off by starting/stopping the
+// stream instead of the timer.
+//
+// Signals
+//
+// The render thread never emits signals or posts events, as both allocate and
+// lock, which the device callback must not do. Instead it sets atomic flags
+// after publishing its snapshot, and a timer on the GUI thread polls these
+// while rendering, emitting frameSync, updateVisualizers and isPlayingChanged
+// and handling stop requests.
+
+
+Renderer::Command::Command(Type type) :
+    type(type),
+    note(0),
+    pattern(0),
+    row(0),
+    track(-1),
+    instrument(-1),
+    flag(false),
+    framerate(0),
+    output(ChannelOutput::AllOn),
+    data()
+{
+}
 
+Renderer::ModuleData::ModuleData(Module const& mod) :
+    song(*mod.song()),
+    instruments(),
+    waveforms()
+{
+    TU::copyTable(mod.data().instrumentTable(), instruments);
+    TU::copyTable(mod.data().waveformTable(), waveforms);
+}
 
-Renderer::RenderContext::RenderContext(Module &mod) :
+Renderer::RenderContext::RenderContext(Module &mod, ChannelScopeBuffer &scopes) :
     mod(mod),
     stepping(false),
     step(false),
-    song(nullptr),
+    data(),
+    song(),
     apu(),
+    tap(apu, scopes),
     synth(apu, 44100),
-    engine(apu, &mod.data()),
-    ip(),
-    previewState(PreviewState::none),
-    previewChannel(trackerboy::ChType::ch1),
+    engine(tap, &data),
+    currentEngineFrame(),
+    playingFrame(),
+    writePosition(0),
+    pendingFrames(),
     state(State::stopped),
     stopCounter(0),
+    keepAlive(false),
     bufferSize(0),
+    bufferUse(0),
+    expectedPeriod(0),
     watchdog(),
     lastPeriod(),
     periodTime(0),
@@ -48,98 +182,178 @@ Renderer::RenderContext::RenderContext(Module &mod) :
 
 Renderer::Renderer(Module &mod, QObject *parent) :
     QObject(parent),
-    mTimerThread(),
-    mTimer(new FastTimer),
+    mTimer(),
     mStream(),
     mVisBuffer(),
+    mChannelScopes(),
+    mLevelMeter(),
+    mSpectrum(),
     mOutputFlags(ChannelOutput::AllOn),
-    mContext(mod)
+    mRendering(false),
+    mStepping(false),
+    mCallbackRender(false),
+    mSamplerate(44100),
+    mCommands(),
+    mRetiredData(),
+    mModuleDataPending(false),
+    mSnapshot(),
+    mMidiTarget(),
+    mMidiPreview(),
+    mPreviewInstruments(),
+    mPreviewWaveforms(),
+    mMidiStartPending(false),
+    mMidiInput(false),
+    mVisualizersDirty(false),
+    mFrameDirty(false),
+    mStopRequest(StopRequest::none),
+    mPollTimerId(0),
+    mPlaying(false),
+    mHistograms{
+        Histogram(Histogram::Scale::log),
+        Histogram(Histogram::Scale::log),
+        Histogram(Histogram::Scale::log),
+        Histogram(Histogram::Scale::linear)
+    },
+    mUnderrunQueue(),
+    mUnderrunHistory(),
+    mUnderrunSequence(0),
+    mContext(mod, mChannelScopes),
+    mPreview(mContext.apu)
 {
-    mTimer->setCallback(timerCallback, this);
-    mTimer->moveToThread(&mTimerThread);
-    connect(&mTimerThread, &QThread::finished, mTimer, &FastTimer::deleteLater);
-    mTimerThread.setObjectName(QStringLiteral("renderer timer thread"));
-    mTimerThread.start();
+    mTimer.setCallback(timerCallback, this);
 
     connect(&mStream, &AudioStream::aborted, this,
         [this]() {
-            auto handle = mContext.access();
-            stopRender(handle, true);
+            if (mRendering) {
+                acquireContext();
+                stopRender(true);
+            }
         });
 
     connect(&mod, &Module::songChanged, this, &Renderer::setSong);
+    connect(&mod, &Module::editFinished, this, &Renderer::moduleEdited);
+    connect(&mod, &Module::reloaded, this, &Renderer::moduleReloaded);
     setSong();
+    publish();
+    setMidiTarget({ MidiTarget::Type::none, -1, -1 });
 }
 
 Renderer::~Renderer() {
-    mTimer->stop();
+    mTimer.stop();
 
     if (mStream.isRunning()) {
         mStream.stop();
     }
-
-    mTimerThread.quit();
-    mTimerThread.wait();
 }
 
 void Renderer::setSong() {
-    auto ctx = mContext.access();
-    ctx->song = ctx->mod.songShared();
-    ctx->engine.setSong(ctx->song.get());
+    Command cmd(Command::Type::setSong);
+    cmd.data = std::make_unique<ModuleData>(mContext.mod);
+    post(std::move(cmd));
 
     // if we are playing, restart playback from the start with the new song
     // if we are stepping, stop playback
 
-    if (mStream.isRunning()) {
-        if (ctx->stepping) {
-            _stopMusic(ctx);
+    if (mRendering) {
+        if (mStepping) {
+            stopMusic();
         } else {
-            _play(ctx, 0, 0, false);
+            _play(0, 0, false);
         }
     }
 }
 
-Renderer::Diagnostics Renderer::diagnostics() {
-    auto handle = mContext.access();
+void Renderer::moduleEdited() {
+    if (!mModuleDataPending) {
+        mModuleDataPending = true;
+        QMetaObject::invokeMethod(this, &Renderer::updateModuleData, Qt::QueuedConnection);
+    }
+}
 
-    auto size = mStream.bufferSize();
-    // it is safe to access the writer since we have acquired access to context
-    auto usage = size - mStream.writer().availableWrite();
+void Renderer::updateModuleData() {
+    mModuleDataPending = false;
+    Command cmd(Command::Type::setData);
+    cmd.data = std::make_unique<ModuleData>(mContext.mod);
+    post(std::move(cmd));
+    updatePreviews();
+}
 
+void Renderer::moduleReloaded() {
+    for (auto &copy : mPreviewInstruments) {
+        copy.reset();
+    }
+    for (auto &copy : mPreviewWaveforms) {
+        copy.reset();
+    }
+    updateMidiPreview();
+}
+
+Renderer::Diagnostics Renderer::diagnostics() {
+    auto const& snapshot = mSnapshot.read();
 
     return {
         mStream.underruns(),
-        usage,
-        size,
-        handle->writesSinceLastPeriod,
-        handle->periodTime,
-        0.0
+        snapshot.bufferUse,
+        mStream.bufferSize(),
+        snapshot.writesSinceLastPeriod,
+        snapshot.periodTime,
+        mStream.isRunning() ? (double)mStream.consumed() / mSamplerate : 0.0,
+        mTimer.drift()
     };
 }
 
+Histogram const& Renderer::histogram(Metric metric) const {
+    return mHistograms[(size_t)metric];
+}
+
+std::deque<Renderer::Underrun> const& Renderer::underruns() {
+    constexpr size_t MAX_HISTORY = 1000;
+
+    Underrun underrun;
+    while (mUnderrunQueue.pop(underrun)) {
+        if (mUnderrunHistory.size() == MAX_HISTORY) {
+            mUnderrunHistory.pop_front();
+        }
+        underrun.sequence = mUnderrunSequence++;
+        mUnderrunHistory.push_back(underrun);
+    }
+    return mUnderrunHistory;
+}
+
 int Renderer::samplerate() {
-    return mContext.access()->synth.samplerate();
+    return mSamplerate;
 }
 
-Guarded<VisualizerBuffer>& Renderer::visualizerBuffer() {
+VisualizerBuffer& Renderer::visualizerBuffer() {
     return mVisBuffer;
 }
 
+ChannelScopeBuffer& Renderer::channelScopeBuffer() {
+    return mChannelScopes;
+}
+
+LevelMeter& Renderer::levelMeter() {
+    return mLevelMeter;
+}
+
+SpectrumAnalyzer& Renderer::spectrumAnalyzer() {
+    return mSpectrum;
+}
+
 bool Renderer::isRunning() {
     return mStream.isRunning();
 }
 
 bool Renderer::isStepping() {
-    return mContext.access()->stepping;
+    return mStepping;
 }
 
 bool Renderer::isPlaying() {
-    return !mContext.access()->currentEngineFrame.halted;
+    return !mSnapshot.read().frame.halted;
 }
 
 trackerboy::Frame Renderer::currentFrame() {
-    auto handle = mContext.access();
-    return handle->currentEngineFrame;
+    return mSnapshot.read().frame;
 }
 
 bool Renderer::setConfig(SoundConfig const &soundConfig, AudioEnumerator const& enumerator) {
@@ -149,11 +363,15 @@ bool Renderer::setConfig(SoundConfig const &soundConfig, AudioEnumerator const&
     // otherwise the render is stopped
 
 
-    bool wasRunning = mStream.isRunning();
+    bool wasRunning = mRendering;
     if (wasRunning) {
-        mTimer->stop();
+        // stop everything while reconfiguring, we then have ownership of the context
+        acquireContext();
+        mStream.stop();
     }
 
+    mCallbackRender = soundConfig.callbackRender();
+    mStream.setRenderCallback(mCallbackRender ? deviceCallback : nullptr, this);
     mStream.open(
         enumerator.device(soundConfig.backendIndex(), soundConfig.deviceIndex()),
         soundConfig.samplerate(),
@@ -162,121 +380,345 @@ bool Renderer::setConfig(SoundConfig const &soundConfig, AudioEnumerator const&
 
     if (mStream.isEnabled()) {
 
-        mTimer->setInterval(soundConfig.period(), Qt::PreciseTimer);
-        
-
-        // update the synthesizer (the guard isn't necessary here but we'll use it anyways)
-        {
-            auto handle = mContext.access();
-            
-            bool reloadRegisters = false;
-            auto const samplerate = soundConfig.samplerate();
-            if (samplerate != handle->synth.samplerate()) {
-                handle->synth.setSamplerate(samplerate);
-                reloadRegisters = wasRunning;
+        auto const period = std::chrono::milliseconds(soundConfig.period());
+        mTimer.setInterval(period);
+        mTimer.setRealtime(soundConfig.realtimePriority());
+        mContext.expectedPeriod = period;
+
+        // update the synthesizer
+        bool reloadRegisters = false;
+        auto const samplerate = soundConfig.samplerate();
+        if (samplerate != mContext.synth.samplerate()) {
+            mContext.synth.setSamplerate(samplerate);
+            reloadRegisters = wasRunning;
+        }
+        mSamplerate = samplerate;
+        //mContext.synth.apu().setQuality(static_cast<gbapu::Apu::Quality>(soundConfig.quality()));
+        mContext.synth.setupBuffers();
+
+        if (reloadRegisters) {
+            // resizing the buffers in synth results in an APU reset so we need to
+            // rewrite channel registers
+            mContext.engine.reload();
+        }
+
+        mContext.bufferSize = mStream.bufferSize();
+
+        mVisBuffer.setWindow(mContext.synth.framesize());
+        mVisBuffer.setup(samplerate, mContext.bufferSize);
+        mChannelScopes.setup(samplerate, mContext.mod.data().framerate());
+        mLevelMeter.setSamplerate(samplerate);
+        mSpectrum.setup(samplerate, mContext.bufferSize);
+        mPreview.setup(samplerate, mContext.mod.data().framerate());
+
+        if (!wasRunning || releaseContext()) {
+            return true;
+        }
+    }
+
+    // something went wrong
+    mContext.state = State::stopped;
+    mRendering = false;
+    updatePollTimer();
+    mStopRequest = StopRequest::none;
+    return false;
+}
+
+void Renderer::post(Command &&cmd) {
+    if (mRendering) {
+        if (!mCommands.push(std::move(cmd))) {
+            // the render thread is behind, take the context back and run the
+            // command here so that it is not lost (ie a stop)
+            acquireContext();
+            execute(cmd);
+            if (!releaseContext()) {
+                stopRender(true);
             }
-            //handle->synth.apu().setQuality(static_cast<gbapu::Apu::Quality>(soundConfig.quality()));
-            handle->synth.setupBuffers();
+        }
+    } else {
+        // the render thread is idle, we own the context
+        execute(cmd);
+        collectModuleData();
+    }
+}
 
-            if (reloadRegisters) {
-                // resizing the buffers in synth results in an APU reset so we need to
-                // rewrite channel registers
-                handle->engine.reload();
+void Renderer::processCommands() {
+    Command cmd;
+    while (mCommands.pop(cmd)) {
+        execute(cmd);
+    }
+}
+
+void Renderer::execute(Command &cmd) {
+    auto &ctx = mContext;
+
+    switch (cmd.type) {
+        case Command::Type::begin:
+            if (ctx.state == State::stopped) {
+                ctx.lastPeriod = Clock::now();
+                ctx.watchdog = ctx.lastPeriod;
+            }
+            ctx.state = State::running;
+            ctx.stopCounter = 0;
+            mStream.setDraining(false);
+            break;
+        case Command::Type::setSong:
+            applyModuleData(*cmd.data);
+            retire(std::move(cmd.data));
+            ctx.engine.setSong(&ctx.song);
+            break;
+        case Command::Type::setData:
+            applyModuleData(*cmd.data);
+            retire(std::move(cmd.data));
+            break;
+        case Command::Type::play:
+            ctx.engine.play(cmd.pattern, cmd.row);
+            _setChannelOutput(cmd.output);
+            ctx.stepping = cmd.flag;
+            ctx.step = cmd.flag;
+            break;
+        case Command::Type::step:
+            if (ctx.stepping) {
+                ctx.step = true;
             }
+            break;
+        case Command::Type::stepOut:
+            ctx.stepping = false;
+            break;
+        case Command::Type::stopMusic:
+            ctx.engine.halt();
+            ctx.stepping = false;
+            break;
+        case Command::Type::jump:
+            ctx.engine.jump(cmd.pattern);
+            break;
+        case Command::Type::repeat:
+            ctx.engine.repeatPattern(cmd.flag);
+            break;
+        case Command::Type::midiInput:
+            ctx.keepAlive = cmd.flag;
+            break;
+        case Command::Type::framerate:
+            ctx.synth.setFramerate(cmd.framerate);
+            ctx.synth.setupBuffers();
+            mPreview.setup(ctx.synth.samplerate(), cmd.framerate);
+            mChannelScopes.setup(ctx.synth.samplerate(), cmd.framerate);
+            break;
+        case Command::Type::resetVolume:
+            ctx.apu.writeRegister(trackerboy::IApuIo::REG_NR50, 0x77);
+            break;
+        case Command::Type::channelOutput:
+            _setChannelOutput(cmd.output);
+            break;
+    }
+}
 
-            handle->bufferSize = mStream.bufferSize();
+void Renderer::applyModuleData(ModuleData const& data) {
+    auto &ctx = mContext;
+    ctx.song = data.song;
+    TU::updateTable(data.instruments, ctx.data.instrumentTable());
+    TU::updateTable(data.waveforms, ctx.data.waveformTable());
+}
 
+void Renderer::retire(std::unique_ptr<ModuleData> &&data) {
+    // if the GUI thread is so far behind that the queue is full, there is no
+    // choice but to free it here
+    mRetiredData.push(std::move(data));
+}
 
-            mVisBuffer.access()->resize(handle->synth.framesize());
+void Renderer::collectModuleData() {
+    // each popped item is freed here, by the next pop or on return
+    std::unique_ptr<ModuleData> data;
+    while (mRetiredData.pop(data)) {
+    }
+}
 
+void Renderer::publish() {
+    auto &snapshot = mSnapshot.back();
+    snapshot.frame = mContext.playingFrame;
+    snapshot.bufferUse = mContext.bufferUse;
+    snapshot.writesSinceLastPeriod = mContext.writesSinceLastPeriod;
+    snapshot.periodTime = mContext.periodTime;
+    mSnapshot.publish();
+}
 
+void Renderer::beginRender() {
+    if (mRendering) {
+        // cancel the stop countdown, if any
+        post(Command(Command::Type::begin));
+        return;
+    }
 
-        }
+    // the render is not running, we have ownership of the context
+    mContext.lastPeriod = Clock::now();
+    mContext.watchdog = mContext.lastPeriod;
+    mContext.state = State::running;
+    mContext.stopCounter = 0;
 
-        if (wasRunning && mStream.isRunning()) {
-            mTimer->start();
-        }
+    if (!releaseContext()) {
+        // unable to start, an error occurred
+        mContext.state = State::stopped;
+        emit audioError();
+        return;
+    }
 
-        return true;
+    mRendering = true;
+    updatePollTimer();
+    emit audioStarted();
+}
 
+void Renderer::acquireContext() {
+    // once stop returns, the render thread is no longer rendering
+    if (mCallbackRender) {
+        mStream.stop();
     } else {
-        // something went wrong
-        mContext.access()->state = State::stopped;
+        mTimer.stop();
+    }
+    processCommands();
+}
+
+bool Renderer::releaseContext() {
+    bool const restarting = !mStream.isRunning();
+    if (!mStream.start()) {
         return false;
     }
+    if (restarting) {
+        // the stream's consumed count was reset
+        resetPlayhead();
+    }
+    if (!mCallbackRender) {
+        mTimer.start();
+    }
+    return true;
 }
 
-void Renderer::beginRender(Handle &handle) {
-    if (handle->state == State::stopped) {
+void Renderer::requestStop(bool aborted) {
+    // called from the render thread, no more rendering is done until a begin
+    // command is received
+    mContext.state = State::stopped;
+    if (aborted) {
+        mStopRequest = StopRequest::aborted;
+    } else {
+        // an abort takes precedence over a pending drain
+        auto expected = StopRequest::none;
+        mStopRequest.compare_exchange_strong(expected, StopRequest::drained);
+    }
+}
 
-        bool success = mStream.start();
+void Renderer::timerEvent(QTimerEvent *evt) {
+    if (evt->timerId() != mPollTimerId) {
+        QObject::timerEvent(evt);
+        return;
+    }
 
-        if (success) {
-            handle->lastPeriod = Clock::now();
-            handle->watchdog = handle->lastPeriod;
-            mTimer->start();
-            handle.unlock();
-            emit audioStarted();
-            handle.relock();
-        } else {
-            // unable to start, an error occurred
-            handle.unlock();
-            emit audioError();
-            return;
-        }
+    pollSignals();
 
+    auto const request = mStopRequest.exchange(StopRequest::none);
+    if (request != StopRequest::none) {
+        finishStop(request == StopRequest::aborted);
     }
 
-    // reset state to running
-    handle->state = State::running;
-    handle->stopCounter = 0;
+    if (!mRendering) {
+        // a stop has completed, or the render was not running
+        startMidiNotes();
+    }
 }
 
-void Renderer::stopRender(Handle &handle, bool aborted) {
+void Renderer::pollSignals() {
+    mPreview.collect();
+    collectModuleData();
 
-
-    // this lambda must only be called from the same thread as the Renderer
-    auto stopRender_ = [this](bool aborted) {
-
-        auto success = mStream.stop();
-
-        mVisBuffer.access()->clear();
+    if (mVisualizersDirty.exchange(false)) {
         emit updateVisualizers();
+    }
 
-        if (aborted) {
-            mStream.disable();
-            emit audioError();
-        } else {
-            if (success) {
-                emit audioStopped();
-            } else {
-                emit audioError();
-            }
+    if (mFrameDirty.exchange(false)) {
+        // the snapshot was published before the flag was set
+        auto const playing = !mSnapshot.read().frame.halted;
+        if (playing != mPlaying) {
+            mPlaying = playing;
+            emit isPlayingChanged(playing);
         }
-    };
+        emit frameSync();
+    }
+}
 
-    // determine if we are in the GUI thread (same thread as the Renderer)
-    // this function is mostly called from the timer thread, occurs when:
-    //  - the buffer has drained and we are stopping
-    //  - the watchdog timer has exceeded 1 second (unknown problem with device)
-    // for these cases we need to invoke the lambda in the GUI thread (AudioStream is not thread-safe)
+void Renderer::updatePollTimer() {
+    bool const needed = mRendering || mMidiInput;
+    if (needed && mPollTimerId == 0) {
+        mPollTimerId = startTimer(TU::POLL_INTERVAL, Qt::PreciseTimer);
+    } else if (!needed && mPollTimerId != 0) {
+        killTimer(mPollTimerId);
+        mPollTimerId = 0;
+    }
+}
 
-    mTimer->stop();
+void Renderer::startMidiNotes() {
+    // the flag stays set while rendering. Notes posted while the render was
+    // stopping are still queued once it has stopped, and the GUI thread now
+    // owns the voice, so the queue can be checked exactly
+    if (!mMidiStartPending.exchange(false, std::memory_order_acquire) || !mPreview.isActive()) {
+        return;
+    }
 
-    if (objectInCurrentThread(*this)) {
-        handle->state = State::stopped;
-        handle.unlock();
-        stopRender_(aborted);
+    if (mStream.isEnabled()) {
+        beginRender();
     } else {
-        // stopRender was called from mTimerThread, invoke the lambda in the renderer's thread
-        handle.unlock();
-        QMetaObject::invokeMethod(this, [this, &stopRender_, aborted]() {
-            mContext.access()->state = State::stopped;
-            stopRender_(aborted);
-        }, Qt::BlockingQueuedConnection);
+        mPreview.reset();
+        mPreview.collect();
     }
+}
 
+void Renderer::finishStop(bool aborted) {
+    if (!mRendering) {
+        return; // already stopped (ie forceStop was called in the meantime)
+    }
+
+    acquireContext();
+    if (!aborted && mContext.state != State::stopped) {
+        // a command was posted before we got here that resumed the render
+        if (releaseContext()) {
+            return;
+        }
+        aborted = true;
+    }
 
+    stopRender(aborted);
+}
+
+void Renderer::stopRender(bool aborted) {
+    // the render thread must not be running at this point (acquireContext)
+
+    mContext.state = State::stopped;
+    mContext.bufferUse = 0;
+    mRendering = false;
+    // anything still buffered is discarded
+    resetPlayhead();
+    mContext.playingFrame = mContext.currentEngineFrame;
+    publish();
+
+    auto success = mStream.stop();
+
+    // deliver what the render thread flagged before it stopped
+    updatePollTimer();
+    mStopRequest = StopRequest::none;
+    pollSignals();
+
+    mVisBuffer.clear();
+    mChannelScopes.clear();
+    mLevelMeter.clear();
+    emit updateVisualizers();
+
+    if (aborted) {
+        mStream.disable();
+        emit audioError();
+    } else {
+        if (success) {
+            emit audioStopped();
+        } else {
+            emit audioError();
+        }
+    }
 }
 
 
@@ -285,221 +727,336 @@ void Renderer::stopRender(Handle &handle, bool aborted) {
 
 void Renderer::clearDiagnostics() {
     mStream.resetUnderruns();
+    mTimer.resetDrift();
+    for (auto &histogram : mHistograms) {
+        histogram.clear();
+    }
+    underruns();
+    mUnderrunHistory.clear();
 }
 
 void Renderer::play(int pattern, int row, bool stepmode) {
 
     if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        _play(handle, pattern, row, stepmode);
+        _play(pattern, row, stepmode);
     }
 }
 
 
 void Renderer::stepNextFrame() {
-    
-    if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        if (handle->stepping) {
-            handle->step = true;
-        }
 
+    if (mStream.isEnabled() && mStepping) {
+        post(Command(Command::Type::step));
     }
 }
 
 void Renderer::stepOut() {
     if (mStream.isEnabled()) {
-        mContext.access()->stepping = false;
+        mStepping = false;
+        post(Command(Command::Type::stepOut));
     }
 }
 
 void Renderer::jumpToPattern(int pattern) {
     if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        ctx->engine.jump(pattern);
+        Command cmd(Command::Type::jump);
+        cmd.pattern = pattern;
+        post(std::move(cmd));
     }
 }
 
 void Renderer::setPatternRepeat(bool repeat) {
 
     if (mStream.isEnabled()) {
-        mContext.access()->engine.repeatPattern(repeat);
+        Command cmd(Command::Type::repeat);
+        cmd.flag = repeat;
+        post(std::move(cmd));
     }
 }
 
 void Renderer::setPreviewNote(int note) {
     if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        switch (ctx->previewState) {
-            case PreviewState::waveform: {
-                auto freq = trackerboy::lookupToneNote(note);
-                ctx->apu.writeRegister(trackerboy::Apu::REG_NR33, (uint8_t)(freq & 0xFF));
-                ctx->apu.writeRegister(trackerboy::Apu::REG_NR34, (uint8_t)(freq >> 8));
-                break;
-            }
-            case PreviewState::instrument:
-                // update the current note
-                ctx->ip.play((uint8_t)note);
-                break;
-            default:
-                break;
-        
-        }
+        PreviewVoice::Event event(PreviewVoice::Event::Type::note);
+        event.note = note;
+        postPreview(std::move(event));
     }
 }
 
 void Renderer::instrumentPreview(int note, int track, int instrumentId) {
     if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        switch (ctx->previewState) {
-            case PreviewState::instrument:
-            case PreviewState::waveform:
-                resetPreview(ctx);
-                [[fallthrough]];
-            case PreviewState::none: {
-                auto const& itable = ctx->mod.data().instrumentTable();
-                std::shared_ptr<const trackerboy::Instrument> inst = nullptr;
-                if (instrumentId != -1) {
-                    inst = itable.getShared((uint8_t)instrumentId);
-                }
-
-                if (track == -1) {
-                    // instrument preview
-                    Q_ASSERT(inst != nullptr); // must have an instrument
-                    ctx->previewChannel = inst->channel();
-                } else {
-                    // note preview
-                    ctx->previewChannel = static_cast<trackerboy::ChType>(track);
-                }
-
-                ctx->ip.setInstrument(std::move(inst), ctx->previewChannel);
-
-                ctx->previewState = PreviewState::instrument;
-                // unlock the channel for preview
-                ctx->engine.unlock(ctx->previewChannel);
-                ctx->ip.play((uint8_t)note);
-                break;
-            }
+        Q_ASSERT(track != -1 || instrumentId != -1); // instrument previews must have an instrument
+        PreviewVoice::Event event;
+        if (makeInstrumentPreview(event, note, track, instrumentId)) {
+            postPreview(std::move(event));
+            beginRender();
         }
-        beginRender(ctx);
     }
 }
 
 void Renderer::waveformPreview(int note, int waveId) {
     if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        switch (ctx->previewState) {
-            case PreviewState::instrument:
-            case PreviewState::waveform:
-                resetPreview(ctx);
-                [[fallthrough]];
-            case PreviewState::none:
-                ctx->previewState = PreviewState::waveform;
-                ctx->previewChannel = trackerboy::ChType::ch3;
-                // unlock the channel, no longer effected by music
-                ctx->engine.unlock(trackerboy::ChType::ch3);
-
-                trackerboy::ChannelState state(trackerboy::ChType::ch3);
-                state.playing = true;
-                state.frequency = trackerboy::lookupToneNote(note);
-                state.envelope = (uint8_t)waveId;
-                trackerboy::ChannelControl<trackerboy::ChType::ch3>::init(
-                    ctx->apu, ctx->mod.data().waveformTable(), state
-                );
-                break;
+        PreviewVoice::Event event;
+        makeWaveformPreview(event, note, waveId);
+        postPreview(std::move(event));
+        beginRender();
+    }
+}
+
+void Renderer::setMidiTarget(MidiTarget const& target) {
+    mMidiTarget = target;
+    updateMidiPreview();
+}
+
+void Renderer::updateMidiPreview() {
+    // the GUI thread is the only writer of the module, no lock is needed to
+    // read it here
+    auto &preview = mMidiPreview.back();
+    preview.enabled = false;
+    preview.event = PreviewVoice::Event();
+    switch (mMidiTarget.type) {
+        case MidiTarget::Type::none:
+            break;
+        case MidiTarget::Type::instrument:
+            preview.enabled = makeInstrumentPreview(preview.event, 0, mMidiTarget.track, mMidiTarget.id);
+            break;
+        case MidiTarget::Type::waveform:
+            makeWaveformPreview(preview.event, 0, mMidiTarget.id);
+            preview.enabled = true;
+            break;
+    }
+    mMidiPreview.publish();
+}
+
+void Renderer::setMidiInput(bool enabled) {
+    Command cmd(Command::Type::midiInput);
+    cmd.flag = enabled;
+    post(std::move(cmd));
+    mMidiInput = enabled;
+    updatePollTimer();
+}
+
+void Renderer::midiCallback(void *userData, int key, int note, int velocity, std::chrono::steady_clock::time_point time) {
+    // called by Midi from the MIDI input thread
+    static_cast<Renderer*>(userData)->midiNote(key, note, velocity, time);
+}
+
+void Renderer::midiNote(int key, int note, int velocity, Clock::time_point time) {
+    // the event keeps the time the message was received, so it is applied
+    // on the same sample however long it takes to get here
+    PreviewVoice::Event event(PreviewVoice::Event::Type::stop);
+    if (velocity) {
+        auto const& preview = mMidiPreview.read();
+        if (!preview.enabled) {
+            return;
         }
-        beginRender(ctx);
+        // shares the prebuilt copies, nothing is allocated or locked
+        event = preview.event;
+        event.note = note;
+    }
+
+    event.time = time;
+    event.key = key;
+    if (!mPreview.postMidi(std::move(event))) {
+        qWarning() << TU::LOG_PREFIX << "MIDI preview queue is full, event dropped";
+    }
+
+    if (velocity) {
+        // the render is kept running while MIDI input is enabled, but it may
+        // have been stopped (or not started yet). The poll timer starts it,
+        // this thread does not allocate or post events to the GUI
+        mMidiStartPending.store(true, std::memory_order_release);
     }
 }
 
 void Renderer::updateFramerate() {
-    auto ctx = mContext.access();
-    ctx->synth.setFramerate(ctx->mod.data().framerate());
-    ctx->synth.setupBuffers();
+    Command cmd(Command::Type::framerate);
+    cmd.framerate = mContext.mod.data().framerate();
+    post(std::move(cmd));
 }
 
 void Renderer::stopPreview() {
 
     if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        if (handle->previewState != PreviewState::none) {
-            resetPreview(handle);
-        }
+        postPreview(PreviewVoice::Event(PreviewVoice::Event::Type::stop));
     }
-    
+
 }
 
 void Renderer::stopMusic() {
-    
+
     if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        _stopMusic(handle);
+        mStepping = false;
+        post(Command(Command::Type::stopMusic));
     }
 
 }
 
-void Renderer::_stopMusic(Handle &handle) {
-    handle->engine.halt();
-    handle->stepping = false;
+void Renderer::forceStop() {
+
+    if (mStream.isEnabled() && mRendering) {
+        acquireContext();
+        mPreview.reset();
+        mContext.engine.halt();
+        mContext.stepping = false;
+        mStepping = false;
+        stopRender();
+    }
+}
+
+void Renderer::_play(int orderNo, int rowNo, bool stepping) {
+
+    Command cmd(Command::Type::play);
+    cmd.pattern = orderNo;
+    cmd.row = rowNo;
+    cmd.flag = stepping;
+    cmd.output = mOutputFlags;
+    post(std::move(cmd));
+    mStepping = stepping;
+    beginRender();
+
 }
 
-void Renderer::forceStop() {
+bool Renderer::makeInstrumentPreview(PreviewVoice::Event &event, int note, int track, int instrumentId) {
+    // the voice gets its own copy of the instrument, so it can be edited
+    // while it is being previewed
+    event = PreviewVoice::Event(PreviewVoice::Event::Type::instrument);
+    event.note = note;
+    if (instrumentId != -1) {
+        event.instrumentId = instrumentId;
+        event.instrument = previewInstrument((uint8_t)instrumentId);
+    }
 
-    if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        if (handle->state != State::stopped) {
-            resetPreview(handle);
-            handle->engine.halt();
-            handle->stepping = false;
-            stopRender(handle);
+    if (track == -1) {
+        // instrument preview
+        if (event.instrument == nullptr) {
+            return false;
         }
+        event.channel = event.instrument->channel();
+    } else {
+        // note preview
+        event.channel = static_cast<trackerboy::ChType>(track);
     }
+
+    if (event.channel == trackerboy::ChType::ch3 && event.instrument && event.instrument->hasEnvelope()) {
+        // only the waveform the instrument sets
+        event.waveId = event.instrument->envelope();
+        event.waveforms = previewWaveform(event.waveId);
+    }
+    return true;
 }
 
-void Renderer::_play(Handle &handle, int orderNo, int rowNo, bool stepping) {
+void Renderer::makeWaveformPreview(PreviewVoice::Event &event, int note, int waveId) {
+    event = PreviewVoice::Event(PreviewVoice::Event::Type::waveform);
+    event.note = note;
+    event.waveId = (uint8_t)waveId;
+    event.waveforms = previewWaveform(event.waveId);
+}
 
-    handle->engine.play(orderNo, rowNo);
-    _setChannelOutput(handle, mOutputFlags);
-    handle->stepping = stepping;
-    handle->step = stepping;
-    beginRender(handle);
+std::shared_ptr<trackerboy::Instrument const> Renderer::previewInstrument(uint8_t id) {
+    auto &copy = mPreviewInstruments[id];
+    auto const inst = mContext.mod.data().instrumentTable()[id];
+    if (inst == nullptr) {
+        copy.reset();
+    } else if (copy == nullptr || !TU::soundsSame(*inst, *copy)) {
+        copy = std::make_shared<trackerboy::Instrument const>(*inst);
+    }
+    return copy;
+}
 
+std::shared_ptr<trackerboy::WaveformTable const> Renderer::previewWaveform(uint8_t id) {
+    auto &copy = mPreviewWaveforms[id];
+    auto const wave = mContext.mod.data().waveformTable()[id];
+    if (wave == nullptr) {
+        copy.reset();
+    } else if (copy == nullptr || (*copy)[id]->data() != wave->data()) {
+        copy = PreviewVoice::copyWaveform(*wave, id);
+    }
+    return copy;
 }
 
-void Renderer::resetPreview(Handle &handle) {
-    // lock the channel so it can be used for music
-    handle->engine.lock(handle->previewChannel);
-    handle->ip.setInstrument(nullptr);
-    handle->previewState = PreviewState::none;
+void Renderer::updatePreviews() {
+    // only items that have been previewed have a copy. Waveforms go first,
+    // so that an edited instrument gets the current copy of its waveform
+    bool changed = false;
+    for (int id = 0; id < (int)mPreviewWaveforms.size(); ++id) {
+        auto const last = mPreviewWaveforms[id];
+        if (last == nullptr) {
+            continue;
+        }
+        auto copy = previewWaveform((uint8_t)id);
+        if (copy == nullptr || copy == last) {
+            continue;
+        }
+        changed = true;
+        if (mRendering) {
+            PreviewVoice::Event event(PreviewVoice::Event::Type::waveformEdit);
+            event.waveId = (uint8_t)id;
+            event.waveforms = std::move(copy);
+            postPreview(std::move(event));
+        }
+    }
+
+    for (int id = 0; id < (int)mPreviewInstruments.size(); ++id) {
+        auto const last = mPreviewInstruments[id];
+        if (last == nullptr) {
+            continue;
+        }
+        auto copy = previewInstrument((uint8_t)id);
+        if (copy == nullptr || copy == last) {
+            continue;
+        }
+        changed = true;
+        if (mRendering) {
+            PreviewVoice::Event event(PreviewVoice::Event::Type::instrumentEdit);
+            event.instrumentId = id;
+            if (copy->hasEnvelope()) {
+                event.waveId = copy->envelope();
+                event.waveforms = previewWaveform(event.waveId);
+            }
+            event.instrument = std::move(copy);
+            postPreview(std::move(event));
+        }
+    }
+
+    if (changed) {
+        // MIDI notes use the new copies from now on
+        updateMidiPreview();
+    }
+}
+
+void Renderer::postPreview(PreviewVoice::Event &&event) {
+    if (!mPreview.post(std::move(event))) {
+        qWarning() << TU::LOG_PREFIX << "preview queue is full, event dropped";
+    }
 }
 
 void Renderer::resetGlobalVolume() {
-    auto ctx = mContext.access();
-    ctx->apu.writeRegister(trackerboy::IApuIo::REG_NR50, 0x77);
+    post(Command(Command::Type::resetVolume));
 }
 
  void Renderer::setChannelOutput(ChannelOutput::Flags flags) {
      mOutputFlags = flags;
-     auto ctx = mContext.access();
-     _setChannelOutput(ctx, flags);
+     Command cmd(Command::Type::channelOutput);
+     cmd.output = flags;
+     post(std::move(cmd));
  }
 
- void Renderer::_setChannelOutput(Handle &handle, ChannelOutput::Flags flags) {
+ void Renderer::_setChannelOutput(ChannelOutput::Flags flags) {
      int flag = ChannelOutput::CH1;
      for (int i = 0; i < 4; ++i) {
          auto ch = static_cast<trackerboy::ChType>(i);
          if (flags.testFlag((ChannelOutput::Flag)(flag))) {
-             handle->engine.lock(ch);
+             mContext.engine.lock(ch);
          } else {
              // channel is disabled, keep unlocked
-             handle->engine.unlock(ch);
+             mContext.engine.unlock(ch);
          }
          flag <<= 1;
      }
  }
 
 void Renderer::timerCallback(void *userData) {
-    // called by FastTimer 
+    // called by FastTimer
     static_cast<Renderer*>(userData)->render();
 }
 
@@ -511,146 +1068,284 @@ constexpr int STOP_FRAMES = 5;
 void Renderer::render() {
     // This function is called from a separate thread!
     // FastTimer lives in its own thread and calls this function via the timer callback
-    
-    auto now = Clock::now();
-
-    auto handle = mContext.access();
 
-    if (handle->state == State::stopped) {
-        return;
+    // the engine only reads the context's copy of the module, so no lock is
+    // needed (see ModuleData)
+    auto const start = Clock::now();
+    processCommands();
+    if (mContext.state != State::stopped) {
+        renderFrames();
+        mHistograms[(size_t)Metric::renderTime].record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+        );
     }
+}
 
+void Renderer::renderFrames() {
 
-    // diagnostics
-    handle->periodTime = now - handle->lastPeriod;
-    handle->lastPeriod = now;
-    handle->writesSinceLastPeriod = 0;
+    auto &ctx = mContext;
+    auto now = Clock::now();
 
+    // diagnostics
+    ctx.periodTime = now - ctx.lastPeriod;
+    ctx.lastPeriod = now;
+    ctx.writesSinceLastPeriod = 0;
+    recordPeriod(ctx.expectedPeriod);
+    mPreview.beginBlock(now);
 
     auto writer = mStream.writer();
     auto framesToRender = writer.availableWrite();
 
     if (framesToRender) {
         // reset the watchdog
-        handle->watchdog = now;
+        ctx.watchdog = now;
     } else {
         constexpr auto WATCHDOG_INTERVAL = std::chrono::seconds(1);
-        auto timeSinceLastWatchdogReset = now - handle->watchdog;
+        auto timeSinceLastWatchdogReset = now - ctx.watchdog;
         if (timeSinceLastWatchdogReset >= WATCHDOG_INTERVAL) {
             // we have gone 1 second without renderering anything
             // abort the render
-            handle.unlock();
-            stopRender(handle, true);
+            requestStop(true);
         }
         // no frames to render, exit early
+        ctx.bufferUse = ctx.bufferSize;
+        finishRender();
         return;
     }
 
-    
-    auto frame = handle->currentEngineFrame;
-    auto const haltedBefore = frame.halted;
+    if (ctx.state == State::stopping && ctx.apu.samplesAvailable() == 0) {
+        // nothing left to synthesize, wait for the buffer to drain
+        if (framesToRender == ctx.bufferSize) {
+            // the buffer has been drained, stop the callback
+            requestStop(false);
+        }
+        ctx.bufferUse = ctx.bufferSize - framesToRender;
+        finishRender();
+        return;
+    }
 
-    // cache a ref to the apu, we'll be using it often
-    auto &apu = handle->apu;
+    while (framesToRender) {
+        // the acquired region is contiguous. When the buffer's memory is
+        // mirrored this is everything available, otherwise a second pass is
+        // needed when the buffer wraps around
+        size_t toWrite = framesToRender;
+        auto writePtr = writer.acquireWrite(toWrite);
 
-    bool newFrame = false;
+        auto const written = synthesize(writePtr, toWrite);
+        writer.commitWrite(written);
 
-    auto visHandle = mVisBuffer.access();
-    visHandle->beginWrite(framesToRender);
+        ctx.writesSinceLastPeriod += written;
+        framesToRender -= written;
 
-    while (framesToRender) {
+        if (written < toWrite) {
+            break; // stopping
+        }
+    }
 
-        if (handle->state == State::stopping) {
-            if (writer.availableWrite() == handle->bufferSize) {
-                // the buffer has been drained, stop the callback
-                visHandle.unlock();
-                stopRender(handle);
-            }
-            return;
+    ctx.bufferUse = ctx.bufferSize - writer.availableWrite();
+    finishRender();
 
-        } else {
+}
 
-            if (apu.samplesAvailable() == 0) {
-                // new frame
+void Renderer::deviceCallback(void *userData, float *out, size_t frames) {
+    // called by AudioStream from the device's thread
+    static_cast<Renderer*>(userData)->renderCallback(out, frames);
+}
 
-                if (handle->state == State::stopping) {
-                    break; // stop, don't render any more
-                }
+void Renderer::renderCallback(float *out, size_t frames) {
+
+    auto &ctx = mContext;
+
+    auto const now = Clock::now();
+    processCommands();
+
+    if (ctx.state != State::stopped) {
+        ctx.periodTime = now - ctx.lastPeriod;
+        ctx.lastPeriod = now;
+        // the device asks for the samples it will play next, so the callback
+        // is expected once every frames samples
+        recordPeriod(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((double)frames / ctx.synth.samplerate())
+        ));
+        mPreview.beginBlock(now);
+
+        // miniaudio clears the output buffer before calling the callback, so
+        // anything not synthesized is silence
+        auto const written = synthesize(out, frames);
+        if (written < frames) {
+            // there is no buffer to drain, the last frame has been played
+            requestStop(false);
+        }
+        ctx.writesSinceLastPeriod = written;
 
-                if (handle->stopCounter) {
-                    if (--handle->stopCounter == 0) {
-                        handle->state = State::stopping;
-                        mStream.setDraining(true);
-                    }
-                } else {
-                    newFrame = true;
-
-                    // the engine and previewer have read access to the module
-                    // so the document must be locked when stepping
-
-                    // step engine/previewer
-                    if (!handle->stepping || handle->step) {
-                        
-                        {
-                            QMutexLocker locker(&handle->mod.mutex());
-                            handle->engine.step(frame);
-                        }
-                        
-                        if (frame.startedNewRow) {
-                            handle->step = false;
-                        }
-                    }
 
-                    if (handle->previewState == PreviewState::instrument) {
-                        auto &mod = handle->mod.data();
-                        trackerboy::RuntimeContext rc(apu, mod.instrumentTable(), mod.waveformTable());
-                        
-                        {
-                            QMutexLocker locker(&handle->mod.mutex());
-                            handle->ip.step(rc);
-                        }
-                    }
+        finishRender();
+        mHistograms[(size_t)Metric::renderTime].record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - now).count()
+        );
+    }
+}
+
+size_t Renderer::synthesize(float *dest, size_t frames) {
+
+    auto &ctx = mContext;
+    // cache a ref to the apu, we'll be using it often
+    auto &apu = ctx.apu;
+
+    size_t written = 0;
+    while (written < frames) {
+
+        if (apu.samplesAvailable() == 0) {
+            // new frame
 
+            if (ctx.state == State::stopping) {
+                break; // stop, don't render any more
+            }
 
-                    if (frame.halted && handle->previewState == PreviewState::none) {
-                        // no longer doing anything, start the stop counter
-                        handle->stopCounter = STOP_FRAMES;
+            if (ctx.stopCounter) {
+                if (mPreview.isActive() || ctx.keepAlive) {
+                    // a preview was started (or MIDI input enabled) while
+                    // counting down
+                    ctx.stopCounter = 0;
+                } else if (--ctx.stopCounter == 0) {
+                    ctx.state = State::stopping;
+                    mStream.setDraining(true);
+                }
+            } else {
+                // step engine
+                auto const stepStart = Clock::now();
+                auto &frame = ctx.currentEngineFrame;
+                if (!ctx.stepping || ctx.step) {
+                    ctx.engine.step(frame);
+                    if (frame.startedNewRow) {
+                        ctx.step = false;
                     }
+                }
+                mHistograms[(size_t)Metric::stepTime].record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - stepStart).count()
+                );
 
+
+                if (frame.halted && !mPreview.isActive() && !ctx.keepAlive) {
+                    // no longer doing anything, start the stop counter
+                    ctx.stopCounter = STOP_FRAMES;
+                }
+
+                // this frame is heard once the device reaches this position
+                if (!ctx.pendingFrames.push(TimedFrame{ ctx.writePosition, frame })) {
+                    // queue is full (very large buffer), drop the oldest
+                    TimedFrame dropped;
+                    ctx.pendingFrames.pop(dropped);
+                    ctx.pendingFrames.push(TimedFrame{ ctx.writePosition, frame });
                 }
 
-                handle->synth.run();
+            }
 
+            // the channels' output for this frame
+            mChannelScopes.capture(apu, ctx.writePosition);
+            if (mLevelMeter.isEnabled()) {
+                // the previous frame's levels end here
+                mLevelMeter.mark(ctx.writePosition);
             }
 
-            size_t toWrite = std::min(framesToRender, apu.samplesAvailable());
-            auto writePtr = writer.acquireWrite(toWrite);
-            
-            // read from the apu to the ringbuffer
-            apu.readSamples(writePtr, toWrite);
-            // send a copy to the visualizer buffer as well
-            visHandle->write(writePtr, toWrite);
-            
-            writer.commitWrite(writePtr, toWrite);
-            
-            handle->writesSinceLastPeriod += toWrite;
-            framesToRender -= toWrite;
+            ctx.synth.run();
 
         }
 
+        size_t toWrite = std::min(frames - written, apu.samplesAvailable());
+        // read from the apu to the destination
+        apu.readSamples(dest + (written * 2), toWrite);
+        mPreview.mix(dest + (written * 2), toWrite);
+        // reduce the new samples for the visualizers while they are still
+        // in cache
+        mVisBuffer.write(dest + (written * 2), toWrite);
+        if (mLevelMeter.isEnabled()) {
+            mLevelMeter.write(dest + (written * 2), toWrite);
+        }
+        if (mSpectrum.isEnabled()) {
+            mSpectrum.write(dest + (written * 2), toWrite);
+        }
+        written += toWrite;
+        ctx.writePosition += toWrite;
     }
 
-    if (handle->writesSinceLastPeriod) {
-        emit updateVisualizers();
+    return written;
+}
+
+bool Renderer::updatePlayhead() {
+    auto &ctx = mContext;
+    auto const played = mStream.consumed();
+
+    bool changed = false;
+    for (auto pending = ctx.pendingFrames.peek(); pending != nullptr && pending->position < played; pending = ctx.pendingFrames.peek()) {
+        ctx.playingFrame = pending->frame;
+        TimedFrame discard;
+        ctx.pendingFrames.pop(discard);
+        changed = true;
     }
+    return changed;
+}
 
-    if (newFrame) {
-        handle->currentEngineFrame = frame;
-        handle.unlock(); // always unlock before emitting signals
-        if (haltedBefore != frame.halted) {
-            emit isPlayingChanged(!frame.halted);
+void Renderer::recordPeriod(Clock::duration expected) {
+    auto const deviation = mContext.periodTime > expected
+        ? mContext.periodTime - expected
+        : expected - mContext.periodTime;
+    mHistograms[(size_t)Metric::jitter].record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(deviation).count()
+    );
+}
+
+void Renderer::resetPlayhead() {
+    TimedFrame discard;
+    while (mContext.pendingFrames.pop(discard)) {
+    }
+    mContext.writePosition = 0;
+    mVisBuffer.reset();
+    mChannelScopes.reset();
+    mLevelMeter.reset();
+}
+
+void Renderer::finishRender() {
+    auto const newFrame = updatePlayhead();
+
+    // tag underruns with the frame that was playing, the playhead is synced
+    // to the device so this is the frame at the time of the underrun
+    AudioStream::Underrun underrun;
+    while (mStream.popUnderrun(underrun)) {
+        mUnderrunQueue.push(Underrun{
+            underrun.time,
+            underrun.position,
+            underrun.missing,
+            mContext.playingFrame.order,
+            mContext.playingFrame.row,
+            0
+        });
+    }
+
+    if (!mCallbackRender && mContext.bufferSize) {
+        mHistograms[(size_t)Metric::bufferFill].record(mContext.bufferUse * 100 / mContext.bufferSize);
+    }
+
+    publish();
+
+    if (mContext.writesSinceLastPeriod) {
+        auto const played = mStream.consumed();
+        mVisBuffer.update(played);
+        if (mChannelScopes.isEnabled()) {
+            mChannelScopes.update(played);
         }
-        emit frameSync();
+        if (mLevelMeter.isEnabled()) {
+            mLevelMeter.update(played);
+        }
+        if (mSpectrum.isEnabled()) {
+            mSpectrum.setLatency((size_t)(mContext.writePosition - played));
+        }
+        mVisualizersDirty = true;
     }
 
+    if (newFrame) {
+        mFrameDirty = true;
+    }
 }
+
+#undef TU
@@ -3,31 +3,47 @@
 
 #include "audio/AudioStream.hpp"
 #include "audio/AudioEnumerator.hpp"
+#include "audio/ChannelScopeBuffer.hpp"
+#include "audio/LevelMeter.hpp"
+#include "audio/PreviewVoice.hpp"
+#include "audio/SpectrumAnalyzer.hpp"
 #include "audio/VisualizerBuffer.hpp"
 #include "config/data/SoundConfig.hpp"
 #include "core/ChannelOutput.hpp"
 #include "utils/FastTimer.hpp"
 #include "core/Module.hpp"
-#include "utils/Guarded.hpp"
+#include "utils/Histogram.hpp"
+#include "utils/SpscQueue.hpp"
+#include "utils/TripleBuffer.hpp"
 
 #include "trackerboy/apu/DefaultApu.hpp"
+#include "trackerboy/data/Module.hpp"
 #include "trackerboy/data/Song.hpp"
 #include "trackerboy/data/Instrument.hpp"
+#include "trackerboy/data/Table.hpp"
 #include "trackerboy/data/Waveform.hpp"
 #include "trackerboy/engine/Engine.hpp"
-#include "trackerboy/InstrumentPreview.hpp"
 #include "trackerboy/Synth.hpp"
 #include "trackerboy/note.hpp"
 
 #include <QObject>
-#include <QThread>
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
 
 //
 // Class handles all sound renderering. Sound is sent to the
 // configured device set in Config.
 //
+// The render thread never blocks on the GUI. Public methods post commands to
+// the render thread via a lock-free queue, and the render thread publishes
+// its state (engine frame, diagnostics) via a lock-free triple buffer. All
+// public methods must be called from the GUI thread.
+//
 class Renderer : public QObject {
 
     Q_OBJECT
@@ -42,9 +58,49 @@ public:
         size_t bufferSize;
         size_t writesSinceLastPeriod;
         Clock::duration lastPeriod;
+        // seconds played out since the stream was started
         double elapsed;
+        // wakeup statistics of the render timer (timer rendering only)
+        FastTimer::Drift timerDrift;
+    };
 
+    //
+    // Statistics collected by the render thread
+    //
+    enum class Metric {
+        jitter,         // deviation of the period from the configured one (ns)
+        renderTime,     // duration of a render call (ns)
+        stepTime,       // duration of an engine step (ns)
+        bufferFill      // buffer usage after a render call (%)
+    };
 
+    //
+    // An underrun, along with the engine frame that was playing when it
+    // occurred.
+    //
+    struct Underrun {
+        std::chrono::system_clock::time_point time;
+        uint64_t position;
+        size_t missing;
+        int order;
+        int row;
+        // increases by one for every underrun logged, set by underruns()
+        uint64_t sequence;
+    };
+
+    //
+    // What MIDI notes preview, see setMidiTarget.
+    //
+    struct MidiTarget {
+        enum class Type {
+            none,
+            instrument,     // track, id (instrument id, -1 for none)
+            waveform        // id (waveform id)
+        };
+
+        Type type;
+        int track;
+        int id;
     };
 
     explicit Renderer(Module &mod, QObject *parent = nullptr);
@@ -57,6 +113,18 @@ public:
     //
     Diagnostics diagnostics();
 
+    //
+    // Gets the histogram for the given metric. The histogram is updated by
+    // the render thread, it can be read at any time.
+    //
+    Histogram const& histogram(Metric metric) const;
+
+    //
+    // Gets the most recent underruns, oldest first. Entries are identified by
+    // their sequence number, as the oldest are dropped when the log is full.
+    //
+    std::deque<Underrun> const& underruns();
+
     //
     // Get the current samplerate
     //
@@ -64,9 +132,31 @@ public:
 
     //
     // Accessor for the visualizer buffer. The updateVisualizers() signal is
-    // emitted when this buffer is modified.
+    // emitted when a new snapshot has been published. The GUI thread may read
+    // snapshots at any time, without locking.
+    //
+    VisualizerBuffer& visualizerBuffer();
+
+    //
+    // Accessor for the per-channel scope buffer. Capturing is disabled until
+    // enabled via ChannelScopeBuffer::setEnabled, snapshots are published
+    // along with the visualizer buffer's.
+    //
+    ChannelScopeBuffer& channelScopeBuffer();
+
+    //
+    // Accessor for the output level meter. Measuring is disabled until
+    // enabled via LevelMeter::setEnabled, levels are published along with
+    // the visualizer buffer's snapshots.
     //
-    Guarded<VisualizerBuffer>& visualizerBuffer();
+    LevelMeter& levelMeter();
+
+    //
+    // Accessor for the spectrum analyzer. The analyzer runs on its own thread
+    // while enabled, and publishes its levels independently of the
+    // updateVisualizers() signal.
+    //
+    SpectrumAnalyzer& spectrumAnalyzer();
 
     //
     // Determines if the renderer is renderering sound.
@@ -84,7 +174,7 @@ public:
     bool isPlaying();
 
     //
-    // Gets a copy of the current engine frame.
+    // Gets a copy of the engine frame currently being played out.
     //
     trackerboy::Frame currentFrame();
 
@@ -99,6 +189,9 @@ public:
     // Changes the note being previewed for an instrument/waveform preview.
     // If there is no current preview this function does nothing.
     //
+    // Previews are played on their own voice (see PreviewVoice), music
+    // playback is not interrupted.
+    //
     void setPreviewNote(int note);
 
     //
@@ -109,11 +202,36 @@ public:
     void instrumentPreview(int note, int track, int instrument);
 
     //
-    // Begins renderering a waveform preview. CH3 is unlocked and loaded with
-    // the given waveform using the waveId.
+    // Begins renderering a waveform preview. The preview voice's CH3 is
+    // loaded with the given waveform using the waveId.
     //
     void waveformPreview(int note, int waveId);
 
+    //
+    // Sets what MIDI notes received via midiCallback preview. The arguments
+    // are the same as for instrumentPreview and waveformPreview. The target's
+    // instrument and waveforms are copied now, and again whenever they are
+    // edited, so the MIDI input thread never reads the module.
+    //
+    void setMidiTarget(MidiTarget const& target);
+
+    //
+    // Enables or disables MIDI input. While enabled, the render keeps running
+    // once started, so that MIDI notes are heard within one render period,
+    // and the poll timer keeps running when it is stopped, so that a MIDI
+    // note can start it.
+    //
+    void setMidiInput(bool enabled);
+
+    //
+    // Midi note callback (Midi::NoteCallback), userData is the Renderer.
+    // Previews the given note on the MIDI target, or stops the note with the
+    // given key if velocity is 0. Notes are polyphonic, each is allocated a
+    // channel of the preview voice. Called from the MIDI input thread, the
+    // note goes directly to the render thread.
+    //
+    static void midiCallback(void *userData, int key, int note, int velocity, std::chrono::steady_clock::time_point time);
+
     //
     // Update the framerate used by the synth. Call this when the module's framerate
     // changes.
@@ -200,7 +318,7 @@ signals:
     void audioError();
 
     //
-    // emitted when a new frame is renderered
+    // emitted when the device starts playing out a new engine frame
     //
     void frameSync();
 
@@ -209,6 +327,10 @@ signals:
     //
     void updateVisualizers();
 
+protected:
+
+    void timerEvent(QTimerEvent *evt) override;
+
 private:
 
     //
@@ -217,13 +339,27 @@ private:
     //
     void setSong();
 
-    Q_DISABLE_COPY(Renderer)
+    //
+    // Invoked when an edit to the module has finished. The engine gets a
+    // copy of the module once control returns to the event loop, so a batch
+    // of edits is copied once.
+    //
+    void moduleEdited();
 
-    enum class PreviewState {
-        none,
-        waveform,
-        instrument
-    };
+    //
+    // Posts a copy of the module's data to the render thread, see ModuleData,
+    // and the edits to previewed instruments and waveforms to the preview
+    // voice.
+    //
+    void updateModuleData();
+
+    //
+    // Invoked when the module is reloaded, the copies kept for previews are
+    // of the old module.
+    //
+    void moduleReloaded();
+
+    Q_DISABLE_COPY(Renderer)
 
     enum class State {
         running,    // render samples
@@ -232,8 +368,88 @@ private:
     };
 
     //
-    // This struct contains shared data between the GUI thread and the
-    // render thread.
+    // Stop requested by the render thread, see requestStop
+    //
+    enum class StopRequest {
+        none,
+        drained,    // the buffer has drained, stop normally
+        aborted     // the watchdog has expired
+    };
+
+    //
+    // Copy of the module data the engine reads, made by the GUI thread after
+    // the module is edited or the song is changed. The render thread never
+    // reads the module being edited: it copies these into its own
+    // trackerboy::Module and Song (see RenderContext), which the engine is
+    // bound to, so the engine's references into them stay valid. This is why
+    // the render thread takes no lock on the module.
+    //
+    struct ModuleData {
+        trackerboy::Song song;
+        trackerboy::InstrumentTable instruments;
+        trackerboy::WaveformTable waveforms;
+
+        explicit ModuleData(Module const& mod);
+    };
+
+    //
+    // Commands posted from the GUI thread to the render thread
+    //
+    struct Command {
+
+        enum class Type {
+            begin,              // cancel any stop countdown and resume rendering
+            setSong,            // data: the new song
+            setData,            // data: the edited module
+            play,               // pattern, row, stepping, output
+            step,
+            stepOut,
+            stopMusic,
+            jump,               // pattern
+            repeat,             // enable
+            midiInput,          // enable
+            framerate,          // framerate
+            resetVolume,
+            channelOutput       // output
+        };
+
+        Type type;
+        int note;
+        int pattern;
+        int row;
+        int track;
+        int instrument;
+        bool flag;
+        int framerate;
+        ChannelOutput::Flags output;
+        std::unique_ptr<ModuleData> data;
+
+        Command() = default;
+        explicit Command(Type type);
+    };
+
+    //
+    // An engine frame and the position in the output where it starts
+    //
+    struct TimedFrame {
+        uint64_t position;
+        trackerboy::Frame frame;
+    };
+
+    //
+    // State published by the render thread to the GUI thread
+    //
+    struct Snapshot {
+        trackerboy::Frame frame;
+        size_t bufferUse;
+        size_t writesSinceLastPeriod;
+        Clock::duration periodTime;
+    };
+
+    //
+    // This struct contains all data used by the render thread. Only the
+    // thread currently owning the render may access it: the timer thread
+    // while the timer is running, the GUI thread otherwise.
     //
     struct RenderContext {
         // the current module
@@ -244,50 +460,117 @@ private:
         // determines if the engine should step (ignored when mStepping = false)
         bool step;
 
-        std::shared_ptr<trackerboy::Song> song;
+        // the render thread's copy of the module's instruments and waveforms,
+        // and of the current song, kept up to date with ModuleData
+        trackerboy::Module data;
+        trackerboy::Song song;
 
         trackerboy::DefaultApu apu;
+        // the engine writes to apu through here, for the channel scopes
+        ChannelScopeBuffer::Tap tap;
         trackerboy::Synth synth;
-        //trackerboy::RuntimeContext mRc;
-        // read access to the current song, wave table and instrument table
+        // read access to song, data's wave table and data's instrument table
         trackerboy::Engine engine;
-        // has read access to an Instrument and wave table
-        trackerboy::InstrumentPreview ip;
-
-
-        PreviewState previewState;
-        trackerboy::ChType previewChannel;
 
+        // last frame stepped by the engine
         trackerboy::Frame currentEngineFrame;
+        // frame currently being played out by the device
+        trackerboy::Frame playingFrame;
+
+        // number of samples written since the stream was started
+        uint64_t writePosition;
+        // frames that have been written but not yet played out, keyed by
+        // the writePosition of their first sample
+        SpscQueue<TimedFrame, 256> pendingFrames;
 
         State state;
         int stopCounter;
+        // keep rendering while idle (MIDI input is enabled)
+        bool keepAlive;
 
         size_t bufferSize; // cache this here so we don't have to call mStream.bufferSize() in the render thread
+        size_t bufferUse; // samples in the buffer as of the last render
 
         // diagnostics
+        Clock::duration expectedPeriod; // configured period, for timer rendering
         Clock::time_point watchdog; // occurance of last watchdog reset
         Clock::time_point lastPeriod; // occurance of the last period
         Clock::duration periodTime; // time difference between the last period and the current one
         size_t writesSinceLastPeriod; // number of samples written for the last period
 
-        RenderContext(Module &mod);
+        RenderContext(Module &mod, ChannelScopeBuffer &scopes);
     };
 
-    // type alias for mutually exclusive access to the RenderContext
-    using Handle = Locked<RenderContext>;
+    //
+    // Posts a command to the render thread. If the render is not running,
+    // the command is processed on the next start.
+    //
+    void post(Command &&cmd);
+
+    //
+    // Processes all pending commands. Must only be called by the thread owning
+    // the RenderContext.
+    //
+    void processCommands();
+
+    void execute(Command &cmd);
+
+    //
+    // Copies the given data into the context's module and song. The
+    // objects the engine reads are updated in place and never replaced.
+    //
+    void applyModuleData(ModuleData const& data);
+
+    //
+    // Hands a ModuleData that has been applied back to the GUI thread, so
+    // that the render thread does not free it.
+    //
+    void retire(std::unique_ptr<ModuleData> &&data);
+
+    //
+    // Frees the retired ModuleData. GUI thread only.
+    //
+    void collectModuleData();
+
+    //
+    // Publishes the current state of the context for the GUI thread.
+    //
+    void publish();
 
     // sets up the engine to play starting at the given pattern and row
-    void _play(Handle &handle, int pattern, int row, bool stepping = false);
+    void _play(int pattern, int row, bool stepping = false);
 
-    void _stopMusic(Handle &handle);
+    // posts an event to the preview voice
+    void postPreview(PreviewVoice::Event &&event);
 
-    // utility function for preview slots
-    void resetPreview(Handle &handle);
+    //
+    // Sets up a preview event with copies of the module's data. The module
+    // must not be modified during the call. Returns false if there is
+    // nothing to preview.
+    //
+    bool makeInstrumentPreview(PreviewVoice::Event &event, int note, int track, int instrumentId);
+    void makeWaveformPreview(PreviewVoice::Event &event, int note, int waveId);
+
+    //
+    // Gets the copy of the module's instrument or waveform kept for
+    // previews, replacing it if the module's has changed. nullptr if the
+    // module has no such item.
+    //
+    std::shared_ptr<trackerboy::Instrument const> previewInstrument(uint8_t id);
+    std::shared_ptr<trackerboy::WaveformTable const> previewWaveform(uint8_t id);
 
-    void previewNoteOrInstrument(int note, int track = -1, int instrument = -1);
+    //
+    // Posts a copy of each previewed instrument and waveform that was
+    // edited, so that the notes using them are heard with the edit.
+    //
+    void updatePreviews();
+
+    void midiNote(int key, int note, int velocity, Clock::time_point time);
 
-    void _setChannelOutput(Handle &handle, ChannelOutput::Flags flags);
+    // rebuilds and publishes the MIDI preview for the current target
+    void updateMidiPreview();
+
+    void _setChannelOutput(ChannelOutput::Flags flags);
 
     // stream management -----------------------------------------------------
 
@@ -295,39 +578,177 @@ private:
     // Start the audio callback thread for the configured device. If the audio
     // callback thread is already running, the stop countdown is cancelled
     //
-    void beginRender(Handle &handle);
+    void beginRender();
+
+    //
+    // Stops the render timer (or the stream when rendering in the callback),
+    // giving the GUI thread ownership of the RenderContext. Pending commands
+    // are processed.
+    //
+    void acquireContext();
+
+    //
+    // Hands ownership of the RenderContext back to the render thread, by
+    // restarting the timer or the stream. false is returned if the stream
+    // could not be restarted.
+    //
+    bool releaseContext();
 
     static void timerCallback(void *userData);
 
+    //
+    // Processes pending commands and renders. This function is called
+    // periodically from a separate thread.
+    //
+    void render();
+
     //
     // Fills the playback buffer with newly renderered samples. Stops rendering
     // if there is no work to do and the buffer has drained completely.
     //
-    // This function is called periodically from a separate thread.
+    void renderFrames();
+
+    static void deviceCallback(void *userData, float *out, size_t frames);
+
     //
-    void render();
+    // Processes pending commands and synthesizes the requested samples
+    // directly into the device's buffer. Called from the device's thread
+    // when callback rendering is enabled.
+    //
+    void renderCallback(float *out, size_t frames);
 
     //
-    // Immediately stops the render without letting the buffer drain.
+    // Synthesizes up to the given number of samples into the destination,
+    // with the preview voice mixed in. Returns the number of samples written,
+    // which is less than requested only when the render is stopping. Each
+    // stepped frame is queued with its position in the output.
     //
-    void stopRender(Handle &handle, bool aborted = false);
+    size_t synthesize(float *dest, size_t frames);
 
-    // class members ---------------------------------------------------------
+    //
+    // Advances the playing frame to the last pending frame that the device
+    // has started playing. Returns true if the playing frame changed.
+    //
+    bool updatePlayhead();
 
-    QThread mTimerThread;
-    FastTimer *mTimer;      // thread-safe: yes
+    //
+    // Discards all pending frames and resets the write position. Called when
+    // the stream is (re)started.
+    //
+    void resetPlayhead();
 
-    AudioStream mStream;    // thread-safe: no
-    Guarded<VisualizerBuffer> mVisBuffer;
+    //
+    // Updates the playhead, publishes the context and flags the signals for
+    // a render call.
+    //
+    void finishRender();
 
-    ChannelOutput::Flags mOutputFlags;
+    //
+    // Records the jitter of the period that just ended, given the expected
+    // duration of the period.
+    //
+    void recordPeriod(Clock::duration expected);
 
     //
-    // All variables accessible from multiple threads are stored in the RenderContext
-    // struct, access to them is guarded by a mutex.
+    // Flags a stop for the poll timer to handle. Called from the render
+    // thread when the buffer has drained or the watchdog has expired.
     //
-    Guarded<RenderContext> mContext;
-    
+    void requestStop(bool aborted);
 
+    //
+    // Stops the render, invoked by the poll timer after a call to
+    // requestStop. The render is resumed instead if a command posted in the
+    // meantime has restarted it.
+    //
+    void finishStop(bool aborted);
+
+    //
+    // Immediately stops the render without letting the buffer drain. The
+    // GUI thread must own the context.
+    //
+    void stopRender(bool aborted = false);
+
+    //
+    // Emits the signals for what the render thread has flagged since the
+    // last poll. GUI thread only.
+    //
+    void pollSignals();
+
+    //
+    // Starts or stops the poll timer: it runs while rendering or while MIDI
+    // input is enabled. GUI thread only.
+    //
+    void updatePollTimer();
+
+    //
+    // Starts the render for the MIDI notes posted since it was stopped,
+    // invoked by the poll timer. GUI thread only.
+    //
+    void startMidiNotes();
+
+    // class members ---------------------------------------------------------
+
+    FastTimer mTimer;       // thread-safe: yes
+
+    AudioStream mStream;    // thread-safe: no
+    // written by the owner of the context as samples are synthesized
+    VisualizerBuffer mVisBuffer;
+    ChannelScopeBuffer mChannelScopes;
+    LevelMeter mLevelMeter;
+    SpectrumAnalyzer mSpectrum;
+
+    // GUI thread state, mirrors of what has been sent to the render thread
+    ChannelOutput::Flags mOutputFlags;
+    bool mRendering;
+    bool mStepping;
+    bool mCallbackRender;
+    int mSamplerate;
+
+    SpscQueue<Command, 256> mCommands;
+    // ModuleData applied by the render thread, freed by the GUI thread
+    SpscQueue<std::unique_ptr<ModuleData>, 16> mRetiredData;
+    // GUI thread, set while an updateModuleData call is queued
+    bool mModuleDataPending;
+    TripleBuffer<Snapshot> mSnapshot;
+    // GUI thread, the last target given to setMidiTarget
+    MidiTarget mMidiTarget;
+    //
+    // Prebuilt preview for the MIDI target, a copy of the event is posted
+    // for each note. Written by the GUI thread, read by the MIDI input thread
+    //
+    struct MidiPreview {
+        bool enabled;
+        PreviewVoice::Event event;
+    };
+    TripleBuffer<MidiPreview> mMidiPreview;
+    // GUI thread, the last copies given to the preview voice, indexed by id
+    std::array<std::shared_ptr<trackerboy::Instrument const>, trackerboy::InstrumentTable::MAX_SIZE> mPreviewInstruments;
+    std::array<std::shared_ptr<trackerboy::WaveformTable const>, trackerboy::WaveformTable::MAX_SIZE> mPreviewWaveforms;
+    // set by the MIDI input thread when it posts a note, so the poll timer
+    // can start the render if it was stopped or stopping
+    std::atomic_bool mMidiStartPending;
+    // GUI thread, the last value given to setMidiInput
+    bool mMidiInput;
+
+    // set by the render thread, turned into signals by the poll timer so that
+    // the render thread never emits or posts events
+    std::atomic_bool mVisualizersDirty;
+    std::atomic_bool mFrameDirty;
+    // set by requestStop
+    std::atomic<StopRequest> mStopRequest;
+    // GUI thread only
+    int mPollTimerId;
+    bool mPlaying;
+
+    // telemetry, written by the render thread
+    std::array<Histogram, 4> mHistograms;
+    SpscQueue<Underrun, 64> mUnderrunQueue;
+    // GUI thread only
+    std::deque<Underrun> mUnderrunHistory;
+    uint64_t mUnderrunSequence;
+
+    RenderContext mContext;
+    // mixed in by the owner of the context, uses the context's APU
+    PreviewVoice mPreview;
 
 };
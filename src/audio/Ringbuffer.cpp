@@ -1,167 +1,226 @@
 
 #include "audio/Ringbuffer.hpp"
 
-#include "miniaudio.h"
-
 #include <QtGlobal>
 
-#include <cstring>
-
-
-RingbufferBase::RingbufferBase() :
-    mInitialized(false),
-    mRingbuffer(),
-    mSize(0)
-{
-
-}
-
-RingbufferBase::~RingbufferBase() {
-    uninit();
-}
-
-void RingbufferBase::init(size_t buffersize, void *buffer) {
-    uninit();
-    auto result = ma_rb_init(buffersize, buffer, nullptr, &mRingbuffer);
-    mInitialized = result == MA_SUCCESS;
-    if (mInitialized) {
-        ma_rb_reset(&mRingbuffer);
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(Q_OS_WIN)
+#include <Windows.h>
+#elif defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define TU RingbufferTU
+namespace TU {
+
+#if defined(Q_OS_WIN)
+
+size_t granularity() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+//
+// Maps a pagefile-backed section twice. The address range is found by
+// reserving it and then releasing it, another thread could take the range
+// before it is mapped, so this is retried a few times.
+//
+void* mapMirrored(size_t bytes) {
+    auto section = CreateFileMappingW(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        (DWORD)((uint64_t)bytes >> 32),
+        (DWORD)(bytes & 0xFFFFFFFF),
+        nullptr
+    );
+    if (section == nullptr) {
+        return nullptr;
     }
-    mSize = buffersize;
-}
 
-void RingbufferBase::uninit() {
-    if (mInitialized) {
-        ma_rb_uninit(&mRingbuffer);
-        mInitialized = false;
+    void *result = nullptr;
+    for (int attempt = 0; attempt < 8 && result == nullptr; ++attempt) {
+        auto address = static_cast<char*>(VirtualAlloc(nullptr, bytes * 2, MEM_RESERVE, PAGE_NOACCESS));
+        if (address == nullptr) {
+            break;
+        }
+        VirtualFree(address, 0, MEM_RELEASE);
+
+        auto first = MapViewOfFileEx(section, FILE_MAP_ALL_ACCESS, 0, 0, bytes, address);
+        if (first == nullptr) {
+            continue;
+        }
+        auto second = MapViewOfFileEx(section, FILE_MAP_ALL_ACCESS, 0, 0, bytes, address + bytes);
+        if (second == nullptr) {
+            UnmapViewOfFile(first);
+            continue;
+        }
+        result = first;
     }
-}
 
-size_t RingbufferBase::size() const {
-    return mSize;
+    // the views keep the section alive
+    CloseHandle(section);
+    return result;
 }
 
-size_t RingbufferBase::read(void *data, size_t sizeInBytes) {
-    size_t bytesToRead = sizeInBytes;
-    void *src;
-    
-    auto result = ma_rb_acquire_read(&mRingbuffer, &bytesToRead, &src);
-    Q_ASSERT(result == MA_SUCCESS);
-
-    memcpy(data, src, bytesToRead);
-    
-    result = ma_rb_commit_read(&mRingbuffer, bytesToRead, src);
-    Q_ASSERT(result == MA_SUCCESS || result == MA_AT_END);
-    
-    Q_UNUSED(result)
-    return bytesToRead;
+void unmapMirrored(void *data, size_t bytes) {
+    UnmapViewOfFile(static_cast<char*>(data) + bytes);
+    UnmapViewOfFile(data);
 }
 
-size_t RingbufferBase::write(void const *data, size_t sizeInBytes) {
-    void *dest;
-    size_t bytesToWrite = sizeInBytes;
-
-    auto result = ma_rb_acquire_write(&mRingbuffer, &bytesToWrite, &dest);
-    Q_ASSERT(result == MA_SUCCESS);
+#elif defined(Q_OS_UNIX)
 
-    memcpy(dest, data, bytesToWrite);
-    
-    result = ma_rb_commit_write(&mRingbuffer, bytesToWrite, dest);
-    Q_ASSERT(result == MA_SUCCESS || result == MA_AT_END);
-    
-    Q_UNUSED(result)
-    return bytesToWrite;
+size_t granularity() {
+    return (size_t)sysconf(_SC_PAGESIZE);
 }
 
-size_t RingbufferBase::fullRead(void *buf, size_t sizeInBytes) {
-    size_t readAvail = ma_rb_available_read(&mRingbuffer);
-
-    if (readAvail == 0) {
-        return 0;
+int createSharedMemory() {
+    #if defined(Q_OS_LINUX)
+    return memfd_create("trackerboy-ringbuffer", 0);
+    #else
+    // anonymous shared memory object, unlinked immediately
+    char name[] = "/trackerboy-rb-XXXXXX";
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        auto value = (unsigned)rand();
+        for (size_t i = sizeof(name) - 7; i < sizeof(name) - 1; ++i) {
+            name[i] = "0123456789abcdefghijklmnopqrstuv"[value & 31];
+            value >>= 5;
+        }
+        auto fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd != -1) {
+            shm_unlink(name);
+            return fd;
+        }
     }
+    return -1;
+    #endif
+}
 
-    // do the first read
-    size_t bytesRead = read(buf, sizeInBytes);
-
-    sizeInBytes -= bytesRead;
-    readAvail -= bytesRead;
-
-    if (sizeInBytes != 0 && readAvail) {
-        // do the second read (the read pointer starts at the beginning)
-        bytesRead += read(reinterpret_cast<uint8_t*>(buf) + bytesRead, sizeInBytes);
+//
+// Reserves twice the size, then maps the same shared memory over both halves
+//
+void* mapMirrored(size_t bytes) {
+    auto fd = createSharedMemory();
+    if (fd == -1) {
+        return nullptr;
+    }
 
+    void *result = nullptr;
+    if (ftruncate(fd, (off_t)bytes) == 0) {
+        auto address = static_cast<char*>(mmap(nullptr, bytes * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (address != MAP_FAILED) {
+            if (mmap(address, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+                mmap(address + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                result = address;
+            } else {
+                munmap(address, bytes * 2);
+            }
+        }
     }
 
-    return bytesRead;
+    // the mappings keep the memory alive
+    close(fd);
+    return result;
 }
 
-size_t RingbufferBase::fullWrite(void const *buf, size_t sizeInBytes) {
-    size_t writeAvail = ma_rb_available_write(&mRingbuffer);
-
-    if (writeAvail == 0) {
-        return 0;
-    }
+void unmapMirrored(void *data, size_t bytes) {
+    munmap(data, bytes * 2);
+}
 
-    size_t bytesWritten = write(buf, sizeInBytes);
+#else
 
-    sizeInBytes -= bytesWritten;
-    writeAvail -= bytesWritten;
+size_t granularity() {
+    return 4096;
+}
 
-    if (sizeInBytes != 0 && writeAvail) {
-        bytesWritten += write(reinterpret_cast<uint8_t const*>(buf) + bytesWritten, sizeInBytes);
-    }
+void* mapMirrored(size_t bytes) {
+    Q_UNUSED(bytes)
+    return nullptr;
+}
 
-    return bytesWritten;
+void unmapMirrored(void *data, size_t bytes) {
+    Q_UNUSED(data)
+    Q_UNUSED(bytes)
 }
 
-void* RingbufferBase::acquireRead(size_t &outSize) {
-    void *buf;
-    auto result = ma_rb_acquire_read(&mRingbuffer, &outSize, &buf);
-    Q_ASSERT(result == MA_SUCCESS);
-    Q_UNUSED(result)
-    return buf;
+#endif
+
 }
 
-void RingbufferBase::commitRead(void *buf, size_t size) {
-    auto result = ma_rb_commit_read(&mRingbuffer, size, buf);
-    Q_ASSERT(result == MA_SUCCESS);
-    Q_UNUSED(result)
+RingbufferMemory::RingbufferMemory() :
+    mData(nullptr),
+    mSize(0),
+    mMirrored(false)
+{
 }
 
-void* RingbufferBase::acquireWrite(size_t &outSize) {
-    void *buf;
-    auto result = ma_rb_acquire_write(&mRingbuffer, &outSize, &buf);
-    Q_ASSERT(result == MA_SUCCESS);
-    Q_UNUSED(result)
-    return buf;
+RingbufferMemory::~RingbufferMemory() {
+    release();
 }
 
-void RingbufferBase::commitWrite(void *buf, size_t size) {
-    auto result = ma_rb_commit_write(&mRingbuffer, size, buf);
-    Q_ASSERT(result == MA_SUCCESS);
-    Q_UNUSED(result)
+bool RingbufferMemory::allocate(size_t bytes, bool mirror) {
+    release();
+
+    Q_ASSERT((bytes & (bytes - 1)) == 0);
+
+    if (!mirror || !allocateMirrored(bytes)) {
+        // fallback to a regular allocation, reads and writes get split at
+        // the wraparound
+        mData = std::calloc(bytes, 1);
+        if (mData == nullptr) {
+            return false;
+        }
+        mSize = bytes;
+    }
+    return true;
 }
 
-size_t RingbufferBase::availableRead() {
-    return ma_rb_available_read(&mRingbuffer);
+bool RingbufferMemory::allocateMirrored(size_t bytes) {
+    if (bytes % granularity()) {
+        return false;
+    }
+    mData = TU::mapMirrored(bytes);
+    if (mData == nullptr) {
+        return false;
+    }
+    mSize = bytes;
+    mMirrored = true;
+    return true;
+}
+
+void RingbufferMemory::release() {
+    if (mData) {
+        if (mMirrored) {
+            TU::unmapMirrored(mData, mSize);
+        } else {
+            std::free(mData);
+        }
+        mData = nullptr;
+        mSize = 0;
+        mMirrored = false;
+    }
 }
 
-size_t RingbufferBase::availableWrite() {
-    return ma_rb_available_write(&mRingbuffer);
+void* RingbufferMemory::data() const {
+    return mData;
 }
 
-void RingbufferBase::seekRead(size_t bytes) {
-    auto result = ma_rb_seek_read(&mRingbuffer, bytes);
-    Q_ASSERT(result == MA_SUCCESS);
-    Q_UNUSED(result)
+size_t RingbufferMemory::size() const {
+    return mSize;
 }
 
-void RingbufferBase::seekWrite(size_t bytes) {
-    auto result = ma_rb_seek_write(&mRingbuffer, bytes);
-    Q_ASSERT(result == MA_SUCCESS);
-    Q_UNUSED(result)
+bool RingbufferMemory::isMirrored() const {
+    return mMirrored;
 }
 
-void RingbufferBase::reset() {
-    ma_rb_reset(&mRingbuffer);
+size_t RingbufferMemory::granularity() {
+    static size_t const value = TU::granularity();
+    return value;
 }
+
+#undef TU
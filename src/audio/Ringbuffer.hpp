@@ -1,81 +1,92 @@
-
 #pragma once
 
-#include "miniaudio.h"
-
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstring>
 
 //
-// Wrapper for a miniaudio ringbuffer, ma_rb.
+// Backing memory for a Ringbuffer. When possible, the memory is mapped twice
+// into consecutive virtual address ranges, so that reading or writing past
+// the end of the first mapping lands at the start of the buffer. Any region
+// of the buffer is then contiguous, regardless of where it wraps around.
 //
-class RingbufferBase {
+// If the OS does not allow the double mapping, a regular allocation is used
+// instead and isMirrored() returns false.
+//
+class RingbufferMemory {
 
 public:
 
-    ~RingbufferBase();
-    
-    void uninit();
-
-    void reset();
-
-protected:
-    RingbufferBase();
-
-    void init(size_t buffersize, void* buffer = nullptr);
-
-
-    // convenience "high level" read/write methods
+    RingbufferMemory();
+    ~RingbufferMemory();
 
-    size_t write(void const *buffer, size_t sizeInBytes);
+    //
+    // Allocates the given number of bytes, which must be a power of two and a
+    // multiple of granularity(). Any previous allocation is released. Returns
+    // false if no memory could be allocated. When mirror is false, the
+    // regular allocation is always used (for testing the fallback).
+    //
+    bool allocate(size_t bytes, bool mirror = true);
 
-    size_t read(void *buffer, size_t sizeInBytes);
+    void release();
 
-    size_t fullRead(void *buffer, size_t sizeInBytes);
+    void* data() const;
 
-    size_t fullWrite(void const *buffer, size_t sizeInBytes);
-
-    // "low level" read/write access
-    void* acquireRead(size_t &outSize);
-
-    void commitRead(void *buf, size_t size);
-
-    void* acquireWrite(size_t &outSize);
-
-    void commitWrite(void *buf, size_t size);
-
-    size_t availableRead();
-
-    size_t availableWrite();
-
-    void seekRead(size_t bytes);
+    size_t size() const;
 
-    void seekWrite(size_t bytes);
+    bool isMirrored() const;
 
-    size_t size() const;
+    //
+    // The smallest size a mirrored allocation can be, the page size or
+    // allocation granularity of the OS. Always a power of two.
+    //
+    static size_t granularity();
 
 private:
 
-    bool mInitialized;
-    ma_rb mRingbuffer;
+    RingbufferMemory(RingbufferMemory const&) = delete;
+    RingbufferMemory& operator=(RingbufferMemory const&) = delete;
+
+    bool allocateMirrored(size_t bytes);
 
+    void *mData;
     size_t mSize;
+    bool mMirrored;
 
 };
 
-// thin template idiom
-
+//
+// Lock-free, single-producer single-consumer ringbuffer of frames, where a
+// frame is channels elements of T.
+//
+// The read and write indices are kept on separate cache lines, along with
+// a cached copy of the other thread's index, so that acquiring a region only
+// touches the other side's cache line when the cached copy does not have
+// enough room. Indices are free running and the capacity is a power of two,
+// so wrapping is a mask.
+//
+// The buffer holds size() frames as given in init(), the capacity may be
+// larger so that it can be rounded to a power of two that is also a multiple
+// of the page size.
+//
+// When the backing memory is mirrored, acquireRead/acquireWrite always return
+// everything that is available as one contiguous region, so a producer can
+// synthesize directly into the buffer without splitting at the wraparound.
+//
 template <typename T, size_t channels = 1>
-class Ringbuffer : public RingbufferBase {
+class Ringbuffer {
     static_assert(channels > 0, "channels cannot be 0");
-    static constexpr auto SIZE_UNIT = sizeof(T) * channels;
+    static constexpr auto FRAME_SIZE = sizeof(T) * channels;
+    static_assert((FRAME_SIZE & (FRAME_SIZE - 1)) == 0, "frame size must be a power of two");
 
 public:
 
-    // read interface for the ringbuffer
+    // read interface for the ringbuffer, consumer thread only
     class Reader {
 
         Ringbuffer<T, channels> &mRb;
-    
+
     public:
 
         Reader(Ringbuffer<T, channels> &rb) :
@@ -83,31 +94,55 @@ public:
         {
         }
 
+        //
+        // Reads up to count frames from one contiguous region.
+        //
         size_t read(T *data, size_t count) {
-            return mRb.read(data, count * SIZE_UNIT) / SIZE_UNIT;
+            auto src = acquireRead(count);
+            std::memcpy(data, src, count * FRAME_SIZE);
+            commitRead(count);
+            return count;
         }
 
+        //
+        // Reads up to count frames, wrapping around if needed.
+        //
         size_t fullRead(T *data, size_t count) {
-            return mRb.fullRead(data, count * SIZE_UNIT) / SIZE_UNIT;
+            auto nread = read(data, count);
+            if (nread < count && !mRb.mMemory.isMirrored()) {
+                nread += read(data + nread * channels, count - nread);
+            }
+            return nread;
         }
 
-        T* acquireRead(size_t &outCount) {
-            size_t size = outCount * SIZE_UNIT;
-            auto result = static_cast<T*>(mRb.acquireRead(size));
-            outCount = size / SIZE_UNIT;
-            return result;
+        //
+        // Gets a pointer to the next frames to read. count is set to the
+        // number of contiguous frames available, up to the count given.
+        //
+        T* acquireRead(size_t &count) {
+            auto &side = mRb.mRead;
+            auto const index = side.index.load(std::memory_order_relaxed);
+            auto available = side.cached - index;
+            if (available < count) {
+                available = availableRead();
+            }
+            count = std::min(count, mRb.contiguous(index, available));
+            return mRb.frame(index);
         }
 
-        void commitRead(T *buf, size_t count) {
-            mRb.commitRead(buf, count * SIZE_UNIT);
+        void commitRead(size_t count) {
+            auto const index = mRb.mRead.index.load(std::memory_order_relaxed);
+            mRb.mRead.index.store(index + count, std::memory_order_release);
         }
 
         size_t availableRead() {
-            return mRb.availableRead() / SIZE_UNIT;
+            auto &side = mRb.mRead;
+            side.cached = mRb.mWrite.index.load(std::memory_order_acquire);
+            return side.cached - side.index.load(std::memory_order_relaxed);
         }
 
         void seekRead(size_t count) {
-            mRb.seekRead(count * SIZE_UNIT);
+            commitRead(std::min(count, availableRead()));
         }
 
         //
@@ -119,51 +154,78 @@ public:
 
     };
 
-    // write interface for the ringbuffer
+    // write interface for the ringbuffer, producer thread only
     class Writer {
-        Ringbuffer<T, channels> &mRb;
 
+        Ringbuffer<T, channels> &mRb;
 
     public:
+
         Writer(Ringbuffer<T, channels> &rb) :
             mRb(rb)
         {
         }
 
+        //
+        // Writes up to count frames to one contiguous region.
+        //
         size_t write(T const *data, size_t count) {
-            return mRb.write(data, count * SIZE_UNIT) / SIZE_UNIT;
+            auto dest = acquireWrite(count);
+            std::memcpy(dest, data, count * FRAME_SIZE);
+            commitWrite(count);
+            return count;
         }
 
+        //
+        // Writes up to count frames, wrapping around if needed.
+        //
         size_t fullWrite(T const *data, size_t count) {
-            return mRb.fullWrite(data, count * SIZE_UNIT) / SIZE_UNIT;
+            auto nwritten = write(data, count);
+            if (nwritten < count && !mRb.mMemory.isMirrored()) {
+                nwritten += write(data + nwritten * channels, count - nwritten);
+            }
+            return nwritten;
         }
 
-        T* acquireWrite(size_t &outCount) {
-            size_t size = outCount * SIZE_UNIT;
-            auto result = static_cast<T*>(mRb.acquireWrite(size));
-            outCount = size / SIZE_UNIT;
-            return result;
+        //
+        // Gets a pointer to the next frames to write. count is set to the
+        // number of contiguous frames available, up to the count given.
+        //
+        T* acquireWrite(size_t &count) {
+            auto &side = mRb.mWrite;
+            auto const index = side.index.load(std::memory_order_relaxed);
+            auto available = mRb.mSize - (index - side.cached);
+            if (available < count) {
+                available = availableWrite();
+            }
+            count = std::min(count, mRb.contiguous(index, available));
+            return mRb.frame(index);
         }
 
-        void commitWrite(T *buf, size_t count) {
-            mRb.commitWrite(buf, count * SIZE_UNIT);
+        void commitWrite(size_t count) {
+            auto const index = mRb.mWrite.index.load(std::memory_order_relaxed);
+            mRb.mWrite.index.store(index + count, std::memory_order_release);
         }
 
         size_t availableWrite() {
-            return mRb.availableWrite() / SIZE_UNIT;
+            auto &side = mRb.mWrite;
+            side.cached = mRb.mRead.index.load(std::memory_order_acquire);
+            return mRb.mSize - (side.index.load(std::memory_order_relaxed) - side.cached);
         }
 
-
         void seekWrite(size_t count) {
-            mRb.seekWrite(count * SIZE_UNIT);
+            commitWrite(std::min(count, availableWrite()));
         }
 
     };
 
-
     Ringbuffer() :
-        RingbufferBase() 
-    { 
+        mRead(),
+        mWrite(),
+        mMemory(),
+        mSize(0),
+        mMask(0)
+    {
     }
 
     Reader reader() {
@@ -174,14 +236,87 @@ public:
         return { *this };
     }
 
-    void init(size_t count, T* buffer = nullptr) {
-        RingbufferBase::init(count * SIZE_UNIT, buffer);
+    //
+    // Allocates the buffer for the given number of frames and empties it.
+    // Neither the reader or writer may be in use. See RingbufferMemory for
+    // mirror.
+    //
+    void init(size_t count, bool mirror = true) {
+        auto bytes = std::max(RingbufferMemory::granularity(), FRAME_SIZE);
+        while (bytes < count * FRAME_SIZE) {
+            bytes <<= 1;
+        }
+        bool const reallocate = bytes != mMemory.size() || (!mirror && mMemory.isMirrored());
+        if (reallocate && !mMemory.allocate(bytes, mirror)) {
+            uninit();
+            return;
+        }
+        mSize = count;
+        mMask = bytes / FRAME_SIZE - 1;
+        reset();
+    }
+
+    void uninit() {
+        mMemory.release();
+        mSize = 0;
+        mMask = 0;
+        reset();
+    }
+
+    //
+    // Empties the buffer. Neither the reader or writer may be in use.
+    //
+    void reset() {
+        mRead.index.store(0, std::memory_order_relaxed);
+        mRead.cached = 0;
+        mWrite.index.store(0, std::memory_order_relaxed);
+        mWrite.cached = 0;
     }
 
+    //
+    // Number of frames the buffer holds
+    //
     size_t size() const {
-        return RingbufferBase::size() / SIZE_UNIT;
+        return mSize;
     }
 
+    bool isMirrored() const {
+        return mMemory.isMirrored();
+    }
+
+private:
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    T* frame(size_t index) const {
+        return static_cast<T*>(mMemory.data()) + (index & mMask) * channels;
+    }
+
+    // number of frames that can be accessed contiguously at index
+    size_t contiguous(size_t index, size_t available) const {
+        if (mMemory.isMirrored()) {
+            return available;
+        }
+        return std::min(available, mMask + 1 - (index & mMask));
+    }
+
+    //
+    // Each side's index, with its copy of the other side's index. Only the
+    // owning thread writes to its Side.
+    //
+    struct alignas(CACHE_LINE) Side {
+        std::atomic_size_t index{0};
+        size_t cached = 0;
+    };
+
+    Side mRead;
+    Side mWrite;
+
+    // shared, read-only while in use
+    alignas(CACHE_LINE) RingbufferMemory mMemory;
+    size_t mSize;
+    size_t mMask;
+
 };
 
 //
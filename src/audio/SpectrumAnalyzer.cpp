@@ -0,0 +1,231 @@
+
+#include "audio/SpectrumAnalyzer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define TU SpectrumAnalyzerTU
+namespace TU {
+
+// the levels are analyzed at the display rate
+constexpr auto PERIOD = std::chrono::nanoseconds(1000000000 / 60);
+
+// level lost per analysis when a band gets quieter (~0.5 s from full to empty)
+constexpr float FALL = 1.0f / 30.0f;
+
+// number of analyses a peak is held before it falls
+constexpr int PEAK_HOLD = 45;
+
+// power is clamped to this before converting to decibels
+constexpr float MIN_POWER = 1e-12f;
+
+size_t nextPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer() :
+    mTimer(),
+    mEnabled(false),
+    mTap(),
+    mLatency(0),
+    mFft(FFT_SIZE),
+    mHistory(),
+    mHistoryMask(0),
+    mHistoryPosition(0),
+    mAnalyzed(0),
+    mBlock(FFT_SIZE),
+    mPower(mFft.bins()),
+    mBandEdges(),
+    mLevels(),
+    mPeaks(),
+    mPeakHold(),
+    mVersion(0),
+    mSnapshots()
+{
+    mTimer.setCallback(timerCallback, this);
+    mTimer.setInterval(TU::PERIOD);
+    setup(44100, 0);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+    mTimer.stop();
+}
+
+void SpectrumAnalyzer::setEnabled(bool enabled) {
+    if (enabled == isEnabled()) {
+        return;
+    }
+
+    if (enabled) {
+        // the analysis thread is not running, discard anything left in the
+        // tap from the last time it was
+        mTap.reader().flush();
+        clear();
+        mEnabled.store(true, std::memory_order_relaxed);
+        mTimer.start();
+    } else {
+        mEnabled.store(false, std::memory_order_relaxed);
+        mTimer.stop();
+        clear();
+    }
+}
+
+bool SpectrumAnalyzer::isEnabled() const {
+    return mEnabled.load(std::memory_order_relaxed);
+}
+
+void SpectrumAnalyzer::setup(int samplerate, size_t latency) {
+    bool const running = mTimer.isRunning();
+    if (running) {
+        mTimer.stop();
+    }
+
+    // the tap is drained every period, a tenth of a second is plenty of
+    // margin for a late analysis
+    auto const tapSize = latency + (size_t)samplerate / 10;
+    mTap.init(tapSize);
+
+    auto const historySize = TU::nextPowerOfTwo(latency + tapSize + FFT_SIZE);
+    mHistory.assign(historySize, 0.0f);
+    mHistoryMask = historySize - 1;
+
+    auto const maxBin = mFft.bins() - 1;
+    auto const binWidth = (float)samplerate / FFT_SIZE;
+    auto const ratio = MAX_FREQUENCY / MIN_FREQUENCY;
+    for (int i = 0; i <= BANDS; ++i) {
+        auto const frequency = MIN_FREQUENCY * std::pow(ratio, (float)i / BANDS);
+        mBandEdges[i] = std::min((size_t)(frequency / binWidth), maxBin);
+    }
+
+    clear();
+
+    if (running) {
+        mTimer.start();
+    }
+}
+
+void SpectrumAnalyzer::write(float const *frames, size_t count) {
+    auto writer = mTap.writer();
+    while (count) {
+        auto chunk = count;
+        auto dest = writer.acquireWrite(chunk);
+        if (chunk == 0) {
+            // full, the analysis thread is behind
+            break;
+        }
+        for (size_t i = 0; i < chunk; ++i) {
+            dest[i] = (frames[i * 2] + frames[i * 2 + 1]) * 0.5f;
+        }
+        writer.commitWrite(chunk);
+        frames += chunk * 2;
+        count -= chunk;
+    }
+}
+
+void SpectrumAnalyzer::setLatency(size_t frames) {
+    mLatency.store(frames, std::memory_order_relaxed);
+}
+
+SpectrumAnalyzer::Snapshot const& SpectrumAnalyzer::read() {
+    return mSnapshots.read();
+}
+
+void SpectrumAnalyzer::timerCallback(void *userData) {
+    static_cast<SpectrumAnalyzer*>(userData)->analyze();
+}
+
+void SpectrumAnalyzer::analyze() {
+    // drain the tap
+    auto reader = mTap.reader();
+    for (;;) {
+        size_t count = mHistory.size();
+        auto src = reader.acquireRead(count);
+        if (count == 0) {
+            break;
+        }
+        auto const offset = (size_t)(mHistoryPosition & mHistoryMask);
+        auto const first = std::min(count, mHistory.size() - offset);
+        std::copy_n(src, first, mHistory.data() + offset);
+        std::copy_n(src + first, count - first, mHistory.data());
+        reader.commitRead(count);
+        mHistoryPosition += count;
+    }
+
+    // the block ends at what is currently being heard
+    auto const latency = std::min((uint64_t)mLatency.load(std::memory_order_relaxed), mHistoryPosition);
+    auto const end = mHistoryPosition - latency;
+
+    std::array<float, BANDS> targets{};
+    if (end != mAnalyzed) {
+        mAnalyzed = end;
+        for (size_t i = 0; i < FFT_SIZE; ++i) {
+            auto const position = (int64_t)end - (int64_t)FFT_SIZE + (int64_t)i;
+            mBlock[i] = position < 0 ? 0.0f : mHistory[(size_t)position & mHistoryMask];
+        }
+        mFft.powerSpectrum(mBlock.data(), mPower.data());
+
+        for (int band = 0; band < BANDS; ++band) {
+            auto const first = mBandEdges[band];
+            auto const last = std::max(mBandEdges[band + 1], first + 1);
+            auto const power = *std::max_element(mPower.begin() + first, mPower.begin() + last);
+            auto const db = 10.0f * std::log10(std::max(power, TU::MIN_POWER));
+            targets[band] = std::clamp((db - FLOOR) / -FLOOR, 0.0f, 1.0f);
+        }
+    }
+    // otherwise nothing new was played, let the levels fall
+
+    bool changed = false;
+    for (int band = 0; band < BANDS; ++band) {
+        auto &level = mLevels[band];
+        auto const lastLevel = level;
+        level = std::max(targets[band], level - TU::FALL);
+
+        auto &peak = mPeaks[band];
+        auto const lastPeak = peak;
+        if (level >= peak) {
+            peak = level;
+            mPeakHold[band] = TU::PEAK_HOLD;
+        } else if (mPeakHold[band]) {
+            --mPeakHold[band];
+        } else {
+            peak = std::max(level, peak - TU::FALL);
+        }
+
+        changed |= level != lastLevel || peak != lastPeak;
+    }
+
+    // silence or a paused song leaves the levels at rest, skip the publish
+    // so the reader does not redraw an identical spectrum
+    if (!changed) {
+        return;
+    }
+
+    auto &snapshot = mSnapshots.back();
+    snapshot.version = ++mVersion;
+    snapshot.levels = mLevels;
+    snapshot.peaks = mPeaks;
+    mSnapshots.publish();
+}
+
+void SpectrumAnalyzer::clear() {
+    std::fill(mHistory.begin(), mHistory.end(), 0.0f);
+    mHistoryPosition = 0;
+    mAnalyzed = 0;
+    mLevels.fill(0.0f);
+    mPeaks.fill(0.0f);
+    mPeakHold.fill(0);
+
+    auto &snapshot = mSnapshots.back();
+    snapshot.version = ++mVersion;
+    snapshot.levels.fill(0.0f);
+    snapshot.peaks.fill(0.0f);
+    mSnapshots.publish();
+}
+
+#undef TU
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "audio/Fft.hpp"
+#include "audio/Ringbuffer.hpp"
+#include "utils/FastTimer.hpp"
+#include "utils/TripleBuffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// Real-time spectrum of the rendered audio, for the spectrum visualizer.
+//
+// The render thread writes a mono mix of everything it synthesizes to a
+// lock-free tap. An analysis thread (a FastTimer at the display rate) drains
+// the tap into its own history, transforms the FFT_SIZE samples ending at
+// the play position and reduces the power spectrum to BANDS logarithmically
+// spaced bands. Levels fall smoothly and hold their peaks, and are published
+// through a TripleBuffer, so the GUI thread only reads precomputed levels.
+//
+// The analysis thread only runs while enabled, and the render thread only
+// writes to the tap while enabled.
+//
+// Threads:
+//  - GUI thread: setEnabled, setup, read
+//  - Render thread (owner of the render context): write, setLatency
+//  - Analysis thread: everything else
+//
+class SpectrumAnalyzer {
+
+public:
+
+    static constexpr int BANDS = 48;
+    static constexpr size_t FFT_SIZE = 4096;
+
+    // lowest and highest frequencies shown
+    static constexpr float MIN_FREQUENCY = 30.0f;
+    static constexpr float MAX_FREQUENCY = 16000.0f;
+
+    // level of an empty band, in dBFS
+    static constexpr float FLOOR = -72.0f;
+
+    struct Snapshot {
+        // incremented for each published snapshot
+        uint64_t version;
+        // level of each band, 0.0 (FLOOR or lower) to 1.0 (0 dBFS)
+        std::array<float, BANDS> levels;
+        // peak level held for each band
+        std::array<float, BANDS> peaks;
+    };
+
+    SpectrumAnalyzer();
+    ~SpectrumAnalyzer();
+
+    //
+    // Starts or stops the analysis thread. GUI thread.
+    //
+    void setEnabled(bool enabled);
+
+    bool isEnabled() const;
+
+    //
+    // Allocates the tap and history for the given samplerate and playback
+    // buffer size. GUI thread, the render thread must not be running.
+    //
+    void setup(int samplerate, size_t latency);
+
+    //
+    // Mixes the given stereo frames to mono and writes them to the tap. If
+    // the tap is full, the frames are dropped. Render thread.
+    //
+    void write(float const *frames, size_t count);
+
+    //
+    // Sets the number of frames written but not yet played. Render thread.
+    //
+    void setLatency(size_t frames);
+
+    //
+    // Gets the most recently published levels. GUI thread.
+    //
+    Snapshot const& read();
+
+private:
+
+    SpectrumAnalyzer(SpectrumAnalyzer const&) = delete;
+    SpectrumAnalyzer& operator=(SpectrumAnalyzer const&) = delete;
+
+    static void timerCallback(void *userData);
+
+    void analyze();
+
+    // discards the history and publishes empty levels, the analysis thread
+    // must not be running
+    void clear();
+
+    FastTimer mTimer;
+    std::atomic_bool mEnabled;
+
+    Ringbuffer<float> mTap;
+    std::atomic_size_t mLatency;
+
+    // analysis thread ---
+
+    Fft mFft;
+    // samples drained from the tap
+    std::vector<float> mHistory;
+    size_t mHistoryMask;
+    uint64_t mHistoryPosition;
+    // position of the end of the last analyzed block
+    uint64_t mAnalyzed;
+
+    std::vector<float> mBlock;
+    std::vector<float> mPower;
+
+    // range of bins [first, last) reduced into each band
+    std::array<size_t, BANDS + 1> mBandEdges;
+
+    std::array<float, BANDS> mLevels;
+    std::array<float, BANDS> mPeaks;
+    std::array<int, BANDS> mPeakHold;
+
+    uint64_t mVersion;
+    TripleBuffer<Snapshot> mSnapshots;
+
+};
@@ -2,122 +2,257 @@
 #include "audio/VisualizerBuffer.hpp"
 
 #include <algorithm>
+#include <limits>
 
-#include <QtGlobal>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VISUALIZER_SSE2
+#include <emmintrin.h>
+#endif
 
-VisualizerBuffer::VisualizerBuffer() :
-    mBufferData(),
-    mBufferSize(0),
-    mIndex(0),
-    mIgnoreCounter(0)
-{
-}
-
-void VisualizerBuffer::clear() {
-    std::fill_n(mBufferData.get(), mBufferSize * 2, 0.0f);
-    mIndex = 0;
-    mIgnoreCounter = 0;
-}
+#define TU VisualizerBufferTU
+namespace TU {
 
-void VisualizerBuffer::resize(size_t size) {
+constexpr float MAX = std::numeric_limits<float>::max();
 
-    if (mBufferSize != size) {
-        mBufferSize = size;
+template <class Range>
+constexpr Range emptyRange() {
+    return { { MAX, MAX, MAX, MAX } };
+}
 
-        auto samples = size * 2;
-        mBufferData = std::make_unique<float[]>(samples);
+template <class Range>
+constexpr Range silentRange() {
+    return { { 0.0f, 0.0f, 0.0f, 0.0f } };
+}
 
-        // resize the buffer clears it
-        clear();
+template <class Range>
+void merge(Range &dest, Range const& src) {
+    #ifdef VISUALIZER_SSE2
+    _mm_store_ps(dest.v, _mm_min_ps(_mm_load_ps(dest.v), _mm_load_ps(src.v)));
+    #else
+    for (int i = 0; i < 4; ++i) {
+        dest.v[i] = std::min(dest.v[i], src.v[i]);
     }
+    #endif
 }
 
-size_t VisualizerBuffer::size() const {
-    return mBufferSize;
+//
+// Merges the range of count interleaved stereo frames into dest
+//
+template <class Range>
+void reduce(Range &dest, float const *frames, size_t count) {
+    #ifdef VISUALIZER_SSE2
+    // two frames per vector, (L, R, L, R)
+    auto min0 = _mm_set1_ps(MAX);
+    auto max0 = _mm_set1_ps(-MAX);
+    auto min1 = min0;
+    auto max1 = max0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto const a = _mm_loadu_ps(frames + i * 2);
+        auto const b = _mm_loadu_ps(frames + i * 2 + 4);
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+        min1 = _mm_min_ps(min1, b);
+        max1 = _mm_max_ps(max1, b);
+    }
+    for (; i < count; ++i) {
+        auto const a = _mm_setr_ps(frames[i * 2], frames[i * 2 + 1], frames[i * 2], frames[i * 2 + 1]);
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+    }
+    min0 = _mm_min_ps(min0, min1);
+    max0 = _mm_max_ps(max0, max1);
+    // fold the upper frame onto the lower one
+    min0 = _mm_min_ps(min0, _mm_movehl_ps(min0, min0));
+    max0 = _mm_max_ps(max0, _mm_movehl_ps(max0, max0));
+    auto const range = _mm_movelh_ps(min0, _mm_sub_ps(_mm_setzero_ps(), max0));
+    _mm_store_ps(dest.v, _mm_min_ps(_mm_load_ps(dest.v), range));
+    #else
+    for (size_t i = 0; i < count; ++i) {
+        auto const left = frames[i * 2];
+        auto const right = frames[i * 2 + 1];
+        dest.v[0] = std::min(dest.v[0], left);
+        dest.v[1] = std::min(dest.v[1], right);
+        dest.v[2] = std::min(dest.v[2], -left);
+        dest.v[3] = std::min(dest.v[3], -right);
+    }
+    #endif
 }
 
+size_t nextPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
 
-void VisualizerBuffer::read(size_t index, float &outLeft, float &outRight) {
-    Q_ASSERT(index < mBufferSize);
+}
 
-    index = (index + mIndex) % mBufferSize;
+VisualizerBuffer::VisualizerBuffer() :
+    mColumns(0),
+    mDuration(0),
+    mWindow(0),
+    mSamplerate(0),
+    mLevels(),
+    mPosition(0),
+    mVersion(0),
+    mSnapshots()
+{
+    clear();
+}
 
-    auto buf = mBufferData.get() + (index * 2);
-    outLeft = *buf++;
-    outRight = *buf;
+void VisualizerBuffer::setColumns(int columns) {
+    mColumns.store(std::clamp(columns, 0, MAX_COLUMNS), std::memory_order_relaxed);
+}
 
+void VisualizerBuffer::setDuration(int milliseconds) {
+    mDuration.store(std::clamp(milliseconds, 0, MAX_DURATION), std::memory_order_relaxed);
 }
 
-void VisualizerBuffer::averageSample(float index, float bin, float &outLeft, float &outRight) {
-    
-    // determine the number of samples to average, with a minimum of 1 sample
-    int samples = std::max(1, (int)((index + bin) - (int)index));
+int VisualizerBuffer::duration() const {
+    return mDuration.load(std::memory_order_relaxed);
+}
 
-    size_t bufIndex = (mIndex + (size_t)index) % mBufferSize;
-    auto buf = mBufferData.get() + (bufIndex * 2);
+void VisualizerBuffer::setWindow(size_t frames) {
+    mWindow = frames;
+}
 
-    float sumLeft = 0.0f;
-    float sumRight = 0.0f;
-    for (int i = 0; i < samples; ++i) {
-        sumLeft += *buf++;
-        sumRight += *buf++;
-        if (++bufIndex == mBufferSize) {
-            bufIndex = 0;
-            buf = mBufferData.get();
+void VisualizerBuffer::setup(int samplerate, size_t latency) {
+    mSamplerate = samplerate;
+    // enough history for the longest window, along with whatever has been
+    // written but not yet played
+    auto const frames = (size_t)MAX_DURATION * samplerate / 1000 + latency;
+    for (int i = 0; i < LEVELS; ++i) {
+        auto const size = TU::nextPowerOfTwo(frames / blockSize(i) + 2);
+        auto &level = mLevels[i];
+        if (level.mask + 1 != size || !level.ranges) {
+            level.ranges = std::make_unique<Range[]>(size);
+            level.mask = size - 1;
         }
     }
-    
-    outLeft = (float)sumLeft / samples;
-    outRight = (float)sumRight / samples;
+    reset();
+}
 
+void VisualizerBuffer::reset() {
+    mPosition = 0;
 }
 
-void VisualizerBuffer::beginWrite(size_t amount) {
+void VisualizerBuffer::clear() {
+    auto &snapshot = mSnapshots.back();
+    snapshot.version = ++mVersion;
+    snapshot.columns = 0;
+    snapshot.peakLeft = 0.0f;
+    snapshot.peakRight = 0.0f;
+    mSnapshots.publish();
+}
 
-    if (amount > mBufferSize) {
-        mIgnoreCounter = amount - mBufferSize;
-    } else {
-        mIgnoreCounter = 0;
+void VisualizerBuffer::write(float const *frames, size_t count) {
+    if (!mLevels[0].ranges) {
+        return;
+    }
+
+    auto &base = mLevels[0];
+    while (count) {
+        auto const offset = (size_t)(mPosition % BLOCK);
+        auto const chunk = std::min(count, BLOCK - offset);
+        auto const block = mPosition / BLOCK;
+        auto &range = base.ranges[block & base.mask];
+        if (offset == 0) {
+            range = TU::emptyRange<Range>();
+            // starting the first block of an upper level block, empty it so
+            // that it does not contain stale ranges until the first merge
+            for (int i = 1; i < LEVELS; ++i) {
+                auto const shift = i * FACTOR_BITS;
+                if ((block & ((UINT64_C(1) << shift) - 1)) != 0) {
+                    break;
+                }
+                auto &level = mLevels[i];
+                level.ranges[(block >> shift) & level.mask] = TU::emptyRange<Range>();
+            }
+        }
+        TU::reduce(range, frames, chunk);
+
+        frames += chunk * 2;
+        count -= chunk;
+        mPosition += chunk;
+
+        if (offset + chunk == BLOCK) {
+            // block completed, merge it into the blocks of the upper levels
+            // that contain it
+            for (int i = 1; i < LEVELS; ++i) {
+                auto &level = mLevels[i];
+                auto const shift = i * FACTOR_BITS;
+                TU::merge(level.ranges[(block >> shift) & level.mask], range);
+            }
+        }
     }
 }
 
-void VisualizerBuffer::write(float buf[], size_t amount) {
+void VisualizerBuffer::update(uint64_t position) {
+    if (!mLevels[0].ranges) {
+        return;
+    }
 
-    auto ignoring = std::min(mIgnoreCounter, amount);
-    amount -= ignoring;
-    mIgnoreCounter -= ignoring;
+    auto const duration = mDuration.load(std::memory_order_relaxed);
+    auto const window = (int64_t)(duration ? (size_t)duration * mSamplerate / 1000 : mWindow);
+    // every column gets at least one frame
+    auto const columns = (int)std::min((int64_t)mColumns.load(std::memory_order_relaxed), window);
+    if (columns == 0) {
+        return;
+    }
 
-    if (amount) {
-        // adjust buffer pointer skip whatever we ignored
-        buf += ignoring * 2;
+    auto &snapshot = mSnapshots.back();
+    auto const start = (int64_t)position - window;
+    float peakLeft = 0.0f;
+    float peakRight = 0.0f;
 
-        auto dest = mBufferData.get() + (mIndex * 2);
+    for (int i = 0; i < columns; ++i) {
+        auto begin = start + window * i / columns;
+        auto const end = start + window * (i + 1) / columns;
 
-        // this loop should only iterate two times max, if not then the amount is
-        // greater than the buffer's capacity and the caller did not call
-        // beginWrite first. Iterating more than twice is inefficient, since we
-        // are overwriting what we just copied.
-        for (;;) {
-            auto const toWrite = std::min(mBufferSize - mIndex, amount);
-            auto const toWriteSamples = toWrite * 2;
-            std::copy_n(buf, toWriteSamples, dest);
-            amount -= toWrite;
-            mIndex += toWrite;
+        // frames before the start of the output are silent
+        auto range = begin < 0 ? TU::silentRange<Range>() : TU::emptyRange<Range>();
+        if (end > 0) {
+            begin = std::max(begin, (int64_t)0);
 
-            if (mIndex == mBufferSize) {
-                mIndex = 0;
-                dest = mBufferData.get();
-            } else {
-                dest += toWriteSamples;
+            // use the coarsest level with blocks no larger than the column,
+            // so that at most FACTOR + 1 ranges are merged
+            auto const span = (size_t)(end - begin);
+            int levelIndex = 0;
+            while (levelIndex + 1 < LEVELS && blockSize(levelIndex + 1) <= span) {
+                ++levelIndex;
             }
-
-            if (amount > 0) {
-                buf += toWriteSamples;
-            } else {
-                break;
+            auto const& level = mLevels[levelIndex];
+            auto const size = blockSize(levelIndex);
+            for (auto block = (uint64_t)begin / size; block <= (uint64_t)(end - 1) / size; ++block) {
+                TU::merge(range, level.ranges[block & level.mask]);
             }
         }
 
+        if (range.v[0] == TU::MAX) {
+            // nothing written to the column's blocks yet
+            range = TU::silentRange<Range>();
+        }
+
+        auto &column = snapshot.data[i];
+        column.minLeft = range.v[0];
+        column.minRight = range.v[1];
+        column.maxLeft = -range.v[2];
+        column.maxRight = -range.v[3];
+        peakLeft = std::max({ peakLeft, -column.minLeft, column.maxLeft });
+        peakRight = std::max({ peakRight, -column.minRight, column.maxRight });
     }
 
+    snapshot.version = ++mVersion;
+    snapshot.columns = columns;
+    snapshot.peakLeft = peakLeft;
+    snapshot.peakRight = peakRight;
+    mSnapshots.publish();
+}
+
+VisualizerBuffer::Snapshot const& VisualizerBuffer::read() {
+    return mSnapshots.read();
 }
+
+#undef TU
@@ -1,72 +1,149 @@
 #pragma once
 
+#include "utils/TripleBuffer.hpp"
+
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 
 
 //
-// Audio buffer for visualizers.
-// 
-// 
-// The buffer is a rotating sample buffer, with newest data at the end of the buffer
-// The index determines the starting and ending position of the buffer
-// 
-// 0 0 0 0 0
-// ^
-// 
-// write A B C to the buffer (0 is now the oldest, C is the newest)
-// 
-// A B C 0 0
-//       ^
-// 
-// write D E F to the buffer (B is now the oldest, F is the newest)
-// 
-// F B C D E
-//   ^
-// 
-// When the index gets to the end of the buffer, it wraps (rotates) to the start
-// The index points to the oldest sample in the buffer, the sample before it is the newest.
+// Min/max envelope of the most recently played audio, for visualizers.
+//
+// As the render thread synthesizes audio, it is reduced into a pyramid of
+// min/max ranges: level 0 holds the range of every BLOCK frames and each
+// level above combines FACTOR ranges of the level below. A snapshot of the
+// window ending at the play position is taken by reducing one column per
+// pixel from the coarsest level that still resolves the column, so its cost
+// only depends on the number of columns, not the length of the window.
+//
+// Snapshots are versioned and published through a TripleBuffer. The GUI
+// thread reads the latest snapshot in O(columns) without ever blocking the
+// render thread.
+//
+// The thread owning the render context (see Renderer) is the writer, the GUI
+// thread is the reader.
 //
 class VisualizerBuffer {
 
 public:
+
+    static constexpr int MAX_COLUMNS = 1024;
+
+    //
+    // Longest window that can be shown, in milliseconds
+    //
+    static constexpr int MAX_DURATION = 4000;
+
+    struct Column {
+        float minLeft;
+        float maxLeft;
+        float minRight;
+        float maxRight;
+    };
+
+    struct Snapshot {
+        // incremented for each published snapshot
+        uint64_t version;
+        // number of columns in data, 0 when nothing is playing
+        int columns;
+        // peak absolute sample of each channel in the window
+        float peakLeft;
+        float peakRight;
+        std::array<Column, MAX_COLUMNS> data;
+    };
+
     VisualizerBuffer();
     ~VisualizerBuffer() = default;
 
-    void clear();
+    //
+    // Sets the number of columns to reduce the window to, typically the
+    // width of the visualizer in pixels. Takes effect on the next update.
+    // Any thread.
+    //
+    void setColumns(int columns);
 
-    void resize(size_t size);
+    //
+    // Sets the length of the window in milliseconds, or 0 to use the default
+    // window set by setWindow. Takes effect on the next update. Any thread.
+    //
+    void setDuration(int milliseconds);
 
-    size_t size() const;
+    int duration() const;
 
-    void read(size_t index, float &outLeft, float &outRight);
+    //
+    // Sets the default window, in frames. Writer only.
+    //
+    void setWindow(size_t frames);
 
     //
-    // Computes the average left and right samples for the given index and bin
-    // size. Bin size refers to the ratio of samples per pixel. ie, a bin size
-    // of 2.5 means that 2.5 samples are represented by a single pixel.
+    // Allocates the pyramid for the given samplerate. latency is the most
+    // frames that can be written ahead of the play position. Writer only.
     //
-    void averageSample(float index, float bin, float &outLeft, float &outRight);
+    void setup(int samplerate, size_t latency);
 
     //
-    // Begin a write operation. If amount is greater than this buffer's
-    // capacity, then some of the data written when calling write will
-    // be ignored. ie, if the buffer capacity is 300 samples and we
-    // begin a write for 500, the first 200 samples will be ignored. This
-    // way, only the most recent samples are stored.
+    // Restarts the write position at 0, to be called whenever the position
+    // of the output restarts. Writer only.
     //
-    void beginWrite(size_t amount);
+    void reset();
 
-    void write(float buf[], size_t amount);
+    //
+    // Publishes an empty snapshot. Writer only.
+    //
+    void clear();
+
+    //
+    // Adds the given interleaved stereo frames to the pyramid. Writer only.
+    //
+    void write(float const *frames, size_t count);
+
+    //
+    // Reduces the window ending at the given position (frames since the last
+    // reset) and publishes the result. Writer only.
+    //
+    void update(uint64_t position);
 
+    //
+    // Gets the latest published snapshot. Reader only.
+    //
+    Snapshot const& read();
 
 private:
 
-    std::unique_ptr<float[]> mBufferData;
-    size_t mBufferSize;
+    static constexpr size_t BLOCK = 16;
+    static constexpr int FACTOR_BITS = 2;
+    static constexpr size_t FACTOR = 1 << FACTOR_BITS;
+    static constexpr int LEVELS = 6;
+
+    //
+    // Minimum and negated maximum of both channels, so that two ranges are
+    // combined with a single min: { minLeft, minRight, -maxLeft, -maxRight }
+    //
+    struct alignas(16) Range {
+        float v[4];
+    };
+
+    struct Level {
+        std::unique_ptr<Range[]> ranges;
+        size_t mask;
+    };
+
+    static constexpr size_t blockSize(int level) {
+        return BLOCK << (level * FACTOR_BITS);
+    }
+
+    std::atomic_int mColumns;
+    std::atomic_int mDuration;
+    size_t mWindow;
+    int mSamplerate;
 
-    size_t mIndex;
+    std::array<Level, LEVELS> mLevels;
+    uint64_t mPosition;
 
-    size_t mIgnoreCounter;
+    uint64_t mVersion;
+    TripleBuffer<Snapshot> mSnapshots;
 
 };
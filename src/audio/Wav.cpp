@@ -10,7 +10,8 @@ namespace WavPrivate {
 #pragma pack(push, 1)
 
 //
-// Header for wav files with 32-bit floating point samples
+// Header for wav files. The same layout is used for both float and PCM
+// sample formats.
 //
 struct WavHeader {
 
@@ -25,12 +26,12 @@ struct WavHeader {
     // fmt subchunk
     char fmtId[4];              // = "fmt "
     uint32_t fmtChunkSize;      // = 18
-    uint16_t fmtTag;            // = 0x3 for IEEE_FLOAT
+    uint16_t fmtTag;            // [B] 0x1 for PCM, 0x3 for IEEE_FLOAT
     uint16_t fmtChannels;       // [B]
     uint32_t fmtSampleRate;     // [B]
-    uint32_t fmtAvgBytesPerSec; // [B] = 4 * fmtSampleRate * fmtChannels
-    uint16_t fmtBlockAlign;     // [B] = 4 * fmtChannels
-    uint16_t fmtBitsPerSample;  // = 32
+    uint32_t fmtAvgBytesPerSec; // [B] = bytesPerSample * fmtSampleRate * fmtChannels
+    uint16_t fmtBlockAlign;     // [B] = bytesPerSample * fmtChannels
+    uint16_t fmtBitsPerSample;  // [B] = 8 * bytesPerSample
     uint16_t fmtCbSize;         // = 0
     // fact subchunk
     char factId[4];             // = "fact"
@@ -67,25 +68,47 @@ struct WavHeader {
 
 #pragma pack(pop)
 
+int bytesPerSample(Wav::Format format) {
+    switch (format) {
+        case Wav::Format::pcm16:
+            return 2;
+        case Wav::Format::pcm24:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
 }
 
 
 
-Wav::Wav(std::string const& filename, int channels, int samplerate) :
+Wav::Wav(std::string const& filename, int channels, int samplerate, Format format) :
     mStream(filename, std::ios::out | std::ios::binary),
     mSampleCount(0),
     mChannels(channels),
-    mSamplingRate(samplerate)
+    mSamplingRate(samplerate),
+    mFormat(format),
+    mBytesPerSample(WavPrivate::bytesPerSample(format)),
+    mFinished(false),
+    mDither(),
+    mPcmBuffer()
 {
     assert(channels > 0);
     assert(samplerate > 0);
 
+    if (format != Format::float32) {
+        mDither.emplace(mBytesPerSample * 8);
+    }
+
     WavPrivate::WavHeader header;
+    header.fmtTag = format == Format::float32 ? 0x3 : 0x1;
     header.fmtChannels = mChannels;
     header.fmtSampleRate = mSamplingRate;
-    uint16_t bytesPerChannel = mChannels * 4;
+    uint16_t bytesPerChannel = mChannels * mBytesPerSample;
     header.fmtAvgBytesPerSec = bytesPerChannel * mSamplingRate;
     header.fmtBlockAlign = bytesPerChannel;
+    header.fmtBitsPerSample = mBytesPerSample * 8;
 
 
     mStream.write(reinterpret_cast<const char *>(&header), sizeof(header));
@@ -93,8 +116,17 @@ Wav::Wav(std::string const& filename, int channels, int samplerate) :
 }
 
 Wav::~Wav() {
+    finish();
+}
+
+bool Wav::finish() {
+    if (mFinished) {
+        return good();
+    }
+    mFinished = true;
+
     uint32_t totalSamples = static_cast<uint32_t>(mSampleCount);
-    uint32_t dataChunkSize = totalSamples * mChannels * 4;
+    uint32_t dataChunkSize = totalSamples * mChannels * mBytesPerSample;
 
     // chunk size totals
     // 4: riff chunk
@@ -123,16 +155,36 @@ Wav::~Wav() {
     // overwrite the chunk size of the data subchunk
     mStream.seekp(offsetof(WavPrivate::WavHeader, dataChunkSize));
     mStream.write(reinterpret_cast<const char *>(&dataChunkSize), sizeof(dataChunkSize));
+
+    mStream.close();
+    return good();
 }
 
 std::ofstream const& Wav::stream() const {
     return mStream;
 }
 
-void Wav::write(float buf[], std::size_t nsamples) {
+bool Wav::good() const {
+    return !mStream.fail();
+}
+
+void Wav::write(float const buf[], std::size_t nsamples) {
 
     std::size_t totalSamples = mChannels * nsamples;
-    mStream.write(reinterpret_cast<const char*>(buf), totalSamples * sizeof(float));
+    if (mFormat == Format::float32) {
+        mStream.write(reinterpret_cast<const char*>(buf), totalSamples * sizeof(float));
+    } else {
+        // convert to little-endian PCM
+        mPcmBuffer.resize(totalSamples * mBytesPerSample);
+        auto dest = mPcmBuffer.data();
+        for (std::size_t i = 0; i < totalSamples; ++i) {
+            auto const sample = (*mDither)(buf[i]);
+            for (int b = 0; b < mBytesPerSample; ++b) {
+                *dest++ = (char)((sample >> (8 * b)) & 0xFF);
+            }
+        }
+        mStream.write(mPcmBuffer.data(), mPcmBuffer.size());
+    }
     if (!mStream.good()) {
         return;
     }
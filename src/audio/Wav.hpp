@@ -1,14 +1,15 @@
 /*
 ** Wav.hpp
 **
-** A header-only library for writing wav files. To use, define
-** WAV_IMPLEMENTATION in one of your source files that include this header.
+** Encoder for writing wav files.
 **
 ** To create a file, construct a Wav object with a filepath, number of channels
-** and samplerate. Then write as many samples you want to it via the write
-** method. Note that for multichannel data, the samples are interleaved.
+** samplerate and sample format. Then write as many samples you want to it via
+** the write method. Note that for multichannel data, the samples are
+** interleaved.
 **
-** This library only writes wav files using 32-bit float samples.
+** Samples can be written as 32-bit float, or as 16/24-bit PCM. PCM samples
+** are dithered when converting from float.
 **
 ** stoneface86
 **
@@ -43,38 +44,60 @@
 
 #pragma once
 
+#include "audio/Dither.hpp"
+#include "audio/Encoder.hpp"
+
 #include <cstddef>
 #include <fstream>
+#include <optional>
 #include <string>
+#include <vector>
 
 
-class Wav {
+class Wav : public Encoder {
 
 public:
 
+    enum class Format {
+        float32,
+        pcm16,
+        pcm24
+    };
 
     //
-    // Opens a wav file for writing sample data with the given channel count
-    // and samplerate. Existing files will be overwritten.
+    // Opens a wav file for writing sample data with the given channel count,
+    // samplerate and sample format. Existing files will be overwritten.
     //
-    explicit Wav(std::string const& filename, int channels, int samplerate);
+    explicit Wav(
+        std::string const& filename,
+        int channels,
+        int samplerate,
+        Format format = Format::float32
+    );
 
     //
     // Adjusts the wav header with the final number of samples written and
-    // closes the file.
+    // closes the file, if finish() was not called.
     //
-    ~Wav();
+    virtual ~Wav();
 
     //
     // Get the stream used by the wav writer.
     //
     std::ofstream const& stream() const;
 
+    virtual bool good() const override;
+
     //
     // Writes the given number of samples from the given buffer to the wav
     // file. The buffer should be at least the size of nsamples * channels.
     //
-    void write(float buf[], std::size_t nsamples);
+    virtual void write(float const buf[], std::size_t nsamples) override;
+
+    //
+    // Adjusts the wav header with the final number of samples written.
+    //
+    virtual bool finish() override;
 
 private:
 
@@ -91,5 +114,13 @@ private:
 
     int mChannels;
     int mSamplingRate;
+    Format mFormat;
+    int mBytesPerSample;
+    bool mFinished;
+
+    // PCM formats only
+    std::optional<Dither> mDither;
+    // conversion buffer for PCM formats
+    std::vector<char> mPcmBuffer;
 
 };
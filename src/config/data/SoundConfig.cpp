@@ -17,7 +17,9 @@ SoundConfig::SoundConfig() :
     mDeviceIndex(0),
     mSamplerateIndex(4),
     mLatency(40),
-    mPeriod(5)
+    mPeriod(5),
+    mCallbackRender(false),
+    mRealtimePriority(false)
 {
 }
 
@@ -45,6 +47,14 @@ int SoundConfig::period() const {
     return mPeriod;
 }
 
+bool SoundConfig::callbackRender() const {
+    return mCallbackRender;
+}
+
+bool SoundConfig::realtimePriority() const {
+    return mRealtimePriority;
+}
+
 void SoundConfig::setBackendIndex(int index) {
     if (index >= -1) {
         mBackendIndex = index;
@@ -92,6 +102,14 @@ void SoundConfig::setPeriod(int period) {
     mPeriod = period;
 }
 
+void SoundConfig::setCallbackRender(bool callbackRender) {
+    mCallbackRender = callbackRender;
+}
+
+void SoundConfig::setRealtimePriority(bool realtimePriority) {
+    mRealtimePriority = realtimePriority;
+}
+
 void SoundConfig::readSettings(QSettings &settings, AudioEnumerator &enumerator) {
     settings.beginGroup(Keys::Sound);
 
@@ -127,6 +145,8 @@ void SoundConfig::readSettings(QSettings &settings, AudioEnumerator &enumerator)
     setSamplerate(settings.value(Keys::samplerate, samplerate()).toInt());
     setLatency(settings.value(Keys::latency, mLatency).toInt());
     setPeriod(settings.value(Keys::period, mPeriod).toInt());
+    setCallbackRender(settings.value(Keys::callbackRender, mCallbackRender).toBool());
+    setRealtimePriority(settings.value(Keys::realtimePriority, mRealtimePriority).toBool());
 
     settings.endGroup();
 }
@@ -147,6 +167,8 @@ void SoundConfig::writeSettings(QSettings &settings, AudioEnumerator const& enum
     settings.setValue(Keys::samplerate, samplerate());
     settings.setValue(Keys::latency, mLatency);
     settings.setValue(Keys::period, mPeriod);
+    settings.setValue(Keys::callbackRender, mCallbackRender);
+    settings.setValue(Keys::realtimePriority, mRealtimePriority);
 
     settings.endGroup();
 }
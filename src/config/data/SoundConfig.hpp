@@ -24,6 +24,20 @@ public:
     int latency() const;
     int period() const;
 
+    //
+    // Determines if audio is synthesized on demand in the device's data
+    // callback, instead of periodically into a buffer. When enabled, the
+    // latency setting is the size of the device's period and the period
+    // setting is unused.
+    //
+    bool callbackRender() const;
+
+    //
+    // Determines if the render timer thread requests real-time scheduling
+    // from the OS. Only used when callbackRender is disabled.
+    //
+    bool realtimePriority() const;
+
     void setBackendIndex(int index);
 
     void setDeviceIndex(int index);
@@ -35,6 +49,10 @@ public:
     void setLatency(int latency);
 
     void setPeriod(int period);
+
+    void setCallbackRender(bool callbackRender);
+
+    void setRealtimePriority(bool realtimePriority);
     
     void readSettings(QSettings &settings, AudioEnumerator &enumerator);
 
@@ -47,4 +65,6 @@ private:
     int mSamplerateIndex;        // index of the current samplerate
     int mLatency;                // latency, or internal buffer size, in milliseconds
     int mPeriod;                 // period, in milliseconds
+    bool mCallbackRender;        // render from the device callback instead of a timer
+    bool mRealtimePriority;      // request real-time scheduling for the render timer
 };
@@ -34,6 +34,8 @@ QString const rownoHex ( QStringLiteral("rownoHex") );
 QString const samplerate { QStringLiteral("samplerate") };
 QString const period { QStringLiteral("period") };
 QString const latency { QStringLiteral("latency") };
+QString const callbackRender { QStringLiteral("callbackRender") };
+QString const realtimePriority { QStringLiteral("realtimePriority") };
 QString const deviceId { QStringLiteral("deviceId") };
 QString const noteCut { QStringLiteral("noteCut") };
 
@@ -45,6 +45,8 @@ extern QString const rownoHex;
 extern QString const samplerate;
 extern QString const period;
 extern QString const latency;
+extern QString const callbackRender;
+extern QString const realtimePriority;
 extern QString const deviceId;
 extern QString const noteCut;
 
@@ -5,6 +5,7 @@
 #include "midi/MidiEnumerator.hpp"
 #include "utils/connectutils.hpp"
 
+#include <QCheckBox>
 #include <QComboBox>
 #include <QGridLayout>
 #include <QGroupBox>
@@ -118,6 +119,22 @@ SoundConfigTab::SoundConfigTab(
     mSamplerateCombo = new QComboBox;
     audioLayout->addWidget(mSamplerateCombo, 2, 1);
 
+    // row 3, render mode
+    mCallbackRenderCheck = new QCheckBox(tr("Low latency (render in audio callback)"));
+    mCallbackRenderCheck->setToolTip(tr(
+        "Synthesize audio on demand when the device requests it. "
+        "Buffer size sets the device period and Period is unused."
+    ));
+    audioLayout->addWidget(mCallbackRenderCheck, 3, 0, 1, 2);
+
+    // row 4, timer priority
+    mRealtimeCheck = new QCheckBox(tr("Real-time render thread priority"));
+    mRealtimeCheck->setToolTip(tr(
+        "Request real-time scheduling for the render timer, reducing wakeup "
+        "jitter on a busy system. May require additional privileges."
+    ));
+    audioLayout->addWidget(mRealtimeCheck, 4, 0, 1, 2);
+
     audioGroup->setLayout(audioLayout);
 
     mMidiGroup = new DeviceGroup(tr("MIDI Input"));
@@ -143,6 +160,10 @@ SoundConfigTab::SoundConfigTab(
     mSamplerateCombo->setCurrentIndex(soundConfig.samplerateIndex());
     mLatencySpin->setValue(soundConfig.latency());
     mPeriodSpin->setValue(soundConfig.period());
+    mCallbackRenderCheck->setChecked(soundConfig.callbackRender());
+    mPeriodSpin->setEnabled(!soundConfig.callbackRender());
+    mRealtimeCheck->setChecked(soundConfig.realtimePriority());
+    mRealtimeCheck->setEnabled(!soundConfig.callbackRender());
 
     auto setupTimeSpinbox = [](QSpinBox &spin, int min, int max) {
         spin.setSuffix(tr(" ms"));
@@ -158,6 +179,13 @@ SoundConfigTab::SoundConfigTab(
     connect(mSamplerateCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
     connect(mLatencySpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
     connect(mPeriodSpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
+    connect(mCallbackRenderCheck, &QCheckBox::toggled, this,
+        [this](bool checked) {
+            mPeriodSpin->setEnabled(!checked);
+            mRealtimeCheck->setEnabled(!checked);
+            setDirty<Config::CategorySound>();
+        });
+    connect(mRealtimeCheck, &QCheckBox::toggled, this, &SoundConfigTab::setDirty<Config::CategorySound>);
 
     connect(mAudioGroup->mApiCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &SoundConfigTab::audioApiChanged);
     connect(mAudioGroup->mDeviceCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
@@ -176,6 +204,8 @@ void SoundConfigTab::apply(SoundConfig &soundConfig) {
 
     soundConfig.setLatency(mLatencySpin->value());
     soundConfig.setPeriod(mPeriodSpin->value());
+    soundConfig.setCallbackRender(mCallbackRenderCheck->isChecked());
+    soundConfig.setRealtimePriority(mRealtimeCheck->isChecked());
 
     clean();
 }
@@ -3,19 +3,26 @@
 
 
 Module::Editor::Editor(Module &mod) :
-    QMutexLocker(&mod.mMutex)
+    QMutexLocker(&mod.mMutex),
+    mModule(mod)
 {
 }
 
+Module::Editor::~Editor() {
+    // no-op if a PermanentEditor already unlocked
+    unlock();
+    emit mModule.editFinished();
+}
+
 Module::PermanentEditor::PermanentEditor(Module &mod) :
-    Editor(mod),
-    mModule(mod)
+    Editor(mod)
 {
 }
 
 Module::PermanentEditor::~PermanentEditor() {
     unlock();
     mModule.makeDirty();
+    emit mModule.permanentEditFinished();
 }
 
 Module::Module(QObject *parent) :
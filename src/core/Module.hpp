@@ -24,15 +24,21 @@ class Module : public QObject {
 public:
 
     //
-    // Editor is just a QMutexLocker subclass. This
-    // context is used for edits that can be undone, by using a QUndoCommand
-    // subclass.
+    // Editor is a QMutexLocker subclass that emits editFinished once the
+    // module is unlocked. This context is used for edits that can be undone,
+    // by using a QUndoCommand subclass.
     //
     class Editor : public QMutexLocker {
+    public:
+
+        ~Editor();
 
+    protected:
         friend class Module;
 
         Editor(Module &module);
+
+        Module &mModule;
     };
 
     //
@@ -49,8 +55,6 @@ public:
 
         PermanentEditor(Module &module);
 
-        Module &mModule;
-
     };
 
     explicit Module(QObject *parent = nullptr);
@@ -167,6 +171,19 @@ signals:
     //
     void aboutToSave();
 
+    //
+    // Emitted when a permanent edit (see permanentEdit) has finished, after
+    // the module is unlocked.
+    //
+    void permanentEditFinished();
+
+    //
+    // Emitted when any edit (see edit and permanentEdit) has finished, after
+    // the module is unlocked. For permanent edits, this signal is emitted
+    // after permanentEditFinished.
+    //
+    void editFinished();
+
 private:
 
     Q_DISABLE_COPY(Module)
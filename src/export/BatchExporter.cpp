@@ -0,0 +1,133 @@
+
+#include "export/BatchExporter.hpp"
+#include "core/ModuleFile.hpp"
+#include "export/WavExporter.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+
+#include <algorithm>
+#include <cstdio>
+
+
+BatchExporter::BatchExporter(QObject *parent) :
+    QObject(parent),
+    mModules(),
+    mBasenames(),
+    mTasks(),
+    mNextTask(0),
+    mRunning(0),
+    mFailures(0),
+    mDestination(QStringLiteral(".")),
+    mDuration(1),
+    mFormat(Encoder::Format::wavFloat),
+    mSamplerate(44100),
+    mSong(ALL_SONGS)
+{
+}
+
+BatchExporter::~BatchExporter() {
+}
+
+bool BatchExporter::addModule(QString const& filename) {
+    auto mod = std::make_unique<Module>();
+    ModuleFile file;
+    if (!file.open(filename, *mod)) {
+        return false;
+    }
+
+    mModules.push_back(std::move(mod));
+    mBasenames.push_back(QFileInfo(filename).completeBaseName());
+    return true;
+}
+
+void BatchExporter::setDestination(QString const& dir) {
+    mDestination = dir;
+}
+
+void BatchExporter::setDuration(trackerboy::Player::Duration duration) {
+    mDuration = duration;
+}
+
+void BatchExporter::setFormat(Encoder::Format format) {
+    mFormat = format;
+}
+
+void BatchExporter::setSamplerate(int samplerate) {
+    mSamplerate = samplerate;
+}
+
+void BatchExporter::setSong(int index) {
+    mSong = index;
+}
+
+void BatchExporter::start() {
+    mTasks.clear();
+    mNextTask = 0;
+    mFailures = 0;
+
+    for (size_t i = 0; i < mModules.size(); ++i) {
+        auto mod = mModules[i].get();
+        int const songCount = (int)mod->data().songs().size();
+        if (mSong == ALL_SONGS) {
+            for (int song = 0; song < songCount; ++song) {
+                mTasks.push_back({ mod, mBasenames[i], song });
+            }
+        } else if (mSong < songCount) {
+            mTasks.push_back({ mod, mBasenames[i], mSong });
+        } else {
+            fprintf(stderr, "%s: no song with index %d\n", qPrintable(mBasenames[i]), mSong);
+            ++mFailures;
+        }
+    }
+
+    // deferred so that finished is always emitted from the event loop
+    QMetaObject::invokeMethod(this, &BatchExporter::startNext, Qt::QueuedConnection);
+}
+
+void BatchExporter::startNext() {
+    // the exporters only render the mixdown (one file each), so each one
+    // occupies a single core
+    int const maxRunning = std::max(1, QThread::idealThreadCount());
+
+    while (mRunning < maxRunning && mNextTask < mTasks.size()) {
+        auto const& task = mTasks[mNextTask++];
+
+        auto const filename = QDir(mDestination).filePath(
+            QStringLiteral("%1.song%2.%3").arg(
+                task.basename,
+                QString::number(task.song),
+                QString::fromLatin1(Encoder::extension(mFormat))
+            )
+        );
+
+        auto exporter = new WavExporter(*task.module, mSamplerate, this);
+        exporter->setSong(task.module->data().songs().getShared(task.song));
+        exporter->setDestination(filename);
+        exporter->setDuration(mDuration);
+        exporter->setFormat(mFormat);
+        connect(exporter, &WavExporter::finished, this,
+            [this, exporter, filename]() {
+                if (exporter->failed()) {
+                    fprintf(stderr, "%s: export failed\n", qPrintable(filename));
+                    ++mFailures;
+                } else {
+                    fprintf(stdout, "%s (%.0f frames/s, %.1fx realtime)\n",
+                        qPrintable(filename),
+                        exporter->framesPerSecond(),
+                        exporter->realtimeFactor());
+                }
+                exporter->deleteLater();
+                --mRunning;
+                startNext();
+            });
+
+        ++mRunning;
+        exporter->start();
+    }
+
+    if (mRunning == 0 && mNextTask == mTasks.size()) {
+        emit finished(mFailures);
+    }
+}
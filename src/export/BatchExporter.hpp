@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include "audio/Encoder.hpp"
+#include "core/Module.hpp"
+
+#include "trackerboy/export/Player.hpp"
+
+#include <QObject>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+class WavExporter;
+
+//
+// Headless export of one or more modules to wav files, used by the --export
+// command line option. Each song to export is rendered by its own
+// WavExporter, with up to QThread::idealThreadCount() exporters running at
+// a time.
+//
+class BatchExporter : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    static constexpr int ALL_SONGS = -1;
+
+    explicit BatchExporter(QObject *parent = nullptr);
+    ~BatchExporter();
+
+    //
+    // Loads the given module file for exporting. false is returned if the
+    // module could not be loaded.
+    //
+    bool addModule(QString const& filename);
+
+    //
+    // Directory to write the exported files to. Files are named
+    // <module>.song<index>.<ext>, where ext is determined by the format.
+    //
+    void setDestination(QString const& dir);
+
+    void setDuration(trackerboy::Player::Duration duration);
+
+    void setFormat(Encoder::Format format);
+
+    void setSamplerate(int samplerate);
+
+    //
+    // Only export the song with the given index, or every song if ALL_SONGS
+    // (the default) is given.
+    //
+    void setSong(int index);
+
+    //
+    // Begins exporting once control returns to the event loop. The finished
+    // signal is emitted when all exports have completed.
+    //
+    void start();
+
+signals:
+
+    //
+    // Emitted when all exports have completed, failures is the number of
+    // songs that could not be exported.
+    //
+    void finished(int failures);
+
+private:
+
+    struct Task {
+        Module *module;
+        QString basename;
+        int song;
+    };
+
+    void startNext();
+
+    std::vector<std::unique_ptr<Module>> mModules;
+    std::vector<QString> mBasenames;
+    std::vector<Task> mTasks;
+    size_t mNextTask;
+    int mRunning;
+    int mFailures;
+
+    QString mDestination;
+    trackerboy::Player::Duration mDuration;
+    Encoder::Format mFormat;
+    int mSamplerate;
+    int mSong;
+
+};
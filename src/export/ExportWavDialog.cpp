@@ -6,6 +6,7 @@
 #include "export/WavExporter.hpp"
 
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDialogButtonBox>
 #include <QFileDialog>
 #include <QFileInfo>
@@ -31,7 +32,7 @@ ExportWavDialog::ExportWavDialog(
     mTimeEditDuration(60)
 {
     setModal(true);
-    setWindowTitle(tr("Export to WAV"));
+    setWindowTitle(tr("Export to WAV/FLAC"));
 
     auto layout = new QVBoxLayout;
     mDurationGroup = new QGroupBox(tr("Duration"));
@@ -84,8 +85,19 @@ ExportWavDialog::ExportWavDialog(
 
     mDestinationGroup = new QGroupBox(tr("Destination"));
     auto destinationLayout = new QVBoxLayout;
+    auto formatLayout = new QHBoxLayout;
+    mFormatCombo = new QComboBox;
+    // items are in the same order as Encoder::Format
+    mFormatCombo->addItem(tr("WAV, 32-bit float"));
+    mFormatCombo->addItem(tr("WAV, 16-bit PCM"));
+    mFormatCombo->addItem(tr("WAV, 24-bit PCM"));
+    mFormatCombo->addItem(tr("FLAC, 16-bit"));
+    mFormatCombo->addItem(tr("FLAC, 24-bit"));
+    formatLayout->addWidget(new QLabel(tr("Format")));
+    formatLayout->addWidget(mFormatCombo, 1);
     mSeparateChannelsCheck = new QCheckBox(tr("Export each channel separately"));
     mDestinationStack = new QStackedLayout;
+    destinationLayout->addLayout(formatLayout);
     destinationLayout->addWidget(mSeparateChannelsCheck);
     destinationLayout->addLayout(mDestinationStack, 1);
     auto singleContainer = new QWidget;
@@ -191,7 +203,9 @@ ExportWavDialog::ExportWavDialog(
                 this,
                 tr("Select destination"),
                 mSingleDestination->text(),
-                tr("WAV files (*.wav)")
+                mFormatCombo->currentIndex() >= (int)Encoder::Format::flac16
+                    ? tr("FLAC files (*.flac)")
+                    : tr("WAV files (*.wav)")
             );
 
             if (filename.isEmpty()) {
@@ -213,6 +227,8 @@ ExportWavDialog::ExportWavDialog(
             mSeparateDestination->setText(path);
         });
 
+    connect(mFormatCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &ExportWavDialog::updateExtension);
+
     connect(mSeparateChannelsCheck, &QCheckBox::toggled, this,
         [this](bool checked) {
             mDestinationStack->setCurrentIndex(checked ? 1 : 0);
@@ -252,7 +268,8 @@ void ExportWavDialog::accept() {
                         mStatusLabel->setText(tr("Export failed"));
                     } else {
                         mProgress->setValue(mProgress->maximum());
-                        mStatusLabel->setText(tr("Export complete"));
+                        mStatusLabel->setText(tr("Export complete (%1x realtime)")
+                            .arg(mExporter->realtimeFactor(), 0, 'f', 1));
                     }
                     mExportButton->setEnabled(true);
                     setGroupsEnabled(true);
@@ -265,6 +282,8 @@ void ExportWavDialog::accept() {
             mExporter->setDuration(std::chrono::seconds(mTimeEditDuration));
         }
 
+        mExporter->setFormat(static_cast<Encoder::Format>(mFormatCombo->currentIndex()));
+
         {
             ChannelOutput::Flags channels = ChannelOutput::AllOff;
             if (mChannelChecks[0]->isChecked()) {
@@ -312,6 +331,18 @@ void ExportWavDialog::reject() {
     QDialog::reject();
 }
 
+void ExportWavDialog::updateExtension() {
+    // change the extension of the single destination to match the format
+    auto const format = static_cast<Encoder::Format>(mFormatCombo->currentIndex());
+    QFileInfo info(mSingleDestination->text());
+    if (info.fileName().isEmpty()) {
+        return;
+    }
+    mSingleDestination->setText(info.dir().filePath(
+        QStringLiteral("%1.%2").arg(info.completeBaseName(), QString::fromLatin1(Encoder::extension(format)))
+    ));
+}
+
 void ExportWavDialog::setGroupsEnabled(bool enabled) {
     mDurationGroup->setEnabled(enabled);
     mChannelsGroup->setEnabled(enabled);
@@ -6,6 +6,7 @@ class ModuleFile;
 class WavExporter;
 
 class QCheckBox;
+class QComboBox;
 #include <QDialog>
 class QDialogButtonBox;
 class QGroupBox;
@@ -39,6 +40,8 @@ public:
 private:
     void setGroupsEnabled(bool enabled);
 
+    void updateExtension();
+
     Module const& mModule;
     int mSamplerate;
     WavExporter *mExporter;
@@ -54,6 +57,7 @@ private:
     QLineEdit *mTimeEdit;
     std::array<QCheckBox*, 4> mChannelChecks;
 
+    QComboBox *mFormatCombo;
     QCheckBox *mSeparateChannelsCheck;
     QStackedLayout *mDestinationStack;
     QLineEdit *mSingleDestination;
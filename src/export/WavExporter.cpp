@@ -1,12 +1,23 @@
 
 #include "export/WavExporter.hpp"
 
-#include "audio/Wav.hpp"
+
+#include "trackerboy/apu/DefaultApu.hpp"
+#include "trackerboy/Synth.hpp"
 
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 
 
@@ -16,18 +27,20 @@ WavExporter::WavExporter(
     QObject *parent
 ) :
     QThread(parent),
+    mModule(mod),
+    mSong(),
     mSamplerate(samplerate),
-    mApu(),
-    mSynth(mApu, samplerate, mod.data().framerate()),
-    mEngine(mApu, &mod.data()),
     mDuration(0),
     mChannels(ChannelOutput::AllOn),
     mSeparate(false),
+    mFormat(Encoder::Format::wavFloat),
     mDestination(),
     mFailed(false),
-    mAbort(false)
+    mAbort(false),
+    mProgressCount(0),
+    mFramesRendered(0),
+    mElapsed(0)
 {
-    mEngine.setSong(mod.song());
 }
 
 void WavExporter::setDuration(trackerboy::Player::Duration duration) {
@@ -42,8 +55,18 @@ bool WavExporter::failed() const {
     return mFailed;
 }
 
+double WavExporter::framesPerSecond() const {
+    if (mElapsed <= 0) {
+        return 0.0;
+    }
+    return mFramesRendered * 1e9 / mElapsed;
+}
+
+double WavExporter::realtimeFactor() const {
+    return framesPerSecond() / mModule.data().framerate();
+}
+
 void WavExporter::cancel() {
-    QMutexLocker locker(&mMutex);
     mAbort = true;
 }
 
@@ -59,6 +82,14 @@ void WavExporter::setSeparatePrefix(QString const& prefix) {
     mSeparatePrefix = prefix;
 }
 
+void WavExporter::setFormat(Encoder::Format format) {
+    mFormat = format;
+}
+
+void WavExporter::setSong(std::shared_ptr<trackerboy::Song const> song) {
+    mSong = std::move(song);
+}
+
 #define TU WavExporterTU
 namespace TU {
 
@@ -67,8 +98,50 @@ struct Batch {
     ChannelOutput::Flags channels;
 };
 
+//
+// Number of samples (per channel) rendered before handing them to the
+// encoder. Rendering many frames per encoder write keeps the per-frame cost
+// down to just stepping the player and running the synth.
+//
+constexpr size_t BLOCK_SAMPLES = 32768;
+
+//
+// How often the combined progress of the workers is reported
+//
+constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(50);
+
+struct alignas(64) SampleBlock {
+    std::array<float, BLOCK_SAMPLES * 2> samples;
+};
+
 }
 
+struct WavExporter::Job {
+
+    Job(Module const& mod, trackerboy::Song const *song, int samplerate, TU::Batch const& batch) :
+        filename(batch.filename),
+        apu(),
+        synth(apu, samplerate, mod.data().framerate()),
+        engine(apu, &mod.data()),
+        player(engine)
+    {
+        engine.setSong(song);
+        for (int ch = 0; ch < 4; ++ch) {
+            if (batch.channels.testFlag((ChannelOutput::Flag)(1 << ch))) {
+                engine.lock(static_cast<trackerboy::ChType>(ch));
+            } else {
+                engine.unlock(static_cast<trackerboy::ChType>(ch));
+            }
+        }
+    }
+
+    QString filename;
+    trackerboy::DefaultApu apu;
+    trackerboy::Synth synth;
+    trackerboy::Engine engine;
+    trackerboy::Player player;
+};
+
 
 void WavExporter::run() {
 
@@ -86,9 +159,10 @@ void WavExporter::run() {
             if (mChannels.testFlag(flag)) {
                 iter->channels = flag;
                 iter->filename = dest.filePath(
-                    QStringLiteral("%1.ch%2.wav").arg(
+                    QStringLiteral("%1.ch%2.%3").arg(
                         mSeparatePrefix,
-                        QString::number(i + 1)
+                        QString::number(i + 1),
+                        QString::fromLatin1(Encoder::extension(mFormat))
                     ));
                 ++iter;
             }
@@ -102,69 +176,134 @@ void WavExporter::run() {
         batches[0].channels = mChannels;
     }
 
-    // temporary buffer for transferring samples from apu to the wav file
-    auto buffersize = mSynth.framesize() * 2;
-    auto buffer = std::make_unique<float[]>(buffersize);
+    if (batchCount == 0) {
+        return;
+    }
 
+    // each batch is independent of the others (own apu, synth and engine),
+    // so they can all be rendered at the same time
+    auto const song = mSong ? mSong.get() : mModule.song();
+    std::vector<std::unique_ptr<Job>> jobs;
+    jobs.reserve(batchCount);
+    int progressMaxTotal = 0;
     for (int i = 0; i < batchCount; ++i) {
+        auto &job = jobs.emplace_back(std::make_unique<Job>(mModule, song, mSamplerate, batches[i]));
+        job->player.start(mDuration);
+        progressMaxTotal += job->player.progressMax();
+    }
 
-        trackerboy::Player player(mEngine);
-        player.start(mDuration);
-
-        auto const channels = batches[i].channels;
-        for (int ch = 0; ch < 4; ++ch) {
-            if (channels.testFlag((ChannelOutput::Flag)(1 << ch))) {
-                mEngine.lock(static_cast<trackerboy::ChType>(ch));
-            } else {
-                mEngine.unlock(static_cast<trackerboy::ChType>(ch));
+    mFailed = false;
+    mProgressCount = 0;
+    mFramesRendered = 0;
+    emit progressMax(progressMaxTotal);
+    emit progress(0);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // worker pool, the workers only add to mProgressCount
+    int const threadCount = std::clamp(QThread::idealThreadCount(), 1, batchCount);
+    std::atomic_int nextJob = 0;
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    int running = threadCount;
+    auto worker = [&]() {
+        for (int i = nextJob++; i < batchCount; i = nextJob++) {
+            if (!renderJob(*jobs[i])) {
+                // stop the other workers, the export is incomplete
+                mFailed = true;
+                mAbort = true;
             }
         }
+        std::lock_guard lock(doneMutex);
+        --running;
+        doneCv.notify_one();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
 
-
-        Wav wav(batches[i].filename.toStdString(), 2, mSamplerate);
-        if (!wav.stream().good()) {
-            mFailed = true;
-            return;
+    // progress is only emitted from this thread, so that it never goes
+    // backwards
+    int reported = 0;
+    for (;;) {
+        bool finished;
+        {
+            std::unique_lock lock(doneMutex);
+            finished = doneCv.wait_for(lock, TU::PROGRESS_INTERVAL, [&]() { return running == 0; });
         }
+        auto const current = mProgressCount.load();
+        if (current != reported) {
+            reported = current;
+            emit progress(current);
+        }
+        if (finished) {
+            break;
+        }
+    }
 
-        emit progressMax(player.progressMax());
-        auto lastProgress = player.progress();
-        emit progress(lastProgress);
+    for (auto &thread : threads) {
+        thread.join();
+    }
 
-        for (;;) {
+    mElapsed = timer.nsecsElapsed();
+    mAbort = false;
+}
 
-            mMutex.lock();
-            if (mAbort) {
-                mAbort = false;
-                mMutex.unlock();
-                break;
-            }
-            mMutex.unlock();
+bool WavExporter::renderJob(Job &job) {
 
-            auto currentProgress = player.progress();
-            if (currentProgress != lastProgress) {
-                lastProgress = currentProgress;
-                emit progress(currentProgress);
-            }
+    auto encoder = Encoder::create(mFormat, job.filename.toStdString(), 2, mSamplerate);
+    if (!encoder->good()) {
+        return false;
+    }
 
-            player.step();
-            if (!player.isPlaying()) {
-                break;
-            }
-            mSynth.run();
+    // frames are rendered into this block, which is given to the encoder
+    // when there is no room left for another frame
+    auto block = std::make_unique<TU::SampleBlock>();
+    auto const framesize = job.synth.framesize();
+    assert(framesize <= TU::BLOCK_SAMPLES);
+    size_t blockFill = 0;
+    unsigned frames = 0;
 
-            auto samplesRead = mApu.readSamples(buffer.get(), mSynth.framesize());
-            wav.write(buffer.get(), samplesRead);
-            if (!wav.stream().good()) {
-                mFailed = true;
-                return;
-            }
+    auto lastProgress = job.player.progress();
+
+    for (;;) {
 
+        if (mAbort) {
+            break;
         }
 
-        mFailed = false;
+        auto currentProgress = job.player.progress();
+        if (currentProgress != lastProgress) {
+            int const delta = currentProgress - lastProgress;
+            lastProgress = currentProgress;
+            mProgressCount += delta;
+        }
+
+        job.player.step();
+        if (!job.player.isPlaying()) {
+            break;
+        }
+        job.synth.run();
+        ++frames;
+
+        blockFill += job.apu.readSamples(block->samples.data() + blockFill * 2, framesize);
+        if (TU::BLOCK_SAMPLES - blockFill < framesize) {
+            encoder->write(block->samples.data(), blockFill);
+            blockFill = 0;
+            if (!encoder->good()) {
+                return false;
+            }
+        }
 
     }
+
+    encoder->write(block->samples.data(), blockFill);
+    mFramesRendered += frames;
+    return encoder->finish();
 }
 
 #undef TU
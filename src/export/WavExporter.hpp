@@ -3,16 +3,19 @@
 
 #include "core/Module.hpp"
 #include "core/ChannelOutput.hpp"
+#include "audio/Encoder.hpp"
 
-#include "trackerboy/apu/DefaultApu.hpp"
 #include "trackerboy/export/Player.hpp"
-#include "trackerboy/Synth.hpp"
 
 #include <QThread>
-#include <QMutex>
+
+#include <atomic>
+#include <memory>
 
 //
-// Worker thread for exporting a module to a wav file
+// Worker thread for exporting a module to a wav (or flac) file. When exporting
+// channels to separate files, each file is rendered in parallel on a pool of
+// worker threads, while this thread reports their combined progress.
 //
 class WavExporter : public QThread {
     Q_OBJECT
@@ -34,8 +37,32 @@ public:
 
     void setSeparatePrefix(QString const& prefix);
 
+    //
+    // Sets the format of the exported file(s), default is 32-bit float WAV.
+    // Samples are encoded as they are rendered.
+    //
+    void setFormat(Encoder::Format format);
+
+    //
+    // Export the given song instead of the module's current song. The
+    // song must belong to the module given in the constructor.
+    //
+    void setSong(std::shared_ptr<trackerboy::Song const> song);
+
     bool failed() const;
 
+    //
+    // Throughput of the last export, in frames rendered per second. When
+    // exporting channels separately, frames from every file are counted.
+    //
+    double framesPerSecond() const;
+
+    //
+    // Throughput of the last export relative to realtime playback, ie 100.0
+    // means 100 seconds of audio were rendered per second.
+    //
+    double realtimeFactor() const;
+
     void cancel();
 
 signals:
@@ -46,22 +73,39 @@ protected:
     virtual void run() override;
 
 private:
-    QMutex mMutex;
 
+    //
+    // A file to render, with its own APU, Synth, Engine and Player
+    //
+    struct Job;
+
+    //
+    // Renders the given job to its file, returns false on I/O failure.
+    // Called from the worker threads.
+    //
+    bool renderJob(Job &job);
+
+    Module const& mModule;
+    std::shared_ptr<trackerboy::Song const> mSong;
     int mSamplerate;
-    trackerboy::DefaultApu mApu;
-    trackerboy::Synth mSynth;
-    trackerboy::Engine mEngine;
 
     trackerboy::Player::Duration mDuration;
 
     ChannelOutput::Flags mChannels;
     bool mSeparate;
+    Encoder::Format mFormat;
 
     QString mDestination;
     QString mSeparatePrefix;
 
-    bool mFailed;
-    bool mAbort;
+    std::atomic_bool mFailed;
+    std::atomic_bool mAbort;
+
+    // combined progress of all jobs, added to by the workers
+    std::atomic_int mProgressCount;
+
+    // statistics for the last export
+    std::atomic_uint64_t mFramesRendered;
+    qint64 mElapsed;
 
 };
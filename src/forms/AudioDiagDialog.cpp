@@ -1,19 +1,73 @@
 
 #include "forms/AudioDiagDialog.hpp"
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileDialog>
+#include <QHeaderView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMessageBox>
 #include <QTimerEvent>
 
+#include <algorithm>
+#include <iterator>
+
 #define TU AudioDiagDialogTU
 namespace TU {
 
 constexpr int DEFAULT_REFRESH_INTERVAL = 100;
 
+// rows of the histogram table, in the same order as Renderer::Metric
+constexpr Renderer::Metric METRICS[] = {
+    Renderer::Metric::jitter,
+    Renderer::Metric::renderTime,
+    Renderer::Metric::stepTime,
+    Renderer::Metric::bufferFill
+};
+
+constexpr const char* METRIC_KEYS[] = {
+    "jitter",
+    "renderTime",
+    "stepTime",
+    "bufferFill"
+};
+
+enum LatencyColumn {
+    ColCount,
+    ColMin,
+    ColMean,
+    ColMedian,
+    Col99,
+    ColMax,
+    ColTotal
+};
+
+//
+// Formats a histogram value for display, in the unit given by the row's
+// header: microseconds for durations, percent for the buffer fill
+//
+QString formatValue(Renderer::Metric metric, double value) {
+    if (metric == Renderer::Metric::bufferFill) {
+        return QStringLiteral("%1").arg(value, 0, 'f', 0);
+    } else {
+        return QStringLiteral("%1").arg(value / 1000.0, 0, 'f', 1);
+    }
+}
+
+QString formatTime(std::chrono::system_clock::time_point time) {
+    auto const msecs = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    return QDateTime::fromMSecsSinceEpoch(msecs).toString(Qt::ISODateWithMs);
+}
+
 }
 
 AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
     QDialog(parent, Qt::WindowTitleHint | Qt::WindowSystemMenuHint | Qt::WindowCloseButtonHint),
     mRenderer(renderer),
     mTimerId(-1),
+    mUnderrunNext(0),
     mLayout(),
     mRenderGroup(tr("Render statistics")),
     mRenderLayout(),
@@ -23,11 +77,19 @@ AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
     mElapsedLabel(),
     mPeriodLabel(),
     mPeriodWrittenLabel(),
+    mTimerDriftLabel(),
     mClearButton(tr("Clear")),
+    mHistogramGroup(tr("Histograms")),
+    mHistogramLayout(),
+    mHistogramTable(4, TU::ColTotal),
+    mUnderrunGroup(tr("Underrun log")),
+    mUnderrunLayout(),
+    mUnderrunList(),
     mButtonLayout(),
     mAutoRefreshCheck(tr("Auto refresh")),
     mIntervalSpin(),
     mRefreshButton(tr("Refresh")),
+    mExportButton(tr("Export...")),
     mCloseButton(tr("Close"))
 {
     mRenderLayout.addRow(tr("Underruns"), &mUnderrunLabel);
@@ -36,16 +98,60 @@ AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
     mRenderLayout.addRow(tr("Elapsed"), &mElapsedLabel);
     mRenderLayout.addRow(tr("Refresh rate"), &mPeriodLabel);
     mRenderLayout.addRow(tr("Samples written"), &mPeriodWrittenLabel);
-    mRenderLayout.setWidget(6, QFormLayout::LabelRole, &mClearButton);
+    mRenderLayout.addRow(tr("Timer drift"), &mTimerDriftLabel);
+    mRenderLayout.setWidget(7, QFormLayout::LabelRole, &mClearButton);
     mRenderGroup.setLayout(&mRenderLayout);
 
+    mHistogramTable.setHorizontalHeaderLabels({
+        tr("Samples"),
+        tr("Min"),
+        tr("Mean"),
+        tr("Median"),
+        tr("99%"),
+        tr("Max")
+    });
+    mHistogramTable.setVerticalHeaderLabels({
+        tr("Timer jitter (µs)"),
+        tr("Render time (µs)"),
+        tr("Engine step (µs)"),
+        tr("Buffer fill (%)")
+    });
+    mHistogramTable.setEditTriggers(QAbstractItemView::NoEditTriggers);
+    mHistogramTable.setSelectionMode(QAbstractItemView::NoSelection);
+    mHistogramTable.horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    mHistogramTable.setSizeAdjustPolicy(QAbstractScrollArea::AdjustToContents);
+    for (int row = 0; row < mHistogramTable.rowCount(); ++row) {
+        for (int col = 0; col < TU::ColTotal; ++col) {
+            auto item = new QTableWidgetItem;
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            mHistogramTable.setItem(row, col, item);
+        }
+    }
+    mHistogramLayout.addWidget(&mHistogramTable);
+    mHistogramGroup.setLayout(&mHistogramLayout);
+
+    mUnderrunList.setHeaderLabels({
+        tr("Time"),
+        tr("Position"),
+        tr("Missing"),
+        tr("Order"),
+        tr("Row")
+    });
+    mUnderrunList.setRootIsDecorated(false);
+    mUnderrunList.setMinimumHeight(120);
+    mUnderrunLayout.addWidget(&mUnderrunList);
+    mUnderrunGroup.setLayout(&mUnderrunLayout);
+
     mButtonLayout.addWidget(&mAutoRefreshCheck);
     mButtonLayout.addWidget(&mIntervalSpin);
     mButtonLayout.addWidget(&mRefreshButton);
     mButtonLayout.addStretch();
+    mButtonLayout.addWidget(&mExportButton);
     mButtonLayout.addWidget(&mCloseButton);
 
     mLayout.addWidget(&mRenderGroup, 1);
+    mLayout.addWidget(&mHistogramGroup);
+    mLayout.addWidget(&mUnderrunGroup);
     mLayout.addLayout(&mButtonLayout);
     mLayout.setSizeConstraint(QLayout::SizeConstraint::SetFixedSize);
     setLayout(&mLayout);
@@ -65,7 +171,12 @@ AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
 
     connect(&mCloseButton, &QPushButton::clicked, this, &AudioDiagDialog::close);
     connect(&mRefreshButton, &QPushButton::clicked, this, &AudioDiagDialog::refresh);
-    connect(&mClearButton, &QPushButton::clicked, &mRenderer, &Renderer::clearDiagnostics);
+    connect(&mExportButton, &QPushButton::clicked, this, &AudioDiagDialog::exportDiagnostics);
+    connect(&mClearButton, &QPushButton::clicked, this,
+        [this]() {
+            mRenderer.clearDiagnostics();
+            refresh();
+        });
     connect(&mAutoRefreshCheck, &QCheckBox::stateChanged, this,
         [this](int state) {
             bool checked = state == Qt::Checked;
@@ -142,6 +253,123 @@ void AudioDiagDialog::refresh() {
     double periodMs = std::chrono::duration<double>(diags.lastPeriod).count() * 1000.0;
     mPeriodLabel.setText(tr("%1 ms").arg(periodMs, 0, 'f', 3));
     mPeriodWrittenLabel.setText(QString::number(diags.writesSinceLastPeriod));
+
+    auto const& drift = diags.timerDrift;
+    auto toUs = [](std::chrono::nanoseconds ns) {
+        return std::chrono::duration<double, std::micro>(ns).count();
+    };
+    mTimerDriftLabel.setText(tr("%1 / %2 / %3 us (last / mean / max), %4 missed%5")
+        .arg(toUs(drift.last), 0, 'f', 1)
+        .arg(toUs(drift.mean), 0, 'f', 1)
+        .arg(toUs(drift.max), 0, 'f', 1)
+        .arg(drift.missed)
+        .arg(drift.realtime ? tr(", real-time") : QString()));
+
+    for (int row = 0; row < (int)std::size(TU::METRICS); ++row) {
+        auto const metric = TU::METRICS[row];
+        auto const& histogram = mRenderer.histogram(metric);
+        mHistogramTable.item(row, TU::ColCount)->setText(QString::number(histogram.total()));
+        mHistogramTable.item(row, TU::ColMin)->setText(TU::formatValue(metric, (double)histogram.min()));
+        mHistogramTable.item(row, TU::ColMean)->setText(TU::formatValue(metric, histogram.mean()));
+        mHistogramTable.item(row, TU::ColMedian)->setText(TU::formatValue(metric, (double)histogram.percentile(0.5)));
+        mHistogramTable.item(row, TU::Col99)->setText(TU::formatValue(metric, (double)histogram.percentile(0.99)));
+        mHistogramTable.item(row, TU::ColMax)->setText(TU::formatValue(metric, (double)histogram.max()));
+    }
+
+    // entries are added to the end of the log and dropped from the front
+    // (or cleared), so remove the dropped items and add the new entries
+    auto const& underruns = mRenderer.underruns();
+    auto const oldest = underruns.empty() ? mUnderrunNext : underruns.front().sequence;
+    while (mUnderrunList.topLevelItemCount() > 0) {
+        auto item = mUnderrunList.topLevelItem(0);
+        if (item->data(0, Qt::UserRole).toULongLong() >= oldest) {
+            break;
+        }
+        delete item;
+    }
+    for (auto i = (size_t)(std::max(mUnderrunNext, oldest) - oldest); i < underruns.size(); ++i) {
+        auto const& underrun = underruns[i];
+        auto item = new QTreeWidgetItem(QStringList {
+            TU::formatTime(underrun.time),
+            QString::number(underrun.position),
+            QString::number(underrun.missing),
+            QString::number(underrun.order),
+            QString::number(underrun.row)
+        });
+        item->setData(0, Qt::UserRole, (qulonglong)underrun.sequence);
+        mUnderrunList.addTopLevelItem(item);
+    }
+    if (!underruns.empty()) {
+        mUnderrunNext = underruns.back().sequence + 1;
+    }
+}
+
+void AudioDiagDialog::exportDiagnostics() {
+    auto const filename = QFileDialog::getSaveFileName(
+        this,
+        tr("Export diagnostics"),
+        QString(),
+        tr("JSON files (*.json)")
+    );
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    auto const diags = mRenderer.diagnostics();
+    QJsonObject root {
+        { QStringLiteral("time"), QDateTime::currentDateTime().toString(Qt::ISODateWithMs) },
+        { QStringLiteral("samplerate"), mRenderer.samplerate() },
+        { QStringLiteral("underruns"), (qint64)diags.underruns },
+        { QStringLiteral("timer"), QJsonObject {
+            { QStringLiteral("ticks"), (qint64)diags.timerDrift.ticks },
+            { QStringLiteral("missed"), (qint64)diags.timerDrift.missed },
+            { QStringLiteral("meanLateness"), (qint64)diags.timerDrift.mean.count() },
+            { QStringLiteral("maxLateness"), (qint64)diags.timerDrift.max.count() },
+            { QStringLiteral("realtime"), diags.timerDrift.realtime }
+        }},
+        { QStringLiteral("bufferSize"), (qint64)diags.bufferSize }
+    };
+
+    // histograms are exported in full, durations in nanoseconds and buffer
+    // fill in percent. Only non-empty buckets are included.
+    QJsonObject histograms;
+    for (size_t i = 0; i < std::size(TU::METRICS); ++i) {
+        auto const& histogram = mRenderer.histogram(TU::METRICS[i]);
+        QJsonArray buckets;
+        for (int b = 0; b < Histogram::BUCKETS; ++b) {
+            auto const count = histogram.count(b);
+            if (count) {
+                buckets.append(QJsonArray { (qint64)histogram.bucketLowerBound(b), (qint64)count });
+            }
+        }
+        histograms.insert(QString::fromLatin1(TU::METRIC_KEYS[i]), QJsonObject {
+            { QStringLiteral("count"), (qint64)histogram.total() },
+            { QStringLiteral("min"), (qint64)histogram.min() },
+            { QStringLiteral("mean"), histogram.mean() },
+            { QStringLiteral("p50"), (qint64)histogram.percentile(0.5) },
+            { QStringLiteral("p99"), (qint64)histogram.percentile(0.99) },
+            { QStringLiteral("max"), (qint64)histogram.max() },
+            { QStringLiteral("buckets"), buckets }
+        });
+    }
+    root.insert(QStringLiteral("histograms"), histograms);
+
+    QJsonArray underrunLog;
+    for (auto const& underrun : mRenderer.underruns()) {
+        underrunLog.append(QJsonObject {
+            { QStringLiteral("time"), TU::formatTime(underrun.time) },
+            { QStringLiteral("position"), (qint64)underrun.position },
+            { QStringLiteral("missing"), (qint64)underrun.missing },
+            { QStringLiteral("order"), underrun.order },
+            { QStringLiteral("row"), underrun.row }
+        });
+    }
+    root.insert(QStringLiteral("underrunLog"), underrunLog);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) == -1) {
+        QMessageBox::critical(this, tr("Export diagnostics"), tr("Could not write to %1").arg(filename));
+    }
 }
 
 #undef TU
@@ -13,6 +13,8 @@
 #include <QProgressBar>
 #include <QPushButton>
 #include <QSpinBox>
+#include <QTableWidget>
+#include <QTreeWidget>
 
 //
 // Audio diagnostics dialog. Shows stats about the Renderer and detailed device information
@@ -39,8 +41,12 @@ private:
 
     void refresh();
 
+    void exportDiagnostics();
+
     Renderer &mRenderer;
     int mTimerId;
+    // sequence number of the next underrun to add to the log
+    uint64_t mUnderrunNext;
 
     QVBoxLayout mLayout;
         QGroupBox mRenderGroup;
@@ -52,10 +58,18 @@ private:
                 QLabel mElapsedLabel;
                 QLabel mPeriodLabel;
                 QLabel mPeriodWrittenLabel;
+                QLabel mTimerDriftLabel;
                 QPushButton mClearButton;
+        QGroupBox mHistogramGroup;
+            QVBoxLayout mHistogramLayout;
+                QTableWidget mHistogramTable;
+        QGroupBox mUnderrunGroup;
+            QVBoxLayout mUnderrunLayout;
+                QTreeWidget mUnderrunList;
         QHBoxLayout mButtonLayout;
             QCheckBox mAutoRefreshCheck;
             QSpinBox mIntervalSpin;
             QPushButton mRefreshButton;
+            QPushButton mExportButton;
             QPushButton mCloseButton;
 };
@@ -74,6 +74,7 @@ MainWindow::MainWindow() :
     mWaveModel = new WaveListModel(*mModule, this);
 
     mRenderer = new Renderer(*mModule, this);
+    mMidi.setNoteCallback(Renderer::midiCallback, mRenderer);
 
     setupUi();
 
@@ -327,6 +328,7 @@ void MainWindow::setupUi() {
                 }
             }
             mPatternEditor->setInstrument(id);
+            updateMidiTarget();
         });
 
     connect(mWaveforms, &TableView::selectedItemChanged, this,
@@ -451,6 +453,12 @@ void MainWindow::setupUi() {
     lazyconnect(mPatternEditor, stopNotePreview, mRenderer, stopPreview);
 
     lazyconnect(&mMidi, error, this, onMidiError);
+    connect(mPatternModel, &PatternModel::cursorChanged, this,
+        [this](PatternModel::CursorChangeFlags flags) {
+            if (flags.testFlag(PatternModel::CursorTrackChanged)) {
+                updateMidiTarget();
+            }
+        });
 
     connect(mModule, &Module::modifiedChanged, this,
         [this](bool modified) {
@@ -473,6 +481,13 @@ void MainWindow::setupUi() {
     auto scope = mSidebar->scope();
     scope->setBuffer(&mRenderer->visualizerBuffer());
     connect(mRenderer, &Renderer::updateVisualizers, scope, qOverload<>(&AudioScope::update));
+    auto channelScopes = mSidebar->channelScopes();
+    channelScopes->setBuffer(&mRenderer->channelScopeBuffer());
+    connect(mRenderer, &Renderer::updateVisualizers, channelScopes, qOverload<>(&ChannelScopes::update));
+    mSidebar->spectrum()->setAnalyzer(&mRenderer->spectrumAnalyzer());
+    auto peakMeter = mSidebar->peakMeter();
+    peakMeter->setMeter(&mRenderer->levelMeter());
+    connect(mRenderer, &Renderer::updateVisualizers, peakMeter, &PeakMeter::updateLevels);
 
     lazyconnect(mRenderer, isPlayingChanged, mPatternModel, setPlaying);
 
@@ -577,8 +592,36 @@ void MainWindow::handleFocusChange(QWidget *oldWidget, QWidget *newWidget) {
             widget = widget->parentWidget();
         }
         mMidi.setReceiver(receiver);
+        updateMidiTarget();
+    }
+
+}
+
+void MainWindow::updateMidiTarget() {
+    Renderer::MidiTarget target{ Renderer::MidiTarget::Type::none, -1, -1 };
+
+    if (mMidi.isOpen()) {
+        auto receiver = mMidi.receiver();
+        if (receiver == mPatternEditor) {
+            target.type = Renderer::MidiTarget::Type::instrument;
+            target.track = mPatternModel->cursorTrack();
+            target.id = mPatternEditor->instrument();
+        } else if (mInstrumentEditor && receiver == mInstrumentEditor->piano()) {
+            auto item = mInstrumentEditor->currentItem();
+            if (item != -1) {
+                target.type = Renderer::MidiTarget::Type::instrument;
+                target.id = mInstrumentModel->id(item);
+            }
+        } else if (mWaveEditor && receiver == mWaveEditor->piano()) {
+            auto item = mWaveEditor->currentItem();
+            if (item != -1) {
+                target.type = Renderer::MidiTarget::Type::waveform;
+                target.id = mWaveModel->id(item);
+            }
+        }
     }
 
+    mRenderer->setMidiTarget(target);
 }
 
 namespace TU {
@@ -228,6 +228,12 @@ private:
     //
     void handleFocusChange(QWidget *oldWidget, QWidget *newWidget);
 
+    //
+    // Sets the renderer's MIDI target to what the current midi receiver
+    // previews.
+    //
+    void updateMidiTarget();
+
     //
     // Pushes the given filename to the recent files list. Each file that is
     // successfully opened and newly saved files should get added to this list
@@ -366,6 +366,9 @@ void MainWindow::setupSongMenu(QMenu *menu) {
 
 void MainWindow::setupViewMenu(QMenu *menu) {
     menu->addAction(mActionViewHistory);
+    menu->addAction(mSidebar->channelScopesAction());
+    menu->addAction(mSidebar->peakMeterAction());
+    menu->addAction(mSidebar->spectrumAction());
     menu->addSeparator();
     auto toolbarMenu = menu->addMenu(tr("Toolbars"));
     for (auto toolbar : {
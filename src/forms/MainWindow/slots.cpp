@@ -310,6 +310,9 @@ Config::Categories MainWindow::applyConfig(Config const& config, Config::Categor
         orderGrid->setColors(mPalette);
 
         mSidebar->scope()->setColors(mPalette);
+        mSidebar->channelScopes()->setColors(mPalette);
+        mSidebar->spectrum()->setColors(mPalette);
+        mSidebar->peakMeter()->setColors(mPalette);
         if (mInstrumentEditor) {
             mInstrumentEditor->setColors(mPalette);
         }
@@ -355,6 +358,8 @@ Config::Categories MainWindow::applyConfig(Config const& config, Config::Categor
                 qCritical().noquote() << "[MIDI] Failed to initialize MIDI device:" << mMidi.lastError();
             }
         }
+        mRenderer->setMidiInput(mMidi.isOpen());
+        updateMidiTarget();
     }
 
     return flags;
@@ -442,6 +447,7 @@ void MainWindow::showInstrumentEditor() {
         lazyconnect(piano, keyChange, mRenderer, setPreviewNote);
         lazyconnect(piano, keyUp, mRenderer, stopPreview);
         lazyconnect(mInstrumentEditor, openWaveEditor, this, editWaveform);
+        lazyconnect(mInstrumentEditor, currentItemChanged, this, updateMidiTarget);
     }
 
     mInstrumentEditor->show();
@@ -462,6 +468,7 @@ void MainWindow::showWaveEditor() {
             });
         lazyconnect(piano, keyChange, mRenderer, setPreviewNote);
         lazyconnect(piano, keyUp, mRenderer, stopPreview);
+        lazyconnect(mWaveEditor, currentItemChanged, this, updateMidiTarget);
     }
     mWaveEditor->show();
 }
@@ -519,9 +526,8 @@ void MainWindow::onAudioStop() {
 }
 
 void MainWindow::onFrameSync() {
-    // this slot is called when the renderer has renderered a new frame
-    // sync is a bit misleading here, as this slot is called when this frame
-    // is in process of being bufferred. It is not the current frame being played out.
+    // this slot is called when the device has started playing out a new
+    // frame, so the frame here is the one currently being heard.
 
     auto frame = mRenderer->currentFrame();
 
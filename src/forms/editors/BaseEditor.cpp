@@ -83,6 +83,7 @@ void BaseEditor::onIndexChanged(int index) {
     if (!hasIndex) {
         hide();
     }
+    emit currentItemChanged(index);
 }
 
 void BaseEditor::onNameEdited(QString const& name) {
@@ -28,6 +28,13 @@ public:
     // 
     void openItem(int index);
 
+signals:
+
+    //
+    // Emitted when the item being edited changes, index is -1 for none
+    //
+    void currentItemChanged(int index);
+
 protected:
 
     explicit BaseEditor(
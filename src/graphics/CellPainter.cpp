@@ -2,6 +2,9 @@
 #include "graphics/CellPainter.hpp"
 
 #include <QFontMetrics>
+#include <QPaintDevice>
+
+#include <algorithm>
 
 #define TU CellPainterTU
 namespace TU {
@@ -31,12 +34,26 @@ static const char HEX_TABLE[16] = {
 static const char PAINTABLE_CHARS[] = "ABCDEFGHTVIHSLPQR0123456789? -#b";
 static constexpr int PAINTABLE_CHARS_COUNT = sizeof(PAINTABLE_CHARS) - 1;
 
+// glyphs in an atlas, printable ASCII
+static constexpr char FIRST_GLYPH = ' ';
+static constexpr char LAST_GLYPH = '~';
+static constexpr int GLYPH_COUNT = LAST_GLYPH - FIRST_GLYPH + 1;
+
+// atlases kept before all are discarded, only a few colors are used at once
+static constexpr size_t MAX_ATLASES = 16;
+
 }
 
 CellPainter::CellPainter() :
+    mFont(),
+    mImageAtlases(false),
     mCellHeight(0),
     mCellWidth(0),
-    mCellScratch(1, '\0')
+    mGlyphWidth(0),
+    mGlyphHeight(0),
+    mGlyphMargin(0),
+    mAtlases(),
+    mCurrentAtlas(0)
 {
 }
 
@@ -59,15 +76,121 @@ void CellPainter::setFont(QFont const& font) {
 
     // get the average character width
     mCellWidth = metrics.size(Qt::TextSingleLine, TU::PAINTABLE_CHARS).width() / TU::PAINTABLE_CHARS_COUNT;
+
+    // glyphs are drawn the same way drawText would in a cell, aligned to the
+    // bottom. Leave room for anything drawn outside of it.
+    mFont = font;
+    mGlyphMargin = std::max(0, metrics.height() - mCellHeight);
+    mGlyphHeight = mCellHeight + mGlyphMargin;
+    mGlyphWidth = std::max(mCellWidth, metrics.maxWidth());
+    clearGlyphs();
 }
 
+void CellPainter::setImageAtlases(bool images) {
+    mImageAtlases = images;
+    clearGlyphs();
+}
+
+void CellPainter::clearGlyphs() {
+    mAtlases.clear();
+    mCurrentAtlas = 0;
+}
+
+CellPainter::GlyphAtlas& CellPainter::atlasFor(QPainter &painter) const {
+    auto const color = painter.pen().color().rgba();
+    auto const dpr = painter.device()->devicePixelRatioF();
+
+    // consecutive cells are usually the same color
+    if (mCurrentAtlas < mAtlases.size()) {
+        auto &current = mAtlases[mCurrentAtlas];
+        if (current.color == color && current.dpr == dpr) {
+            return current;
+        }
+    }
+
+    for (size_t i = 0; i < mAtlases.size(); ++i) {
+        auto &atlas = mAtlases[i];
+        if (atlas.color == color && atlas.dpr == dpr) {
+            mCurrentAtlas = i;
+            return atlas;
+        }
+    }
+
+    if (mAtlases.size() == TU::MAX_ATLASES) {
+        // cells queued are lost, flushCells is called at the end of each
+        // paint so this only happens with too many colors in one paint
+        mAtlases.clear();
+    }
+
+    auto &atlas = mAtlases.emplace_back();
+    mCurrentAtlas = mAtlases.size() - 1;
+    atlas.color = color;
+    atlas.dpr = dpr;
+    auto const size = QSize(mGlyphWidth * TU::GLYPH_COUNT, mGlyphHeight) * dpr;
+    QPaintDevice *device;
+    if (mImageAtlases) {
+        atlas.image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+        atlas.image.setDevicePixelRatio(dpr);
+        atlas.image.fill(Qt::transparent);
+        device = &atlas.image;
+    } else {
+        atlas.pixmap = QPixmap(size);
+        atlas.pixmap.setDevicePixelRatio(dpr);
+        atlas.pixmap.fill(Qt::transparent);
+        device = &atlas.pixmap;
+    }
+
+    QPainter glyphPainter(device);
+    glyphPainter.setFont(mFont);
+    glyphPainter.setPen(QColor::fromRgba(color));
+    QString glyph(1, QChar(' '));
+    for (int i = 0; i < TU::GLYPH_COUNT; ++i) {
+        glyph[0] = QChar(TU::FIRST_GLYPH + i);
+        glyphPainter.drawText(i * mGlyphWidth, mGlyphMargin, mCellWidth, mCellHeight, Qt::AlignBottom, glyph);
+    }
+
+    return atlas;
+}
 
 int CellPainter::drawCell(QPainter &painter, char cell, int xpos, int ypos) const {
-    mCellScratch[0] = cell;
-    painter.drawText(xpos, ypos, mCellWidth, mCellHeight, Qt::AlignBottom, mCellScratch);
+    if (cell > TU::FIRST_GLYPH && cell <= TU::LAST_GLYPH) {
+        auto &atlas = atlasFor(painter);
+        // fragments are positioned by their center and sourced in device
+        // pixels, scale them back to logical pixels
+        auto const dpr = atlas.dpr;
+        atlas.cells.push_back(QPainter::PixmapFragment::create(
+            QPointF(xpos + mGlyphWidth * 0.5, ypos - mGlyphMargin + mGlyphHeight * 0.5),
+            QRectF((cell - TU::FIRST_GLYPH) * mGlyphWidth * dpr, 0, mGlyphWidth * dpr, mGlyphHeight * dpr),
+            1.0 / dpr,
+            1.0 / dpr
+        ));
+    }
     return xpos + mCellWidth;
 }
 
+void CellPainter::flushCells(QPainter &painter) const {
+    for (auto &atlas : mAtlases) {
+        if (atlas.cells.empty()) {
+            continue;
+        }
+        if (mImageAtlases) {
+            // there is no image equivalent of drawPixmapFragments
+            for (auto const& cell : atlas.cells) {
+                auto const w = cell.width * cell.scaleX;
+                auto const h = cell.height * cell.scaleY;
+                painter.drawImage(
+                    QRectF(cell.x - w * 0.5, cell.y - h * 0.5, w, h),
+                    atlas.image,
+                    QRectF(cell.sourceLeft, cell.sourceTop, cell.width, cell.height)
+                );
+            }
+        } else {
+            painter.drawPixmapFragments(atlas.cells.data(), (int)atlas.cells.size(), atlas.pixmap);
+        }
+        atlas.cells.clear();
+    }
+}
+
 int CellPainter::drawHex(QPainter &painter, int hex, int xpos, int ypos) const {
     xpos = drawCell(painter, TU::HEX_TABLE[(hex >> 4) & 0xF], xpos, ypos);
     return drawCell(painter, TU::HEX_TABLE[hex & 0xF], xpos, ypos);
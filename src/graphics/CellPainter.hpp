@@ -1,13 +1,27 @@
-
 #pragma once
 
+#include <QColor>
 #include <QFont>
+#include <QImage>
 #include <QPainter>
+#include <QPixmap>
 #include <QString>
 
+#include <vector>
+
 //
 // Utility class for painting single characters in a grid of "cells". The size
-// of a cell is determined by the given font. 
+// of a cell is determined by the given font.
+//
+// Characters are not drawn as text. Each glyph is rendered once into an atlas
+// pixmap for the painter's pen color, and cells are queued as fragments of
+// that atlas. Queued cells are drawn by flushCells, with one
+// drawPixmapFragments call per color. Atlases are rebuilt when the font is
+// changed.
+//
+// QPixmap may only be used on the GUI thread. A copy painting on another
+// thread must use image atlases instead (see setImageAtlases), which are
+// drawn one cell at a time.
 //
 class CellPainter {
 
@@ -21,8 +35,21 @@ public:
     void setFont(QFont const& font);
 
     //
-    // Draws a cell at the given x and y coordinates. The x position of the
-    // next cell is returned
+    // Renders atlases into QImages instead of QPixmaps, so that the painter
+    // can be used off the GUI thread. Discards the glyphs rendered, call it
+    // on the GUI thread before handing a copy to another thread.
+    //
+    void setImageAtlases(bool images);
+
+    //
+    // Discards the glyphs rendered for colors no longer in use, call when
+    // changing colors.
+    //
+    void clearGlyphs();
+
+    //
+    // Queues a cell at the given x and y coordinates, using the painter's pen
+    // color. The x position of the next cell is returned
     //
     int drawCell(QPainter &painter, char cell, int xpos, int ypos) const;
 
@@ -30,6 +57,12 @@ public:
 
     int drawDec(QPainter &painter, int dec, int xpos, int ypos) const;
 
+    //
+    // Draws all cells queued by drawCell, drawHex and drawDec. Must be called
+    // with the same painter, before it ends.
+    //
+    void flushCells(QPainter &painter) const;
+
     //
     // Determines the number of rows that can fit in the given height. The
     // result is rounded up, so this function will always return a number >= 1.
@@ -38,13 +71,37 @@ public:
 
 private:
 
+    //
+    // Pre-rendered glyphs of every printable ASCII character, in one color
+    //
+    struct GlyphAtlas {
+        QRgb color;
+        qreal dpr;
+        // only one is used, depending on mImageAtlases
+        QPixmap pixmap;
+        QImage image;
+        // cells queued since the last flush
+        std::vector<QPainter::PixmapFragment> cells;
+    };
+
+    // gets the atlas for the painter's pen color, rendering it if needed
+    GlyphAtlas& atlasFor(QPainter &painter) const;
+
+    QFont mFont;
+    bool mImageAtlases;
+
     int mCellHeight;
     int mCellWidth;
 
-    // 1-character string used by drawCell
-    // this way we don't have to create a temporary QString every call
-    // unnecessary if QString has small string optimization (don't think it does)
-    QString mutable mCellScratch;
+    // size of a glyph in an atlas, glyphs may be larger than a cell
+    int mGlyphWidth;
+    int mGlyphHeight;
+    // space above the cell in a glyph, for fonts with tall ascenders
+    int mGlyphMargin;
+
+    std::vector<GlyphAtlas> mutable mAtlases;
+    // index of the last atlas used by drawCell
+    size_t mutable mCurrentAtlas;
 
 
 };
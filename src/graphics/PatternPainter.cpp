@@ -127,6 +127,8 @@ void PatternPainter::setColors(Palette const& colors) {
         color.setAlpha(128);
     }
 
+    clearGlyphs();
+
 }
 
 void PatternPainter::drawRowBackground(QPainter &p, PatternLayout const& l, RowType type, int row) const {
@@ -195,65 +197,83 @@ int PatternPainter::drawPattern(
     int ypos
 ) const {
     auto const _cellHeight = cellHeight();
+
+    std::array<trackerboy::TrackRow, 4> tracks;
+    for (int rowno = rowStart; rowno <= rowEnd; ++rowno) {
+        for (int track = 0; track <= 3; ++track) {
+            tracks[track] = pattern.getTrackRow(static_cast<trackerboy::ChType>(track), rowno);
+        }
+        drawRow(p, l, rowno, tracks.data(), ypos);
+        ypos += _cellHeight;
+    }
+
+    flushCells(p);
+
+    return ypos;
+}
+
+void PatternPainter::drawRow(
+    QPainter &p,
+    PatternLayout const& l,
+    int rowno,
+    trackerboy::TrackRow const *tracks,
+    int ypos
+) const {
     auto const start = l.patternStart();
 
     // text centering
     ypos++;
 
-    auto rownoDraw = l.rownoHex() ? &PatternPainter::drawHex : &PatternPainter::drawDec;
+    auto const& fgcolor = mForegroundColors[highlightIndex(rowno)];
+    p.setPen(mPen.get(fgcolor));
+    if (l.rownoHex()) {
+        drawHex(p, rowno, PatternLayout::SPACING, ypos);
+    } else {
+        drawDec(p, rowno, PatternLayout::SPACING, ypos);
+    }
+    int xpos = start + PatternLayout::SPACING;
+    for (int track = 0; track <= 3; ++track) {
+        auto const& trackdata = tracks[track];
+
+        auto note = trackdata.queryNote();
+        if (note) {
+            xpos = drawNote(p, *note, xpos, ypos);
+        } else {
+            xpos = drawNone(p, 3, xpos, ypos);
+        }
+
+        xpos += PatternLayout::SPACING;
+        auto instrument = trackdata.queryInstrument();
+        if (instrument) {
+            p.setPen(mPen.get(mColorInstrument));
+            xpos = drawHex(p, *instrument, xpos, ypos);
+            p.setPen(mPen.get(fgcolor));
+        } else {
+            xpos = drawNone(p, 2, xpos, ypos);
+        }
 
-    for (int rowno = rowStart; rowno <= rowEnd; ++rowno) {
-        auto const& fgcolor = mForegroundColors[highlightIndex(rowno)];
-        p.setPen(mPen.get(fgcolor));
-        (*this.*rownoDraw)(p, rowno, PatternLayout::SPACING, ypos);
-        int xpos = start + PatternLayout::SPACING;
-        for (int track = 0; track <= 3; ++track) {
-            auto &trackdata = pattern.getTrackRow(static_cast<trackerboy::ChType>(track), rowno);
+        xpos += PatternLayout::SPACING;
 
-            auto note = trackdata.queryNote();
-            if (note) {
-                xpos = drawNote(p, *note, xpos, ypos);
-            } else {
-                xpos = drawNone(p, 3, xpos, ypos);
-            }
+        auto const effectsVisible = l.effectsVisible(track);
+        for (int effect = 0; effect < effectsVisible; ++effect) {
+            auto effectdata = trackdata.effects[effect];
+            if (effectdata.type != trackerboy::EffectType::noEffect) {
+                p.setPen(mPen.get(mColorEffect));
+
+                xpos = drawCell(p, TU::effectTypeToChar(effectdata.type), xpos, ypos);
 
-            xpos += PatternLayout::SPACING;
-            auto instrument = trackdata.queryInstrument();
-            if (instrument) {
-                p.setPen(mPen.get(mColorInstrument));
-                xpos = drawHex(p, *instrument, xpos, ypos);
                 p.setPen(mPen.get(fgcolor));
+                xpos = drawHex(p, effectdata.param, xpos, ypos);
             } else {
-                xpos = drawNone(p, 2, xpos, ypos);
+                xpos = drawNone(p, 3, xpos, ypos);
             }
 
             xpos += PatternLayout::SPACING;
 
-            auto const effectsVisible = l.effectsVisible(track);
-            for (int effect = 0; effect < effectsVisible; ++effect) {
-                auto effectdata = trackdata.effects[effect];
-                if (effectdata.type != trackerboy::EffectType::noEffect) {
-                    p.setPen(mPen.get(mColorEffect));
-
-                    xpos = drawCell(p, TU::effectTypeToChar(effectdata.type), xpos, ypos);
-
-                    p.setPen(mPen.get(fgcolor));
-                    xpos = drawHex(p, effectdata.param, xpos, ypos);
-                } else {
-                    xpos = drawNone(p, 3, xpos, ypos);
-                }
-
-                xpos += PatternLayout::SPACING;
-
-            }
-
-            xpos += PatternLayout::LINE_WIDTH + PatternLayout::SPACING;
         }
 
-        ypos += _cellHeight;
+        xpos += PatternLayout::LINE_WIDTH + PatternLayout::SPACING;
     }
-
-    return ypos - 1;
 }
 
 void PatternPainter::drawSelection(QPainter &painter, QRect const& rect) const {
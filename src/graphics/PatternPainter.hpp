@@ -10,6 +10,7 @@
 #include "graphics/PatternLayout.hpp"
 
 #include "trackerboy/data/Pattern.hpp"
+#include "trackerboy/data/TrackRow.hpp"
 
 #include <QColor>
 
@@ -70,6 +71,18 @@ public:
         int ypos
     ) const;
 
+    //
+    // Draws a single row at the given y position, from the data of each of
+    // the 4 tracks in the given array. The row's cells are queued, call
+    // flushCells to draw them.
+    //
+    void drawRow(
+        QPainter &p, PatternLayout const& l,
+        int rowno,
+        trackerboy::TrackRow const *tracks,
+        int ypos
+    ) const;
+
     //
     // Draws the selection rectangle
     //
@@ -0,0 +1,83 @@
+
+#include "graphics/PatternTileRenderer.hpp"
+
+#include <QFontDatabase>
+#include <QPainter>
+
+PatternTileRenderer::PatternTileRenderer(QObject *parent) :
+    QObject(parent),
+    mThread(),
+    mWorker(),
+    mStyle(0),
+    mPainter(),
+    mLayout(),
+    mDpr(1.0)
+{
+    if (isThreaded()) {
+        mThread.setObjectName(QStringLiteral("PatternTileRenderer"));
+        mWorker.moveToThread(&mThread);
+        mThread.start(QThread::LowPriority);
+    }
+}
+
+PatternTileRenderer::~PatternTileRenderer() {
+    // jobs still queued are dropped with the thread's event loop
+    mStyle = 0;
+    mThread.quit();
+    mThread.wait();
+}
+
+bool PatternTileRenderer::isThreaded() {
+    static bool const threaded = QFontDatabase::supportsThreadedFontRendering();
+    return threaded;
+}
+
+void PatternTileRenderer::setStyle(PatternPainter const& painter, PatternLayout const& layout, qreal dpr) {
+    auto const style = ++mStyle;
+    // the copy's pixmap atlases are dropped here, on the GUI thread
+    PatternPainter copy(painter);
+    copy.setImageAtlases(isThreaded());
+    QMetaObject::invokeMethod(&mWorker, [this, copy, layout, dpr, style]() {
+        if (style != mStyle) {
+            return;
+        }
+        mPainter = std::make_unique<PatternPainter>(copy);
+        mLayout = layout;
+        mDpr = dpr;
+    }, Qt::QueuedConnection);
+}
+
+void PatternTileRenderer::render(Tile tile) {
+    tile.style = mStyle;
+    QMetaObject::invokeMethod(&mWorker, [this, tile]() {
+        // skip requests for an old style, the painter is set by then
+        if (tile.style != mStyle || !mPainter) {
+            return;
+        }
+
+        auto rendered = tile;
+        renderTile(rendered);
+
+        QMetaObject::invokeMethod(this, [this, rendered]() {
+            if (rendered.style == mStyle) {
+                emit tileRendered(rendered);
+            }
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void PatternTileRenderer::renderTile(Tile &tile) {
+    auto const rows = (int)tile.rows.size() / 4;
+    auto const rowHeight = mPainter->cellHeight();
+    auto const width = mLayout.patternStart() + mLayout.rowWidth();
+
+    tile.image = QImage(QSize(width, rows * rowHeight) * mDpr, QImage::Format_ARGB32_Premultiplied);
+    tile.image.setDevicePixelRatio(mDpr);
+    tile.image.fill(Qt::transparent);
+
+    QPainter painter(&tile.image);
+    for (int i = 0; i < rows; ++i) {
+        mPainter->drawRow(painter, mLayout, tile.rowStart + i, tile.rows.data() + i * 4, i * rowHeight);
+    }
+    mPainter->flushCells(painter);
+}
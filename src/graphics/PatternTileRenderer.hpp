@@ -0,0 +1,105 @@
+#pragma once
+
+#include "graphics/PatternLayout.hpp"
+#include "graphics/PatternPainter.hpp"
+
+#include "trackerboy/data/TrackRow.hpp"
+
+#include <QImage>
+#include <QObject>
+#include <QThread>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//
+// Renders the text of pattern rows into tiles on a worker thread, for
+// PatternGrid. A tile is up to TILE_ROWS rows of a pattern on a transparent
+// background, drawn the same way PatternPainter::drawPattern would.
+//
+// The GUI thread copies the rows of a tile (a snapshot) and requests a
+// render. The worker only reads the snapshot, never the module, so it needs
+// no lock and never blocks an edit. The image is handed back to the GUI
+// thread via tileRendered, along with the snapshot it was rendered from, so
+// the grid can tell if the tile is still current by comparing snapshots.
+//
+// The worker paints with copies of the grid's PatternPainter and
+// PatternLayout, given by setStyle. Requests made before the last setStyle
+// are skipped and never emitted.
+//
+// Rendering text off the GUI thread needs threaded font rendering. When the
+// platform does not support it, there is no worker thread: tiles are
+// rendered on the GUI thread, from its event loop, after the paint that
+// requested them.
+//
+// Threads:
+//  - GUI thread: everything, tileRendered is emitted on the GUI thread
+//  - Worker thread: rendering
+//
+class PatternTileRenderer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    static constexpr int TILE_ROWS = 16;
+
+    struct Tile {
+        // identifies the tile, set by the requester
+        int key;
+        // row number of the tile's first row
+        int rowStart;
+        // style the tile is rendered with, set by render
+        uint64_t style;
+        // data of each row, 4 tracks per row
+        std::vector<trackerboy::TrackRow> rows;
+        // the rendered rows, set by the worker
+        QImage image;
+    };
+
+    explicit PatternTileRenderer(QObject *parent = nullptr);
+    ~PatternTileRenderer();
+
+    //
+    // Determines if tiles are rendered on a worker thread, checked once.
+    //
+    static bool isThreaded();
+
+    //
+    // Sets the painter, layout and device pixel ratio tiles are rendered
+    // with. Pending requests are discarded.
+    //
+    void setStyle(PatternPainter const& painter, PatternLayout const& layout, qreal dpr);
+
+    //
+    // Requests a render of the given tile, tileRendered is emitted when done.
+    //
+    void render(Tile tile);
+
+signals:
+
+    void tileRendered(PatternTileRenderer::Tile const& tile);
+
+private:
+
+    Q_DISABLE_COPY(PatternTileRenderer)
+
+    // worker thread
+    void renderTile(Tile &tile);
+
+    QThread mThread;
+    // context of the jobs run on the worker thread
+    QObject mWorker;
+
+    // incremented by setStyle
+    std::atomic<uint64_t> mStyle;
+
+    // worker thread only, set by the job posted by setStyle. The painter
+    // uses image atlases when threaded
+    std::unique_ptr<PatternPainter> mPainter;
+    PatternLayout mLayout;
+    qreal mDpr;
+
+};
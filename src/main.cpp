@@ -1,5 +1,6 @@
 
 #include "forms/MainWindow.hpp"
+#include "export/BatchExporter.hpp"
 
 #include <QApplication>
 #include <QCommandLineParser>
@@ -52,6 +53,9 @@ static std::string demangle(const char* name) {
 
 constexpr int EXIT_BAD_ARGUMENTS = -1;
 constexpr int EXIT_BAD_ALLOC = 1;
+constexpr int EXIT_EXPORT_FAILED = 2;
+
+#define main_tr(str) QCoreApplication::translate("main", str)
 
 //
 // Singleton class for a custom Qt message handler. This message handler wraps
@@ -126,9 +130,174 @@ public:
 };
 
 
+static void setupApplication() {
+    QCoreApplication::setOrganizationName("Trackerboy");
+    QCoreApplication::setApplicationName("Trackerboy");
+    QCoreApplication::setApplicationVersion(VERSION_STR);
+    // use INI on all systems, much easier to edit by hand
+    QSettings::setDefaultFormat(QSettings::IniFormat);
+}
+
+static int badArguments(QCommandLineParser const& parser, char const* msg) {
+    fputs(msg, stderr);
+    fputc('\n', stderr);
+    fputs(qPrintable(parser.helpText()), stderr);
+    return EXIT_BAD_ARGUMENTS;
+}
+
+//
+// Headless export (--export). Every song of each module given, or just the
+// one selected with --song, is rendered to a wav file. No window is created,
+// only a QCoreApplication for the exporters' event loop.
+//
+static int exportMain(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+    setupApplication();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(main_tr("Game Boy music tracker - headless wav export"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption exportOption(
+        QStringLiteral("export"),
+        main_tr("Export the given modules to wav files without opening the GUI")
+    );
+    QCommandLineOption outputOption(
+        { QStringLiteral("o"), QStringLiteral("output") },
+        main_tr("Directory to write the exported files to"),
+        main_tr("dir"),
+        QStringLiteral(".")
+    );
+    QCommandLineOption songOption(
+        QStringLiteral("song"),
+        main_tr("Only export the song with the given index (default: all songs)"),
+        main_tr("index")
+    );
+    QCommandLineOption loopsOption(
+        QStringLiteral("loops"),
+        main_tr("Number of times to play each song (default: 1)"),
+        main_tr("count"),
+        QStringLiteral("1")
+    );
+    QCommandLineOption secondsOption(
+        QStringLiteral("seconds"),
+        main_tr("Play each song for the given number of seconds instead of looping"),
+        main_tr("seconds")
+    );
+    QCommandLineOption formatOption(
+        QStringLiteral("format"),
+        main_tr("Format of the exported files: wav (32-bit float), wav16, wav24, flac or flac24 (default: wav)"),
+        main_tr("format"),
+        QStringLiteral("wav")
+    );
+    QCommandLineOption samplerateOption(
+        QStringLiteral("samplerate"),
+        main_tr("Samplerate of the exported files (default: 44100)"),
+        main_tr("rate"),
+        QStringLiteral("44100")
+    );
+    parser.addOptions({
+        exportOption,
+        outputOption,
+        songOption,
+        loopsOption,
+        secondsOption,
+        formatOption,
+        samplerateOption
+    });
+    parser.addPositionalArgument("module_files", main_tr("The module files to export"), "module_files...");
+
+    parser.process(app);
+
+    auto const modules = parser.positionalArguments();
+    if (modules.isEmpty()) {
+        return badArguments(parser, "no module files given");
+    }
+
+    BatchExporter exporter;
+    exporter.setDestination(parser.value(outputOption));
+
+    bool ok;
+    if (parser.isSet(songOption)) {
+        auto const song = parser.value(songOption).toInt(&ok);
+        if (!ok || song < 0) {
+            return badArguments(parser, "invalid song index");
+        }
+        exporter.setSong(song);
+    }
+
+    if (parser.isSet(secondsOption)) {
+        auto const seconds = parser.value(secondsOption).toInt(&ok);
+        if (!ok || seconds <= 0) {
+            return badArguments(parser, "invalid number of seconds");
+        }
+        exporter.setDuration(std::chrono::seconds(seconds));
+    } else {
+        auto const loops = parser.value(loopsOption).toInt(&ok);
+        if (!ok || loops <= 0) {
+            return badArguments(parser, "invalid loop count");
+        }
+        exporter.setDuration(loops);
+    }
+
+    {
+        auto const format = parser.value(formatOption);
+        if (format == QLatin1String("wav")) {
+            exporter.setFormat(Encoder::Format::wavFloat);
+        } else if (format == QLatin1String("wav16")) {
+            exporter.setFormat(Encoder::Format::wav16);
+        } else if (format == QLatin1String("wav24")) {
+            exporter.setFormat(Encoder::Format::wav24);
+        } else if (format == QLatin1String("flac")) {
+            exporter.setFormat(Encoder::Format::flac16);
+        } else if (format == QLatin1String("flac24")) {
+            exporter.setFormat(Encoder::Format::flac24);
+        } else {
+            return badArguments(parser, "invalid format");
+        }
+    }
+
+    auto const samplerate = parser.value(samplerateOption).toInt(&ok);
+    if (!ok || samplerate <= 0) {
+        return badArguments(parser, "invalid samplerate");
+    }
+    exporter.setSamplerate(samplerate);
+
+    int failures = 0;
+    for (auto const& filename : modules) {
+        if (!exporter.addModule(filename)) {
+            fprintf(stderr, "%s: could not open module\n", qPrintable(filename));
+            ++failures;
+        }
+    }
+
+    QObject::connect(&exporter, &BatchExporter::finished, &app,
+        [&failures](int exportFailures) {
+            failures += exportFailures;
+            QCoreApplication::exit(failures ? EXIT_EXPORT_FAILED : 0);
+        });
+    exporter.start();
+
+    try {
+        return app.exec();
+    } catch (const std::bad_alloc &) {
+        qCritical() << "out of memory";
+        return EXIT_BAD_ALLOC;
+    }
+}
+
 
 int main(int argc, char *argv[]) {
 
+    // headless mode, must be checked before the QApplication is created
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--export") == 0) {
+            return exportMain(argc, argv);
+        }
+    }
+
     int code;
 
     #ifndef QT_NO_INFO_OUTPUT
@@ -137,19 +306,17 @@ int main(int argc, char *argv[]) {
     #endif
 
     Application app(argc, argv);
-    QCoreApplication::setOrganizationName("Trackerboy");
-    QCoreApplication::setApplicationName("Trackerboy");
-    QCoreApplication::setApplicationVersion(VERSION_STR);
-    // use INI on all systems, much easier to edit by hand
-    QSettings::setDefaultFormat(QSettings::IniFormat);
-
-#define main_tr(str) QCoreApplication::translate("main", str)
+    setupApplication();
 
     QCommandLineParser parser;
     parser.setApplicationDescription(main_tr("Game Boy music tracker"));
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addPositionalArgument("[module_file]", main_tr("(Optional) the module file to open"));
+    parser.addOption({
+        QStringLiteral("export"),
+        main_tr("Export modules to wav files without opening the GUI, see --export --help")
+    });
 
     parser.process(app);
 
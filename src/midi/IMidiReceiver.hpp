@@ -9,9 +9,16 @@ class IMidiReceiver {
 
 public:
 
-    virtual void midiNoteOn(int note) = 0;
-
-    virtual void midiNoteOff() = 0;
+    //
+    // A note was pressed. note is the trackerboy note, velocity is 1-127 and
+    // channel is the MIDI channel (0-15). Several notes may be held at once.
+    //
+    virtual void midiNoteOn(int note, int velocity, int channel) = 0;
+
+    //
+    // A note that was pressed has been released.
+    //
+    virtual void midiNoteOff(int note, int channel) = 0;
 
 protected:
     IMidiReceiver() = default;
@@ -15,6 +15,9 @@ namespace TU {
 
 constexpr auto LOG_PREFIX = "[Midi]";
 
+// timestamps further behind the clock than this are assumed to be wrong
+constexpr auto MAX_DELAY = std::chrono::milliseconds(50);
+
 static void logError(const char* str) {
     qCritical() << LOG_PREFIX << str;
 }
@@ -25,51 +28,21 @@ static void logError(const char* str, RtMidiError const& err) {
 }
 
 //
-// Custom event for a MIDI input message
+// Event posted to wake up the GUI thread when there are messages in the
+// queue. Since it is only used internally by the Midi class, just use the
+// first User event id.
 //
-class MidiEvent : public QEvent {
-
-public:
-
-    enum Message {
-        NoteOn,
-        NoteOff
-    };
+constexpr auto MESSAGE_EVENT = QEvent::User;
 
-    explicit MidiEvent(Message msg, int note = -1) :
-        QEvent(getType()),
-        mMessage(msg),
-        mNote(note)
-    {
-
-    }
-
-    //
-    // Get the type of the message that was received
-    //
-    Message message() const {
-        return mMessage;
-    }
-
-    //
-    // Get the note pressed if the message type was NoteOn
-    //
-    int note() const {
-        return mNote;
-    }
-
-    static constexpr Type getType() {
-        // since this event is only used internally by the Midi class, just
-        // use the first User event id. 
-        return QEvent::User;
-    }
-
-private:
-    Message const mMessage;
-    int const mNote;
-
-
-};
+//
+// Gets the trackerboy note for the given MIDI key, keys outside of the
+// tracker's range are clamped.
+//
+int keyToNote(int key) {
+    // 69 is A-4
+    // 36 is C-2
+    return std::clamp(key - 36, 0, (int)trackerboy::NOTE_LAST);
+}
 
 }
 
@@ -77,10 +50,15 @@ private:
 Midi::Midi(QObject *parent) :
     QObject(parent),
     mReceiver(nullptr),
-    mNoteDown(false),
+    mReceiverNotes(),
     mMidiIn(),
-    mMutex(),
-    mLastNotePitch(-1)
+    mNoteCallback(nullptr),
+    mNoteCallbackData(nullptr),
+    mLastMessageTime(),
+    mHeldKeys(),
+    mMessages(),
+    mWakeupPending(false),
+    mMutex()
 {
 }
 
@@ -106,6 +84,45 @@ void Midi::close() {
             TU::logError("could not close port:", err);
             return;
         }
+        releaseAll();
+    }
+}
+
+void Midi::releaseAll() {
+    // the input thread is no longer running, we can act as it
+    for (int channel = 0; channel < CHANNELS; ++channel) {
+        auto &held = mHeldKeys[channel];
+        for (int key = 0; held.any() && key < KEYS; ++key) {
+            if (held.test(key)) {
+                held.reset(key);
+                if (mNoteCallback) {
+                    mNoteCallback(mNoteCallbackData, channel * KEYS + key, TU::keyToNote(key), 0, std::chrono::steady_clock::now());
+                }
+            }
+        }
+    }
+
+    Message msg;
+    while (mMessages.pop(msg)) {
+        dispatch(msg);
+    }
+    mWakeupPending = false;
+
+    // anything still held by the receiver is released
+    releaseReceiverNotes();
+}
+
+void Midi::releaseReceiverNotes() {
+    for (int channel = 0; channel < CHANNELS; ++channel) {
+        auto &notes = mReceiverNotes[channel];
+        for (int key = 0; notes.any() && key < KEYS; ++key) {
+            if (notes.test(key)) {
+                notes.reset(key);
+                if (mReceiver) {
+                    mReceiver->midiNoteOff(TU::keyToNote(key), channel);
+                }
+            }
+        }
     }
 }
 
@@ -144,7 +161,7 @@ bool Midi::open(MidiEnumerator::Device const& device) {
         }
 
 
-        mLastNotePitch = -1;
+        mLastMessageTime = {};
         // setup callbacks and open the port
         mMidiIn->setCallback(midiInCallback, this);
         mMidiIn->openPort(port);
@@ -163,38 +180,49 @@ void Midi::setReceiver(IMidiReceiver *receiver) {
 
     if (mReceiver != receiver) {
         // change the receiver
-        if (mNoteDown && mReceiver) {
-            // force the note off
-            // if we don't do this, the previous receiver won't get the next noteOff message
-            // and the note will be held indefinitely
-            mReceiver->midiNoteOff();
-            mNoteDown = false;
-        }
+        // force the notes off
+        // if we don't do this, the previous receiver won't get the next noteOff message
+        // and the notes will be held indefinitely
+        releaseReceiverNotes();
         mReceiver = receiver;
 
     }
 }
 
+IMidiReceiver* Midi::receiver() const {
+    return mReceiver;
+}
+
+void Midi::setNoteCallback(NoteCallback callback, void *userData) {
+    Q_ASSERT(!isOpen());
+    mNoteCallback = callback;
+    mNoteCallbackData = userData;
+}
+
 void Midi::customEvent(QEvent *evt) {
-    if (evt->type() == TU::MidiEvent::getType()) {
-        auto midiEvt = static_cast<TU::MidiEvent*>(evt);
-        switch (midiEvt->message()) {
-            case TU::MidiEvent::NoteOff:
-                if (mReceiver) {
-                    mReceiver->midiNoteOff();
-                    mNoteDown = false;
-                }
-                break;
-            case TU::MidiEvent::NoteOn:
-                if (mReceiver) {
-                    mReceiver->midiNoteOn(midiEvt->note());
-                    mNoteDown = true;
-                }
-                break;
-            default:
-                break;
+    if (evt->type() == TU::MESSAGE_EVENT) {
+        // cleared before draining, a message pushed from now on posts a new
+        // event
+        mWakeupPending = false;
+        Message msg;
+        while (mMessages.pop(msg)) {
+            dispatch(msg);
         }
+    }
+}
+
+void Midi::dispatch(Message const& msg) {
+    if (mReceiver == nullptr) {
+        return;
+    }
 
+    auto &notes = mReceiverNotes[msg.channel];
+    if (msg.velocity) {
+        notes.set(msg.key);
+        mReceiver->midiNoteOn(msg.note, msg.velocity, msg.channel);
+    } else if (notes.test(msg.key)) {
+        notes.reset(msg.key);
+        mReceiver->midiNoteOff(msg.note, msg.channel);
     }
 }
 
@@ -233,37 +261,69 @@ void Midi::midiInCallback(double deltatime, std::vector<unsigned char> *message,
     static_cast<Midi*>(userdata)->handleMidiIn(deltatime, *message);
 }
 
+std::chrono::steady_clock::time_point Midi::timestamp(double deltatime) {
+    // deltatime is the time since the previous message, as measured by the
+    // backend. Accumulating it keeps the spacing of messages that were
+    // delivered together, the time is reset to the arrival time when it is
+    // ahead of the clock or too far behind it (first message, dropped
+    // messages).
+    auto const now = std::chrono::steady_clock::now();
+    auto time = mLastMessageTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(deltatime)
+    );
+    if (time > now || now - time > TU::MAX_DELAY) {
+        time = now;
+    }
+    mLastMessageTime = time;
+    return time;
+}
+
 void Midi::handleMidiIn(double deltatime, std::vector<unsigned char> &message) {
-    Q_UNUSED(deltatime)
 
-    auto const msgSize = message.size();
-    if (msgSize == 0) {
-        return; // shouldn't happen but just in case do nothing
+    auto const time = timestamp(deltatime);
+
+    // note messages should be three bytes
+    if (message.size() != 3) {
+        return;
     }
-    
+
     auto const status = message[0];
+    auto const channel = status & 0x0F;
+    auto const key = message[1] & 0x7F;
+    int velocity = message[2] & 0x7F;
+    bool on;
     switch (status & 0xF0) {
-        case MidiNoteOff:
-            // message should be three bytes
-            if (msgSize == 3) {
-                if (mLastNotePitch == (int)message[1]) {
-                    mLastNotePitch = -1;
-                    QCoreApplication::postEvent(this, new TU::MidiEvent(TU::MidiEvent::NoteOff), Qt::HighEventPriority);
-                }
-            }
-            break;
         case MidiNoteOn:
-            // message should be three bytes
-            if (msgSize == 3) {
-                mLastNotePitch = (int)message[1];
-                // 69 is A-4
-                // 36 is C-2
-                int trackerboyNote = std::clamp((int)message[1] - 36, 0, (int)trackerboy::NOTE_LAST);
-                QCoreApplication::postEvent(this, new TU::MidiEvent(TU::MidiEvent::NoteOn, trackerboyNote), Qt::HighEventPriority);
-            }
+            // a note on with a velocity of 0 is a note off
+            on = velocity != 0;
+            break;
+        case MidiNoteOff:
+            on = false;
             break;
         default:
-            break; // ignore everything else
+            return; // ignore everything else
+    }
+
+    auto &held = mHeldKeys[channel];
+    if (on) {
+        held.set(key);
+    } else {
+        if (!held.test(key)) {
+            return; // not held, ignore
+        }
+        held.reset(key);
+        velocity = 0;
+    }
+
+    int const trackerboyNote = TU::keyToNote(key);
+    if (mNoteCallback) {
+        mNoteCallback(mNoteCallbackData, channel * KEYS + key, trackerboyNote, velocity, time);
+    }
+
+    // if the queue is full the GUI thread is behind, it still gets woken up
+    // by the event that was already posted
+    if (mMessages.push(Message{ key, trackerboyNote, velocity, channel }) && !mWakeupPending.exchange(true)) {
+        QCoreApplication::postEvent(this, new QEvent(TU::MESSAGE_EVENT), Qt::HighEventPriority);
     }
 
 }
@@ -3,19 +3,33 @@
 
 #include "midi/MidiEnumerator.hpp"
 #include "midi/IMidiReceiver.hpp"
+#include "utils/SpscQueue.hpp"
 
 #include "RtMidi.h"
 
 #include <QMutex>
 #include <QObject>
 
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
 #include <optional>
 #include <vector>
 
 
 //
 // Midi class. Notifies an IMidiReceiver whenever a MIDI note message
-// is received.
+// is received. Notes are polyphonic, the held keys of each MIDI channel are
+// tracked so that only the release of a held key is a note off.
+//
+// Messages are passed from the MIDI input thread to the GUI thread through
+// a bounded lock-free queue. Only one event is posted to wake up the GUI
+// thread per batch of messages, nothing is allocated per message.
+//
+// Notes are also passed to a callback directly from the MIDI input thread,
+// with the time the message was received, for sounding them without going
+// through the GUI thread.
 //
 class Midi : public QObject {
 
@@ -23,6 +37,13 @@ class Midi : public QObject {
 
 public:
 
+    //
+    // Callback for a note on/off message, called from the MIDI input thread.
+    // key identifies the note (channel * 128 + MIDI key number), note is the
+    // trackerboy note and velocity is 0 for note off.
+    //
+    using NoteCallback = void (*)(void *userData, int key, int note, int velocity, std::chrono::steady_clock::time_point time);
+
     explicit Midi(QObject *parent = nullptr);
 
     //
@@ -51,6 +72,14 @@ public:
     //
     void setReceiver(IMidiReceiver *receiver);
 
+    IMidiReceiver* receiver() const;
+
+    //
+    // Sets the callback for note messages. Must be set while no port is
+    // open.
+    //
+    void setNoteCallback(NoteCallback callback, void *userData);
+
     
 signals:
     //
@@ -65,8 +94,34 @@ protected:
 private:
     Q_DISABLE_COPY(Midi)
 
+    static constexpr int CHANNELS = 16;
+    static constexpr int KEYS = 128;
+
+    //
+    // A note message for the GUI thread
+    //
+    struct Message {
+        // MIDI key number, 0-127
+        int key;
+        int note;
+        // 0 for note off
+        int velocity;
+        int channel;
+    };
+
+    // releases all held notes, the port must be closed
+    void releaseAll();
+
+    // sends a note off to the receiver for each note it was sent
+    void releaseReceiverNotes();
+
+    // sends the given message to the receiver
+    void dispatch(Message const& msg);
+
     IMidiReceiver *mReceiver;
-    bool mNoteDown;
+    // notes that the receiver has been notified of, by MIDI key. Several
+    // keys clamp to the same trackerboy note, so that is not unique
+    std::array<std::bitset<KEYS>, CHANNELS> mReceiverNotes;
 
     // callback functions
     // note that these functions are called from a separate thread
@@ -74,21 +129,33 @@ private:
     static void midiInCallback(double deltatime, std::vector<unsigned char> *message, void *userData);
     void handleMidiIn(double deltatime, std::vector<unsigned char> &message);
 
+    // estimates when a message was received from its deltatime
+    std::chrono::steady_clock::time_point timestamp(double deltatime);
+
     static void midiErrorCallback(RtMidiError::Type type, const std::string &errorText, void *userData);
     void handleMidiError(RtMidiError::Type type, const std::string &errorText);
 
     std::optional<RtMidiIn> mMidiIn;
 
+    NoteCallback mNoteCallback;
+    void *mNoteCallbackData;
+    // MIDI input thread only (or the GUI thread while closed) ---
+    // time of the last message
+    std::chrono::steady_clock::time_point mLastMessageTime;
+    // keys being held, by MIDI key number
+    std::array<std::bitset<KEYS>, CHANNELS> mHeldKeys;
+
+    SpscQueue<Message, 256> mMessages;
+    // set when an event has been posted and the GUI thread has not yet
+    // drained the queue
+    std::atomic_bool mWakeupPending;
+
     QMutex mMutex;
     // start of mutex requirement
     // mutex is required since these variables are modified from
     // the callback functions, which are called from an RtMidi managed thread
     QString mLastErrorString;
 
-    // MIDI pitch of the last note on message, we only send the noteOff signal
-    // when we get a note off message with this pitch
-    int mLastNotePitch;
-
     // end of mutex requirement
 
 
@@ -10,6 +10,7 @@
 #include <QtDebug>
 
 #include <algorithm>
+#include <cstdlib>
 #include <memory>
 
 #define TU PatternModelTU
@@ -75,6 +76,18 @@ trackerboy::Pattern* PatternModel::nextPattern() {
     return mPatternNext ? &*mPatternNext : nullptr;
 }
 
+trackerboy::Pattern const* PatternModel::previousPattern() const {
+    return mPatternPrev ? &*mPatternPrev : nullptr;
+}
+
+trackerboy::Pattern const& PatternModel::currentPattern() const {
+    return mPatternCurr;
+}
+
+trackerboy::Pattern const* PatternModel::nextPattern() const {
+    return mPatternNext ? &*mPatternNext : nullptr;
+}
+
 trackerboy::Order& PatternModel::order() {
     return source()->order();
 }
@@ -292,7 +305,7 @@ void PatternModel::setCursorRowImpl(int row, CursorChangeFlags &flags) {
             } else {
                 prevPattern = mCursorPattern - 1;
             }
-            setCursorPatternImpl(prevPattern, flags);
+            setCursorPatternImpl(prevPattern, flags, true);
             newRow = std::max(0, (int)mPatternCurr.totalRows() + row);
         } else {
             newRow = 0;
@@ -305,7 +318,7 @@ void PatternModel::setCursorRowImpl(int row, CursorChangeFlags &flags) {
             if (nextPattern == patterns()) {
                 nextPattern = 0;
             }
-            setCursorPatternImpl(nextPattern, flags);
+            setCursorPatternImpl(nextPattern, flags, true);
             newRow = std::min((int)mPatternCurr.totalRows() - 1, row);
         } else {
             newRow = mPatternCurr.totalRows() - 1;
@@ -417,13 +430,18 @@ void PatternModel::setCursorPattern(int pattern) {
     emitIfChanged(flags);
 }
 
-void PatternModel::setCursorPatternImpl(int pattern, CursorChangeFlags &flags) {
+void PatternModel::setCursorPatternImpl(int pattern, CursorChangeFlags &flags, bool adjacent) {
     if (mCursorPattern == pattern) {
         return;
     }
 
+    auto const previous = mCursorPattern;
     mCursorPattern = pattern;
-    setPatterns(pattern, flags);
+    if (adjacent && previous >= 0 && std::abs(pattern - previous) == 1) {
+        shiftPatterns(pattern, pattern > previous, flags);
+    } else {
+        setPatterns(pattern, flags);
+    }
     emit cursorPatternChanged(pattern);
     deselect();
 }
@@ -443,7 +461,7 @@ void PatternModel::setTrackerCursor(int row, int pattern) {
     if (changed) {
         if (mFollowing) {
             CursorChangeFlags flags = CursorUnchanged;
-            setCursorPatternImpl(pattern, flags);
+            setCursorPatternImpl(pattern, flags, true);
             setCursorRowImpl(row, flags);
             emitIfChanged(flags);
         }
@@ -505,6 +523,41 @@ void PatternModel::setPatterns(int pattern, CursorChangeFlags &flags) {
     // update the current pattern
     auto oldsize = mPatternCurr.totalRows();
     mPatternCurr = song->getPattern(pattern);
+    currentPatternChanged(oldsize, flags);
+}
+
+void PatternModel::shiftPatterns(int pattern, bool forward, CursorChangeFlags &flags) {
+    // the pattern moving into the current one is only held with previews
+    // enabled
+    auto &incoming = forward ? mPatternNext : mPatternPrev;
+    if (!incoming) {
+        setPatterns(pattern, flags);
+        return;
+    }
+
+    auto song = source();
+    auto oldsize = mPatternCurr.totalRows();
+    if (forward) {
+        mPatternPrev.emplace(mPatternCurr);
+        mPatternCurr = *mPatternNext;
+        if (pattern + 1 < patterns()) {
+            mPatternNext.emplace(song->getPattern(pattern + 1));
+        } else {
+            mPatternNext.reset();
+        }
+    } else {
+        mPatternNext.emplace(mPatternCurr);
+        mPatternCurr = *mPatternPrev;
+        if (pattern > 0) {
+            mPatternPrev.emplace(song->getPattern(pattern - 1));
+        } else {
+            mPatternPrev.reset();
+        }
+    }
+    currentPatternChanged(oldsize, flags);
+}
+
+void PatternModel::currentPatternChanged(int oldsize, CursorChangeFlags &flags) {
     auto newsize = mPatternCurr.totalRows();
 
     if (oldsize != newsize) {
@@ -546,14 +599,16 @@ int PatternModel::cursorEffectNo() {
     return (mCursor.column - PatternCursor::ColumnEffect1Type) / 3;
 }
 
+bool PatternModel::isAccessible(int pattern) const {
+    return (mCursorPattern == pattern) ||
+           (mPatternPrev && pattern == mCursorPattern - 1) ||
+           (mPatternNext && pattern == mCursorPattern + 1);
+}
+
 void PatternModel::invalidate(int pattern, bool updatePatterns) {
 
     // check if the pattern being invalidated is accessible
-    bool isInvalid = (mCursorPattern == pattern) ||
-                     (mPatternPrev && pattern == mCursorPattern - 1) ||
-                     (mPatternNext && pattern == mCursorPattern + 1);
-
-    if (isInvalid) {
+    if (isAccessible(pattern)) {
         // pattern is now invalid, either reset the pattern accessors
         // or send the invalidated signal
         if (updatePatterns) {
@@ -569,6 +624,32 @@ void PatternModel::invalidate(int pattern, bool updatePatterns) {
 
 }
 
+void PatternModel::invalidate(int pattern, PatternSelection const& region) {
+    // a track can be used by more than one pattern in the order, so any held
+    // pattern sharing one of the edited tracks has changed in the same region
+    auto const& order = this->order();
+    auto const edited = order[pattern];
+    auto const iter = region.iterator();
+    auto sharesTrack = [&](int held) {
+        if (held == pattern) {
+            return true;
+        }
+        auto const row = order[held];
+        for (auto track = iter.trackStart(); track <= iter.trackEnd(); ++track) {
+            if (row[track] == edited[track]) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (auto held : { mCursorPattern - 1, mCursorPattern, mCursorPattern + 1 }) {
+        if (isAccessible(held) && sharesTrack(held)) {
+            emit dataChanged(held, region);
+        }
+    }
+}
+
 bool PatternModel::selectionDataIsEmpty() {
     if (mHasSelection) {
         auto iter = mSelection.iterator();
@@ -54,6 +54,12 @@ public:
 
     trackerboy::Pattern* nextPattern();
 
+    trackerboy::Pattern const* previousPattern() const;
+
+    trackerboy::Pattern const& currentPattern() const;
+
+    trackerboy::Pattern const* nextPattern() const;
+
     trackerboy::Order& order();
     trackerboy::Order const& order() const;
 
@@ -259,6 +265,14 @@ signals:
     //
     void invalidated();
 
+    //
+    // emitted when data in the given region of a pattern has changed, without
+    // changing the size of any pattern. Only the pattern's rows in the region
+    // need to be redrawn. The pattern is the current one or one of its
+    // previews.
+    //
+    void dataChanged(int pattern, PatternSelection region);
+
     void effectsVisibleChanged();
 
     void totalColumnsChanged(int columns);
@@ -289,11 +303,26 @@ private:
     void setCursorRowImpl(int row, CursorChangeFlags &flags);
     void setCursorColumnImpl(int col, CursorChangeFlags &flags);
     void setCursorTrackImpl(int track, CursorChangeFlags &flags);
-    void setCursorPatternImpl(int pattern, CursorChangeFlags &flags);
+    //
+    // When adjacent is true, the pattern is next to the current one and the
+    // order has not changed since the patterns were last set, so the ones
+    // already held are reused (see shiftPatterns).
+    //
+    void setCursorPatternImpl(int pattern, CursorChangeFlags &flags, bool adjacent = false);
 
     void setPatterns(int pattern, CursorChangeFlags &flags);
     void setPreviewPatterns(int pattern);
 
+    //
+    // Moves the previous, current and next patterns by one, so that only the
+    // pattern coming into view is looked up in the song. Scrolling through
+    // the orders does not refetch patterns that are already held.
+    //
+    void shiftPatterns(int pattern, bool forward, CursorChangeFlags &flags);
+
+    // emits the signals for a new current pattern
+    void currentPatternChanged(int oldsize, CursorChangeFlags &flags);
+
     void emitIfChanged(CursorChangeFlags flags);
 
     int cursorEffectNo();
@@ -310,6 +339,16 @@ private:
 
     void invalidate(int pattern, bool updatePatterns);
 
+    //
+    // Same as invalidate(pattern, false), for an edit that only changed the
+    // data in the given region. The region is also emitted for the held
+    // previews that share one of the edited tracks.
+    //
+    void invalidate(int pattern, PatternSelection const& region);
+
+    // determines if the given pattern is the current one or one of its previews
+    bool isAccessible(int pattern) const;
+
     bool selectionDataIsEmpty();
 
     // called by insert, remove and duplicate commands
@@ -331,6 +370,8 @@ private:
     int mTrackerRow;
     int mTrackerPattern;
 
+    // views of the song's tracks for the patterns around the cursor, copying
+    // them does not copy any track data
     std::optional<trackerboy::Pattern> mPatternPrev;
     trackerboy::Pattern mPatternCurr;
     std::optional<trackerboy::Pattern> mPatternNext;
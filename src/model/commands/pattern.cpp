@@ -17,7 +17,11 @@ void SelectionCmd::restore(bool update) {
         mClip.restore(pattern);
     }
 
-    mModel.invalidate(mPattern, update);
+    if (update) {
+        mModel.invalidate(mPattern, true);
+    } else {
+        mModel.invalidate(mPattern, mClip.selection());
+    }
 }
 
 EraseCmd::EraseCmd(PatternModel &model) :
@@ -193,7 +197,7 @@ void ReplaceInstrumentCmd::redo() {
         }
     }
 
-    mModel.invalidate(mPattern, false);
+    mModel.invalidate(mPattern, mClip.selection());
 }
 
 void ReplaceInstrumentCmd::undo() {
@@ -246,7 +250,15 @@ void TrackEditCmd::setData(uint8_t data) {
         update = edit(rowdata, data);
     }
 
-    mModel.invalidate(mPattern, update);
+    if (update) {
+        mModel.invalidate(mPattern, true);
+    } else {
+        // only the edited track row needs to be redrawn
+        mModel.invalidate(mPattern, PatternSelection(
+            PatternAnchor(mRow, PatternAnchor::SelectNote, mTrack),
+            PatternAnchor(mRow, PatternAnchor::SelectEffect3, mTrack)
+        ));
+    }
 
 }
 
@@ -318,7 +330,7 @@ void TransposeCmd::redo()  {
         }
     }
 
-    mModel.invalidate(mPattern, false);
+    mModel.invalidate(mPattern, mClip.selection());
 }
 
 void TransposeCmd::undo() {
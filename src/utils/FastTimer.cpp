@@ -1,98 +1,332 @@
 
 #include "utils/FastTimer.hpp"
-#include "utils/utils.hpp"
 
-#include <QMutexLocker>
-#include <QTimerEvent>
-#include <QThread>
+#include <QtGlobal>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <ctime>
+#endif
+
+#if defined(Q_OS_UNIX)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(Q_OS_WIN)
+#include <Windows.h>
+#include <timeapi.h>
+
+#include <algorithm>
+
+// requires Windows 10 1803, may be missing from older SDKs
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
 
 #define TU FastTimerTU
 namespace TU {
 
-constexpr auto NO_TIMER = -1;
+using Clock = std::chrono::steady_clock;
+
+//
+// Sleeps the timer thread until a deadline. Owned by the timer thread for as
+// long as it runs, as some platforms need setup for precise sleeps.
+//
+class Sleeper {
+
+public:
+
+#if defined(Q_OS_LINUX)
+
+    Sleeper() = default;
+
+    // steady_clock is CLOCK_MONOTONIC with libstdc++ and libc++ on Linux, so
+    // the deadline can be given to clock_nanosleep directly
+    void sleepUntil(Clock::time_point deadline) {
+        auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        timespec ts;
+        ts.tv_sec = (time_t)(ns / 1000000000);
+        ts.tv_nsec = (long)(ns % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+    }
+
+#elif defined(Q_OS_WIN)
+
+    // Sleep and regular waitable timers have the resolution of the system
+    // timer, 15.6 ms by default, which is longer than a period. Use a high
+    // resolution waitable timer when available, otherwise raise the system
+    // timer resolution to 1 ms while the timer runs.
+    Sleeper() :
+        mTimer(CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS)),
+        mPeriodSet(false)
+    {
+        if (mTimer == nullptr) {
+            mPeriodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+            mTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        }
+    }
+
+    ~Sleeper() {
+        if (mTimer) {
+            CloseHandle(mTimer);
+        }
+        if (mPeriodSet) {
+            timeEndPeriod(1);
+        }
+    }
+
+    void sleepUntil(Clock::time_point deadline) {
+        auto const remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+        if (remaining <= 0) {
+            return;
+        }
+        if (mTimer) {
+            // negative due time is relative, in 100 ns units
+            LARGE_INTEGER due;
+            due.QuadPart = -std::max<LONGLONG>(remaining / 100, 1);
+            if (SetWaitableTimer(mTimer, &due, 0, nullptr, nullptr, FALSE)) {
+                WaitForSingleObject(mTimer, INFINITE);
+                return;
+            }
+        }
+        std::this_thread::sleep_until(deadline);
+    }
+
+private:
+    Q_DISABLE_COPY(Sleeper)
+
+    HANDLE mTimer;
+    bool mPeriodSet;
+
+#else
+
+    Sleeper() = default;
+
+    void sleepUntil(Clock::time_point deadline) {
+        std::this_thread::sleep_until(deadline);
+    }
+
+#endif
+
+};
+
+//
+// Attempts to give the calling thread real-time priority, returns true on
+// success.
+//
+bool setRealtimePriority() {
+    #if defined(Q_OS_UNIX)
+    sched_param param{};
+    // a low real-time priority is enough to preempt normal threads, while
+    // staying below the audio server/device threads
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    #elif defined(Q_OS_WIN)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+    #else
+    return false;
+    #endif
+}
+
+//
+// Returns the calling thread to normal priority
+//
+void setNormalPriority() {
+    #if defined(Q_OS_UNIX)
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    #elif defined(Q_OS_WIN)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+    #endif
+}
 
 }
 
-FastTimer::FastTimer(QObject *parent) :
-    QObject(parent),
+FastTimer::FastTimer() :
+    mMutex(),
+    mCondition(),
     mCallback(nullptr),
     mCallbackData(nullptr),
-    mInterval(0),
-    mTimerType(Qt::CoarseTimer),
-    mTimerId(TU::NO_TIMER)
+    mPeriod(std::chrono::milliseconds(5)),
+    mRealtimeRequested(false),
+    mThread(),
+    mRunning(false),
+    mActive(false),
+    mQuit(false),
+    mTicks(0),
+    mMissed(0),
+    mLastLateness(0),
+    mTotalLateness(0),
+    mMaxLateness(0),
+    mRealtime(false)
 {
 }
 
+FastTimer::~FastTimer() {
+    {
+        std::unique_lock lock(mMutex);
+        _stop(lock);
+        mQuit = true;
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
 void FastTimer::setCallback(CallbackFn function, void *data) {
-    QMutexLocker locker(&mMutex);
+    std::unique_lock lock(mMutex);
+    bool const running = mRunning;
+    _stop(lock);
     mCallback = function;
     mCallbackData = data;
+    if (running) {
+        _start(lock);
+    }
 }
 
-void FastTimer::setInterval(int ms, Qt::TimerType type) {
-    mMutex.lock();
-    bool changed = false;
-    if (mInterval != ms) {
-        mInterval = ms;
-        changed = true;
-    }
-    if (mTimerType != type) {
-        mTimerType = type;
-        changed = true;
+void FastTimer::setInterval(std::chrono::nanoseconds period) {
+    std::unique_lock lock(mMutex);
+    if (mPeriod != period) {
+        mPeriod = period;
+        if (mRunning) {
+            // restart the timer with the new interval
+            _stop(lock);
+            _start(lock);
+        }
     }
-    auto timerId = mTimerId;
-    mMutex.unlock();
+}
 
-    if (changed && timerId != TU::NO_TIMER) {
-        // restart the timer with the new interval
-        start();
-    }
+void FastTimer::setRealtime(bool realtime) {
+    mRealtimeRequested = realtime;
 }
 
-void FastTimer::timerEvent(QTimerEvent *evt) {
-    mMutex.lock();
-    auto const timerId = mTimerId;
-    auto const callback = mCallback;
-    auto const data = mCallbackData;
-    mMutex.unlock();
+void FastTimer::start() {
+    std::unique_lock lock(mMutex);
+    _stop(lock);
+    _start(lock);
+}
 
+void FastTimer::stop() {
+    std::unique_lock lock(mMutex);
+    _stop(lock);
+}
 
-    if (evt->timerId() == timerId && callback) {
-        callback(data);
-    }
+bool FastTimer::isRunning() const {
+    std::lock_guard lock(mMutex);
+    return mRunning;
+}
 
+FastTimer::Drift FastTimer::drift() const {
+    auto const ticks = mTicks.load(std::memory_order_relaxed);
+    return {
+        ticks,
+        mMissed.load(std::memory_order_relaxed),
+        std::chrono::nanoseconds(mLastLateness.load(std::memory_order_relaxed)),
+        std::chrono::nanoseconds(ticks ? mTotalLateness.load(std::memory_order_relaxed) / (int64_t)ticks : 0),
+        std::chrono::nanoseconds(mMaxLateness.load(std::memory_order_relaxed)),
+        mRealtime.load(std::memory_order_relaxed)
+    };
 }
 
+void FastTimer::resetDrift() {
+    mTicks = 0;
+    mMissed = 0;
+    mLastLateness = 0;
+    mTotalLateness = 0;
+    mMaxLateness = 0;
+}
 
-void FastTimer::start() {
-    if (objectInCurrentThread(*this)) {
-        QMutexLocker locker(&mMutex);
-        _stopTimer();
-        _startTimer();
-    } else {
-        // re-invoke in the object's thread
-        QMetaObject::invokeMethod(this, [this]() { start(); }, Qt::BlockingQueuedConnection);
+void FastTimer::_start(std::unique_lock<std::mutex> &lock) {
+    if (!mThread.joinable()) {
+        mThread = std::thread(&FastTimer::run, this);
     }
+    mRunning = true;
+    mCondition.notify_all();
+    mCondition.wait(lock, [this]() { return mActive; });
 }
 
-void FastTimer::stop() {
-    if (objectInCurrentThread(*this)) {
-        QMutexLocker locker(&mMutex);
-        _stopTimer();
-    } else {
-        QMetaObject::invokeMethod(this, [this]() { stop(); }, Qt::BlockingQueuedConnection);
+void FastTimer::_stop(std::unique_lock<std::mutex> &lock) {
+    if (mRunning) {
+        // the thread parks at its next wakeup, at most one period from now
+        mRunning = false;
+        mCondition.wait(lock, [this]() { return !mActive; });
     }
 }
 
+void FastTimer::run() {
+    // the priority the thread has, kept between runs
+    bool realtime = false;
+
+    std::unique_lock lock(mMutex);
+    for (;;) {
+        mCondition.wait(lock, [this]() { return mRunning || mQuit; });
+        if (mQuit) {
+            break;
+        }
+
+        // settings are only modified while the timer is stopped
+        auto const callback = mCallback;
+        auto const data = mCallbackData;
+        auto const period = mPeriod;
+
+        auto const requested = mRealtimeRequested.load();
+        if (requested != realtime) {
+            if (requested) {
+                realtime = TU::setRealtimePriority();
+            } else {
+                TU::setNormalPriority();
+                realtime = false;
+            }
+        }
+        mRealtime = realtime;
 
-void FastTimer::_startTimer() {
-    mTimerId = startTimer(mInterval, mTimerType);
+        mActive = true;
+        mCondition.notify_all();
+        lock.unlock();
+
+        tick(callback, data, period);
+
+        lock.lock();
+        mActive = false;
+        mCondition.notify_all();
+    }
 }
 
-void FastTimer::_stopTimer() {
-    if (mTimerId != TU::NO_TIMER) {
-        killTimer(mTimerId);
-        mTimerId = -1;
+void FastTimer::tick(CallbackFn callback, void *data, std::chrono::nanoseconds interval) {
+    auto const period = std::chrono::duration_cast<TU::Clock::duration>(interval);
+
+    TU::Sleeper sleeper;
+    auto deadline = TU::Clock::now() + period;
+    for (;;) {
+        sleeper.sleepUntil(deadline);
+        if (!mRunning.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        auto const now = TU::Clock::now();
+        auto const lateness = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline).count();
+        mLastLateness.store(lateness, std::memory_order_relaxed);
+        mTotalLateness.fetch_add(lateness, std::memory_order_relaxed);
+        if (lateness > mMaxLateness.load(std::memory_order_relaxed)) {
+            mMaxLateness.store(lateness, std::memory_order_relaxed);
+        }
+        mTicks.fetch_add(1, std::memory_order_relaxed);
+
+        if (callback) {
+            callback(data);
+        }
+
+        deadline += period;
+        auto const after = TU::Clock::now();
+        if (after >= deadline) {
+            // overran one or more periods, skip the deadlines that have
+            // already passed instead of calling back in a burst
+            auto const missed = (after - deadline) / period + 1;
+            mMissed.fetch_add((uint64_t)missed, std::memory_order_relaxed);
+            deadline += missed * period;
+        }
     }
 }
 
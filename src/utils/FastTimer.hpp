@@ -1,58 +1,120 @@
-
 #pragma once
 
-#include <QObject>
-#include <QMutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 
 //
-// Similar to QTimer, but uses a callback function instead of signals.
+// Periodic timer that invokes a callback function from its own thread.
 // The signal/slot mechanism has some overhead that is undesirable for a signal
-// that is invoked very often (ie every 5 ms), especially when invoked via queued
-// connection.
-// 
-// Qt Timers are used in this implementation for conveienence. Qt::PreciseTimer
-// offers millisecond resolution on all platforms, which is desired. If a better
-// implementation is needed, it can be implemented here (instead of using QObject timers).
-// 
-// All functions in this class are thread-safe.
+// that is invoked very often (ie every 5 ms), and a QObject timer stalls
+// whenever its thread's event queue is busy, so the timer runs a dedicated
+// thread instead.
 //
-class FastTimer : public QObject {
-
-    Q_OBJECT
+// The thread sleeps until absolute deadlines (clock_nanosleep with
+// CLOCK_MONOTONIC on Linux, a high resolution waitable timer on Windows,
+// std::this_thread::sleep_until elsewhere), so periods do not accumulate
+// error and may be shorter than a millisecond.
+// Deadlines missed by more than a period are skipped rather than bunched up.
+//
+// The thread is created by the first start() and lives as long as the timer.
+// While stopped it is parked on a condition variable, so restarting the timer
+// never creates a thread. start() and stop() block until the thread has
+// started/parked, after stop() returns the callback is guaranteed to not be
+// running.
+//
+// All functions in this class are thread-safe, but must not be called from
+// the callback.
+//
+class FastTimer {
 
 public:
 
     using CallbackFn = void(*)(void*);
 
-    explicit FastTimer(QObject *parent = nullptr);
-    virtual ~FastTimer() = default;
+    //
+    // Timing statistics of the callback invocations
+    //
+    struct Drift {
+        uint64_t ticks;             // number of callbacks invoked
+        uint64_t missed;            // deadlines skipped due to overruns
+        std::chrono::nanoseconds last;  // lateness of the last wakeup
+        std::chrono::nanoseconds mean;  // mean lateness of all wakeups
+        std::chrono::nanoseconds max;   // maximum lateness
+        bool realtime;              // true if real-time priority was granted
+    };
+
+    FastTimer();
+    ~FastTimer();
 
     void setCallback(CallbackFn function, void* data = nullptr);
 
-    void setInterval(int ms, Qt::TimerType type = Qt::CoarseTimer);
+    //
+    // Sets the period of the timer. If running, the timer is restarted.
+    //
+    void setInterval(std::chrono::nanoseconds period);
+
+    //
+    // Request real-time scheduling (SCHED_FIFO on POSIX systems, time
+    // critical priority on Windows) for the timer thread. Takes effect on the
+    // next start, which reverts to normal priority if the request was
+    // withdrawn. If the request is denied, the timer runs with normal
+    // priority and Drift::realtime is false.
+    //
+    void setRealtime(bool realtime);
 
     void start();
 
     void stop();
 
-protected:
+    bool isRunning() const;
 
-    virtual void timerEvent(QTimerEvent *evt) override;
+    Drift drift() const;
+
+    void resetDrift();
 
 private:
 
-    void _startTimer();
+    FastTimer(FastTimer const&) = delete;
+    FastTimer& operator=(FastTimer const&) = delete;
 
-    void _stopTimer();
+    void _start(std::unique_lock<std::mutex> &lock);
 
+    void _stop(std::unique_lock<std::mutex> &lock);
 
-    QMutex mMutex;
-    CallbackFn mCallback;
-    void *mCallbackData;
-    int mInterval;
-    Qt::TimerType mTimerType;
+    // timer thread, waits for a start and runs the timer until stopped
+    void run();
 
-    int mTimerId;
+    // runs the timer until mRunning is cleared
+    void tick(CallbackFn callback, void *data, std::chrono::nanoseconds period);
 
+    // protects the thread, the settings and the handshake flags
+    mutable std::mutex mMutex;
+    // signals a change to mRunning, mActive or mQuit
+    std::condition_variable mCondition;
+    CallbackFn mCallback;
+    void *mCallbackData;
+    std::chrono::nanoseconds mPeriod;
+    // read by the timer thread when it starts running
+    std::atomic_bool mRealtimeRequested;
+
+    std::thread mThread;
+    // set by start, cleared by stop. The timer thread checks it every wakeup
+    std::atomic_bool mRunning;
+    // set by the timer thread while it is running, cleared when it parks
+    bool mActive;
+    // tells the timer thread to exit, set on destruction
+    bool mQuit;
+
+    // drift statistics, written by the timer thread
+    std::atomic_uint64_t mTicks;
+    std::atomic_uint64_t mMissed;
+    std::atomic_int64_t mLastLateness;
+    std::atomic_int64_t mTotalLateness;
+    std::atomic_int64_t mMaxLateness;
+    std::atomic_bool mRealtime;
 
 };
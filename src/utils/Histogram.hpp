@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+//
+// Lock-free histogram for collecting statistics in a real-time thread. A
+// single writer records values, any thread may read the counts at any time.
+// Counters are updated with relaxed atomics, so a reader may see a sample
+// counted in one field (ie total) before another (ie its bucket).
+//
+// Values are sorted into BUCKETS buckets, either linearly (bucket width of 1)
+// or logarithmically, with 4 buckets per power of two. Values past the last
+// bucket are counted in the last bucket.
+//
+// Ex:
+// Histogram h(Histogram::Scale::log);
+// h.record(elapsedNs);        // writer thread
+// auto p99 = h.percentile(0.99); // reader thread
+//
+class Histogram {
+
+public:
+
+    static constexpr int BUCKETS = 128;
+
+    enum class Scale {
+        linear,
+        log
+    };
+
+    explicit Histogram(Scale scale) :
+        mScale(scale),
+        mCounts(),
+        mTotal(0),
+        mSum(0),
+        mMin(std::numeric_limits<uint64_t>::max()),
+        mMax(0)
+    {
+        for (auto &count : mCounts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Scale scale() const {
+        return mScale;
+    }
+
+    //
+    // Counts the given value. Writer thread only.
+    //
+    void record(uint64_t value) {
+        auto &count = mCounts[bucketOf(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        mTotal.store(mTotal.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        mSum.store(mSum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value < mMin.load(std::memory_order_relaxed)) {
+            mMin.store(value, std::memory_order_relaxed);
+        }
+        if (value > mMax.load(std::memory_order_relaxed)) {
+            mMax.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    //
+    // Resets all counts. May be called from any thread, a value being
+    // recorded at the same time may be partially counted.
+    //
+    void clear() {
+        for (auto &count : mCounts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        mTotal.store(0, std::memory_order_relaxed);
+        mSum.store(0, std::memory_order_relaxed);
+        mMin.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        mMax.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count(int bucket) const {
+        return mCounts[bucket].load(std::memory_order_relaxed);
+    }
+
+    uint64_t total() const {
+        return mTotal.load(std::memory_order_relaxed);
+    }
+
+    //
+    // Smallest value recorded, 0 if there are none.
+    //
+    uint64_t min() const {
+        return total() ? mMin.load(std::memory_order_relaxed) : 0;
+    }
+
+    uint64_t max() const {
+        return mMax.load(std::memory_order_relaxed);
+    }
+
+    double mean() const {
+        auto const n = total();
+        return n ? (double)mSum.load(std::memory_order_relaxed) / n : 0.0;
+    }
+
+    //
+    // Smallest value sorted into the given bucket.
+    //
+    uint64_t bucketLowerBound(int bucket) const {
+        if (mScale == Scale::linear || bucket < 4) {
+            return (uint64_t)bucket;
+        }
+        int const exponent = (bucket - 4) / 4 + 2;
+        uint64_t const sub = (uint64_t)((bucket - 4) % 4);
+        return (UINT64_C(4) + sub) << (exponent - 2);
+    }
+
+    //
+    // Estimates the value at the given fraction (0.0 - 1.0) of the recorded
+    // values, as the upper bound of the bucket it falls in (clamped to the
+    // maximum recorded value).
+    //
+    uint64_t percentile(double fraction) const {
+        auto const n = total();
+        if (n == 0) {
+            return 0;
+        }
+        // rank of the value, rounded up so that ie the 99th percentile of 10
+        // values is the 10th
+        auto const target = (uint64_t)std::max(1.0, std::ceil(fraction * n));
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += count(i);
+            if (seen >= target) {
+                if (i == BUCKETS - 1) {
+                    break;
+                }
+                return std::min(bucketLowerBound(i + 1) - 1, max());
+            }
+        }
+        return max();
+    }
+
+private:
+
+    int bucketOf(uint64_t value) const {
+        if (mScale == Scale::linear || value < 4) {
+            return (int)std::min(value, (uint64_t)(BUCKETS - 1));
+        }
+        // floor(log2(value)), value >= 4
+        int exponent = 2;
+        while ((value >> (exponent + 1)) != 0) {
+            ++exponent;
+        }
+        int const sub = (int)((value >> (exponent - 2)) & 3);
+        return std::min(4 + (exponent - 2) * 4 + sub, BUCKETS - 1);
+    }
+
+    Scale mScale;
+    std::array<std::atomic_uint64_t, BUCKETS> mCounts;
+    std::atomic_uint64_t mTotal;
+    std::atomic_uint64_t mSum;
+    std::atomic_uint64_t mMin;
+    std::atomic_uint64_t mMax;
+
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+//
+// Bounded, lock-free, single-producer single-consumer queue. One thread may
+// push while another thread pops, without either thread ever blocking.
+//
+// The producer and consumer indices are kept on separate cache lines so that
+// the two threads do not invalidate each other's line on every operation.
+// Capacity must be a power of two.
+//
+// Ex:
+// SpscQueue<Command, 64> queue;
+// queue.push(cmd);                     // GUI thread
+// Command cmd; while (queue.pop(cmd))  // render thread
+//
+template <class T, size_t N>
+class SpscQueue {
+
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+
+    static constexpr size_t CAPACITY = N;
+
+    SpscQueue() :
+        mHead(0),
+        mTail(0),
+        mItems()
+    {
+    }
+
+    //
+    // Pushes an item onto the queue. false is returned if the queue is full,
+    // in which case the item is left untouched. Producer thread only.
+    //
+    template <class U>
+    bool push(U &&item) {
+        auto const tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        mItems[tail & MASK] = std::forward<U>(item);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //
+    // Pops the oldest item in the queue into out. false is returned if the
+    // queue is empty. Consumer thread only.
+    //
+    bool pop(T &out) {
+        auto const head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = std::move(mItems[head & MASK]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //
+    // Gets the oldest item in the queue without removing it, or nullptr if
+    // the queue is empty. Consumer thread only.
+    //
+    T* peek() {
+        auto const head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &mItems[head & MASK];
+    }
+
+    //
+    // Determines if the queue is empty. The result is only exact when called
+    // from the consumer thread.
+    //
+    bool isEmpty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+private:
+
+    static constexpr size_t MASK = N - 1;
+    static constexpr size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic_size_t mHead;  // consumer index
+    alignas(CACHE_LINE) std::atomic_size_t mTail;  // producer index
+    alignas(CACHE_LINE) std::array<T, N> mItems;
+
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//
+// Lock-free triple buffer for publishing snapshots of a value from one thread
+// (the writer) to another (the reader). The writer fills the back buffer and
+// publishes it, the reader always gets the most recently published value.
+// Neither side ever blocks or waits on the other.
+//
+// Ex:
+// TripleBuffer<Stats> stats;
+// stats.back() = current; stats.publish();  // writer thread
+// auto const& latest = stats.read();        // reader thread
+//
+template <class T>
+class TripleBuffer {
+
+public:
+
+    TripleBuffer() :
+        mBuffers(),
+        mMiddle(1),
+        mBack(0),
+        mFront(2)
+    {
+    }
+
+    //
+    // Gets the buffer for the writer to modify. Writer thread only.
+    //
+    T& back() {
+        return mBuffers[mBack];
+    }
+
+    //
+    // Publishes the back buffer so that the reader can access it. The
+    // contents of the new back buffer are those of a previous snapshot, so
+    // the writer should overwrite them entirely. Writer thread only.
+    //
+    void publish() {
+        mBack = mMiddle.exchange(mBack | DIRTY, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    //
+    // Gets the latest published value. Reader thread only.
+    //
+    T const& read() {
+        if (mMiddle.load(std::memory_order_relaxed) & DIRTY) {
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        return mBuffers[mFront];
+    }
+
+private:
+
+    static constexpr uint8_t DIRTY = 0x4;
+    static constexpr uint8_t INDEX_MASK = 0x3;
+
+    T mBuffers[3];
+
+    // index of the middle buffer, with the DIRTY flag set when it contains
+    // a snapshot not yet seen by the reader
+    std::atomic_uint8_t mMiddle;
+    uint8_t mBack;      // writer
+    uint8_t mFront;     // reader
+
+};
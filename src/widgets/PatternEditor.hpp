@@ -42,14 +42,19 @@ public:
 
     void setPageStep(int pageStep);
 
-    virtual void midiNoteOn(int note) override;
+    virtual void midiNoteOn(int note, int velocity, int channel) override;
 
-    virtual void midiNoteOff() override;
+    virtual void midiNoteOff(int note, int channel) override;
 
     void setEditStep(int step);
 
     void setInstrument(int id);
 
+    //
+    // Gets the instrument id set by setInstrument, -1 for none
+    //
+    int instrument() const;
+
     void setKeyRepeat(bool repeat);
 
     void cut();
@@ -122,15 +122,25 @@ void PianoWidget::release() {
     emit keyUp();
 }
 
-void PianoWidget::midiNoteOn(int note) {
+void PianoWidget::midiNoteOn(int note, int velocity, int channel) {
+    Q_UNUSED(velocity)
+    Q_UNUSED(channel)
+
+    // the note is previewed by the renderer directly from the MIDI thread,
+    // only show it (the most recent note of a chord)
     if (isEnabled()) {
-        play(note);
+        mNote = note;
+        mIsKeyDown = true;
+        update();
     }
 }
 
-void PianoWidget::midiNoteOff() {
-    if (isEnabled()) {
-        release();
+void PianoWidget::midiNoteOff(int note, int channel) {
+    Q_UNUSED(channel)
+
+    if (isEnabled() && note == mNote) {
+        mIsKeyDown = false;
+        update();
     }
 }
 
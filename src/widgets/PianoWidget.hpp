@@ -25,9 +25,9 @@ public:
     void play(int note);
     void release();
 
-    virtual void midiNoteOn(int note) override;
+    virtual void midiNoteOn(int note, int velocity, int channel) override;
 
-    virtual void midiNoteOff() override;
+    virtual void midiNoteOff(int note, int channel) override;
 
 signals:
     void keyDown(int note);
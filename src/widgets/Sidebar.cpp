@@ -16,6 +16,9 @@ Sidebar::Sidebar(
 ) :
     QWidget(parent),
     mScope(new AudioScope),
+    mChannelScopes(new ChannelScopes),
+    mPeakMeter(new PeakMeter),
+    mSpectrum(new SpectrumView),
     mOrderEditor(new OrderEditor(patternModel)),
     mSongEditor(new SongEditor(songModel)),
     mSongChooser(new QComboBox)
@@ -23,6 +26,12 @@ Sidebar::Sidebar(
 
     auto layout = new QVBoxLayout;
     layout->addWidget(mScope);
+    layout->addWidget(mPeakMeter);
+    mPeakMeter->hide();
+    layout->addWidget(mChannelScopes);
+    mChannelScopes->hide();
+    layout->addWidget(mSpectrum);
+    mSpectrum->hide();
 
     auto groupbox = new QGroupBox(tr("Song"));
     auto groupLayout = new QVBoxLayout;
@@ -54,6 +63,18 @@ Sidebar::Sidebar(
     mPrevAction = createAction(this, tr("Previous song"), tr("Selects the previous song in the list"), Icons::prev);
     connectActionToThis(mPrevAction, previousSong);
 
+    mChannelScopesAction = createAction(this, tr("Channel scopes"), tr("Shows an oscilloscope for each channel"));
+    mChannelScopesAction->setCheckable(true);
+    connect(mChannelScopesAction, &QAction::toggled, mChannelScopes, &ChannelScopes::setVisible);
+
+    mPeakMeterAction = createAction(this, tr("Level meters"), tr("Shows the peak and RMS level of the output"));
+    mPeakMeterAction->setCheckable(true);
+    connect(mPeakMeterAction, &QAction::toggled, mPeakMeter, &PeakMeter::setVisible);
+
+    mSpectrumAction = createAction(this, tr("Spectrum analyzer"), tr("Shows the frequency spectrum of the output"));
+    mSpectrumAction->setCheckable(true);
+    connect(mSpectrumAction, &QAction::toggled, mSpectrum, &SpectrumView::setVisible);
+
     lazyconnect(&mod, reloaded, this, reload);
     connect(mSongChooser, qOverload<int>(&QComboBox::currentIndexChanged), this,
         [this, &mod](int index) {
@@ -76,6 +97,14 @@ AudioScope* Sidebar::scope() {
     return mScope;
 }
 
+ChannelScopes* Sidebar::channelScopes() {
+    return mChannelScopes;
+}
+
+PeakMeter* Sidebar::peakMeter() {
+    return mPeakMeter;
+}
+
 OrderEditor* Sidebar::orderEditor() {
     return mOrderEditor;
 }
@@ -84,6 +113,10 @@ SongEditor* Sidebar::songEditor() {
     return mSongEditor;
 }
 
+SpectrumView* Sidebar::spectrum() {
+    return mSpectrum;
+}
+
 QAction* Sidebar::previousSongAction() {
     return mPrevAction;
 }
@@ -92,6 +125,18 @@ QAction* Sidebar::nextSongAction() {
     return mNextAction;
 }
 
+QAction* Sidebar::channelScopesAction() {
+    return mChannelScopesAction;
+}
+
+QAction* Sidebar::peakMeterAction() {
+    return mPeakMeterAction;
+}
+
+QAction* Sidebar::spectrumAction() {
+    return mSpectrumAction;
+}
+
 void Sidebar::nextSong() {
     mSongChooser->setCurrentIndex(mSongChooser->currentIndex() + 1);
 }
@@ -5,8 +5,11 @@
 #include "model/SongModel.hpp"
 #include "model/SongListModel.hpp"
 #include "widgets/sidebar/AudioScope.hpp"
+#include "widgets/sidebar/ChannelScopes.hpp"
 #include "widgets/sidebar/OrderEditor.hpp"
 #include "widgets/sidebar/SongEditor.hpp"
+#include "widgets/sidebar/SpectrumView.hpp"
+#include "widgets/visualizers/PeakMeter.hpp"
 
 #include <QAction>
 #include <QComboBox>
@@ -32,6 +35,12 @@ public:
 
     AudioScope* scope();
 
+    ChannelScopes* channelScopes();
+
+    PeakMeter* peakMeter();
+
+    SpectrumView* spectrum();
+
     OrderEditor* orderEditor();
 
     SongEditor* songEditor();
@@ -40,6 +49,21 @@ public:
 
     QAction* previousSongAction();
 
+    //
+    // Checkable action for showing the channel scopes, hidden by default
+    //
+    QAction* channelScopesAction();
+
+    //
+    // Checkable action for showing the level meters, hidden by default
+    //
+    QAction* peakMeterAction();
+
+    //
+    // Checkable action for showing the spectrum analyzer, hidden by default
+    //
+    QAction* spectrumAction();
+
     //
     // Selects the next song in the list
     //
@@ -59,11 +83,17 @@ private:
     void updateActions();
 
     AudioScope *mScope;
+    ChannelScopes *mChannelScopes;
+    PeakMeter *mPeakMeter;
+    SpectrumView *mSpectrum;
     OrderEditor *mOrderEditor;
     SongEditor *mSongEditor;
     QComboBox *mSongChooser;
 
     QAction *mNextAction;
     QAction *mPrevAction;
+    QAction *mChannelScopesAction;
+    QAction *mPeakMeterAction;
+    QAction *mSpectrumAction;
 
 };
@@ -10,6 +10,32 @@
 #include <QtDebug>
 
 #include <algorithm>
+#include <iterator>
+
+#define TU PatternGridTU
+namespace TU {
+
+static bool sameRows(std::vector<trackerboy::TrackRow> const& a, std::vector<trackerboy::TrackRow> const& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        auto const& rowA = a[i];
+        auto const& rowB = b[i];
+        if (rowA.note != rowB.note || rowA.instrumentId != rowB.instrumentId) {
+            return false;
+        }
+        for (size_t effect = 0; effect < std::size(rowA.effects); ++effect) {
+            if (rowA.effects[effect].type != rowB.effects[effect].type ||
+                rowA.effects[effect].param != rowB.effects[effect].param) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
 
 
 // Philisophy note
@@ -44,6 +70,14 @@ PatternGrid::PatternGrid(
     mShowShadow(true),
     mSelecting(false),
     mVisibleRows(0),
+    mTrackerRow(),
+    mPaintedSelection(),
+    mTileRenderer(),
+    mTiles(),
+    mRestyleTiles(true),
+    mTileDpr(0.0),
+    mPaintCount(0),
+    mSnapshot(),
     mEditorFocus(false),
     mMousePos(),
     mSelectionStart(),
@@ -62,7 +96,9 @@ PatternGrid::PatternGrid(
     connect(&model, &PatternModel::cursorChanged, this, &PatternGrid::updateCursor);
     // these changes require a full redraw
     connect(&model, &PatternModel::invalidated, this, &PatternGrid::updateAll);
-    connect(&model, &PatternModel::selectionChanged, this, &PatternGrid::updateAll);
+    // these only redraw the rows affected
+    connect(&model, &PatternModel::dataChanged, this, &PatternGrid::updateRegion);
+    connect(&model, &PatternModel::selectionChanged, this, &PatternGrid::updateSelection);
     // these we only need to redraw the cursor row
     connect(&model, &PatternModel::recordingChanged, this, &PatternGrid::updateCursorRow);
     
@@ -70,6 +106,8 @@ PatternGrid::PatternGrid(
     connect(&model, &PatternModel::trackerCursorChanged, this, &PatternGrid::calculateTrackerRow);
     connect(&model, &PatternModel::playingChanged, this, &PatternGrid::setPlaying);
 
+    connect(&mTileRenderer, &PatternTileRenderer::tileRendered, this, &PatternGrid::tileRendered);
+
     connect(&model, &PatternModel::effectsVisibleChanged, this,
         [this]() {
             // update the layout
@@ -78,6 +116,7 @@ PatternGrid::PatternGrid(
                 mLayout.setEffectsVisible((int)i, counts[i]);
             }
             // redraw everything
+            clearTiles();
             update();
             mHeader.update();
 
@@ -100,12 +139,14 @@ void PatternGrid::setColors(Palette const& colors) {
     setPalette(pal);
 
     // new colors, redraw everything
+    clearTiles();
     update();
 }
 
 void PatternGrid::setShowFlats(bool showFlats) {
     if (showFlats != mPainter.flats()) {
         mPainter.setFlats(showFlats);
+        clearTiles();
         update();
     }
 }
@@ -120,6 +161,7 @@ void PatternGrid::setShowShadow(bool shadow) {
 void PatternGrid::setRownoHex(bool hex) {
     if (hex != mLayout.rownoHex()) {
         mLayout.setRownoHex(hex);
+        clearTiles();
         update();
     }
 }
@@ -185,9 +227,9 @@ void PatternGrid::dropEvent(QDropEvent *evt) {
 }
 
 void PatternGrid::paintEvent(QPaintEvent *evt) {
-    Q_UNUSED(evt)
 
     QPainter painter(this);
+    ++mPaintCount;
 
 
     auto const h = height();
@@ -196,7 +238,7 @@ void PatternGrid::paintEvent(QPaintEvent *evt) {
 
     auto const cursor = mModel.cursor();
     auto patternPrev = mModel.previousPattern();
-    auto patternCurr = mModel.currentPattern();
+    auto const& patternCurr = mModel.currentPattern();
     auto patternNext = mModel.nextPattern();
     auto const rowsInPrevious = patternPrev ? patternPrev->totalRows() : 0;
     auto const rowsInCurrent = patternCurr.totalRows();
@@ -241,63 +283,86 @@ void PatternGrid::paintEvent(QPaintEvent *evt) {
     }
 
     // [4] selection
-    if (mModel.hasSelection()) {
-        auto selection = mModel.selection();
-        selection.translate(-cursor.row + centerRow);
-        auto rect = mLayout.selectionRectangle(selection);
-        mPainter.drawSelection(painter, rect);
+    mPaintedSelection = selectionRect();
+    if (!mPaintedSelection.isNull()) {
+        mPainter.drawSelection(painter, mPaintedSelection);
     }
 
     // [5] cursor
     mPainter.drawCursor(painter, mLayout, PatternCursor(centerRow, cursor.column, cursor.track));
 
-    // [6] text
+    // [6] text, only for the rows being repainted
     {
-        int rowYpos = 0;
-        int rowsToDraw = mVisibleRows;
-        int relativeRowIndex = cursor.row - centerRow;
+        auto const dirty = evt->rect();
+        // rows are relative to the start of the current pattern, the previous
+        // pattern's are negative
+        auto const rowOffset = cursor.row - centerRow;
+        auto const firstRow = rowOffset + std::max(0, dirty.top() / rowHeight);
+        auto const lastRow = rowOffset + std::min(mVisibleRows - 1, dirty.bottom() / rowHeight);
+
+        // the renderer gets the current appearance before any tile is
+        // requested
+        auto const dpr = devicePixelRatioF();
+        if (mRestyleTiles || dpr != mTileDpr) {
+            mTiles.clear();
+            mTileRenderer.setStyle(mPainter, mLayout, dpr);
+            mRestyleTiles = false;
+            mTileDpr = dpr;
+        }
+
+        constexpr auto TILE_ROWS = PatternTileRenderer::TILE_ROWS;
+        auto drawRows = [&](trackerboy::Pattern const& pattern, int patternIndex, int start, int rows) {
+            auto const first = std::max(firstRow, start);
+            auto const last = std::min(lastRow, start + rows - 1);
+            if (first > last) {
+                return;
+            }
 
-        if (relativeRowIndex < 0) {
-            // a negative row index means we draw from the previous pattern
-            if (patternPrev) {
-                int rowno;
-                int rowIndexToPrev = relativeRowIndex + rowsInPrevious;
-                if (rowIndexToPrev < 0) {
-                    // clamp
-                    rowYpos += -rowIndexToPrev * rowHeight;
-                    rowno = 0;
+            auto const tileFirst = (first - start) / TILE_ROWS;
+            auto const tileLast = (last - start) / TILE_ROWS;
+            for (int tileNo = tileFirst; tileNo <= tileLast; ++tileNo) {
+                auto const tileStart = tileNo * TILE_ROWS;
+                auto image = tileImage(pattern, patternIndex, tileNo);
+                if (image) {
+                    painter.drawImage(QPointF(0, (start + tileStart - rowOffset) * rowHeight), *image);
                 } else {
-                    rowno = rowIndexToPrev;
+                    // not rendered yet, draw the rows here
+                    auto const rowFirst = std::max(first - start, tileStart);
+                    auto const rowLast = std::min(last - start, tileStart + TILE_ROWS - 1);
+                    mPainter.drawPattern(painter, mLayout, pattern, rowFirst, rowLast, (start + rowFirst - rowOffset) * rowHeight);
                 }
-                painter.setOpacity(0.5);
-                rowYpos = mPainter.drawPattern(painter, mLayout, *patternPrev, rowno, rowsInPrevious - 1, rowYpos);
-                painter.setOpacity(1.0);
-            } else {
-                // previews disabled or we don't have a previous pattern, just skip these rows
-                rowYpos += -relativeRowIndex * rowHeight;
             }
 
-            rowsToDraw += relativeRowIndex;
-            relativeRowIndex = 0;
-        }
+            // have the tile below ready, playback scrolls down
+            if ((tileLast + 1) * TILE_ROWS < rows) {
+                tileImage(pattern, patternIndex, tileLast + 1);
+            }
+        };
 
-        // draw the current pattern
-        int rowEnd = relativeRowIndex + rowsToDraw;
-        if (rowEnd >= rowsInCurrent) {
-            rowEnd = rowsInCurrent - 1;
+        auto const patternIndex = mModel.cursorPattern();
+        if (patternPrev) {
+            painter.setOpacity(0.5);
+            drawRows(*patternPrev, patternIndex - 1, -rowsInPrevious, rowsInPrevious);
+            painter.setOpacity(1.0);
         }
-        rowYpos = mPainter.drawPattern(painter, mLayout, patternCurr, relativeRowIndex, rowEnd, rowYpos);
-        rowsToDraw -= rowEnd - relativeRowIndex;
-
-        if (rowsToDraw > 0 && patternNext) {
-            // we have extra rows and a next pattern, draw it
-            if (rowsToDraw > rowsInNext) {
-                rowsToDraw = rowsInNext;
-            }
+        drawRows(patternCurr, patternIndex, 0, rowsInCurrent);
+        if (patternNext) {
             painter.setOpacity(0.5);
-            mPainter.drawPattern(painter, mLayout, *patternNext, 0, rowsToDraw - 1, rowYpos);
+            drawRows(*patternNext, patternIndex + 1, rowsInCurrent, rowsInNext);
             painter.setOpacity(1.0);
         }
+
+        // drop the tiles scrolled out of view, when all rows were just drawn
+        auto const maxTiles = (size_t)(mVisibleRows / TILE_ROWS + 3) * 2;
+        if (dirty.height() >= h && mTiles.size() > maxTiles) {
+            for (auto iter = mTiles.begin(); iter != mTiles.end(); ) {
+                if (iter->second.lastPaint != mPaintCount) {
+                    iter = mTiles.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
     }
 
     // [7] lines
@@ -462,7 +527,7 @@ void PatternGrid::mouseReleaseEvent(QMouseEvent *evt) {
 
 void PatternGrid::updateCursor(PatternModel::CursorChangeFlags flags) {
 
-    if (flags | (PatternModel::CursorRowChanged | PatternModel::CursorTrackChanged)) {
+    if (flags & (PatternModel::CursorRowChanged | PatternModel::CursorTrackChanged)) {
         updateAll();
     } else {
         updateCursorRow();
@@ -480,6 +545,89 @@ void PatternGrid::updateAll() {
     update();
 }
 
+void PatternGrid::clearTiles() {
+    mTiles.clear();
+    mRestyleTiles = true;
+}
+
+QImage const* PatternGrid::tileImage(trackerboy::Pattern const& pattern, int patternIndex, int tileNo) {
+    constexpr auto TILE_ROWS = PatternTileRenderer::TILE_ROWS;
+    auto const rowStart = tileNo * TILE_ROWS;
+    auto const rows = std::min(TILE_ROWS, pattern.totalRows() - rowStart);
+    mSnapshot.clear();
+    for (int row = rowStart; row < rowStart + rows; ++row) {
+        for (int track = 0; track <= 3; ++track) {
+            mSnapshot.push_back(pattern.getTrackRow(static_cast<trackerboy::ChType>(track), row));
+        }
+    }
+
+    // patterns have at most 256 rows
+    auto const key = (patternIndex << 16) | tileNo;
+    auto &entry = mTiles[key];
+    entry.lastPaint = mPaintCount;
+    if (!entry.image.isNull() && TU::sameRows(entry.rows, mSnapshot)) {
+        return &entry.image;
+    }
+
+    if (!TU::sameRows(entry.requested, mSnapshot)) {
+        entry.requested = mSnapshot;
+        mTileRenderer.render({ key, rowStart, 0, mSnapshot, QImage() });
+    }
+    return nullptr;
+}
+
+void PatternGrid::tileRendered(PatternTileRenderer::Tile const& tile) {
+    auto iter = mTiles.find(tile.key);
+    if (iter == mTiles.end()) {
+        // scrolled out of view and dropped
+        return;
+    }
+    auto &entry = iter->second;
+    entry.rows = tile.rows;
+    entry.image = tile.image;
+
+    // only the tile's rows need to be redrawn
+    auto const rowHeight = mPainter.cellHeight();
+    auto const row = patternStart(tile.key >> 16) + tile.rowStart + mVisibleRows / 2 - mModel.cursorRow();
+    QRect const rect(0, row * rowHeight, width(), (int)(tile.rows.size() / 4) * rowHeight);
+    if (rect.intersects(this->rect())) {
+        update(rect);
+    }
+}
+
+int PatternGrid::patternStart(int pattern) const {
+    auto const current = mModel.cursorPattern();
+    if (pattern == current - 1) {
+        auto prev = mModel.previousPattern();
+        return prev ? -prev->totalRows() : 0;
+    } else if (pattern == current + 1) {
+        return mModel.currentPattern().totalRows();
+    }
+    return 0;
+}
+
+void PatternGrid::updateRegion(int pattern, PatternSelection region) {
+    region.translate(patternStart(pattern) + mVisibleRows / 2 - mModel.cursorRow());
+    auto rect = mLayout.selectionRectangle(region);
+    if (rect.intersects(this->rect())) {
+        update(rect);
+    }
+}
+
+void PatternGrid::updateSelection() {
+    auto const rect = selectionRect();
+    update(rect.united(mPaintedSelection));
+}
+
+QRect PatternGrid::selectionRect() const {
+    if (!mModel.hasSelection()) {
+        return {};
+    }
+    auto selection = mModel.selection();
+    selection.translate(mVisibleRows / 2 - mModel.cursorRow());
+    return mLayout.selectionRectangle(selection);
+}
+
 void PatternGrid::setPlaying(bool playing) {
     if (!playing && mTrackerRow) {
         // this just hides the player row if it was set
@@ -490,16 +638,20 @@ void PatternGrid::setPlaying(bool playing) {
 
 void PatternGrid::setFirstHighlight(int highlight) {
     mPainter.setFirstHighlight(highlight);
+    clearTiles();
     update();
 }
 
 void PatternGrid::setSecondHighlight(int highlight) {
     mPainter.setSecondHighlight(highlight);
+    clearTiles();
     update();
 }
 
 void PatternGrid::fontChanged() {
 
+    clearTiles();
+
     mVisibleRows = mPainter.calculateRowsAvailable(height());
     mLayout.setCellSize(mPainter.cellWidth(), mPainter.cellHeight());
     //auto const rownoWidth = mPainter.rownoWidth();
@@ -565,3 +717,5 @@ void PatternGrid::calculateTrackerRow() {
     }
 
 }
+
+#undef TU
@@ -3,6 +3,7 @@
 
 #include "graphics/PatternLayout.hpp"
 #include "graphics/PatternPainter.hpp"
+#include "graphics/PatternTileRenderer.hpp"
 #include "model/PatternModel.hpp"
 #include "config/data/Palette.hpp"
 #include "config/data/PianoInput.hpp"
@@ -12,12 +13,16 @@
 #include "trackerboy/note.hpp"
 
 #include <QWidget>
+#include <QImage>
 #include <QPaintEvent>
 #include <QString>
 #include <QRect>
 #include <QSize>
 
+#include <cstdint>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
 
 class PatternGrid : public QWidget {
@@ -90,6 +95,46 @@ private:
     
     void updateCursorRow();
     void updateAll();
+
+    //
+    // Discards all tiles, for a change in appearance. The tile renderer gets
+    // the new appearance on the next paint.
+    //
+    void clearTiles();
+
+    //
+    // Keeps the rendered tile and redraws its rows
+    //
+    void tileRendered(PatternTileRenderer::Tile const& tile);
+
+    //
+    // Row of the given pattern's first row, relative to the current pattern.
+    // The pattern is the current one or one of its previews.
+    //
+    int patternStart(int pattern) const;
+
+    //
+    // Redraws the rows of the given region, for a change to a pattern's data
+    //
+    void updateRegion(int pattern, PatternSelection region);
+
+    //
+    // Redraws the area covered by the old and new selection
+    //
+    void updateSelection();
+
+    //
+    // Rectangle of the model's selection, null if there is no selection
+    //
+    QRect selectionRect() const;
+
+    //
+    // Gets the rendered text of a tile of the given pattern, which is given
+    // by its index in the order. If the tile is not rendered, or was
+    // rendered from different data, a render is requested and nullptr is
+    // returned.
+    //
+    QImage const* tileImage(trackerboy::Pattern const& pattern, int patternIndex, int tileNo);
     void setPlaying(bool playing);
 
     void updateCursor(PatternModel::CursorChangeFlags flags);
@@ -126,6 +171,35 @@ private:
     // saved here so we don't have to calculate it every paint event
     std::optional<int> mTrackerRow;
 
+    // the selection rectangle as of the last paint event
+    QRect mPaintedSelection;
+
+    //
+    // Text of the patterns, rendered in tiles of rows by mTileRenderer and
+    // keyed by pattern index and tile number. Painting the text is a blit of
+    // each tile. A tile is only used while the pattern's data matches the
+    // rows it was rendered from, rows without a current tile are drawn
+    // directly until one arrives.
+    //
+    struct TileEntry {
+        // rows the image was rendered from
+        std::vector<trackerboy::TrackRow> rows;
+        QImage image;
+        // rows of the last render requested
+        std::vector<trackerboy::TrackRow> requested;
+        // the last paint event that drew this tile
+        uint64_t lastPaint;
+    };
+
+    PatternTileRenderer mTileRenderer;
+    std::unordered_map<int, TileEntry> mTiles;
+    // set when the tile renderer needs the current appearance
+    bool mRestyleTiles;
+    qreal mTileDpr;
+    uint64_t mPaintCount;
+    // rows of the tile being checked, reused by tileImage
+    std::vector<trackerboy::TrackRow> mSnapshot;
+
     bool mEditorFocus;
 
     // user must move this amount of pixels to begin selecting
@@ -1,20 +1,54 @@
 
 #include "widgets/sidebar/AudioScope.hpp"
 
+#include <QActionGroup>
+#include <QContextMenuEvent>
 #include <QGuiApplication>
+#include <QMenu>
 #include <QPainter>
 #include <QPen>
+#include <QResizeEvent>
+
+#include <algorithm>
 
 #define TU AudioScopeTU
 namespace TU {
 
 constexpr int LINE_WIDTH = 1;
 
+struct WindowChoice {
+    char const *name;
+    int milliseconds;
+};
+
+// window lengths selectable from the context menu, 0 is one frame
+constexpr WindowChoice WINDOW_CHOICES[] = {
+    { QT_TR_NOOP("Frame"), 0 },
+    { QT_TR_NOOP("20 ms"), 20 },
+    { QT_TR_NOOP("100 ms"), 100 },
+    { QT_TR_NOOP("500 ms"), 500 },
+    { QT_TR_NOOP("1 s"), 1000 },
+    { QT_TR_NOOP("2 s"), 2000 },
+    { QT_TR_NOOP("4 s"), VisualizerBuffer::MAX_DURATION }
+};
+
+//
+// Converts a column's range to a vertical line, extended to reach the
+// previous column so that the waveform is continuous.
+//
+QLineF columnLine(float x, float axis, float scale, float prevMin, float prevMax, float min, float max) {
+    auto const top = std::max(max, prevMin);
+    auto const bottom = std::min(min, prevMax);
+    // +/- 0.5 so that a flat line is still one pixel tall
+    return QLineF(x, axis - (top * scale) - 0.5f, x, axis - (bottom * scale) + 0.5f);
+}
+
 }
 
 AudioScope::AudioScope(QWidget *parent) :
     QFrame(parent),
     mBuffer(nullptr),
+    mLines(),
     mLineColor(Qt::white)
 {
     setAttribute(Qt::WA_StyledBackground);
@@ -36,9 +70,12 @@ AudioScope::AudioScope(QWidget *parent) :
 
 }
 
-void AudioScope::setBuffer(Guarded<VisualizerBuffer> *buffer) {
+void AudioScope::setBuffer(VisualizerBuffer *buffer) {
     if (buffer != mBuffer) {
         mBuffer = buffer;
+        if (mBuffer) {
+            mBuffer->setColumns(columns());
+        }
         update();
     }
 }
@@ -53,58 +90,78 @@ void AudioScope::setColors(Palette const& pal) {
     update();
 }
 
+void AudioScope::contextMenuEvent(QContextMenuEvent *evt) {
+    if (mBuffer == nullptr) {
+        return;
+    }
+
+    auto menu = new QMenu(this);
+    menu->setAttribute(Qt::WA_DeleteOnClose);
+    menu->addSection(tr("Window"));
+    auto group = new QActionGroup(menu);
+    auto const current = mBuffer->duration();
+    for (auto const& choice : TU::WINDOW_CHOICES) {
+        auto action = menu->addAction(tr(choice.name));
+        action->setCheckable(true);
+        action->setChecked(choice.milliseconds == current);
+        group->addAction(action);
+        auto const ms = choice.milliseconds;
+        connect(action, &QAction::triggered, this, [this, ms]() {
+            if (mBuffer) {
+                mBuffer->setDuration(ms);
+            }
+        });
+    }
+    menu->popup(evt->globalPos());
+}
+
 void AudioScope::paintEvent(QPaintEvent *evt) {
     QFrame::paintEvent(evt);
 
-    // it may be more efficient to do renderering in a separate thread
-    // we can convert a sample buffer to a buffer of QLines, then
-    // the paint event just draws the lines
-
     if (mBuffer == nullptr) {
         // no buffer, draw nothing
         drawSilence();
         return;
     }
 
-    auto handle = mBuffer->access();
-    auto size = handle->size();
-    if (size == 0) {
+    // the envelope is computed by the render thread, painting only costs
+    // one line per column and channel
+    auto const& snapshot = mBuffer->read();
+    if (snapshot.columns == 0) {
         // buffer is empty, draw nothing
         drawSilence();
         return;
     }
 
-    auto const w = width() - (TU::LINE_WIDTH * 2);
-    
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setPen(mLineColor);
-
-    // pixels per sample
-    float ratio = (unsigned)size / (float)w;
-    float index = 0;
-
-    float prevLeft;
-    float prevRight;
-    sample(handle, 0.0f, ratio, prevLeft, prevRight);
-
-    int const end = w + TU::LINE_WIDTH;
-    for (int t = 1 + TU::LINE_WIDTH; t < end; ++t) {
-        index += ratio;
-        
-        float leftSample;
-        float rightSample;
-        sample(handle, index, ratio, leftSample, rightSample);
-
-        painter.drawLine(QLineF(t - 1, prevLeft, t, leftSample));
-        painter.drawLine(QLineF(t - 1, prevRight, t, rightSample));
+    // the number of columns may lag behind a resize, stretch to fit
+    auto const w = columns();
+    auto const xscale = (float)w / snapshot.columns;
+    constexpr float yscale = WAVE_HEIGHT / 2.0f;
+
+    mLines.resize(snapshot.columns * 2);
+    auto prev = snapshot.data[0];
+    for (int i = 0; i < snapshot.columns; ++i) {
+        auto const& column = snapshot.data[i];
+        auto const x = TU::LINE_WIDTH + (i + 0.5f) * xscale;
+        mLines[i * 2] = TU::columnLine(x, WAVE_LEFT_AXIS, yscale, prev.minLeft, prev.maxLeft, column.minLeft, column.maxLeft);
+        mLines[i * 2 + 1] = TU::columnLine(x, WAVE_RIGHT_AXIS, yscale, prev.minRight, prev.maxRight, column.minRight, column.maxRight);
+        prev = column;
+    }
 
-        prevLeft = leftSample;
-        prevRight = rightSample;
+    QPainter painter(this);
+    painter.setPen(QPen(mLineColor, std::max(1.0f, xscale)));
+    painter.drawLines(mLines);
+}
 
-        
+void AudioScope::resizeEvent(QResizeEvent *evt) {
+    QFrame::resizeEvent(evt);
+    if (mBuffer) {
+        mBuffer->setColumns(columns());
     }
-    
+}
+
+int AudioScope::columns() const {
+    return width() - (TU::LINE_WIDTH * 2);
 }
 
 void AudioScope::drawSilence() {
@@ -116,12 +173,4 @@ void AudioScope::drawSilence() {
 
 }
 
-void AudioScope::sample(Locked<VisualizerBuffer> &handle, float index, float ratio, float &outLeft, float &outRight) {
-    float left, right;
-    handle->averageSample(index, ratio, left, right);
-
-    outLeft = WAVE_LEFT_AXIS - (left / (2.0f / WAVE_HEIGHT));
-    outRight = WAVE_RIGHT_AXIS - (right / (2.0f / WAVE_HEIGHT));
-}
-
 #undef TU
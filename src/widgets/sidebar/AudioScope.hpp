@@ -4,9 +4,10 @@
 
 #include "audio/VisualizerBuffer.hpp"
 #include "config/data/Palette.hpp"
-#include "utils/Guarded.hpp"
 
 #include <QFrame>
+#include <QLineF>
+#include <QVector>
 
 
 class AudioScope : public QFrame {
@@ -19,20 +20,24 @@ public:
     explicit AudioScope(QWidget *parent = nullptr);
 
 
-    void setBuffer(Guarded<VisualizerBuffer>* buffer);
+    void setBuffer(VisualizerBuffer* buffer);
 
     void setColors(Palette const& pal);
 
 protected:
 
+    void contextMenuEvent(QContextMenuEvent *evt) override;
+
     void paintEvent(QPaintEvent *evt) override;
 
+    void resizeEvent(QResizeEvent *evt) override;
+
 private:
     Q_DISABLE_COPY(AudioScope)
 
     void drawSilence();
 
-    void sample(Locked<VisualizerBuffer> &handle, float index, float ratio, float &outLeft, float &outRight);
+    int columns() const;
 
     static constexpr int WAVE_WIDTH = 160;
     static constexpr int WAVE_HEIGHT = 64;
@@ -41,7 +46,10 @@ private:
     static constexpr int WAVE_LEFT_AXIS = (WAVE_HEIGHT / 2) + 1;
     static constexpr int WAVE_RIGHT_AXIS = (WAVE_HEIGHT / 2) + WAVE_HEIGHT + 1;
 
-    Guarded<VisualizerBuffer> *mBuffer;
+    VisualizerBuffer *mBuffer;
+
+    // line segments for each channel, reused between paints
+    QVector<QLineF> mLines;
 
     QColor mLineColor;
 
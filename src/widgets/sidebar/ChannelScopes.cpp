@@ -0,0 +1,128 @@
+
+#include "widgets/sidebar/ChannelScopes.hpp"
+
+#include <QGuiApplication>
+#include <QPainter>
+#include <QPen>
+
+#include <algorithm>
+
+#define TU ChannelScopesTU
+namespace TU {
+
+constexpr int LINE_WIDTH = 1;
+
+}
+
+ChannelScopes::ChannelScopes(QWidget *parent) :
+    QFrame(parent),
+    mBuffer(nullptr),
+    mLines(),
+    mLineColor(Qt::white)
+{
+    setAttribute(Qt::WA_StyledBackground);
+    setAutoFillBackground(true);
+
+    // same defaults as AudioScope
+    auto pal = palette();
+    if (pal.isCopyOf(QGuiApplication::palette())) {
+        pal.setColor(QPalette::Window, Qt::black);
+        setPalette(pal);
+    }
+
+    setFrameStyle(QFrame::Box | QFrame::Plain);
+    setLineWidth(TU::LINE_WIDTH);
+    setFixedHeight(SCOPE_HEIGHT + TU::LINE_WIDTH * 2);
+}
+
+void ChannelScopes::setBuffer(ChannelScopeBuffer *buffer) {
+    if (buffer != mBuffer) {
+        if (mBuffer) {
+            mBuffer->setEnabled(false);
+        }
+        mBuffer = buffer;
+        if (mBuffer) {
+            mBuffer->setEnabled(isVisible());
+        }
+        update();
+    }
+}
+
+void ChannelScopes::setColors(Palette const& pal) {
+    auto widgetPal = palette();
+    widgetPal.setColor(QPalette::Window, pal[Palette::ColorScopeBackground]);
+    setPalette(widgetPal);
+
+    mLineColor = pal[Palette::ColorScopeLine];
+
+    update();
+}
+
+void ChannelScopes::hideEvent(QHideEvent *evt) {
+    QFrame::hideEvent(evt);
+    if (mBuffer) {
+        // nothing to show, stop capturing
+        mBuffer->setEnabled(false);
+    }
+}
+
+void ChannelScopes::showEvent(QShowEvent *evt) {
+    QFrame::showEvent(evt);
+    if (mBuffer) {
+        mBuffer->setEnabled(true);
+    }
+}
+
+void ChannelScopes::paintEvent(QPaintEvent *evt) {
+    QFrame::paintEvent(evt);
+
+    QPainter painter(this);
+
+    auto const inner = contentsRect();
+    auto const scopeWidth = (float)inner.width() / ChannelScopeBuffer::CHANNELS;
+    auto const axis = inner.top() + SCOPE_HEIGHT / 2.0f;
+    // leave a pixel above and below the waveform
+    auto const yscale = SCOPE_HEIGHT / 2.0f - 1.0f;
+
+    // dividers between each scope, and the channel names
+    auto dimColor = mLineColor;
+    dimColor.setAlphaF(0.4);
+    painter.setPen(dimColor);
+    for (int i = 0; i < ChannelScopeBuffer::CHANNELS; ++i) {
+        auto const left = inner.left() + i * scopeWidth;
+        if (i) {
+            painter.drawLine(QPointF(left, inner.top()), QPointF(left, inner.bottom() + 1));
+        }
+        painter.drawText(QRectF(left + 2, inner.top(), scopeWidth, SCOPE_HEIGHT),
+                         Qt::AlignLeft | Qt::AlignTop, tr("CH%1").arg(i + 1));
+    }
+
+    mLines.clear();
+    ChannelScopeBuffer::Snapshot const *snapshot = mBuffer ? &mBuffer->read() : nullptr;
+    for (int i = 0; i < ChannelScopeBuffer::CHANNELS; ++i) {
+        auto const left = inner.left() + i * scopeWidth + 1.0f;
+        auto const xscale = (scopeWidth - 2.0f) / (ChannelScopeBuffer::SAMPLES - 1);
+        if (snapshot == nullptr || !snapshot->channels[i].playing) {
+            mLines.append(QLineF(left, axis, left + scopeWidth - 2.0f, axis));
+            continue;
+        }
+        // samples are steps, so each sample is a horizontal line joined to
+        // the next by a vertical one
+        auto const& samples = snapshot->channels[i].samples;
+        auto prevY = axis - samples[0] * yscale;
+        for (int s = 0; s < ChannelScopeBuffer::SAMPLES; ++s) {
+            auto const y = axis - samples[s] * yscale;
+            auto const x = left + s * xscale;
+            if (s) {
+                mLines.append(QLineF(x, prevY, x, y));
+            }
+            mLines.append(QLineF(x, y, std::min(x + xscale, left + scopeWidth - 2.0f), y));
+            prevY = y;
+        }
+    }
+
+    painter.setPen(QPen(mLineColor, 1.0));
+    painter.drawLines(mLines);
+}
+
+#undef TU
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "audio/ChannelScopeBuffer.hpp"
+#include "config/data/Palette.hpp"
+
+#include <QFrame>
+#include <QLineF>
+#include <QVector>
+
+//
+// Four mini oscilloscopes, one for each channel, shown side by side. Capture
+// in the buffer is only enabled while the widget is visible.
+//
+class ChannelScopes : public QFrame {
+
+    Q_OBJECT
+
+public:
+
+    explicit ChannelScopes(QWidget *parent = nullptr);
+
+    void setBuffer(ChannelScopeBuffer *buffer);
+
+    void setColors(Palette const& pal);
+
+protected:
+
+    void hideEvent(QHideEvent *evt) override;
+
+    void paintEvent(QPaintEvent *evt) override;
+
+    void showEvent(QShowEvent *evt) override;
+
+private:
+    Q_DISABLE_COPY(ChannelScopes)
+
+    static constexpr int SCOPE_HEIGHT = 32;
+
+    ChannelScopeBuffer *mBuffer;
+
+    // line segments for all scopes, reused between paints
+    QVector<QLineF> mLines;
+
+    QColor mLineColor;
+
+};
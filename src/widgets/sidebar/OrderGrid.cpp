@@ -71,6 +71,7 @@ void OrderGrid::setColors(Palette const& colors) {
     mTrackerColor = colors[Palette::ColorRowPlayer];
     mCursorColor = colors[Palette::ColorCursor];
     mCursorColor.setAlpha(128);
+    mCellPainter.clearGlyphs();
 
     update();
 }
@@ -334,6 +335,7 @@ void OrderGrid::paintEvent(QPaintEvent *evt) {
 
         ypos += cellHeight;
     }
+    mCellPainter.flushCells(painter);
 
 
     // line
@@ -0,0 +1,136 @@
+
+#include "widgets/sidebar/SpectrumView.hpp"
+
+#include <QGuiApplication>
+#include <QPainter>
+#include <QTimerEvent>
+
+#define TU SpectrumViewTU
+namespace TU {
+
+constexpr int LINE_WIDTH = 1;
+
+// about 60 fps, the rate of the analyzer
+constexpr int REFRESH_INTERVAL = 16;
+
+// space between bars
+constexpr float BAR_GAP = 1.0f;
+
+}
+
+SpectrumView::SpectrumView(QWidget *parent) :
+    QFrame(parent),
+    mAnalyzer(nullptr),
+    mRefreshTimer(),
+    mVersion(0),
+    mBars(),
+    mPeaks(),
+    mBarColor(Qt::white)
+{
+    setAttribute(Qt::WA_StyledBackground);
+    setAutoFillBackground(true);
+
+    // same defaults as AudioScope
+    auto pal = palette();
+    if (pal.isCopyOf(QGuiApplication::palette())) {
+        pal.setColor(QPalette::Window, Qt::black);
+        setPalette(pal);
+    }
+
+    setFrameStyle(QFrame::Box | QFrame::Plain);
+    setLineWidth(TU::LINE_WIDTH);
+    setFixedHeight(VIEW_HEIGHT + TU::LINE_WIDTH * 2);
+}
+
+void SpectrumView::setAnalyzer(SpectrumAnalyzer *analyzer) {
+    if (analyzer != mAnalyzer) {
+        if (mAnalyzer) {
+            mAnalyzer->setEnabled(false);
+        }
+        mAnalyzer = analyzer;
+        if (mAnalyzer) {
+            mAnalyzer->setEnabled(isVisible());
+        }
+        update();
+    }
+}
+
+void SpectrumView::setColors(Palette const& pal) {
+    auto widgetPal = palette();
+    widgetPal.setColor(QPalette::Window, pal[Palette::ColorScopeBackground]);
+    setPalette(widgetPal);
+
+    mBarColor = pal[Palette::ColorScopeLine];
+
+    update();
+}
+
+void SpectrumView::hideEvent(QHideEvent *evt) {
+    QFrame::hideEvent(evt);
+    mRefreshTimer.stop();
+    if (mAnalyzer) {
+        // nothing to show, stop analyzing
+        mAnalyzer->setEnabled(false);
+    }
+}
+
+void SpectrumView::showEvent(QShowEvent *evt) {
+    QFrame::showEvent(evt);
+    if (mAnalyzer) {
+        mAnalyzer->setEnabled(true);
+    }
+    mRefreshTimer.start(TU::REFRESH_INTERVAL, Qt::PreciseTimer, this);
+}
+
+void SpectrumView::timerEvent(QTimerEvent *evt) {
+    if (evt->timerId() == mRefreshTimer.timerId()) {
+        if (mAnalyzer && mAnalyzer->read().version != mVersion) {
+            update();
+        }
+    } else {
+        QFrame::timerEvent(evt);
+    }
+}
+
+void SpectrumView::paintEvent(QPaintEvent *evt) {
+    QFrame::paintEvent(evt);
+
+    if (mAnalyzer == nullptr) {
+        return;
+    }
+
+    auto const& snapshot = mAnalyzer->read();
+    mVersion = snapshot.version;
+
+    auto const inner = contentsRect();
+    auto const barWidth = (float)inner.width() / SpectrumAnalyzer::BANDS;
+    auto const bottom = (float)(inner.bottom() + 1);
+    auto const height = (float)inner.height();
+
+    mBars.clear();
+    mPeaks.clear();
+    for (int i = 0; i < SpectrumAnalyzer::BANDS; ++i) {
+        auto const left = inner.left() + i * barWidth;
+        auto const right = left + barWidth - TU::BAR_GAP;
+        auto const level = snapshot.levels[i] * height;
+        if (level >= 1.0f) {
+            mBars.append(QRectF(left, bottom - level, right - left, level));
+        }
+        auto const peak = snapshot.peaks[i] * height;
+        if (peak >= 1.0f) {
+            auto const y = bottom - peak + 0.5f;
+            mPeaks.append(QLineF(left, y, right, y));
+        }
+    }
+
+    QPainter painter(this);
+    auto barColor = mBarColor;
+    barColor.setAlphaF(0.6);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(barColor);
+    painter.drawRects(mBars);
+    painter.setPen(mBarColor);
+    painter.drawLines(mPeaks);
+}
+
+#undef TU
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "audio/SpectrumAnalyzer.hpp"
+#include "config/data/Palette.hpp"
+
+#include <QBasicTimer>
+#include <QFrame>
+#include <QLineF>
+#include <QRectF>
+#include <QVector>
+
+//
+// Bar display of a SpectrumAnalyzer's levels. The analyzer is only enabled
+// while the view is visible. Painting only draws the published levels, the
+// view repaints at the display rate when a new snapshot is available.
+//
+class SpectrumView : public QFrame {
+
+    Q_OBJECT
+
+public:
+
+    explicit SpectrumView(QWidget *parent = nullptr);
+
+    void setAnalyzer(SpectrumAnalyzer *analyzer);
+
+    void setColors(Palette const& pal);
+
+protected:
+
+    void hideEvent(QHideEvent *evt) override;
+
+    void paintEvent(QPaintEvent *evt) override;
+
+    void showEvent(QShowEvent *evt) override;
+
+    void timerEvent(QTimerEvent *evt) override;
+
+private:
+    Q_DISABLE_COPY(SpectrumView)
+
+    static constexpr int VIEW_HEIGHT = 48;
+
+    SpectrumAnalyzer *mAnalyzer;
+    QBasicTimer mRefreshTimer;
+    // version of the last snapshot painted
+    uint64_t mVersion;
+
+    // reused between paints
+    QVector<QRectF> mBars;
+    QVector<QLineF> mPeaks;
+
+    QColor mBarColor;
+
+};
@@ -4,30 +4,144 @@
 #include <QPaintEvent>
 #include <QPainter>
 
+#include <algorithm>
+#include <cmath>
+
+#define TU PeakMeterTU
+namespace TU {
+
+// width of the channel labels
+constexpr int LABEL_WIDTH = 12;
+
+qreal dbToWidth(float amplitude, int width) {
+    if (amplitude <= 0.0f) {
+        return 0.0;
+    }
+    auto const db = 20.0 * std::log10(amplitude);
+    if (db <= VolumeMeterAnimation::MIN_DB) {
+        return 0.0;
+    }
+    return std::min(1.0, (db - VolumeMeterAnimation::MIN_DB) / -VolumeMeterAnimation::MIN_DB) * width;
+}
+
+}
+
 
 PeakMeter::PeakMeter(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent),
+    mMeter(nullptr),
+    mVersion(0),
+    mPeaks(),
+    mRms(),
+    mHolds(),
+    mHoldTimers(),
+    mBackgroundColor(Qt::black),
+    mBarColor(Qt::white)
 {
-    connect(&mMeterLeft, &VolumeMeterAnimation::redraw, this, qOverload<>(&PeakMeter::update));
-    connect(&mMeterRight, &VolumeMeterAnimation::redraw, this, qOverload<>(&PeakMeter::update));
+    for (int i = 0; i < LevelMeter::CHANNELS; ++i) {
+        connect(&mPeaks[i], &VolumeMeterAnimation::redraw, this, qOverload<>(&PeakMeter::update));
+        connect(&mRms[i], &VolumeMeterAnimation::redraw, this, qOverload<>(&PeakMeter::update));
+        mHoldTimers[i].start();
+    }
+
+    setFixedHeight(LevelMeter::CHANNELS * (BAR_HEIGHT + BAR_SPACING) - BAR_SPACING);
 }
 
+void PeakMeter::setMeter(LevelMeter *meter) {
+    if (meter != mMeter) {
+        if (mMeter) {
+            mMeter->setEnabled(false);
+        }
+        mMeter = meter;
+        if (mMeter) {
+            mMeter->setEnabled(isVisible());
+        }
+        updateLevels();
+    }
+}
+
+void PeakMeter::setColors(Palette const& pal) {
+    mBackgroundColor = pal[Palette::ColorScopeBackground];
+    mBarColor = pal[Palette::ColorScopeLine];
+    update();
+}
 
-void PeakMeter::setPeaks(qint16 left, qint16 right) {
+void PeakMeter::updateLevels() {
+    if (mMeter == nullptr) {
+        return;
+    }
 
-    mMeterLeft.setTarget(left);
-    mMeterRight.setTarget(right);
+    auto const& levels = mMeter->read();
+    if (levels.version == mVersion) {
+        return;
+    }
+    mVersion = levels.version;
 
+    for (int i = 0; i < LevelMeter::CHANNELS; ++i) {
+        mPeaks[i].setTarget(levels.peak[i]);
+        mRms[i].setTarget(levels.rms[i]);
+        auto const truePeak = levels.truePeak[i];
+        // silence (ie the render stopped) releases the hold immediately
+        if (truePeak >= mHolds[i] || truePeak == 0.0f || mHoldTimers[i].hasExpired(HOLD_TIME)) {
+            mHolds[i] = truePeak;
+            mHoldTimers[i].restart();
+        }
+    }
+    update();
+}
+
+void PeakMeter::hideEvent(QHideEvent *evt) {
+    QWidget::hideEvent(evt);
+    if (mMeter) {
+        // nothing to show, stop measuring
+        mMeter->setEnabled(false);
+    }
+}
+
+void PeakMeter::showEvent(QShowEvent *evt) {
+    QWidget::showEvent(evt);
+    if (mMeter) {
+        mMeter->setEnabled(true);
+    }
 }
 
 void PeakMeter::paintEvent(QPaintEvent *evt) {
     Q_UNUSED(evt)
 
+    static char const *const LABELS[LevelMeter::CHANNELS] = { "L", "R", "M" };
+
     QPainter painter(this);
+    auto font = painter.font();
+    font.setPixelSize(BAR_HEIGHT);
+    painter.setFont(font);
 
-    int const w = width();
-    int const center = w / 2;
+    auto const barWidth = width() - TU::LABEL_WIDTH;
+    auto peakColor = mBarColor;
+    peakColor.setAlphaF(0.5);
 
-    painter.fillRect(QRectF(center, 0.0, mMeterLeft.meterWidth(center), 16.0), Qt::black);
-    painter.fillRect(QRectF(center, 0.0, -mMeterRight.meterWidth(center), 16.0), Qt::black);
+    for (int i = 0; i < LevelMeter::CHANNELS; ++i) {
+        auto const y = i * (BAR_HEIGHT + BAR_SPACING);
+
+        painter.setPen(palette().color(QPalette::WindowText));
+        painter.drawText(QRect(0, y, TU::LABEL_WIDTH, BAR_HEIGHT), Qt::AlignCenter, QString::fromLatin1(LABELS[i]));
+
+        QRectF bar(TU::LABEL_WIDTH, y, barWidth, BAR_HEIGHT);
+        painter.fillRect(bar, mBackgroundColor);
+
+        auto const rms = mRms[i].meterWidth(barWidth);
+        auto const peak = mPeaks[i].meterWidth(barWidth);
+        painter.fillRect(QRectF(bar.left(), y, rms, BAR_HEIGHT), mBarColor);
+        if (peak > rms) {
+            painter.fillRect(QRectF(bar.left() + rms, y, peak - rms, BAR_HEIGHT), peakColor);
+        }
+
+        auto const hold = mHolds[i];
+        auto const holdX = TU::dbToWidth(hold, barWidth);
+        if (holdX > 0.0) {
+            auto const clipped = hold >= 1.0f;
+            painter.fillRect(QRectF(bar.left() + holdX - 1.0, y, 2.0, BAR_HEIGHT), clipped ? QColor(Qt::red) : mBarColor);
+        }
+    }
 }
+
+#undef TU
@@ -1,10 +1,22 @@
-
 #pragma once
 
+#include "audio/LevelMeter.hpp"
+#include "config/data/Palette.hpp"
 #include "widgets/visualizers/VolumeMeterAnimation.hpp"
 
+#include <QElapsedTimer>
 #include <QWidget>
 
+#include <array>
+
+//
+// Level meter for the left, right and master output. Each meter shows the
+// RMS level as a solid bar, the peak level past it, and the true peak held
+// for a moment as a tick, which turns red when the output clips (0 dBTP).
+//
+// Levels are computed by the render thread (see LevelMeter), measuring is
+// only enabled while the meter is visible.
+//
 class PeakMeter : public QWidget {
 
     Q_OBJECT
@@ -12,18 +24,43 @@ class PeakMeter : public QWidget {
 public:
     PeakMeter(QWidget *parent = nullptr);
 
+    void setMeter(LevelMeter *meter);
+
+    void setColors(Palette const& pal);
+
 public slots:
 
-    void setPeaks(qint16 left, qint16 right);
+    //
+    // Reads the latest levels from the meter and animates to them.
+    //
+    void updateLevels();
 
 protected:
 
+    void hideEvent(QHideEvent *evt) override;
+
     void paintEvent(QPaintEvent *evt) override;
 
+    void showEvent(QShowEvent *evt) override;
+
 private:
     Q_DISABLE_COPY(PeakMeter)
 
-    VolumeMeterAnimation mMeterLeft;
-    VolumeMeterAnimation mMeterRight;
+    static constexpr int BAR_HEIGHT = 8;
+    static constexpr int BAR_SPACING = 2;
+    // how long the true peak is held, in milliseconds
+    static constexpr int HOLD_TIME = 1500;
+
+    LevelMeter *mMeter;
+    uint64_t mVersion;
+
+    std::array<VolumeMeterAnimation, LevelMeter::CHANNELS> mPeaks;
+    std::array<VolumeMeterAnimation, LevelMeter::CHANNELS> mRms;
+    // held true peak of each channel, linear
+    std::array<float, LevelMeter::CHANNELS> mHolds;
+    std::array<QElapsedTimer, LevelMeter::CHANNELS> mHoldTimers;
+
+    QColor mBackgroundColor;
+    QColor mBarColor;
 
 };
@@ -5,11 +5,10 @@
 
 #include <cmath>
 
-constexpr int DURATION = 100;
+constexpr int DURATION = 300;
 
 VolumeMeterAnimation::VolumeMeterAnimation(QObject *parent) :
     QAbstractAnimation(parent),
-    mTargetSample(0),
     mTarget(MIN_DB),
     mVolume(MIN_DB),
     mStartValue(MIN_DB),
@@ -35,23 +34,27 @@ int VolumeMeterAnimation::duration() const {
     return DURATION;
 }
 
-void VolumeMeterAnimation::setTarget(qint16 volume) {
-    if (mTargetSample != volume) {
-        mTargetSample = volume;
-        auto target = volume ? 6.0 * log2(volume / (double)INT16_MAX) : MIN_DB;
-        if (target < MIN_DB) {
-            target = MIN_DB;
-        }
-
-        if (!qFuzzyCompare(target, mTarget)) {
-            stop();
-            mTarget = target;
-            mStartValue = mVolume;
-            mDifference = mTarget - mVolume;
-            start();
-        }
+void VolumeMeterAnimation::setTarget(float amplitude) {
+    auto target = amplitude > 0.0f ? 20.0 * std::log10(amplitude) : MIN_DB;
+    if (target < MIN_DB) {
+        target = MIN_DB;
+    }
+
+    if (qFuzzyCompare(target, mTarget)) {
+        return;
+    }
+
+    stop();
+    mTarget = target;
+    if (target >= mVolume) {
+        // rise immediately
+        mVolume = target;
+        emit redraw();
+    } else {
+        mStartValue = mVolume;
+        mDifference = mTarget - mVolume;
+        start();
     }
-    
 }
 
 void VolumeMeterAnimation::updateCurrentTime(int currentTime) {
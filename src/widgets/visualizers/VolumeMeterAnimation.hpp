@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include <QAbstractAnimation>
@@ -9,6 +8,7 @@
 //
 // Simple animation class for a volume meter. Set the target volume
 // via setTarget and the class will animate the level using sine interpolation.
+// Rises are shown immediately, only falls are animated.
 //
 class VolumeMeterAnimation : public QAbstractAnimation {
 
@@ -34,10 +34,10 @@ public:
     int duration() const override;
 
     //
-    // Set the target volume to move to. If the animation was stopped
-    // it is started.
+    // Set the target volume to move to, as a linear amplitude (1.0 is
+    // 0 dBFS). If the animation was stopped it is started.
     //
-    void setTarget(qint16 volume);
+    void setTarget(float amplitude);
 
 signals:
     //
@@ -53,8 +53,6 @@ private:
 
     Q_DISABLE_COPY(VolumeMeterAnimation)
 
-    qint16 mTargetSample;
-
     // these values are in dB
     qreal mTarget;
     qreal mVolume;
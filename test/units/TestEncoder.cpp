@@ -0,0 +1,499 @@
+
+#include "units/TestEncoder.hpp"
+
+#include "audio/Encoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+Q_DECLARE_METATYPE(Encoder::Format)
+
+#define TU TestEncoderTU
+namespace TU {
+
+constexpr int CHANNELS = 2;
+constexpr int SAMPLERATE = 44100;
+// not a multiple of the FLAC block size, so the last block is partial
+constexpr size_t SAMPLES = 10000;
+
+std::vector<uint8_t> readFile(std::string const& filename) {
+    std::ifstream stream(filename, std::ios::binary);
+    return { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+}
+
+bool encode(Encoder::Format format, std::string const& filename, std::vector<float> const& signal) {
+    auto encoder = Encoder::create(format, filename, CHANNELS, SAMPLERATE);
+    // written in uneven chunks, like the exporter does
+    size_t const total = signal.size() / CHANNELS;
+    size_t offset = 0;
+    for (size_t chunk = 1; offset < total; chunk += 777) {
+        auto const count = std::min(chunk, total - offset);
+        encoder->write(signal.data() + offset * CHANNELS, count);
+        offset += count;
+    }
+    return encoder->finish();
+}
+
+int32_t signExtend(uint32_t value, int bits) {
+    auto const shift = 32 - bits;
+    return (int32_t)(value << shift) >> shift;
+}
+
+//
+// Decoded WAV file, samples are interleaved and stored in floats or ints
+// depending on the format tag.
+//
+struct WavFile {
+    int formatTag = 0;
+    int channels = 0;
+    int samplerate = 0;
+    int bits = 0;
+    std::vector<float> floats;
+    std::vector<int32_t> ints;
+};
+
+bool decodeWav(std::vector<uint8_t> const& data, WavFile &wav) {
+    auto u16 = [&](size_t pos) {
+        return (uint32_t)data[pos] | ((uint32_t)data[pos + 1] << 8);
+    };
+    auto u32 = [&](size_t pos) {
+        return u16(pos) | (u16(pos + 2) << 16);
+    };
+
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4)) {
+        return false;
+    }
+    if (u32(4) + 8 != data.size()) {
+        return false;
+    }
+
+    size_t pos = 12;
+    while (pos + 8 <= data.size()) {
+        auto const id = data.data() + pos;
+        size_t const size = u32(pos + 4);
+        pos += 8;
+        if (pos + size > data.size()) {
+            return false;
+        }
+        if (!memcmp(id, "fmt ", 4)) {
+            wav.formatTag = u16(pos);
+            wav.channels = u16(pos + 2);
+            wav.samplerate = u32(pos + 4);
+            wav.bits = u16(pos + 14);
+        } else if (!memcmp(id, "data", 4)) {
+            int const bytes = wav.bits / 8;
+            if (bytes == 0) {
+                return false;
+            }
+            for (size_t i = 0; i + bytes <= size; i += bytes) {
+                uint32_t value = 0;
+                for (int b = 0; b < bytes; ++b) {
+                    value |= (uint32_t)data[pos + i + b] << (8 * b);
+                }
+                if (wav.formatTag == 3) {
+                    float sample;
+                    memcpy(&sample, &value, sizeof(sample));
+                    wav.floats.push_back(sample);
+                } else {
+                    wav.ints.push_back(signExtend(value, wav.bits));
+                }
+            }
+        }
+        // chunks are padded to an even size
+        pos += size + (size & 1);
+    }
+    return pos == data.size();
+}
+
+//
+// Big-endian bit reader for FLAC streams
+//
+class BitReader {
+
+public:
+    explicit BitReader(std::vector<uint8_t> const& data, size_t pos) :
+        mData(data),
+        mBit(pos * 8)
+    {
+    }
+
+    bool eof() const {
+        return mBit >= mData.size() * 8;
+    }
+
+    size_t bytePos() const {
+        return mBit / 8;
+    }
+
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        while (bits--) {
+            auto const byte = mBit / 8;
+            auto const bit = byte < mData.size() ? (mData[byte] >> (7 - mBit % 8)) & 1 : 0;
+            value = (value << 1) | bit;
+            ++mBit;
+        }
+        return value;
+    }
+
+    int32_t readSigned(int bits) {
+        return signExtend(read(bits), bits);
+    }
+
+    int32_t readRice(int param) {
+        uint32_t quotient = 0;
+        while (!eof() && read(1) == 0) {
+            ++quotient;
+        }
+        auto const folded = (quotient << param) | read(param);
+        return (int32_t)(folded >> 1) ^ -(int32_t)(folded & 1);
+    }
+
+    void alignByte() {
+        mBit = (mBit + 7) & ~size_t(7);
+    }
+
+private:
+    std::vector<uint8_t> const& mData;
+    size_t mBit;
+};
+
+uint8_t crc8(uint8_t const *data, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t crc16(uint8_t const *data, size_t len) {
+    uint16_t crc = 0;
+    while (len--) {
+        crc ^= (uint16_t)(*data++ << 8);
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+struct FlacFile {
+    int channels = 0;
+    int samplerate = 0;
+    int bits = 0;
+    uint64_t totalSamples = 0;
+    // interleaved
+    std::vector<int32_t> samples;
+};
+
+//
+// Decodes the subset of FLAC written by the Flac encoder (fixed block size,
+// CONSTANT, VERBATIM and FIXED subframes). Returns false if the stream is
+// malformed or a CRC does not match.
+//
+bool decodeFlac(std::vector<uint8_t> const& data, FlacFile &flac) {
+    if (data.size() < 42 || memcmp(data.data(), "fLaC", 4)) {
+        return false;
+    }
+
+    BitReader reader(data, 4);
+    bool last = false;
+    while (!last) {
+        last = reader.read(1);
+        auto const type = reader.read(7);
+        auto const length = reader.read(24);
+        if (type == 0) {
+            reader.read(16);    // min block size
+            reader.read(16);    // max block size
+            reader.read(24);    // min frame size
+            reader.read(24);    // max frame size
+            flac.samplerate = (int)reader.read(20);
+            flac.channels = (int)reader.read(3) + 1;
+            flac.bits = (int)reader.read(5) + 1;
+            flac.totalSamples = (uint64_t)reader.read(4) << 32;
+            flac.totalSamples |= reader.read(32);
+            for (int i = 0; i < 4; ++i) {
+                reader.read(32);
+            }
+        } else {
+            for (uint32_t i = 0; i < length; ++i) {
+                reader.read(8);
+            }
+        }
+    }
+
+    std::vector<std::vector<int32_t>> block(flac.channels);
+    uint32_t expectedFrame = 0;
+    while (!reader.eof()) {
+        auto const frameStart = reader.bytePos();
+        if (reader.read(16) != 0xFFF8) {
+            return false;
+        }
+        auto const blocksizeCode = reader.read(4);
+        auto const samplerateCode = reader.read(4);
+        auto const assignment = reader.read(4);
+        auto const sizeCode = reader.read(3);
+        reader.read(1);
+        if (blocksizeCode != 0x7 || samplerateCode != 0 || sizeCode != (flac.bits == 16 ? 0x4u : 0x6u)) {
+            return false;
+        }
+
+        // UTF-8 coded frame number
+        uint32_t frameNumber = reader.read(8);
+        int continuation = 0;
+        while (frameNumber & (0x80 >> continuation)) {
+            ++continuation;
+        }
+        if (continuation) {
+            frameNumber &= 0x7F >> continuation;
+            for (int i = 1; i < continuation; ++i) {
+                frameNumber = (frameNumber << 6) | (reader.read(8) & 0x3F);
+            }
+        }
+        if (frameNumber != expectedFrame++) {
+            return false;
+        }
+
+        int const n = (int)reader.read(16) + 1;
+        auto const headerCrc = crc8(data.data() + frameStart, reader.bytePos() - frameStart);
+        if (reader.read(8) != headerCrc) {
+            return false;
+        }
+
+        for (int ch = 0; ch < flac.channels; ++ch) {
+            auto &samples = block[ch];
+            samples.resize(n);
+            // the side channel has an extra bit
+            int bps = flac.bits;
+            if ((assignment == 0x8 && ch == 1) || (assignment == 0x9 && ch == 0) || (assignment == 0xA && ch == 1)) {
+                ++bps;
+            }
+
+            if (reader.read(1) != 0) {
+                return false;
+            }
+            auto const type = reader.read(6);
+            if (reader.read(1) != 0) {
+                return false; // wasted bits are never written
+            }
+
+            if (type == 0x00) {
+                std::fill(samples.begin(), samples.end(), reader.readSigned(bps));
+            } else if (type == 0x01) {
+                for (auto &sample : samples) {
+                    sample = reader.readSigned(bps);
+                }
+            } else if ((type & 0x38) == 0x08 && (type & 0x7) <= 4) {
+                int const order = type & 0x7;
+                for (int i = 0; i < order; ++i) {
+                    samples[i] = reader.readSigned(bps);
+                }
+                auto const method = reader.read(2);
+                int const paramBits = method ? 5 : 4;
+                int const partitionOrder = (int)reader.read(4);
+                int const partitionSize = n >> partitionOrder;
+                int i = order;
+                for (int part = 0; part < (1 << partitionOrder); ++part) {
+                    int const param = (int)reader.read(paramBits);
+                    if (param == (1 << paramBits) - 1) {
+                        return false; // escape codes are never written
+                    }
+                    for (int const end = (part + 1) * partitionSize; i < end; ++i) {
+                        int64_t prediction = 0;
+                        auto const x = samples.data() + i;
+                        switch (order) {
+                            case 1:
+                                prediction = x[-1];
+                                break;
+                            case 2:
+                                prediction = 2 * (int64_t)x[-1] - x[-2];
+                                break;
+                            case 3:
+                                prediction = 3 * (int64_t)x[-1] - 3 * (int64_t)x[-2] + x[-3];
+                                break;
+                            case 4:
+                                prediction = 4 * (int64_t)x[-1] - 6 * (int64_t)x[-2] + 4 * (int64_t)x[-3] - x[-4];
+                                break;
+                            default:
+                                break;
+                        }
+                        *x = (int32_t)(prediction + reader.readRice(param));
+                    }
+                }
+            } else {
+                return false;
+            }
+        }
+
+        reader.alignByte();
+        auto const frameCrc = crc16(data.data() + frameStart, reader.bytePos() - frameStart);
+        if (reader.read(16) != frameCrc) {
+            return false;
+        }
+
+        // undo the stereo decorrelation
+        if (flac.channels == 2) {
+            auto &a = block[0];
+            auto &b = block[1];
+            for (int i = 0; i < n; ++i) {
+                switch (assignment) {
+                    case 0x8:
+                        // left, side
+                        b[i] = a[i] - b[i];
+                        break;
+                    case 0x9:
+                        // side, right
+                        a[i] = a[i] + b[i];
+                        break;
+                    case 0xA: {
+                        // mid, side
+                        auto const mid = (a[i] * 2) | (b[i] & 1);
+                        auto const side = b[i];
+                        a[i] = (mid + side) >> 1;
+                        b[i] = (mid - side) >> 1;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+        }
+
+        for (int i = 0; i < n; ++i) {
+            for (auto const& channel : block) {
+                flac.samples.push_back(channel[i]);
+            }
+        }
+    }
+
+    return flac.samples.size() == flac.totalSamples * flac.channels;
+}
+
+}
+
+TestEncoder::TestEncoder() :
+    mDir(),
+    mSignal()
+{
+}
+
+void TestEncoder::initTestCase() {
+    QVERIFY(mDir.isValid());
+
+    // a mix of content so that every subframe type and channel assignment is
+    // exercised: tones, silence (constant), noise (verbatim) and clipping
+    uint32_t noise = 12345;
+    mSignal.reserve(TU::SAMPLES * TU::CHANNELS);
+    for (size_t i = 0; i < TU::SAMPLES; ++i) {
+        float left, right;
+        if (i < 3000) {
+            left = 0.5f * std::sin(i * 0.05f);
+            right = 0.25f * std::sin(i * 0.031f);
+        } else if (i < 4500) {
+            left = 0.0f;
+            right = 0.0f;
+        } else if (i < 6000) {
+            noise = noise * 1664525u + 1013904223u;
+            left = (int32_t)noise / 2147483648.0f;
+            right = -left;
+        } else if (i < 7000) {
+            left = 1.5f * std::sin(i * 0.01f);
+            right = left;
+        } else {
+            left = 0.3f * std::sin(i * 0.02f);
+            right = 0.3f * std::sin(i * 0.02f + 0.5f);
+        }
+        mSignal.push_back(left);
+        mSignal.push_back(right);
+    }
+}
+
+void TestEncoder::wavFloat() {
+    auto const filename = mDir.filePath(QStringLiteral("float.wav")).toStdString();
+    QVERIFY(TU::encode(Encoder::Format::wavFloat, filename, mSignal));
+
+    TU::WavFile wav;
+    QVERIFY(TU::decodeWav(TU::readFile(filename), wav));
+    QCOMPARE(wav.formatTag, 3);
+    QCOMPARE(wav.channels, TU::CHANNELS);
+    QCOMPARE(wav.samplerate, TU::SAMPLERATE);
+    QCOMPARE(wav.bits, 32);
+    QVERIFY(wav.floats == mSignal);
+}
+
+void TestEncoder::wavPcm_data() {
+    QTest::addColumn<Encoder::Format>("format");
+    QTest::addColumn<int>("bits");
+
+    QTest::newRow("16-bit") << Encoder::Format::wav16 << 16;
+    QTest::newRow("24-bit") << Encoder::Format::wav24 << 24;
+}
+
+void TestEncoder::wavPcm() {
+    QFETCH(Encoder::Format, format);
+    QFETCH(int, bits);
+
+    auto const filename = mDir.filePath(QStringLiteral("pcm%1.wav").arg(bits)).toStdString();
+    QVERIFY(TU::encode(format, filename, mSignal));
+
+    TU::WavFile wav;
+    QVERIFY(TU::decodeWav(TU::readFile(filename), wav));
+    QCOMPARE(wav.formatTag, 1);
+    QCOMPARE(wav.channels, TU::CHANNELS);
+    QCOMPARE(wav.samplerate, TU::SAMPLERATE);
+    QCOMPARE(wav.bits, bits);
+    QCOMPARE(wav.ints.size(), mSignal.size());
+
+    // dither adds less than 1 LSB of noise to the rounded sample, clipped
+    // samples are clamped to the full scale
+    double const scale = (double)(INT64_C(1) << (bits - 1));
+    for (size_t i = 0; i < mSignal.size(); ++i) {
+        auto const expected = std::clamp((double)mSignal[i] * scale, -scale, scale - 1);
+        if (std::abs(wav.ints[i] - expected) > 1.5) {
+            QFAIL(qPrintable(QStringLiteral("sample %1 is %2, expected %3").arg(i).arg(wav.ints[i]).arg(expected)));
+        }
+    }
+}
+
+void TestEncoder::flac_data() {
+    QTest::addColumn<Encoder::Format>("format");
+    QTest::addColumn<Encoder::Format>("wavFormat");
+    QTest::addColumn<int>("bits");
+
+    QTest::newRow("16-bit") << Encoder::Format::flac16 << Encoder::Format::wav16 << 16;
+    QTest::newRow("24-bit") << Encoder::Format::flac24 << Encoder::Format::wav24 << 24;
+}
+
+void TestEncoder::flac() {
+    QFETCH(Encoder::Format, format);
+    QFETCH(Encoder::Format, wavFormat);
+    QFETCH(int, bits);
+
+    auto const filename = mDir.filePath(QStringLiteral("flac%1.flac").arg(bits)).toStdString();
+    QVERIFY(TU::encode(format, filename, mSignal));
+
+    TU::FlacFile flac;
+    QVERIFY(TU::decodeFlac(TU::readFile(filename), flac));
+    QCOMPARE(flac.channels, TU::CHANNELS);
+    QCOMPARE(flac.samplerate, TU::SAMPLERATE);
+    QCOMPARE(flac.bits, bits);
+    QCOMPARE(flac.totalSamples, (uint64_t)TU::SAMPLES);
+
+    // both encoders dither the same way, so a lossless decode must match the
+    // PCM WAV of the same depth exactly
+    auto const wavFilename = mDir.filePath(QStringLiteral("flacref%1.wav").arg(bits)).toStdString();
+    QVERIFY(TU::encode(wavFormat, wavFilename, mSignal));
+    TU::WavFile wav;
+    QVERIFY(TU::decodeWav(TU::readFile(wavFilename), wav));
+    QVERIFY(flac.samples == wav.ints);
+}
+
+#undef TU
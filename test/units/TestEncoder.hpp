@@ -0,0 +1,36 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+
+#include <vector>
+
+class TestEncoder : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestEncoder();
+
+private slots:
+
+    void initTestCase();
+
+    void wavFloat();
+
+    void wavPcm_data();
+    void wavPcm();
+
+    void flac_data();
+    void flac();
+
+private:
+
+    QTemporaryDir mDir;
+
+    // interleaved stereo test signal
+    std::vector<float> mSignal;
+
+};
@@ -0,0 +1,112 @@
+
+#include "units/TestFft.hpp"
+
+#include "audio/Fft.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+#define TU TestFftTU
+namespace TU {
+
+constexpr double PI = 3.14159265358979323846;
+
+//
+// Reference for Fft::powerSpectrum, a Hann windowed DFT computed directly in
+// double precision and normalized the same way.
+//
+std::vector<double> naivePowerSpectrum(std::vector<float> const& input) {
+    auto const n = input.size();
+    std::vector<double> windowed(n);
+    double gain = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        auto const w = 0.5 - 0.5 * std::cos(2.0 * PI * i / n);
+        windowed[i] = input[i] * w;
+        gain += w;
+    }
+
+    std::vector<double> power(n / 2 + 1);
+    for (size_t k = 0; k < power.size(); ++k) {
+        double re = 0.0;
+        double im = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            auto const angle = -2.0 * PI * (double)((k * i) % n) / n;
+            re += windowed[i] * std::cos(angle);
+            im += windowed[i] * std::sin(angle);
+        }
+        power[k] = (re * re + im * im) * 4.0 / (gain * gain);
+    }
+    power.front() *= 0.25;
+    power.back() *= 0.25;
+    return power;
+}
+
+}
+
+TestFft::TestFft() {
+
+}
+
+void TestFft::naiveDft_data() {
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("2") << 2;
+    QTest::newRow("8") << 8;
+    QTest::newRow("64") << 64;
+    QTest::newRow("1024") << 1024;
+}
+
+void TestFft::naiveDft() {
+    QFETCH(int, size);
+
+    // noise with a DC offset and a couple of tones
+    std::vector<float> input(size);
+    uint32_t noise = 1;
+    for (int i = 0; i < size; ++i) {
+        noise = noise * 1664525u + 1013904223u;
+        input[i] = 0.1f
+            + 0.5f * (float)std::sin(2.0 * TU::PI * 3.0 * i / size)
+            + 0.25f * (float)std::cos(2.0 * TU::PI * 0.37 * i)
+            + 0.1f * ((int32_t)noise / 2147483648.0f);
+    }
+
+    Fft fft((size_t)size);
+    QCOMPARE(fft.size(), (size_t)size);
+    QCOMPARE(fft.bins(), (size_t)(size / 2 + 1));
+    std::vector<float> power(fft.bins());
+    fft.powerSpectrum(input.data(), power.data());
+
+    auto const expected = TU::naivePowerSpectrum(input);
+    auto const peak = *std::max_element(expected.begin(), expected.end());
+    for (size_t k = 0; k < expected.size(); ++k) {
+        // single precision error, relative to the strongest bin
+        if (std::abs(power[k] - expected[k]) > 1e-5 * peak + 1e-9) {
+            QFAIL(qPrintable(QStringLiteral("bin %1 is %2, expected %3").arg(k).arg(power[k]).arg(expected[k])));
+        }
+    }
+}
+
+void TestFft::fullScaleSine() {
+    // a full scale sine centered on a bin has a power of 1.0 in that bin
+    constexpr size_t SIZE = 4096;
+    constexpr size_t BIN = 100;
+    std::vector<float> input(SIZE);
+    for (size_t i = 0; i < SIZE; ++i) {
+        input[i] = (float)std::sin(2.0 * TU::PI * BIN * i / SIZE);
+    }
+
+    Fft fft(SIZE);
+    std::vector<float> power(fft.bins());
+    fft.powerSpectrum(input.data(), power.data());
+    QVERIFY(std::abs(power[BIN] - 1.0f) < 1e-3f);
+    // the Hann window leaks into the adjacent bins only
+    QVERIFY(std::abs(power[BIN - 1] - 0.25f) < 1e-3f);
+    QVERIFY(std::abs(power[BIN + 1] - 0.25f) < 1e-3f);
+    QVERIFY(power[BIN + 3] < 1e-6f);
+    QVERIFY(power[0] < 1e-6f);
+}
+
+#undef TU
@@ -0,0 +1,21 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestFft : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestFft();
+
+private slots:
+
+    void naiveDft_data();
+    void naiveDft();
+
+    void fullScaleSine();
+
+};
@@ -0,0 +1,109 @@
+
+#include "units/TestHistogram.hpp"
+
+#include "utils/Histogram.hpp"
+
+#include <cstdint>
+
+
+#define TU TestHistogramTU
+namespace TU {
+
+// the bucket with a count, or -1 if there is none
+int countedBucket(Histogram const& histogram) {
+    for (int i = 0; i < Histogram::BUCKETS; ++i) {
+        if (histogram.count(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+}
+
+TestHistogram::TestHistogram() {
+
+}
+
+void TestHistogram::empty() {
+    Histogram histogram(Histogram::Scale::log);
+    QCOMPARE(histogram.total(), (uint64_t)0);
+    QCOMPARE(histogram.min(), (uint64_t)0);
+    QCOMPARE(histogram.max(), (uint64_t)0);
+    QCOMPARE(histogram.mean(), 0.0);
+    QCOMPARE(histogram.percentile(0.5), (uint64_t)0);
+}
+
+void TestHistogram::linear() {
+    Histogram histogram(Histogram::Scale::linear);
+    for (uint64_t i = 0; i < 10; ++i) {
+        histogram.record(i);
+    }
+    QCOMPARE(histogram.total(), (uint64_t)10);
+    QCOMPARE(histogram.min(), (uint64_t)0);
+    QCOMPARE(histogram.max(), (uint64_t)9);
+    QCOMPARE(histogram.mean(), 4.5);
+    for (int i = 0; i < 10; ++i) {
+        QCOMPARE(histogram.count(i), (uint64_t)1);
+    }
+    QCOMPARE(histogram.percentile(0.5), (uint64_t)4);
+    QCOMPARE(histogram.percentile(0.99), (uint64_t)9);
+    QCOMPARE(histogram.percentile(1.0), (uint64_t)9);
+
+    // values past the last bucket are counted in it
+    histogram.record(1000);
+    QCOMPARE(histogram.count(Histogram::BUCKETS - 1), (uint64_t)1);
+    QCOMPARE(histogram.max(), (uint64_t)1000);
+    QCOMPARE(histogram.percentile(1.0), (uint64_t)1000);
+}
+
+void TestHistogram::logBuckets() {
+    // every value is sorted into the bucket whose bounds contain it
+    uint64_t const values[] = {
+        0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 100, 1000, 1023, 1024, 123456789,
+        UINT64_C(1) << 40, (UINT64_C(1) << 40) - 1
+    };
+    for (auto const value : values) {
+        Histogram histogram(Histogram::Scale::log);
+        histogram.record(value);
+        auto const bucket = TU::countedBucket(histogram);
+        QVERIFY(bucket >= 0);
+        QVERIFY2(histogram.bucketLowerBound(bucket) <= value, qPrintable(QString::number(value)));
+        if (bucket < Histogram::BUCKETS - 1) {
+            QVERIFY2(value < histogram.bucketLowerBound(bucket + 1), qPrintable(QString::number(value)));
+        }
+    }
+
+    // bucket bounds increase
+    Histogram histogram(Histogram::Scale::log);
+    for (int i = 1; i < Histogram::BUCKETS; ++i) {
+        QVERIFY(histogram.bucketLowerBound(i - 1) < histogram.bucketLowerBound(i));
+    }
+
+    // percentiles are the upper bound of the bucket, clamped to the maximum
+    for (int i = 0; i < 99; ++i) {
+        histogram.record(100);
+    }
+    histogram.record(5000);
+    auto const p50 = histogram.percentile(0.5);
+    QVERIFY(p50 >= 100 && p50 < 5000);
+    QCOMPARE(histogram.percentile(1.0), (uint64_t)5000);
+}
+
+void TestHistogram::clear() {
+    Histogram histogram(Histogram::Scale::linear);
+    histogram.record(5);
+    histogram.record(50);
+    histogram.clear();
+    QCOMPARE(histogram.total(), (uint64_t)0);
+    QCOMPARE(histogram.count(5), (uint64_t)0);
+    QCOMPARE(histogram.count(50), (uint64_t)0);
+    QCOMPARE(histogram.min(), (uint64_t)0);
+    QCOMPARE(histogram.max(), (uint64_t)0);
+
+    histogram.record(7);
+    QCOMPARE(histogram.min(), (uint64_t)7);
+    QCOMPARE(histogram.max(), (uint64_t)7);
+}
+
+#undef TU
@@ -0,0 +1,24 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestHistogram : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestHistogram();
+
+private slots:
+
+    void empty();
+
+    void linear();
+
+    void logBuckets();
+
+    void clear();
+
+};
@@ -0,0 +1,166 @@
+
+#include "units/TestPatternModel.hpp"
+
+#include "core/Module.hpp"
+#include "model/PatternModel.hpp"
+#include "model/SongModel.hpp"
+
+#include "trackerboy/note.hpp"
+
+#include <vector>
+
+
+#define TU TestPatternModelTU
+namespace TU {
+
+//
+// Records the dataChanged and invalidated signals of a PatternModel. The
+// region is not a registered metatype, so a QSignalSpy cannot be used.
+//
+struct Recorder {
+
+    struct Change {
+        int pattern;
+        PatternSelection region;
+    };
+
+    explicit Recorder(PatternModel &model) :
+        changes(),
+        invalidations(0)
+    {
+        QObject::connect(&model, &PatternModel::dataChanged, &model,
+            [this](int pattern, PatternSelection region) {
+                changes.push_back({ pattern, region });
+            });
+        QObject::connect(&model, &PatternModel::invalidated, &model,
+            [this]() {
+                ++invalidations;
+            });
+    }
+
+    void clear() {
+        changes.clear();
+        invalidations = 0;
+    }
+
+    std::vector<Change> changes;
+    int invalidations;
+};
+
+bool sameRegion(PatternSelection const& lhs, PatternSelection const& rhs) {
+    auto const l = lhs.iterator();
+    auto const r = rhs.iterator();
+    return l.start() == r.start() && l.end() == r.end();
+}
+
+}
+
+TestPatternModel::TestPatternModel() {
+
+}
+
+void TestPatternModel::noteEditRegion() {
+    Module mod;
+    SongModel songModel(mod);
+    PatternModel model(mod, songModel);
+    TU::Recorder recorder(model);
+
+    // only the edited track row is changed
+    PatternSelection const expected(
+        PatternAnchor(3, PatternAnchor::SelectNote, 1),
+        PatternAnchor(3, PatternAnchor::SelectEffect3, 1)
+    );
+
+    model.setCursor(PatternCursor(3, PatternCursor::ColumnNote, 1));
+    model.setNote((uint8_t)(trackerboy::NOTE_C + trackerboy::OCTAVE_4), std::nullopt);
+    QCOMPARE(recorder.changes.size(), (size_t)1);
+    QCOMPARE(recorder.changes[0].pattern, 0);
+    QVERIFY(TU::sameRegion(recorder.changes[0].region, expected));
+    QCOMPARE(recorder.invalidations, 0);
+
+    recorder.clear();
+    mod.undoStack()->undo();
+    QCOMPARE(recorder.changes.size(), (size_t)1);
+    QVERIFY(TU::sameRegion(recorder.changes[0].region, expected));
+    QCOMPARE(recorder.invalidations, 0);
+}
+
+void TestPatternModel::selectionEditRegion() {
+    Module mod;
+    SongModel songModel(mod);
+    PatternModel model(mod, songModel);
+
+    model.setCursor(PatternCursor(2, PatternCursor::ColumnNote, 0));
+    model.setNote((uint8_t)(trackerboy::NOTE_C + trackerboy::OCTAVE_4), (uint8_t)0);
+    model.setCursor(PatternCursor(5, PatternCursor::ColumnNote, 1));
+    model.setNote((uint8_t)(trackerboy::NOTE_E + trackerboy::OCTAVE_4), (uint8_t)0);
+
+    model.setCursor(PatternCursor(2, PatternCursor::ColumnNote, 0));
+    model.selectCursor();
+    model.setSelection(PatternCursor(5, PatternCursor::ColumnInstrumentLow, 1));
+    auto const selection = model.selection();
+
+    TU::Recorder recorder(model);
+
+    // edits of a selection change the selected region
+    model.transpose(1);
+    QCOMPARE(recorder.changes.size(), (size_t)1);
+    QCOMPARE(recorder.changes[0].pattern, 0);
+    QVERIFY(TU::sameRegion(recorder.changes[0].region, selection));
+    QCOMPARE(recorder.invalidations, 0);
+
+    recorder.clear();
+    model.replaceInstrument(1);
+    QCOMPARE(recorder.changes.size(), (size_t)1);
+    QVERIFY(TU::sameRegion(recorder.changes[0].region, selection));
+
+    // and so does undoing them
+    recorder.clear();
+    mod.undoStack()->undo();
+    mod.undoStack()->undo();
+    QCOMPARE(recorder.changes.size(), (size_t)2);
+    QVERIFY(TU::sameRegion(recorder.changes[0].region, selection));
+    QVERIFY(TU::sameRegion(recorder.changes[1].region, selection));
+    QCOMPARE(recorder.invalidations, 0);
+}
+
+void TestPatternModel::sharedTrackEditRegion() {
+    Module mod;
+    SongModel songModel(mod);
+    PatternModel model(mod, songModel);
+
+    // the duplicate uses the same tracks, and becomes the current pattern
+    // with the original as its previous preview
+    model.duplicateOrder();
+    QCOMPARE(model.cursorPattern(), 1);
+
+    TU::Recorder recorder(model);
+    PatternSelection const expected(
+        PatternAnchor(0, PatternAnchor::SelectNote, 0),
+        PatternAnchor(0, PatternAnchor::SelectEffect3, 0)
+    );
+
+    model.setCursor(PatternCursor(0, PatternCursor::ColumnNote, 0));
+    model.setNote((uint8_t)(trackerboy::NOTE_C + trackerboy::OCTAVE_4), std::nullopt);
+    QCOMPARE(recorder.changes.size(), (size_t)2);
+    QCOMPARE(recorder.changes[0].pattern, 0);
+    QVERIFY(TU::sameRegion(recorder.changes[0].region, expected));
+    QCOMPARE(recorder.changes[1].pattern, 1);
+    QVERIFY(TU::sameRegion(recorder.changes[1].region, expected));
+    QCOMPARE(recorder.invalidations, 0);
+}
+
+void TestPatternModel::structuralEdit() {
+    Module mod;
+    SongModel songModel(mod);
+    PatternModel model(mod, songModel);
+    TU::Recorder recorder(model);
+
+    // changing the order changes the patterns, not a region of one
+    auto const patterns = model.patterns();
+    model.insertOrder();
+    QCOMPARE(model.patterns(), patterns + 1);
+    QVERIFY(recorder.changes.empty());
+}
+
+#undef TU
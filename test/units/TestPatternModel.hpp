@@ -0,0 +1,24 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestPatternModel : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestPatternModel();
+
+private slots:
+
+    void noteEditRegion();
+
+    void selectionEditRegion();
+
+    void sharedTrackEditRegion();
+
+    void structuralEdit();
+
+};
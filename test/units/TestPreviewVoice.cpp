@@ -0,0 +1,92 @@
+
+#include "units/TestPreviewVoice.hpp"
+
+#include "audio/PreviewVoice.hpp"
+
+#include <memory>
+#include <vector>
+
+
+#define TU TestPreviewVoiceTU
+namespace TU {
+
+constexpr int CH1 = (int)trackerboy::ChType::ch1;
+constexpr int CH2 = (int)trackerboy::ChType::ch2;
+constexpr int CH3 = (int)trackerboy::ChType::ch3;
+constexpr int CH4 = (int)trackerboy::ChType::ch4;
+
+//
+// Posts a note on for the given key, with an instrument for the given
+// channel. The event is timestamped in the past so that it is applied at the
+// start of the next block.
+//
+void noteOn(PreviewVoice &voice, int key, trackerboy::ChType channel) {
+    PreviewVoice::Event event(PreviewVoice::Event::Type::instrument);
+    event.key = key;
+    event.note = 24 + key;
+    event.channel = channel;
+    event.instrument = std::make_shared<trackerboy::Instrument const>();
+    event.time = PreviewVoice::Clock::time_point();
+    QVERIFY(voice.postMidi(std::move(event)));
+}
+
+// applies the posted events
+void mixBlock(PreviewVoice &voice) {
+    std::vector<float> buffer(256 * 2);
+    voice.beginBlock(PreviewVoice::Clock::now());
+    voice.mix(buffer.data(), 256);
+}
+
+}
+
+TestPreviewVoice::TestPreviewVoice() {
+
+}
+
+void TestPreviewVoice::pulseChord() {
+    trackerboy::DefaultApu music;
+    PreviewVoice voice(music);
+
+    TU::noteOn(voice, 0, trackerboy::ChType::ch1);
+    TU::noteOn(voice, 1, trackerboy::ChType::ch1);
+    TU::mixBlock(voice);
+    QCOMPARE(voice.channelOf(0), TU::CH1);
+    QCOMPARE(voice.channelOf(1), TU::CH2);
+
+    // both pulse channels are in use, the third note replaces the oldest
+    // instead of taking the wave or noise channel
+    TU::noteOn(voice, 2, trackerboy::ChType::ch1);
+    TU::mixBlock(voice);
+    QCOMPARE(voice.channelOf(0), -1);
+    QCOMPARE(voice.channelOf(1), TU::CH2);
+    QCOMPARE(voice.channelOf(2), TU::CH1);
+
+    // the next oldest is replaced next
+    TU::noteOn(voice, 3, trackerboy::ChType::ch2);
+    TU::mixBlock(voice);
+    QCOMPARE(voice.channelOf(1), -1);
+    QCOMPARE(voice.channelOf(2), TU::CH1);
+    QCOMPARE(voice.channelOf(3), TU::CH2);
+}
+
+void TestPreviewVoice::exclusiveChannels() {
+    trackerboy::DefaultApu music;
+    PreviewVoice voice(music);
+
+    TU::noteOn(voice, 0, trackerboy::ChType::ch3);
+    TU::noteOn(voice, 1, trackerboy::ChType::ch4);
+    TU::mixBlock(voice);
+    QCOMPARE(voice.channelOf(0), TU::CH3);
+    QCOMPARE(voice.channelOf(1), TU::CH4);
+
+    // the pulse channels are free, but wave and noise only have one channel
+    TU::noteOn(voice, 2, trackerboy::ChType::ch3);
+    TU::noteOn(voice, 3, trackerboy::ChType::ch4);
+    TU::mixBlock(voice);
+    QCOMPARE(voice.channelOf(0), -1);
+    QCOMPARE(voice.channelOf(1), -1);
+    QCOMPARE(voice.channelOf(2), TU::CH3);
+    QCOMPARE(voice.channelOf(3), TU::CH4);
+}
+
+#undef TU
@@ -0,0 +1,20 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestPreviewVoice : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestPreviewVoice();
+
+private slots:
+
+    void pulseChord();
+
+    void exclusiveChannels();
+
+};
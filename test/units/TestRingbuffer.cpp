@@ -0,0 +1,94 @@
+
+#include "units/TestRingbuffer.hpp"
+
+#include "audio/Ringbuffer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+
+TestRingbuffer::TestRingbuffer() {
+
+}
+
+void TestRingbuffer::wraparound_data() {
+    QTest::addColumn<bool>("mirror");
+
+    QTest::newRow("mirrored") << true;
+    QTest::newRow("fallback") << false;
+}
+
+void TestRingbuffer::wraparound() {
+    QFETCH(bool, mirror);
+
+    // smallest buffer possible, the capacity is the size
+    size_t const size = RingbufferMemory::granularity() / sizeof(int32_t);
+    Ringbuffer<int32_t> rb;
+    rb.init(size, mirror);
+    if (mirror && !rb.isMirrored()) {
+        QSKIP("mirrored memory is not supported on this system");
+    }
+    QCOMPARE(rb.isMirrored(), mirror);
+    QCOMPARE(rb.size(), size);
+
+    auto reader = rb.reader();
+    auto writer = rb.writer();
+
+    std::vector<int32_t> data(size);
+    std::iota(data.begin(), data.end(), 1);
+    std::vector<int32_t> out(size);
+
+    // move the indices so that the next full write wraps around
+    size_t const offset = size - size / 4;
+    QCOMPARE(writer.fullWrite(data.data(), offset), offset);
+    QCOMPARE(reader.fullRead(out.data(), offset), offset);
+    QVERIFY(std::equal(out.begin(), out.begin() + offset, data.begin()));
+    QCOMPARE(reader.availableRead(), (size_t)0);
+    QCOMPARE(writer.availableWrite(), size);
+
+    // the region is only contiguous past the end when mirrored
+    size_t const contiguous = mirror ? size : size - offset;
+    size_t count = size;
+    writer.acquireWrite(count);
+    QCOMPARE(count, contiguous);
+
+    QCOMPARE(writer.fullWrite(data.data(), size), size);
+    QCOMPARE(writer.availableWrite(), (size_t)0);
+    QCOMPARE(reader.availableRead(), size);
+
+    count = size;
+    auto const region = reader.acquireRead(count);
+    QCOMPARE(count, contiguous);
+    QVERIFY(std::equal(region, region + count, data.begin()));
+
+    std::fill(out.begin(), out.end(), 0);
+    QCOMPARE(reader.fullRead(out.data(), size), size);
+    QVERIFY(out == data);
+    QCOMPARE(reader.availableRead(), (size_t)0);
+}
+
+void TestRingbuffer::sizeLimit() {
+    // the capacity is rounded up, but only the requested size is usable
+    size_t const capacity = RingbufferMemory::granularity() / sizeof(int32_t);
+    size_t const size = capacity - 3;
+    Ringbuffer<int32_t> rb;
+    rb.init(size);
+    QCOMPARE(rb.size(), size);
+
+    auto reader = rb.reader();
+    auto writer = rb.writer();
+    std::vector<int32_t> data(capacity, 7);
+    QCOMPARE(writer.availableWrite(), size);
+    QCOMPARE(writer.fullWrite(data.data(), capacity), size);
+    QCOMPARE(writer.availableWrite(), (size_t)0);
+
+    reader.seekRead(2);
+    QCOMPARE(reader.availableRead(), size - 2);
+    QCOMPARE(writer.availableWrite(), (size_t)2);
+
+    reader.flush();
+    QCOMPARE(reader.availableRead(), (size_t)0);
+    QCOMPARE(writer.availableWrite(), size);
+}
@@ -0,0 +1,21 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestRingbuffer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestRingbuffer();
+
+private slots:
+
+    void wraparound_data();
+    void wraparound();
+
+    void sizeLimit();
+
+};
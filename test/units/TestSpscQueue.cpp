@@ -0,0 +1,111 @@
+
+#include "units/TestSpscQueue.hpp"
+
+#include "utils/SpscQueue.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+
+
+TestSpscQueue::TestSpscQueue() {
+
+}
+
+void TestSpscQueue::pushPop() {
+    SpscQueue<int, 4> queue;
+    QVERIFY(queue.isEmpty());
+
+    int out = -1;
+    QVERIFY(!queue.pop(out));
+    QCOMPARE(out, -1);
+
+    // push and pop past the capacity so that the indices wrap
+    for (int i = 0; i < 10; ++i) {
+        QVERIFY(queue.push(i));
+        QVERIFY(queue.push(i + 100));
+        QVERIFY(!queue.isEmpty());
+        QVERIFY(queue.pop(out));
+        QCOMPARE(out, i);
+        QVERIFY(queue.pop(out));
+        QCOMPARE(out, i + 100);
+        QVERIFY(queue.isEmpty());
+    }
+}
+
+void TestSpscQueue::full() {
+    SpscQueue<std::string, 2> queue;
+    QVERIFY(queue.push(std::string("a")));
+    QVERIFY(queue.push(std::string("b")));
+
+    // a failed push leaves the item untouched
+    std::string item("c");
+    QVERIFY(!queue.push(std::move(item)));
+    QCOMPARE(item, std::string("c"));
+
+    std::string out;
+    QVERIFY(queue.pop(out));
+    QCOMPARE(out, std::string("a"));
+    QVERIFY(queue.push(std::move(item)));
+    QVERIFY(queue.pop(out));
+    QCOMPARE(out, std::string("b"));
+    QVERIFY(queue.pop(out));
+    QCOMPARE(out, std::string("c"));
+    QVERIFY(!queue.pop(out));
+}
+
+void TestSpscQueue::peek() {
+    SpscQueue<std::unique_ptr<int>, 4> queue;
+    QVERIFY(queue.peek() == nullptr);
+
+    QVERIFY(queue.push(std::make_unique<int>(1)));
+    QVERIFY(queue.push(std::make_unique<int>(2)));
+
+    // peek gets the oldest item without removing it
+    auto front = queue.peek();
+    QVERIFY(front != nullptr);
+    QCOMPARE(**front, 1);
+    QCOMPARE(queue.peek(), front);
+
+    // and may modify it in place
+    **front = 10;
+    std::unique_ptr<int> out;
+    QVERIFY(queue.pop(out));
+    QCOMPARE(*out, 10);
+
+    front = queue.peek();
+    QVERIFY(front != nullptr);
+    QCOMPARE(**front, 2);
+    QVERIFY(queue.pop(out));
+    QVERIFY(queue.peek() == nullptr);
+}
+
+void TestSpscQueue::threaded() {
+    constexpr int COUNT = 100000;
+    SpscQueue<int, 64> queue;
+
+    std::thread producer([&queue]() {
+        for (int i = 0; i < COUNT; ++i) {
+            while (!queue.push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    // every item arrives, in order
+    int expected = 0;
+    while (expected < COUNT) {
+        int out;
+        if (queue.pop(out)) {
+            if (out != expected) {
+                break;
+            }
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    QCOMPARE(expected, COUNT);
+    QVERIFY(queue.isEmpty());
+}
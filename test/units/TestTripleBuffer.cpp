@@ -0,0 +1,78 @@
+
+#include "units/TestTripleBuffer.hpp"
+
+#include "utils/TripleBuffer.hpp"
+
+#include <atomic>
+#include <thread>
+
+
+TestTripleBuffer::TestTripleBuffer() {
+
+}
+
+void TestTripleBuffer::latest() {
+    TripleBuffer<int> buffer;
+
+    // nothing published, the reader gets a default constructed value
+    QCOMPARE(buffer.read(), 0);
+
+    buffer.back() = 1;
+    buffer.publish();
+    QCOMPARE(buffer.read(), 1);
+    // reading again without a publish gets the same value
+    QCOMPARE(buffer.read(), 1);
+
+    // only the latest of several publishes is seen
+    for (int i = 2; i <= 5; ++i) {
+        buffer.back() = i;
+        buffer.publish();
+    }
+    QCOMPARE(buffer.read(), 5);
+
+    // the back buffer is never one the reader holds
+    buffer.back() = 6;
+    QCOMPARE(buffer.read(), 5);
+    buffer.publish();
+    QCOMPARE(buffer.read(), 6);
+}
+
+void TestTripleBuffer::threaded() {
+    struct Pair {
+        int value;
+        int negated;
+    };
+
+    constexpr int COUNT = 100000;
+    TripleBuffer<Pair> buffer;
+    std::atomic_bool done = false;
+
+    std::thread writer([&]() {
+        for (int i = 1; i <= COUNT; ++i) {
+            auto &back = buffer.back();
+            back.value = i;
+            back.negated = -i;
+            buffer.publish();
+        }
+        done = true;
+    });
+
+    // every snapshot read is whole, and never older than the last one read
+    bool consistent = true;
+    int last = 0;
+    for (;;) {
+        bool const finished = done;
+        auto const& snapshot = buffer.read();
+        if (snapshot.value != -snapshot.negated || snapshot.value < last) {
+            consistent = false;
+            break;
+        }
+        last = snapshot.value;
+        if (finished) {
+            break;
+        }
+    }
+    writer.join();
+    QVERIFY(consistent);
+    QCOMPARE(last, COUNT);
+}
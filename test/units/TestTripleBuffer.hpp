@@ -0,0 +1,20 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestTripleBuffer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestTripleBuffer();
+
+private slots:
+
+    void latest();
+
+    void threaded();
+
+};